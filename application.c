@@ -10,6 +10,7 @@
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
 #include <xdg-shell.h>
+#include <probe.h>
 
 typedef struct {
     struct wl_display * display;
@@ -199,11 +200,13 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    probe_mark("first_frame");
 
     ctx->xdg_surface_configured = false;
     ctx->xdg_toplevel_configured = false;
@@ -305,6 +308,7 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 };
 
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
@@ -344,6 +348,7 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -363,6 +368,7 @@ int main(void) {
         printf("[!] wl_registry: no xdg_wm_base found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
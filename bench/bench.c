@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <options.h>
+#include <clock.h>
+#include <harness.h>
+
+// end-to-end benchmark of the capture clients
+//
+// every client is run for a fixed number of frames (WLEXP_FRAMES) at every
+// resolution, each resolution against a fresh mock-compositor so runs do not
+// influence each other. with WLEXP_BENCH_COMPOSITOR=local the compositor of
+// the current session is used instead and only its native resolution runs
+//
+// the clients report latency, rate and copied bytes themselves (see
+// common/bench_stats.h), CPU time and peak RSS are taken from wait4, results
+// are printed to stdout as one JSON document, logs go to stderr
+
+#define MAX_RESOLUTIONS 16
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+} resolution_t;
+
+typedef struct {
+    harness_t harness;
+    long frames;
+    double timeout_s;
+
+    resolution_t resolutions[MAX_RESOLUTIONS];
+    size_t num_resolutions;
+    char * clients;
+
+    size_t runs;
+} ctx_t;
+
+static const char * const default_clients =
+    "screencopy_shm,screencopy_shm_egl,"
+    "screencopy_dmabuf,screencopy_dmabuf_egl,"
+    "export_dmabuf,export_dmabuf_egl,"
+    "screencopy_pipeline";
+
+static void cleanup(ctx_t * ctx) {
+    harness_stop_compositor(&ctx->harness);
+    free(ctx->clients);
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- results ---
+
+static uint64_t read_result_u64(const char * result, const char * key) {
+    char pattern[64];
+    snprintf(pattern, sizeof pattern, "\"%s\": ", key);
+
+    const char * value = strstr(result, pattern);
+    if (value == NULL) return 0;
+    return strtoull(value + strlen(pattern), NULL, 10);
+}
+
+static void run_client(ctx_t * ctx, const char * client, resolution_t resolution, bool compositor_ready) {
+    char output[4096];
+    snprintf(output, sizeof output, "%s/wlexp-bench-%d.json", ctx->harness.runtime_dir, (int)getpid());
+    unlink(output);
+
+    char frames_env[64];
+    char output_env[4200];
+    snprintf(frames_env, sizeof frames_env, "WLEXP_FRAMES=%ld", ctx->frames);
+    snprintf(output_env, sizeof output_env, "WLEXP_BENCH_OUTPUT=%s", output);
+    char * env[] = { frames_env, output_env, NULL };
+
+    if (compositor_ready) fprintf(stderr, "[info] running %s at %ux%u\n", client, resolution.width, resolution.height);
+    uint64_t start_ns = clock_now_ns();
+
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof usage);
+    bool finished = false;
+    pid_t pid = compositor_ready ? harness_spawn(&ctx->harness, client, env) : -1;
+    if (pid != -1) finished = harness_wait(pid, ctx->timeout_s, &status, &usage);
+
+    uint64_t wall_ns = clock_now_ns() - start_ns;
+    uint64_t cpu_ns =
+        (uint64_t)usage.ru_utime.tv_sec * 1000000000 + usage.ru_utime.tv_usec * 1000 +
+        (uint64_t)usage.ru_stime.tv_sec * 1000000000 + usage.ru_stime.tv_usec * 1000;
+
+    char result[1024] = "";
+    FILE * file = fopen(output, "r");
+    if (file != NULL) {
+        if (fgets(result, sizeof result, file) == NULL) result[0] = '\0';
+        fclose(file);
+        unlink(output);
+    }
+    result[strcspn(result, "\n")] = '\0';
+
+    const char * state = "ok";
+    if (!compositor_ready) state = "no_compositor";
+    else if (pid == -1) state = "spawn_failed";
+    else if (!finished) state = "timeout";
+    else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) state = "failed";
+    else if (result[0] == '\0') state = "no_result";
+
+    uint64_t frames = read_result_u64(result, "frames");
+    if (frames < (uint64_t)ctx->frames && strcmp(state, "ok") == 0) state = "incomplete";
+
+    printf("%s\n    {\"client\": \"%s\", \"width\": %u, \"height\": %u, \"state\": \"%s\", "
+        "\"wall_ns\": %lu, \"cpu_ns\": %lu, \"cpu_ns_per_frame\": %lu, \"peak_rss_kb\": %ld, \"stats\": %s}",
+        ctx->runs == 0 ? "" : ",",
+        client, resolution.width, resolution.height, state,
+        wall_ns, cpu_ns, frames > 0 ? cpu_ns / frames : 0, usage.ru_maxrss,
+        result[0] != '\0' ? result : "null"
+    );
+    fflush(stdout);
+    ctx->runs++;
+}
+
+static void run_resolution(ctx_t * ctx, resolution_t resolution) {
+    // runs without a compositor are still reported, so every result has
+    // the same shape
+    bool compositor_ready = harness_start_compositor(&ctx->harness, resolution.width, resolution.height);
+
+    char * clients = strdup(ctx->clients);
+    char * save = NULL;
+    for (char * client = strtok_r(clients, ",", &save); client != NULL; client = strtok_r(NULL, ",", &save)) {
+        run_client(ctx, client, resolution, compositor_ready);
+    }
+    free(clients);
+
+    harness_stop_compositor(&ctx->harness);
+}
+
+// --- setup ---
+
+static void parse_resolutions(ctx_t * ctx, const char * list) {
+    char * copy = strdup(list);
+    char * save = NULL;
+    for (char * entry = strtok_r(copy, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+        resolution_t resolution;
+        if (sscanf(entry, "%ux%u", &resolution.width, &resolution.height) != 2 || resolution.width == 0 || resolution.height == 0) {
+            fprintf(stderr, "[!] ignoring invalid resolution %s\n", entry);
+            continue;
+        } else if (ctx->num_resolutions == MAX_RESOLUTIONS) {
+            fprintf(stderr, "[!] too many resolutions, ignoring %s\n", entry);
+            continue;
+        }
+
+        ctx->resolutions[ctx->num_resolutions++] = resolution;
+    }
+    free(copy);
+}
+
+int main(void) {
+    ctx_t * ctx = malloc(sizeof (ctx_t));
+    if (ctx == NULL) {
+        fprintf(stderr, "[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    harness_init(&ctx->harness);
+    ctx->frames = option_long("WLEXP_BENCH_FRAMES", 300);
+    ctx->timeout_s = option_double("WLEXP_BENCH_TIMEOUT", 30);
+    ctx->num_resolutions = 0;
+    ctx->clients = strdup(option_string("WLEXP_BENCH_CLIENTS", default_clients));
+    ctx->runs = 0;
+
+    if (ctx->clients == NULL || ctx->frames <= 0 || ctx->timeout_s <= 0) {
+        fprintf(stderr, "[!] invalid bench options\n");
+        exit_fail(ctx);
+    }
+
+    if (ctx->harness.local) {
+        // the resolution is whatever the session's output has
+        ctx->resolutions[0] = (resolution_t){ 0, 0 };
+        ctx->num_resolutions = 1;
+    } else {
+        parse_resolutions(ctx, option_string("WLEXP_BENCH_RESOLUTIONS", "1280x720,1920x1080,3840x2160"));
+        if (ctx->num_resolutions == 0) {
+            fprintf(stderr, "[!] no resolutions to run\n");
+            exit_fail(ctx);
+        }
+    }
+
+    printf("{\"compositor\": \"%s\", \"frames\": %ld, \"runs\": [", ctx->harness.local ? "local" : "mock", ctx->frames);
+    for (size_t i = 0; i < ctx->num_resolutions; i++) run_resolution(ctx, ctx->resolutions[i]);
+    printf("\n]}\n");
+
+    cleanup(ctx);
+}
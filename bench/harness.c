@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <options.h>
+#include <clock.h>
+#include <harness.h>
+
+#define SOCKET_WAIT_NS 5000000000
+#define POLL_INTERVAL_NS 10000000
+
+static const char * find_bin_dir(void) {
+    // the experiments are built next to the harness binaries
+    static char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof path - 1);
+    if (length <= 0) return ".";
+    path[length] = '\0';
+
+    char * slash = strrchr(path, '/');
+    if (slash != NULL) *slash = '\0';
+    return path;
+}
+
+void harness_init(harness_t * harness) {
+    harness->bin_dir = option_string("WLEXP_BENCH_DIR", NULL);
+    if (harness->bin_dir == NULL) harness->bin_dir = find_bin_dir();
+    harness->runtime_dir = option_string("XDG_RUNTIME_DIR", "/tmp");
+    harness->local = strcmp(option_string("WLEXP_BENCH_COMPOSITOR", "mock"), "local") == 0;
+    harness->verbose = option_flag("WLEXP_BENCH_VERBOSE");
+    harness->compositor_pid = -1;
+    harness->socket[0] = '\0';
+
+    // a dying child must not take the harness down with it
+    signal(SIGPIPE, SIG_IGN);
+}
+
+void harness_sleep_ns(uint64_t ns) {
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+pid_t harness_spawn(harness_t * harness, const char * name, char * const * env) {
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", harness->bin_dir, name);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        fprintf(stderr, "[!] fork: failed to spawn %s\n", name);
+        return -1;
+    } else if (pid > 0) {
+        return pid;
+    }
+
+    if (harness->compositor_pid > 0) setenv("WAYLAND_DISPLAY", harness->socket, 1);
+    for (size_t i = 0; env[i] != NULL; i++) putenv(env[i]);
+
+    // experiment logs are far too verbose to mix with the results
+    int out = open(harness->verbose ? "/dev/stderr" : "/dev/null", O_WRONLY);
+    if (out != -1) {
+        dup2(out, STDOUT_FILENO);
+        if (!harness->verbose) dup2(out, STDERR_FILENO);
+        close(out);
+    }
+
+    execl(path, path, (char *)NULL);
+    fprintf(stderr, "[!] exec: failed to run %s\n", path);
+    _exit(127);
+}
+
+bool harness_wait(pid_t pid, double timeout_s, int * status, struct rusage * usage) {
+    uint64_t deadline_ns = clock_now_ns() + (uint64_t)(timeout_s * 1e9);
+
+    while (true) {
+        pid_t result = wait4(pid, status, WNOHANG, usage);
+        if (result == pid) return true;
+        if (result == -1 && errno != EINTR) return false;
+
+        if (clock_now_ns() > deadline_ns) {
+            kill(pid, SIGKILL);
+            wait4(pid, status, 0, usage);
+            return false;
+        }
+
+        harness_sleep_ns(POLL_INTERVAL_NS);
+    }
+}
+
+bool harness_start_compositor(harness_t * harness, uint32_t width, uint32_t height) {
+    if (harness->local) return true;
+
+    snprintf(harness->socket, sizeof harness->socket, "wlexp-bench-%d", (int)getpid());
+
+    char socket_env[128];
+    char width_env[64];
+    char height_env[64];
+    snprintf(socket_env, sizeof socket_env, "WLEXP_MOCK_SOCKET=%s", harness->socket);
+    snprintf(width_env, sizeof width_env, "WLEXP_MOCK_WIDTH=%u", width);
+    snprintf(height_env, sizeof height_env, "WLEXP_MOCK_HEIGHT=%u", height);
+    char * env[] = { socket_env, width_env, height_env, NULL };
+
+    harness->compositor_pid = harness_spawn(harness, "mock-compositor", env);
+    if (harness->compositor_pid == -1) return false;
+
+    // the socket appears once the compositor is ready to accept clients
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", harness->runtime_dir, harness->socket);
+    uint64_t deadline_ns = clock_now_ns() + SOCKET_WAIT_NS;
+    while (clock_now_ns() < deadline_ns) {
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) return true;
+
+        if (waitpid(harness->compositor_pid, NULL, WNOHANG) == harness->compositor_pid) {
+            harness->compositor_pid = -1;
+            break;
+        }
+        harness_sleep_ns(POLL_INTERVAL_NS);
+    }
+
+    fprintf(stderr, "[!] mock-compositor: socket %s did not appear\n", path);
+    harness_stop_compositor(harness);
+    return false;
+}
+
+void harness_stop_compositor(harness_t * harness) {
+    if (harness->compositor_pid <= 0) return;
+
+    kill(harness->compositor_pid, SIGTERM);
+    waitpid(harness->compositor_pid, NULL, 0);
+    harness->compositor_pid = -1;
+}
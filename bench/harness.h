@@ -0,0 +1,41 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// process handling shared by the benchmark harnesses: running the
+// experiments as child processes, with a timeout, against either a
+// mock-compositor started per configuration or the session compositor
+
+typedef struct {
+    const char * bin_dir;
+    const char * runtime_dir;
+    bool local;
+    bool verbose;
+
+    pid_t compositor_pid;
+    char socket[64];
+} harness_t;
+
+// reads WLEXP_BENCH_DIR, WLEXP_BENCH_COMPOSITOR and WLEXP_BENCH_VERBOSE
+void harness_init(harness_t * harness);
+
+// runs bin_dir/name with env added to the environment and its output
+// silenced unless verbose, clients of a running mock-compositor are pointed
+// at it through WAYLAND_DISPLAY
+pid_t harness_spawn(harness_t * harness, const char * name, char * const * env);
+
+// waits for a child with a timeout, returns false if it had to be killed
+bool harness_wait(pid_t pid, double timeout_s, int * status, struct rusage * usage);
+
+// starts a mock-compositor with the given output size and waits for its
+// socket, always succeeds for a local harness
+bool harness_start_compositor(harness_t * harness, uint32_t width, uint32_t height);
+void harness_stop_compositor(harness_t * harness);
+
+void harness_sleep_ns(uint64_t ns);
+
+#endif
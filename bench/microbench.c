@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <options.h>
+#include <clock.h>
+#include <pixels.h>
+
+// microbenchmarks of the CPU pixel kernels, without a GPU or a wayland
+// connection
+//
+// every kernel runs WLEXP_MICROBENCH_WARMUP untimed and WLEXP_MICROBENCH_REPS
+// timed repetitions per buffer size, first at the output resolutions from
+// 640x480 to 7680x4320, then over a sweep of working set sizes that crosses
+// the cache levels. buffers are touched before the warmup so page faults are
+// not measured
+//
+// cycles are TSC reference cycles where available, not core clock cycles,
+// so they only match the core clock with frequency scaling disabled
+
+#define SWEEP_WIDTH 1024
+#define SWEEP_MIN_BYTES (16 * 1024)
+#define SWEEP_MAX_BYTES (256 * 1024 * 1024)
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    const char * name;
+} size_entry_t;
+
+typedef struct {
+    const char * name;
+    // bytes read and written per pixel, for the bandwidth figures
+    uint32_t bytes_per_pixel;
+    void (*run)(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height);
+} kernel_t;
+
+typedef struct {
+    long warmup;
+    long reps;
+    const char * filter;
+
+    uint32_t * dst;
+    uint32_t * src;
+    size_t capacity;
+} ctx_t;
+
+static const size_entry_t resolutions[] = {
+    { 640, 480, "640x480" },
+    { 1280, 720, "1280x720" },
+    { 1920, 1080, "1920x1080" },
+    { 2560, 1440, "2560x1440" },
+    { 3840, 2160, "3840x2160" },
+    { 7680, 4320, "7680x4320" }
+};
+
+// --- kernels ---
+
+static void kernel_checkerboard(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height) {
+    pixels_fill_checkerboard(dst, width, height);
+}
+
+static void kernel_memset(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height) {
+    // the placeholder fill of the export-dmabuf clients
+    memset(dst, 0xcc, (size_t)width * height * 4);
+}
+
+static void kernel_memcpy(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height) {
+    // upper bound for any kernel reading one buffer and writing another
+    memcpy(dst, src, (size_t)width * height * 4);
+}
+
+static void kernel_swizzle(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height) {
+    pixels_swizzle_rb(dst, src, (size_t)width * height);
+}
+
+static void kernel_hash(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height) {
+    // the per-tile hash of WLEXP_DIFF, stored so it is not optimized out
+    dst[0] = (uint32_t)pixels_hash(src, width, height, width);
+}
+
+static void kernel_downscale(uint32_t * dst, const uint32_t * src, uint32_t width, uint32_t height) {
+    // the scale stage of screencopy_pipeline
+    pixels_downscale_2x(dst, width / 2, src, width, width, height);
+}
+
+static const kernel_t kernels[] = {
+    { "checkerboard", 4, kernel_checkerboard },
+    { "memset", 4, kernel_memset },
+    { "memcpy", 8, kernel_memcpy },
+    { "swizzle_rb", 8, kernel_swizzle },
+    { "hash", 4, kernel_hash },
+    { "downscale_2x", 5, kernel_downscale }
+};
+
+// --- measurement ---
+
+static uint64_t cycles_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(ctx_t * ctx, const kernel_t * kernel, uint32_t width, uint32_t height, const char * label) {
+    uint64_t * ns = malloc(ctx->reps * sizeof *ns);
+    uint64_t * cycles = malloc(ctx->reps * sizeof *cycles);
+    if (ns == NULL || cycles == NULL) {
+        printf("[!] malloc: failed to allocate samples\n");
+        free(ns);
+        free(cycles);
+        return;
+    }
+
+    for (long i = 0; i < ctx->warmup; i++) kernel->run(ctx->dst, ctx->src, width, height);
+
+    for (long i = 0; i < ctx->reps; i++) {
+        uint64_t start_cycles = cycles_now();
+        uint64_t start_ns = clock_now_ns();
+        kernel->run(ctx->dst, ctx->src, width, height);
+        ns[i] = clock_now_ns() - start_ns;
+        cycles[i] = cycles_now() - start_cycles;
+    }
+
+    qsort(ns, ctx->reps, sizeof *ns, compare_u64);
+    qsort(cycles, ctx->reps, sizeof *cycles, compare_u64);
+
+    // the minimum is the least disturbed run, the median shows the noise
+    double pixels = (double)width * height;
+    uint64_t min_ns = ns[0] > 0 ? ns[0] : 1;
+    uint64_t median_ns = ns[ctx->reps / 2];
+    printf("%-14s %-10s %10.1f KiB  min %9.3f ms  median %9.3f ms  %7.3f ns/px  %7.3f cycles/px  %7.2f GB/s\n",
+        kernel->name, label, pixels * 4 / 1024,
+        min_ns / 1e6, median_ns / 1e6,
+        min_ns / pixels, cycles[0] / pixels,
+        pixels * kernel->bytes_per_pixel / min_ns
+    );
+
+    free(ns);
+    free(cycles);
+}
+
+static bool kernel_selected(ctx_t * ctx, const kernel_t * kernel) {
+    if (ctx->filter == NULL) return true;
+
+    // comma separated list of kernel names
+    size_t length = strlen(kernel->name);
+    for (const char * entry = ctx->filter; entry != NULL; entry = strchr(entry, ',')) {
+        if (*entry == ',') entry++;
+        if (strncmp(entry, kernel->name, length) == 0 && (entry[length] == ',' || entry[length] == '\0')) return true;
+    }
+    return false;
+}
+
+static void print_caches(void) {
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    printf("[info] caches: L1d %ld KiB, L2 %ld KiB, L3 %ld KiB\n",
+        l1 > 0 ? l1 / 1024 : 0, l2 > 0 ? l2 / 1024 : 0, l3 > 0 ? l3 / 1024 : 0
+    );
+}
+
+int main(void) {
+    ctx_t * ctx = malloc(sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->warmup = option_long("WLEXP_MICROBENCH_WARMUP", 3);
+    ctx->reps = option_long("WLEXP_MICROBENCH_REPS", 20);
+    ctx->filter = option_string("WLEXP_MICROBENCH_KERNELS", NULL);
+    ctx->dst = NULL;
+    ctx->src = NULL;
+    ctx->capacity = 0;
+
+    if (ctx->warmup < 0 || ctx->reps <= 0) {
+        printf("[!] invalid repetition counts\n");
+        free(ctx);
+        exit(1);
+    }
+
+    size_t largest = (size_t)7680 * 4320 * 4;
+    if (largest < SWEEP_MAX_BYTES) largest = SWEEP_MAX_BYTES;
+
+    printf("[info] allocating %zu MiB buffers\n", largest / (1024 * 1024));
+    ctx->dst = aligned_alloc(64, largest);
+    ctx->src = aligned_alloc(64, largest);
+    if (ctx->dst == NULL || ctx->src == NULL) {
+        printf("[!] aligned_alloc: allocating buffers failed\n");
+        free(ctx->dst);
+        free(ctx->src);
+        free(ctx);
+        exit(1);
+    }
+    ctx->capacity = largest;
+
+    // fault in every page and give the source realistic content
+    memset(ctx->dst, 0, ctx->capacity);
+    pixels_fill_checkerboard(ctx->src, ctx->capacity / 4, 1);
+
+    print_caches();
+    printf("[info] %ld warmup and %ld timed repetitions\n", ctx->warmup, ctx->reps);
+
+    printf("[info] resolutions\n");
+    for (size_t k = 0; k < sizeof kernels / sizeof *kernels; k++) {
+        if (!kernel_selected(ctx, &kernels[k])) continue;
+        for (size_t r = 0; r < sizeof resolutions / sizeof *resolutions; r++) {
+            measure(ctx, &kernels[k], resolutions[r].width, resolutions[r].height, resolutions[r].name);
+        }
+    }
+
+    printf("[info] cache sweep\n");
+    for (size_t k = 0; k < sizeof kernels / sizeof *kernels; k++) {
+        if (!kernel_selected(ctx, &kernels[k])) continue;
+        for (size_t bytes = SWEEP_MIN_BYTES; bytes <= SWEEP_MAX_BYTES; bytes *= 2) {
+            uint32_t height = bytes / 4 / SWEEP_WIDTH;
+            char label[32];
+            snprintf(label, sizeof label, "%ux%u", SWEEP_WIDTH, height);
+            measure(ctx, &kernels[k], SWEEP_WIDTH, height, label);
+        }
+    }
+
+    free(ctx->dst);
+    free(ctx->src);
+    free(ctx);
+}
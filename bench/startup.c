@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <options.h>
+#include <clock.h>
+#include <harness.h>
+
+// startup-to-first-frame benchmark of the experiments
+//
+// every target is launched WLEXP_STARTUP_REPS times with WLEXP_PROBE set
+// (see common/probe.h). a run ends when the target exits on its own or marks
+// its first frame, after which it is killed. phases are reported as time
+// since the harness spawned the process, and as the step from the phase that
+// preceded them in the same run, which is where the milliseconds go
+//
+// results are printed to stdout as one JSON line and can be appended to a
+// history file with WLEXP_STARTUP_HISTORY to track them over time
+
+#define MAX_REPS 1000
+#define PROBE_POLL_NS 1000000
+
+typedef enum {
+    PHASE_START,
+    PHASE_CONNECT,
+    PHASE_REGISTRY,
+    PHASE_DMABUF_FEEDBACK,
+    PHASE_GBM_DEVICE,
+    PHASE_EGL_INIT,
+    PHASE_SHADER,
+    PHASE_CONFIGURE,
+    PHASE_FIRST_FRAME,
+    PHASE_COUNT
+} phase_t;
+
+static const char * const phase_names[PHASE_COUNT] = {
+    "start",
+    "connect",
+    "registry",
+    "dmabuf_feedback",
+    "gbm_device",
+    "egl_init",
+    "shader",
+    "configure",
+    "first_frame"
+};
+
+static const char * const default_targets =
+    "connect,registry,surface,xdg_surface,application,"
+    "fractional_scale_checkerboard,egl,"
+    "screencopy_shm,screencopy_shm_egl,"
+    "screencopy_dmabuf,screencopy_dmabuf_egl,"
+    "export_dmabuf,export_dmabuf_egl,"
+    "screencopy_pipeline";
+
+typedef struct {
+    // nanoseconds since spawn, 0 if the phase was not reached
+    uint64_t since_spawn_ns[PHASE_COUNT][MAX_REPS];
+    uint64_t step_ns[PHASE_COUNT][MAX_REPS];
+    size_t runs;
+    size_t failed;
+} target_stats_t;
+
+typedef struct {
+    harness_t harness;
+    long reps;
+    double timeout_s;
+    const char * history;
+    char * targets;
+    char probe_path[4096];
+} ctx_t;
+
+// --- runs ---
+
+// reads the marks of a run, returns true once the first frame was marked
+static bool read_probe(ctx_t * ctx, uint64_t * marks_ns) {
+    FILE * file = fopen(ctx->probe_path, "r");
+    if (file == NULL) return false;
+
+    char phase[64];
+    uint64_t ns;
+    while (fscanf(file, "%63s %lu", phase, &ns) == 2) {
+        for (size_t i = 0; i < PHASE_COUNT; i++) {
+            if (strcmp(phase, phase_names[i]) == 0) marks_ns[i] = ns;
+        }
+    }
+    fclose(file);
+
+    return marks_ns[PHASE_FIRST_FRAME] != 0;
+}
+
+static void run_target(ctx_t * ctx, const char * target, target_stats_t * stats) {
+    unlink(ctx->probe_path);
+
+    char probe_env[4200];
+    snprintf(probe_env, sizeof probe_env, "WLEXP_PROBE=%s", ctx->probe_path);
+    char * env[] = { probe_env, NULL };
+
+    uint64_t marks_ns[PHASE_COUNT] = { 0 };
+    uint64_t spawn_ns = clock_now_ns();
+    pid_t pid = harness_spawn(&ctx->harness, target, env);
+    if (pid == -1) {
+        stats->failed++;
+        return;
+    }
+
+    int status = 0;
+    bool exited = false;
+    bool first_frame = false;
+    uint64_t deadline_ns = spawn_ns + (uint64_t)(ctx->timeout_s * 1e9);
+    while (clock_now_ns() < deadline_ns) {
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            exited = true;
+            break;
+        }
+
+        first_frame = read_probe(ctx, marks_ns);
+        if (first_frame) break;
+        harness_sleep_ns(PROBE_POLL_NS);
+    }
+
+    if (!exited) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    read_probe(ctx, marks_ns);
+    unlink(ctx->probe_path);
+
+    bool ok = first_frame || (exited && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    if (!ok) {
+        stats->failed++;
+        return;
+    }
+
+    size_t rep = stats->runs++;
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        stats->since_spawn_ns[i][rep] = marks_ns[i] != 0 ? marks_ns[i] - spawn_ns : 0;
+    }
+
+    // the step of a phase starts at the latest phase before it in this run,
+    // the order differs between targets
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        if (marks_ns[i] == 0) {
+            stats->step_ns[i][rep] = 0;
+            continue;
+        }
+
+        uint64_t previous_ns = spawn_ns;
+        for (size_t j = 0; j < PHASE_COUNT; j++) {
+            if (marks_ns[j] != 0 && marks_ns[j] < marks_ns[i] && marks_ns[j] > previous_ns) previous_ns = marks_ns[j];
+        }
+        stats->step_ns[i][rep] = marks_ns[i] - previous_ns;
+    }
+}
+
+// --- results ---
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// sorts the reached samples of a phase to the front, returns their count
+static size_t sort_samples(const uint64_t * samples, size_t count, uint64_t * sorted) {
+    size_t reached = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i] != 0) sorted[reached++] = samples[i];
+    }
+    qsort(sorted, reached, sizeof *sorted, compare_u64);
+    return reached;
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    if (count == 0) return 0;
+
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+static void print_target(FILE * file, const char * target, const target_stats_t * stats, bool first) {
+    static uint64_t since_spawn[MAX_REPS];
+    static uint64_t step[MAX_REPS];
+
+    fprintf(file, "%s{\"target\": \"%s\", \"runs\": %zu, \"failed\": %zu, \"phases\": [",
+        first ? "" : ", ", target, stats->runs, stats->failed
+    );
+
+    bool first_phase = true;
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        size_t count = sort_samples(stats->since_spawn_ns[i], stats->runs, since_spawn);
+        sort_samples(stats->step_ns[i], stats->runs, step);
+        if (count == 0) continue;
+
+        fprintf(file, "%s{\"phase\": \"%s\", \"count\": %zu, "
+            "\"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, "
+            "\"step_p50_ns\": %lu, \"step_p90_ns\": %lu}",
+            first_phase ? "" : ", ", phase_names[i], count,
+            percentile(since_spawn, count, 50), percentile(since_spawn, count, 90), percentile(since_spawn, count, 99),
+            percentile(step, count, 50), percentile(step, count, 90)
+        );
+        first_phase = false;
+    }
+
+    fprintf(file, "]}");
+}
+
+static void print_summary(const char * target, const target_stats_t * stats) {
+    static uint64_t since_spawn[MAX_REPS];
+    static uint64_t step[MAX_REPS];
+
+    fprintf(stderr, "[info] %s: %zu runs, %zu failed\n", target, stats->runs, stats->failed);
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        size_t count = sort_samples(stats->since_spawn_ns[i], stats->runs, since_spawn);
+        sort_samples(stats->step_ns[i], stats->runs, step);
+        if (count == 0) continue;
+
+        fprintf(stderr, "    %-16s p50 %8.3f ms  p90 %8.3f ms  p99 %8.3f ms  step p50 %8.3f ms\n",
+            phase_names[i],
+            percentile(since_spawn, count, 50) / 1e6, percentile(since_spawn, count, 90) / 1e6,
+            percentile(since_spawn, count, 99) / 1e6, percentile(step, count, 50) / 1e6
+        );
+    }
+}
+
+// --- setup ---
+
+int main(void) {
+    ctx_t * ctx = malloc(sizeof (ctx_t));
+    if (ctx == NULL) {
+        fprintf(stderr, "[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    harness_init(&ctx->harness);
+    ctx->reps = option_long("WLEXP_STARTUP_REPS", 20);
+    ctx->timeout_s = option_double("WLEXP_STARTUP_TIMEOUT", 10);
+    ctx->history = option_string("WLEXP_STARTUP_HISTORY", NULL);
+    ctx->targets = strdup(option_string("WLEXP_STARTUP_TARGETS", default_targets));
+    snprintf(ctx->probe_path, sizeof ctx->probe_path, "%s/wlexp-startup-%d.probe", ctx->harness.runtime_dir, (int)getpid());
+
+    if (ctx->targets == NULL || ctx->reps <= 0 || ctx->reps > MAX_REPS || ctx->timeout_s <= 0) {
+        fprintf(stderr, "[!] invalid startup options\n");
+        free(ctx->targets);
+        free(ctx);
+        exit(1);
+    }
+
+    // one compositor for all runs, startup does not depend on the output size
+    if (!harness_start_compositor(&ctx->harness, 1920, 1080)) {
+        free(ctx->targets);
+        free(ctx);
+        exit(1);
+    }
+
+    size_t num_targets = 1;
+    for (const char * c = ctx->targets; *c != '\0'; c++) num_targets += *c == ',';
+
+    const char ** names = calloc(num_targets, sizeof *names);
+    target_stats_t * stats = calloc(num_targets, sizeof *stats);
+    if (names == NULL || stats == NULL) {
+        fprintf(stderr, "[!] calloc: allocating results failed\n");
+        harness_stop_compositor(&ctx->harness);
+        exit(1);
+    }
+
+    num_targets = 0;
+    char * save = NULL;
+    for (char * target = strtok_r(ctx->targets, ",", &save); target != NULL; target = strtok_r(NULL, ",", &save)) {
+        names[num_targets] = target;
+        fprintf(stderr, "[info] starting %s %ld times\n", target, ctx->reps);
+        for (long rep = 0; rep < ctx->reps; rep++) run_target(ctx, target, &stats[num_targets]);
+        print_summary(target, &stats[num_targets]);
+        num_targets++;
+    }
+
+    harness_stop_compositor(&ctx->harness);
+
+    FILE * history = NULL;
+    if (ctx->history != NULL) {
+        history = fopen(ctx->history, "a");
+        if (history == NULL) fprintf(stderr, "[!] failed to open history %s\n", ctx->history);
+    }
+
+    FILE * outputs[] = { stdout, history };
+    for (size_t o = 0; o < 2; o++) {
+        FILE * file = outputs[o];
+        if (file == NULL) continue;
+
+        fprintf(file, "{\"time\": %ld, \"compositor\": \"%s\", \"reps\": %ld, \"targets\": [",
+            (long)time(NULL), ctx->harness.local ? "local" : "mock", ctx->reps
+        );
+        for (size_t i = 0; i < num_targets; i++) print_target(file, names[i], &stats[i], i == 0);
+        fprintf(file, "]}\n");
+    }
+    if (history != NULL) fclose(history);
+
+    free(names);
+    free(stats);
+    free(ctx->targets);
+    free(ctx);
+}
@@ -0,0 +1,354 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <options.h>
+#include <clock.h>
+#include <task_pool.h>
+#include <event_loop.h>
+#include <pipeline.h>
+#include <timestamp_pattern.h>
+
+// stress checks of the lock-free and multithreaded helpers in common/, meant
+// to be built with -fsanitize=thread so that races show up even when every
+// result comes out right, and randomized round trips of the pixel codecs
+//
+// every check runs WLEXP_STRESS_ITERATIONS randomized rounds and verifies
+// the results itself, the exit status is 1 if any check failed. the thread
+// counts default to more threads than a small machine has CPUs, so that the
+// threads get preempted at random points
+
+#define MAX_TASKS 5000
+#define MAX_REGION_SIZE 1000
+#define PIPELINE_FRAMES 6
+#define PIPELINE_FRAMES_PER_ITERATION 10
+#define MAX_PATTERN_FRAME_SIZE 256
+
+typedef struct {
+    long iterations;
+    const char * filter;
+    uint32_t random;
+} ctx_t;
+
+typedef struct {
+    const char * name;
+    bool (*func)(ctx_t * ctx);
+} check_t;
+
+static uint32_t next_random(ctx_t * ctx) {
+    // xorshift32, the same sequence on every run
+    uint32_t x = ctx->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ctx->random = x;
+    return x;
+}
+
+// --- task pool ---
+
+typedef struct {
+    uint32_t * hits;
+} task_job_t;
+
+static void count_task(void * data, uint32_t index) {
+    task_job_t * job = (task_job_t *)data;
+
+    // uneven tasks, so that workers run dry at different times and steal
+    volatile uint64_t sum = 0;
+    for (uint32_t i = 0; i < (index % 7) * 200; i++) sum += i;
+
+    __atomic_fetch_add(&job->hits[index], 1, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    uint32_t width;
+    uint8_t * covered;
+} region_job_t;
+
+static void cover_region(void * data, uint32_t index, task_region_t region) {
+    region_job_t * job = (region_job_t *)data;
+
+    // regions must not overlap, so plain stores are enough
+    for (uint32_t y = region.y; y < region.y + region.height; y++) {
+        for (uint32_t x = region.x; x < region.x + region.width; x++) {
+            job->covered[(size_t)y * job->width + x]++;
+        }
+    }
+}
+
+static bool check_task_pool(ctx_t * ctx) {
+    // the default of one worker per CPU may be a single worker here
+    if (getenv("WLEXP_TASK_THREADS") == NULL) setenv("WLEXP_TASK_THREADS", "4", 1);
+
+    task_pool_t * pool = task_pool_create();
+    if (pool == NULL) return false;
+
+    task_job_t job;
+    region_job_t region_job;
+    job.hits = calloc(MAX_TASKS, sizeof (uint32_t));
+    region_job.covered = calloc((size_t)MAX_REGION_SIZE * MAX_REGION_SIZE, 1);
+    bool ok = job.hits != NULL && region_job.covered != NULL;
+    if (!ok) printf("[!] stress: failed to allocate task pool results\n");
+
+    for (long i = 0; ok && i < ctx->iterations; i++) {
+        // mostly small jobs, they stress waking and parking the workers
+        uint32_t count = i % 4 == 0 ? next_random(ctx) % MAX_TASKS : next_random(ctx) % 16;
+        memset(job.hits, 0, count * sizeof (uint32_t));
+        task_pool_run(pool, count, count_task, &job);
+
+        for (uint32_t task = 0; task < count; task++) {
+            if (job.hits[task] == 1) continue;
+            printf("[!] stress: task pool job %ld ran task %u of %u %u times\n", i, task, count, job.hits[task]);
+            ok = false;
+            break;
+        }
+    }
+
+    for (long i = 0; ok && i < ctx->iterations / 20; i++) {
+        uint32_t width = 1 + next_random(ctx) % MAX_REGION_SIZE;
+        uint32_t height = 1 + next_random(ctx) % MAX_REGION_SIZE;
+        region_job.width = width;
+        memset(region_job.covered, 0, (size_t)width * height);
+        if (i % 2 == 0) {
+            task_pool_for_tiles(pool, width, height, 64, 48, cover_region, &region_job);
+        } else {
+            task_pool_for_bands(pool, width, height, cover_region, &region_job);
+        }
+
+        for (size_t pixel = 0; pixel < (size_t)width * height; pixel++) {
+            if (region_job.covered[pixel] == 1) continue;
+            printf("[!] stress: %s of %ux%u covered pixel %zu %u times\n",
+                i % 2 == 0 ? "tiles" : "bands", width, height, pixel, region_job.covered[pixel]
+            );
+            ok = false;
+            break;
+        }
+    }
+
+    task_pool_destroy(pool);
+    free(job.hits);
+    free(region_job.covered);
+    return ok;
+}
+
+// --- pipeline ---
+
+typedef struct {
+    uint32_t threads[3];
+    uint32_t queue_depth;
+} pipeline_config_t;
+
+// single producer/consumer queues, shared queues on either end, and stages
+// with more threads than frames
+static const pipeline_config_t pipeline_configs[] = {
+    { { 1, 1, 1 }, 1 },
+    { { 1, 3, 1 }, 2 },
+    { { 2, 2, 2 }, 2 },
+    { { 1, 4, 3 }, 1 },
+    { { 3, 1, 8 }, 2 },
+};
+
+typedef struct {
+    bool ordered;
+    // the stages a frame went through, written by whichever thread runs
+    // the stage, so only the queues order the accesses
+    uint32_t marks[PIPELINE_FRAMES];
+    bool in_flight[PIPELINE_FRAMES];
+    uint64_t last_completed;
+    uint64_t released;
+    uint64_t errors;
+} pipeline_job_t;
+
+static bool mark_stage(pipeline_job_t * job, pipeline_frame_t * frame, uint32_t stage) {
+    if (job->marks[frame->index] != stage) {
+        __atomic_fetch_add(&job->errors, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    job->marks[frame->index] = stage + 1;
+    return true;
+}
+
+static bool stage_first(void * data, pipeline_frame_t * frame) {
+    return mark_stage((pipeline_job_t *)data, frame, 0);
+}
+
+static bool stage_middle(void * data, pipeline_frame_t * frame) {
+    if (!mark_stage((pipeline_job_t *)data, frame, 1)) return false;
+
+    // uneven work, and some frames dropped halfway
+    volatile uint64_t sum = 0;
+    for (uint32_t i = 0; i < (frame->sequence % 50) * 100; i++) sum += i;
+    return frame->sequence % 13 != 0;
+}
+
+static bool stage_last(void * data, pipeline_frame_t * frame) {
+    if (!mark_stage((pipeline_job_t *)data, frame, 2)) return false;
+
+    uint8_t * bytes = pipeline_frame_bytes(frame, 64 + frame->sequence % 64);
+    if (bytes == NULL) return false;
+    memset(bytes, (int)frame->sequence, 64);
+    frame->size = 64;
+    return true;
+}
+
+static void pipeline_released(void * data, pipeline_frame_t * frame, bool completed) {
+    pipeline_job_t * job = (pipeline_job_t *)data;
+
+    if (!job->in_flight[frame->index]) job->errors++;
+    if (completed && job->marks[frame->index] != 3) job->errors++;
+    if (completed && frame->bytes[0] != (uint8_t)frame->sequence) job->errors++;
+    // frames only overtake each other in stages with several threads
+    if (completed && job->ordered && job->released > 0 && frame->sequence < job->last_completed) job->errors++;
+    if (completed) job->last_completed = frame->sequence;
+
+    job->in_flight[frame->index] = false;
+    job->marks[frame->index] = 0;
+    job->released++;
+}
+
+static bool run_pipeline(ctx_t * ctx, event_loop_t * loop, const pipeline_config_t * config) {
+    pipeline_job_t job;
+    memset(&job, 0, sizeof job);
+    job.ordered = config->threads[0] == 1 && config->threads[1] == 1 && config->threads[2] == 1;
+
+    pipeline_t * pipeline = pipeline_create(loop, PIPELINE_FRAMES, pipeline_released, &job);
+    if (pipeline == NULL) return false;
+
+    bool ok = pipeline_add_stage(pipeline, "first", config->threads[0], config->queue_depth, stage_first, &job);
+    ok = ok && pipeline_add_stage(pipeline, "middle", config->threads[1], config->queue_depth, stage_middle, &job);
+    ok = ok && pipeline_add_stage(pipeline, "last", config->threads[2], config->queue_depth, stage_last, &job);
+    ok = ok && pipeline_start(pipeline);
+
+    uint64_t frames = (uint64_t)ctx->iterations * PIPELINE_FRAMES_PER_ITERATION;
+    uint64_t submitted = 0;
+    while (ok && submitted < frames) {
+        for (uint32_t i = 0; i < PIPELINE_FRAMES && submitted < frames; i++) {
+            if (job.in_flight[i]) continue;
+
+            pipeline_frame_t * frame = pipeline_get_frame(pipeline, i);
+            frame->sequence = submitted;
+            job.in_flight[i] = true;
+            if (pipeline_submit(pipeline, frame)) {
+                submitted++;
+            } else {
+                job.in_flight[i] = false;
+            }
+        }
+        ok = event_loop_dispatch(loop, 100);
+    }
+
+    // the last frames are still in the stages, pipeline_destroy lets them
+    // run through and releases them
+    pipeline_destroy(pipeline);
+
+    if (job.released != submitted || job.errors > 0) {
+        printf("[!] stress: pipeline %u/%u/%u threads: %lu submitted, %lu released, %lu errors\n",
+            config->threads[0], config->threads[1], config->threads[2], submitted, job.released, job.errors
+        );
+        ok = false;
+    }
+    return ok;
+}
+
+static bool check_pipeline(ctx_t * ctx) {
+    event_loop_t * loop = event_loop_create(NULL);
+    if (loop == NULL) return false;
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < sizeof pipeline_configs / sizeof *pipeline_configs; i++) {
+        ok = run_pipeline(ctx, loop, &pipeline_configs[i]);
+    }
+
+    event_loop_destroy(loop);
+    return ok;
+}
+
+// --- timestamp pattern ---
+
+static bool decode_pattern(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride, bool y_invert, uint64_t timestamp_ns) {
+    uint64_t decoded_ns = 0;
+    if (timestamp_pattern_decode(pixels, width, height, stride * 4, y_invert, &decoded_ns) && decoded_ns == timestamp_ns) return true;
+
+    printf("[!] stress: %s pattern %lu in %ux%u decoded as %lu\n",
+        y_invert ? "inverted" : "upright", timestamp_ns, width, height, decoded_ns
+    );
+    return false;
+}
+
+static bool check_timestamp_pattern(ctx_t * ctx) {
+    size_t capacity = (size_t)(MAX_PATTERN_FRAME_SIZE + 16) * MAX_PATTERN_FRAME_SIZE;
+    uint32_t * upright = malloc(capacity * sizeof (uint32_t));
+    uint32_t * inverted = malloc(capacity * sizeof (uint32_t));
+    bool ok = upright != NULL && inverted != NULL;
+    if (!ok) printf("[!] stress: failed to allocate pattern frames\n");
+
+    for (long i = 0; ok && i < ctx->iterations; i++) {
+        uint32_t width = TIMESTAMP_PATTERN_WIDTH + next_random(ctx) % (MAX_PATTERN_FRAME_SIZE - TIMESTAMP_PATTERN_WIDTH);
+        uint32_t height = TIMESTAMP_PATTERN_HEIGHT + next_random(ctx) % (MAX_PATTERN_FRAME_SIZE - TIMESTAMP_PATTERN_HEIGHT);
+        uint32_t stride = width + next_random(ctx) % 16;
+        uint32_t x = next_random(ctx) % (width - TIMESTAMP_PATTERN_WIDTH + 1);
+        uint32_t y = next_random(ctx) % (height - TIMESTAMP_PATTERN_HEIGHT + 1);
+        uint64_t timestamp_ns = (uint64_t)next_random(ctx) << 32 | next_random(ctx);
+
+        // gray background, so only the pattern has cells the decoder knows
+        for (size_t pixel = 0; pixel < (size_t)stride * height; pixel++) upright[pixel] = 0xff808080;
+        timestamp_pattern_encode(upright + (size_t)y * stride + x, stride, timestamp_ns);
+
+        // the same frame as a compositor flagging Y_INVERT would store it
+        for (uint32_t row = 0; row < height; row++) {
+            memcpy(inverted + (size_t)(height - 1 - row) * stride, upright + (size_t)row * stride, stride * sizeof (uint32_t));
+        }
+
+        ok = decode_pattern(upright, width, height, stride, false, timestamp_ns);
+        ok = ok && decode_pattern(inverted, width, height, stride, true, timestamp_ns);
+    }
+
+    free(upright);
+    free(inverted);
+    return ok;
+}
+
+static const check_t checks[] = {
+    { "task_pool", check_task_pool },
+    { "pipeline", check_pipeline },
+    { "timestamp_pattern", check_timestamp_pattern },
+};
+
+static bool check_selected(ctx_t * ctx, const check_t * check) {
+    if (ctx->filter == NULL) return true;
+
+    // comma separated list of check names, as for microbench
+    size_t length = strlen(check->name);
+    for (const char * entry = ctx->filter; entry != NULL; entry = strchr(entry, ',')) {
+        if (*entry == ',') entry++;
+        if (strncmp(entry, check->name, length) == 0 && (entry[length] == ',' || entry[length] == '\0')) return true;
+    }
+    return false;
+}
+
+int main(void) {
+    ctx_t ctx;
+    ctx.iterations = option_long("WLEXP_STRESS_ITERATIONS", 2000);
+    ctx.filter = option_string("WLEXP_STRESS_CHECKS", NULL);
+    ctx.random = 0x2545f491;
+
+    if (ctx.iterations <= 0) {
+        printf("[!] invalid iteration count\n");
+        exit(1);
+    }
+
+    bool ok = true;
+    for (size_t c = 0; c < sizeof checks / sizeof *checks; c++) {
+        if (!check_selected(&ctx, &checks[c])) continue;
+
+        printf("[info] %s: %ld iterations\n", checks[c].name, ctx.iterations);
+        uint64_t start_ns = clock_now_ns();
+        bool passed = checks[c].func(&ctx);
+        printf("[info] %s: %s in %.3f s\n", checks[c].name, passed ? "passed" : "FAILED", (clock_now_ns() - start_ns) / 1e9);
+        ok = ok && passed;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,710 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <options.h>
+#include <clock.h>
+#include <harness.h>
+
+// wayland wire protocol recorder and replayer
+//
+// record (the default WLEXP_TRACE_MODE) runs WLEXP_TRACE_CLIENT behind a
+// proxy socket and writes everything passing through to WLEXP_TRACE_FILE:
+// every chunk read from either side with its time, the number of request
+// bytes the client had sent up to that point, and the type and size of every
+// fd attached to it. small regular files sent by the compositor, like the
+// dmabuf feedback format table, are stored with their contents
+//
+// replay plays the recorded events back to the same client without any
+// compositor. an event chunk is only sent once the client has sent as many
+// request bytes as it had when the chunk was recorded, so the client sees the
+// same event stream in the same order relative to its own requests, and its
+// listeners run exactly as they did against the compositor. fds are replaced
+// by memfds of the recorded size, which covers shm and the format table but
+// not dmabufs a client wants to import into EGL or gbm
+//
+// dump prints the recorded messages with their object id, opcode and fds
+
+#define TRACE_MAGIC "WLEXPTR1"
+#define MAX_FDS 28
+#define CHUNK_SIZE 65536
+#define MAX_FD_DATA (1 << 20)
+#define EXIT_GRACE_S 1.0
+
+typedef enum {
+    DIRECTION_REQUEST,
+    DIRECTION_EVENT
+} direction_t;
+
+typedef enum {
+    FD_FILE,
+    FD_DMABUF,
+    FD_OTHER
+} fd_kind_t;
+
+static const char * const fd_kind_names[] = { "file", "dmabuf", "other" };
+
+typedef struct {
+    uint32_t direction;
+    uint32_t size;
+    uint64_t time_ns;
+    // request bytes sent by the client before this chunk
+    uint64_t request_bytes;
+    uint32_t num_fds;
+    uint32_t reserved;
+} record_header_t;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t size;
+    // contents stored after the fd descriptions, 0 if not stored
+    uint64_t data_size;
+} record_fd_t;
+
+typedef struct {
+    record_header_t header;
+    record_fd_t fds[MAX_FDS];
+    uint8_t * fd_data[MAX_FDS];
+    uint8_t * payload;
+} record_t;
+
+typedef struct {
+    harness_t harness;
+    const char * mode;
+    const char * path;
+    const char * client;
+    long reps;
+    bool realtime;
+    double timeout_s;
+
+    char socket_path[4096];
+    int listen_fd;
+    FILE * trace;
+
+    record_t * records;
+    size_t num_records;
+} ctx_t;
+
+static void cleanup(ctx_t * ctx) {
+    harness_stop_compositor(&ctx->harness);
+    if (ctx->listen_fd != -1) {
+        close(ctx->listen_fd);
+        unlink(ctx->socket_path);
+    }
+    if (ctx->trace != NULL) fclose(ctx->trace);
+
+    for (size_t i = 0; i < ctx->num_records; i++) {
+        for (size_t f = 0; f < ctx->records[i].header.num_fds; f++) free(ctx->records[i].fd_data[f]);
+        free(ctx->records[i].payload);
+    }
+    free(ctx->records);
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- sockets ---
+
+static void listen_socket(ctx_t * ctx) {
+    snprintf(ctx->socket_path, sizeof ctx->socket_path, "%s/wlexp-trace-%d", ctx->harness.runtime_dir, (int)getpid());
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(ctx->socket_path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "[!] socket path %s too long\n", ctx->socket_path);
+        exit_fail(ctx);
+    }
+    strcpy(addr.sun_path, ctx->socket_path);
+    unlink(ctx->socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        fprintf(stderr, "[!] socket: failed to create listening socket\n");
+        exit_fail(ctx);
+    }
+    ctx->listen_fd = fd;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) == -1 || listen(fd, 1) == -1) {
+        fprintf(stderr, "[!] bind: failed to listen on %s\n", ctx->socket_path);
+        close(fd);
+        ctx->listen_fd = -1;
+        exit_fail(ctx);
+    }
+}
+
+// waits for the spawned client to connect, -1 if it exited or timed out
+static int accept_client(ctx_t * ctx, pid_t pid) {
+    uint64_t deadline_ns = clock_now_ns() + (uint64_t)(ctx->timeout_s * 1e9);
+    while (clock_now_ns() < deadline_ns) {
+        struct pollfd pfd = { .fd = ctx->listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 10) > 0) return accept4(ctx->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (waitpid(pid, NULL, WNOHANG) == pid) return -1;
+    }
+
+    return -1;
+}
+
+static int connect_upstream(const char * runtime_dir, const char * name) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (name[0] == '/') {
+        snprintf(addr.sun_path, sizeof addr.sun_path, "%s", name);
+    } else {
+        snprintf(addr.sun_path, sizeof addr.sun_path, "%s/%s", runtime_dir, name);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// reads one chunk with its fds, returns the byte count, 0 on hangup
+static ssize_t recv_chunk(int fd, uint8_t * buffer, int * fds, uint32_t * num_fds) {
+    char control[CMSG_SPACE(sizeof (int) * MAX_FDS)];
+    struct iovec iov = { .iov_base = buffer, .iov_len = CHUNK_SIZE };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control, .msg_controllen = sizeof control
+    };
+
+    ssize_t length;
+    do {
+        length = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (length == -1 && errno == EINTR);
+
+    *num_fds = 0;
+    if (length <= 0) return length;
+
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof (int);
+        for (size_t i = 0; i < count && *num_fds < MAX_FDS; i++) {
+            memcpy(&fds[(*num_fds)++], CMSG_DATA(cmsg) + i * sizeof (int), sizeof (int));
+        }
+    }
+
+    return length;
+}
+
+static bool send_chunk(int fd, const uint8_t * buffer, size_t size, const int * fds, uint32_t num_fds) {
+    char control[CMSG_SPACE(sizeof (int) * MAX_FDS)];
+    memset(control, 0, sizeof control);
+
+    size_t sent = 0;
+    while (sent < size) {
+        struct iovec iov = { .iov_base = (void *)(buffer + sent), .iov_len = size - sent };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+        // fds go out with the first byte of the chunk, as they came in
+        if (sent == 0 && num_fds > 0) {
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof (int) * num_fds);
+            struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof (int) * num_fds);
+            memcpy(CMSG_DATA(cmsg), fds, sizeof (int) * num_fds);
+        }
+
+        ssize_t length = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (length == -1 && errno == EINTR) continue;
+        if (length <= 0) return false;
+        sent += length;
+    }
+
+    return true;
+}
+
+// --- recording ---
+
+static void describe_fd(int fd, direction_t direction, record_fd_t * record_fd, uint8_t ** data) {
+    record_fd->kind = FD_OTHER;
+    record_fd->reserved = 0;
+    record_fd->size = 0;
+    record_fd->data_size = 0;
+    *data = NULL;
+
+    char proc_path[64];
+    char target[256] = { 0 };
+    snprintf(proc_path, sizeof proc_path, "/proc/self/fd/%d", fd);
+    if (readlink(proc_path, target, sizeof target - 1) == -1) target[0] = '\0';
+
+    struct stat st;
+    if (strncmp(target, "/dmabuf:", 8) == 0 || strcmp(target, "anon_inode:dmabuf") == 0) {
+        record_fd->kind = FD_DMABUF;
+        off_t size = lseek(fd, 0, SEEK_END);
+        record_fd->size = size > 0 ? (uint64_t)size : 0;
+        lseek(fd, 0, SEEK_SET);
+    } else if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        record_fd->kind = FD_FILE;
+        record_fd->size = st.st_size;
+
+        // requests carry shm pools which are not needed for replay, events
+        // carry small tables the client reads
+        if (direction == DIRECTION_EVENT && st.st_size > 0 && st.st_size <= MAX_FD_DATA) {
+            *data = malloc(st.st_size);
+            if (*data != NULL && pread(fd, *data, st.st_size, 0) == st.st_size) {
+                record_fd->data_size = st.st_size;
+            } else {
+                free(*data);
+                *data = NULL;
+            }
+        }
+    }
+}
+
+static void write_record(ctx_t * ctx, direction_t direction, uint64_t time_ns, uint64_t request_bytes, const uint8_t * payload, size_t size, const int * fds, uint32_t num_fds) {
+    record_header_t header = {
+        .direction = direction, .size = size, .time_ns = time_ns,
+        .request_bytes = request_bytes, .num_fds = num_fds, .reserved = 0
+    };
+    record_fd_t record_fds[MAX_FDS];
+    uint8_t * fd_data[MAX_FDS];
+    for (uint32_t i = 0; i < num_fds; i++) describe_fd(fds[i], direction, &record_fds[i], &fd_data[i]);
+
+    bool ok = fwrite(&header, sizeof header, 1, ctx->trace) == 1;
+    if (num_fds > 0) ok = ok && fwrite(record_fds, sizeof *record_fds, num_fds, ctx->trace) == num_fds;
+    for (uint32_t i = 0; i < num_fds; i++) {
+        if (record_fds[i].data_size > 0) ok = ok && fwrite(fd_data[i], record_fds[i].data_size, 1, ctx->trace) == 1;
+        free(fd_data[i]);
+    }
+    if (size > 0) ok = ok && fwrite(payload, size, 1, ctx->trace) == 1;
+
+    if (!ok) {
+        fprintf(stderr, "[!] failed to write trace %s\n", ctx->path);
+        exit_fail(ctx);
+    }
+}
+
+static void record(ctx_t * ctx) {
+    if (!harness_start_compositor(&ctx->harness, 1920, 1080)) exit_fail(ctx);
+    const char * upstream = ctx->harness.local ? option_string("WAYLAND_DISPLAY", "wayland-0") : ctx->harness.socket;
+
+    ctx->trace = fopen(ctx->path, "wb");
+    if (ctx->trace == NULL || fwrite(TRACE_MAGIC, 8, 1, ctx->trace) != 1) {
+        fprintf(stderr, "[!] failed to create trace %s\n", ctx->path);
+        exit_fail(ctx);
+    }
+
+    listen_socket(ctx);
+    char display_env[4200];
+    snprintf(display_env, sizeof display_env, "WAYLAND_DISPLAY=%s", ctx->socket_path);
+    char * env[] = { display_env, NULL };
+
+    fprintf(stderr, "[info] recording %s against %s into %s\n", ctx->client, upstream, ctx->path);
+    pid_t pid = harness_spawn(&ctx->harness, ctx->client, env);
+    if (pid == -1) exit_fail(ctx);
+
+    int client_fd = accept_client(ctx, pid);
+    int server_fd = client_fd != -1 ? connect_upstream(ctx->harness.runtime_dir, upstream) : -1;
+    if (client_fd == -1 || server_fd == -1) {
+        fprintf(stderr, "[!] %s\n", client_fd == -1 ? "client did not connect" : "failed to connect to the compositor");
+        if (client_fd != -1) close(client_fd);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        exit_fail(ctx);
+    }
+
+    static uint8_t buffer[CHUNK_SIZE];
+    int fds[MAX_FDS];
+    uint32_t num_fds;
+    uint64_t start_ns = clock_now_ns();
+    uint64_t request_bytes = 0;
+    uint64_t event_bytes = 0;
+    size_t chunks = 0;
+
+    struct pollfd pfds[2] = {
+        { .fd = client_fd, .events = POLLIN },
+        { .fd = server_fd, .events = POLLIN }
+    };
+    bool running = true;
+    while (running) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (size_t i = 0; i < 2 && running; i++) {
+            if (pfds[i].revents == 0) continue;
+
+            direction_t direction = i == 0 ? DIRECTION_REQUEST : DIRECTION_EVENT;
+            ssize_t length = recv_chunk(pfds[i].fd, buffer, fds, &num_fds);
+            if (length <= 0) {
+                running = false;
+                break;
+            }
+
+            write_record(ctx, direction, clock_now_ns() - start_ns, request_bytes, buffer, length, fds, num_fds);
+            if (!send_chunk(pfds[1 - i].fd, buffer, length, fds, num_fds)) running = false;
+            for (uint32_t f = 0; f < num_fds; f++) close(fds[f]);
+
+            if (direction == DIRECTION_REQUEST) {
+                request_bytes += length;
+            } else {
+                event_bytes += length;
+            }
+            chunks++;
+        }
+    }
+
+    close(client_fd);
+    close(server_fd);
+
+    int status = 0;
+    if (!harness_wait(pid, ctx->timeout_s, &status, NULL)) fprintf(stderr, "[!] %s had to be killed\n", ctx->client);
+
+    fprintf(stderr, "[info] recorded %zu chunks, %lu request bytes, %lu event bytes in %.1f ms\n",
+        chunks, request_bytes, event_bytes, (clock_now_ns() - start_ns) / 1e6
+    );
+}
+
+// --- replay ---
+
+static bool read_record(FILE * file, record_t * record) {
+    memset(record, 0, sizeof *record);
+    if (fread(&record->header, sizeof record->header, 1, file) != 1) return false;
+    if (record->header.num_fds > MAX_FDS || record->header.size > CHUNK_SIZE) return false;
+
+    uint32_t num_fds = record->header.num_fds;
+    if (num_fds > 0 && fread(record->fds, sizeof *record->fds, num_fds, file) != num_fds) return false;
+    for (uint32_t i = 0; i < num_fds; i++) {
+        uint64_t data_size = record->fds[i].data_size;
+        if (data_size == 0) continue;
+        if (data_size > MAX_FD_DATA) return false;
+
+        record->fd_data[i] = malloc(data_size);
+        if (record->fd_data[i] == NULL || fread(record->fd_data[i], data_size, 1, file) != 1) return false;
+    }
+
+    record->payload = malloc(record->header.size > 0 ? record->header.size : 1);
+    if (record->payload == NULL) return false;
+    return record->header.size == 0 || fread(record->payload, record->header.size, 1, file) == 1;
+}
+
+static void open_trace(ctx_t * ctx) {
+    char magic[8];
+    ctx->trace = fopen(ctx->path, "rb");
+    if (ctx->trace == NULL || fread(magic, 8, 1, ctx->trace) != 1 || memcmp(magic, TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "[!] %s is not a trace\n", ctx->path);
+        exit_fail(ctx);
+    }
+}
+
+static void load_trace(ctx_t * ctx) {
+    open_trace(ctx);
+
+    size_t capacity = 0;
+    while (true) {
+        if (ctx->num_records == capacity) {
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            record_t * records = realloc(ctx->records, capacity * sizeof *records);
+            if (records == NULL) {
+                fprintf(stderr, "[!] realloc: failed to grow records\n");
+                exit_fail(ctx);
+            }
+            ctx->records = records;
+        }
+
+        record_t * record = &ctx->records[ctx->num_records];
+        bool ok = read_record(ctx->trace, record);
+        if (!ok) {
+            for (size_t f = 0; f < MAX_FDS; f++) free(record->fd_data[f]);
+            free(record->payload);
+            break;
+        }
+        ctx->num_records++;
+    }
+
+    if (!feof(ctx->trace)) fprintf(stderr, "[!] trace %s is truncated after %zu records\n", ctx->path, ctx->num_records);
+}
+
+// a memfd standing in for a recorded fd, with the recorded contents if any
+static int substitute_fd(const record_fd_t * record_fd, const uint8_t * data) {
+    if (record_fd->kind == FD_OTHER) return open("/dev/null", O_RDWR | O_CLOEXEC);
+
+    int fd = memfd_create("wlexp-trace", MFD_CLOEXEC);
+    if (fd == -1) return -1;
+    if (ftruncate(fd, record_fd->size) == -1
+        || (record_fd->data_size > 0 && pwrite(fd, data, record_fd->data_size, 0) != (ssize_t)record_fd->data_size)
+    ) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// reads and discards requests until the client sent at least target bytes
+static bool drain_requests(int client_fd, uint64_t target, uint64_t * received, uint64_t deadline_ns) {
+    static uint8_t buffer[CHUNK_SIZE];
+    int fds[MAX_FDS];
+    uint32_t num_fds;
+
+    while (*received < target) {
+        uint64_t now_ns = clock_now_ns();
+        if (now_ns >= deadline_ns) return false;
+
+        struct pollfd pfd = { .fd = client_fd, .events = POLLIN };
+        int timeout_ms = (int)((deadline_ns - now_ns) / 1000000) + 1;
+        if (poll(&pfd, 1, timeout_ms) <= 0) continue;
+
+        ssize_t length = recv_chunk(client_fd, buffer, fds, &num_fds);
+        for (uint32_t f = 0; f < num_fds; f++) close(fds[f]);
+        if (length <= 0) return false;
+        *received += length;
+    }
+
+    return true;
+}
+
+typedef struct {
+    bool complete;
+    uint64_t events;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+} replay_run_t;
+
+static replay_run_t replay_once(ctx_t * ctx) {
+    replay_run_t run = { 0 };
+
+    char display_env[4200];
+    snprintf(display_env, sizeof display_env, "WAYLAND_DISPLAY=%s", ctx->socket_path);
+    char * env[] = { display_env, NULL };
+
+    uint64_t spawn_ns = clock_now_ns();
+    pid_t pid = harness_spawn(&ctx->harness, ctx->client, env);
+    if (pid == -1) return run;
+
+    int client_fd = accept_client(ctx, pid);
+    uint64_t start_ns = clock_now_ns();
+    uint64_t deadline_ns = start_ns + (uint64_t)(ctx->timeout_s * 1e9);
+    uint64_t received = 0;
+    bool complete = client_fd != -1;
+
+    for (size_t i = 0; i < ctx->num_records && complete; i++) {
+        record_t * record = &ctx->records[i];
+        if (record->header.direction != DIRECTION_EVENT) continue;
+
+        complete = drain_requests(client_fd, record->header.request_bytes, &received, deadline_ns);
+        if (!complete) break;
+
+        if (ctx->realtime) {
+            uint64_t due_ns = start_ns + record->header.time_ns;
+            uint64_t now_ns = clock_now_ns();
+            if (due_ns > now_ns) harness_sleep_ns(due_ns - now_ns);
+        }
+
+        int fds[MAX_FDS];
+        uint32_t num_fds = 0;
+        for (; num_fds < record->header.num_fds; num_fds++) {
+            fds[num_fds] = substitute_fd(&record->fds[num_fds], record->fd_data[num_fds]);
+            if (fds[num_fds] == -1) break;
+        }
+
+        complete = num_fds == record->header.num_fds
+            && send_chunk(client_fd, record->payload, record->header.size, fds, num_fds);
+        for (uint32_t f = 0; f < num_fds; f++) close(fds[f]);
+        run.events += complete;
+    }
+
+    // the trace is over, a client that still waits for events diverged
+    struct rusage usage = { 0 };
+    int status = 0;
+    bool exited = harness_wait(pid, complete ? EXIT_GRACE_S : 0, &status, &usage);
+    if (client_fd != -1) close(client_fd);
+
+    run.complete = complete && exited && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    run.wall_ns = clock_now_ns() - spawn_ns;
+    run.cpu_ns = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+    return run;
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    if (count == 0) return 0;
+
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+static void replay(ctx_t * ctx) {
+    load_trace(ctx);
+    listen_socket(ctx);
+
+    uint64_t * wall_ns = calloc(ctx->reps, sizeof *wall_ns);
+    uint64_t * cpu_ns = calloc(ctx->reps, sizeof *cpu_ns);
+    if (wall_ns == NULL || cpu_ns == NULL) {
+        fprintf(stderr, "[!] calloc: allocating results failed\n");
+        free(wall_ns);
+        free(cpu_ns);
+        exit_fail(ctx);
+    }
+
+    fprintf(stderr, "[info] replaying %zu records of %s to %s %ld times%s\n",
+        ctx->num_records, ctx->path, ctx->client, ctx->reps, ctx->realtime ? " in real time" : ""
+    );
+
+    size_t runs = 0;
+    size_t diverged = 0;
+    uint64_t events = 0;
+    for (long rep = 0; rep < ctx->reps; rep++) {
+        replay_run_t run = replay_once(ctx);
+        if (!run.complete) {
+            diverged++;
+            continue;
+        }
+
+        wall_ns[runs] = run.wall_ns;
+        cpu_ns[runs] = run.cpu_ns;
+        events = run.events;
+        runs++;
+    }
+
+    qsort(wall_ns, runs, sizeof *wall_ns, compare_u64);
+    qsort(cpu_ns, runs, sizeof *cpu_ns, compare_u64);
+
+    printf("{\"client\": \"%s\", \"trace\": \"%s\", \"realtime\": %s, \"runs\": %zu, \"diverged\": %zu, \"event_chunks\": %lu, "
+        "\"wall_ns\": {\"min\": %lu, \"p50\": %lu, \"p90\": %lu}, "
+        "\"cpu_ns\": {\"min\": %lu, \"p50\": %lu, \"p90\": %lu}}\n",
+        ctx->client, ctx->path, ctx->realtime ? "true" : "false", runs, diverged, events,
+        runs > 0 ? wall_ns[0] : 0, percentile(wall_ns, runs, 50), percentile(wall_ns, runs, 90),
+        runs > 0 ? cpu_ns[0] : 0, percentile(cpu_ns, runs, 50), percentile(cpu_ns, runs, 90)
+    );
+
+    free(wall_ns);
+    free(cpu_ns);
+}
+
+// --- dump ---
+
+typedef struct {
+    uint8_t data[CHUNK_SIZE * 2];
+    size_t size;
+} stream_t;
+
+static void dump_messages(stream_t * stream, const record_t * record) {
+    const char * arrow = record->header.direction == DIRECTION_REQUEST ? "->" : "<-";
+
+    if (stream->size + record->header.size > sizeof stream->data) {
+        printf("[!] message stream out of sync\n");
+        stream->size = 0;
+        return;
+    }
+    memcpy(stream->data + stream->size, record->payload, record->header.size);
+    stream->size += record->header.size;
+
+    for (uint32_t i = 0; i < record->header.num_fds; i++) {
+        printf("%10.3f ms %s fd %s, %lu bytes%s\n",
+            record->header.time_ns / 1e6, arrow, fd_kind_names[record->fds[i].kind % 3],
+            record->fds[i].size, record->fds[i].data_size > 0 ? ", contents stored" : ""
+        );
+    }
+
+    // messages start with the object id and a word of size and opcode
+    size_t offset = 0;
+    while (stream->size - offset >= 8) {
+        uint32_t words[2];
+        memcpy(words, stream->data + offset, sizeof words);
+        uint32_t size = words[1] >> 16;
+        uint32_t opcode = words[1] & 0xffff;
+        if (size < 8) {
+            printf("[!] invalid message size %u\n", size);
+            stream->size = 0;
+            return;
+        }
+        if (stream->size - offset < size) break;
+
+        printf("%10.3f ms %s object %u opcode %u, %u bytes\n", record->header.time_ns / 1e6, arrow, words[0], opcode, size);
+        offset += size;
+    }
+
+    memmove(stream->data, stream->data + offset, stream->size - offset);
+    stream->size -= offset;
+}
+
+static void dump(ctx_t * ctx) {
+    open_trace(ctx);
+
+    static stream_t streams[2];
+    record_t record;
+    size_t records = 0;
+    while (read_record(ctx->trace, &record)) {
+        dump_messages(&streams[record.header.direction == DIRECTION_EVENT], &record);
+        for (size_t f = 0; f < MAX_FDS; f++) free(record.fd_data[f]);
+        free(record.payload);
+        records++;
+    }
+    for (size_t f = 0; f < MAX_FDS; f++) free(record.fd_data[f]);
+    free(record.payload);
+
+    fprintf(stderr, "[info] %zu records\n", records);
+}
+
+// --- setup ---
+
+int main(void) {
+    ctx_t * ctx = calloc(1, sizeof (ctx_t));
+    if (ctx == NULL) {
+        fprintf(stderr, "[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    harness_init(&ctx->harness);
+    ctx->mode = option_string("WLEXP_TRACE_MODE", "record");
+    ctx->path = option_string("WLEXP_TRACE_FILE", "wlexp.trace");
+    ctx->client = option_string("WLEXP_TRACE_CLIENT", "screencopy_shm");
+    ctx->reps = option_long("WLEXP_TRACE_REPS", 10);
+    ctx->realtime = option_flag("WLEXP_TRACE_REALTIME");
+    ctx->timeout_s = option_double("WLEXP_TRACE_TIMEOUT", 30);
+    ctx->listen_fd = -1;
+    ctx->trace = NULL;
+    ctx->records = NULL;
+    ctx->num_records = 0;
+
+    if (ctx->reps <= 0 || ctx->timeout_s <= 0) {
+        fprintf(stderr, "[!] invalid trace options\n");
+        exit_fail(ctx);
+    }
+
+    if (strcmp(ctx->mode, "record") == 0) {
+        record(ctx);
+    } else if (strcmp(ctx->mode, "replay") == 0) {
+        replay(ctx);
+    } else if (strcmp(ctx->mode, "dump") == 0) {
+        dump(ctx);
+    } else {
+        fprintf(stderr, "[!] unknown trace mode %s\n", ctx->mode);
+        exit_fail(ctx);
+    }
+
+    cleanup(ctx);
+}
@@ -0,0 +1,559 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <gbm.h>
+#include <drm_fourcc.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <options.h>
+#include <clock.h>
+#include <pixels.h>
+
+// texture upload paths of the EGL capture clients, compared on the same
+// pixel data without a compositor
+//
+// EGL runs on the GBM platform of a render node with a surfaceless context,
+// every upload is followed by a draw sampling the texture into an offscreen
+// framebuffer so the driver cannot defer the copy. each method is measured
+// synchronized, with glFinish after every frame, and pipelined, with a single
+// glFinish after all repetitions, which is how the clients actually run
+//
+// the dmabuf methods copy the pixels into a linear gbm buffer object through
+// gbm_bo_map first, since that is the CPU side cost of getting them there
+
+#define MAX_RESOLUTIONS 16
+#define STRIDE_PADDING 256
+#define TARGET_SIZE 256
+
+typedef struct ctx ctx_t;
+
+typedef struct {
+    const char * name;
+    bool needs_bgra;
+    bool needs_unpack_subimage;
+    bool needs_dmabuf;
+    void (*setup)(ctx_t * ctx, uint32_t width, uint32_t height);
+    void (*upload)(ctx_t * ctx, uint32_t width, uint32_t height);
+} method_t;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+} resolution_t;
+
+struct ctx {
+    long warmup;
+    long reps;
+    const char * filter;
+    resolution_t resolutions[MAX_RESOLUTIONS];
+    size_t num_resolutions;
+
+    int drm_fd;
+    struct gbm_device * gbm_device;
+    EGLDisplay egl_display;
+    EGLContext egl_context;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture;
+    bool has_bgra;
+    bool has_unpack_subimage;
+    bool has_dmabuf;
+    bool has_modifiers;
+
+    GLuint program;
+    GLuint vbo;
+    GLuint framebuffer;
+    GLuint target_texture;
+    GLuint texture;
+
+    uint32_t * pixels;
+    size_t pixels_capacity;
+    struct gbm_bo * bo;
+    EGLImage bo_image;
+};
+
+static void release_method(ctx_t * ctx) {
+    if (ctx->bo_image != EGL_NO_IMAGE) eglDestroyImage(ctx->egl_display, ctx->bo_image);
+    if (ctx->bo != NULL) gbm_bo_destroy(ctx->bo);
+    if (ctx->texture != 0) glDeleteTextures(1, &ctx->texture);
+    ctx->bo_image = EGL_NO_IMAGE;
+    ctx->bo = NULL;
+    ctx->texture = 0;
+}
+
+static void cleanup(ctx_t * ctx) {
+    if (ctx->egl_context != EGL_NO_CONTEXT) {
+        release_method(ctx);
+        if (ctx->target_texture != 0) glDeleteTextures(1, &ctx->target_texture);
+        if (ctx->framebuffer != 0) glDeleteFramebuffers(1, &ctx->framebuffer);
+        if (ctx->vbo != 0) glDeleteBuffers(1, &ctx->vbo);
+        if (ctx->program != 0) glDeleteProgram(ctx->program);
+        eglMakeCurrent(ctx->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(ctx->egl_display, ctx->egl_context);
+    }
+    if (ctx->egl_display != EGL_NO_DISPLAY) eglTerminate(ctx->egl_display);
+    if (ctx->gbm_device != NULL) gbm_device_destroy(ctx->gbm_device);
+    if (ctx->drm_fd != -1) close(ctx->drm_fd);
+    free(ctx->pixels);
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- methods ---
+
+static void create_texture(ctx_t * ctx) {
+    glGenTextures(1, &ctx->texture);
+    glBindTexture(GL_TEXTURE_2D, ctx->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+static void setup_texture(ctx_t * ctx, uint32_t width, uint32_t height) {
+    create_texture(ctx);
+}
+
+static void setup_rgba_storage(ctx_t * ctx, uint32_t width, uint32_t height) {
+    create_texture(ctx);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+}
+
+static void setup_bgra_storage(ctx_t * ctx, uint32_t width, uint32_t height) {
+    create_texture(ctx);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, width, height, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, NULL);
+}
+
+static void upload_teximage_rgba(ctx_t * ctx, uint32_t width, uint32_t height) {
+    // what screencopy_shm_egl does every frame
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, ctx->pixels);
+}
+
+static void upload_teximage_bgra(ctx_t * ctx, uint32_t width, uint32_t height) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, width, height, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, ctx->pixels);
+}
+
+static void upload_subimage_rgba(ctx_t * ctx, uint32_t width, uint32_t height) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, ctx->pixels);
+}
+
+static void upload_subimage_bgra(ctx_t * ctx, uint32_t width, uint32_t height) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, ctx->pixels);
+}
+
+static void upload_subimage_strided(ctx_t * ctx, uint32_t width, uint32_t height) {
+    // rows as a compositor hands them out, with padding after each row
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, width + STRIDE_PADDING);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, ctx->pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+}
+
+static void copy_to_bo(ctx_t * ctx, uint32_t width, uint32_t height) {
+    uint32_t stride = 0;
+    void * map_data = NULL;
+    uint8_t * map = gbm_bo_map(ctx->bo, 0, 0, width, height, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+    if (map == NULL) {
+        printf("[!] gbm_bo_map: failed to map buffer object\n");
+        exit_fail(ctx);
+    }
+
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(map + (size_t)y * stride, ctx->pixels + (size_t)y * width, (size_t)width * 4);
+    }
+    gbm_bo_unmap(ctx->bo, map_data);
+}
+
+static EGLImage import_bo(ctx_t * ctx, uint32_t width, uint32_t height) {
+    int fd = gbm_bo_get_fd(ctx->bo);
+    if (fd < 0) {
+        printf("[!] gbm_bo_get_fd: failed to export buffer object\n");
+        exit_fail(ctx);
+    }
+
+    uint64_t modifier = gbm_bo_get_modifier(ctx->bo);
+    EGLAttrib attribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_XRGB8888,
+        EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, gbm_bo_get_offset(ctx->bo, 0),
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, gbm_bo_get_stride(ctx->bo),
+        EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, modifier & 0xffffffff,
+        EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, modifier >> 32,
+        EGL_NONE
+    };
+    // without the modifiers extension the layout is implied by the driver
+    if (!ctx->has_modifiers || modifier == DRM_FORMAT_MOD_INVALID) attribs[12] = EGL_NONE;
+
+    EGLImage image = eglCreateImage(ctx->egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+    // the image keeps its own reference to the dmabuf
+    close(fd);
+    if (image == EGL_NO_IMAGE) {
+        printf("[!] eglCreateImage: failed to import dmabuf, error = %x\n", eglGetError());
+        exit_fail(ctx);
+    }
+
+    return image;
+}
+
+static void setup_dmabuf(ctx_t * ctx, uint32_t width, uint32_t height) {
+    create_texture(ctx);
+    ctx->bo = gbm_bo_create(ctx->gbm_device, width, height, GBM_FORMAT_XRGB8888, GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING);
+    if (ctx->bo == NULL) {
+        printf("[!] gbm_bo_create: failed to create linear buffer object\n");
+        exit_fail(ctx);
+    }
+}
+
+static void setup_dmabuf_persistent(ctx_t * ctx, uint32_t width, uint32_t height) {
+    setup_dmabuf(ctx, width, height);
+    ctx->bo_image = import_bo(ctx, width, height);
+    ctx->image_target_texture(GL_TEXTURE_2D, ctx->bo_image);
+}
+
+static void upload_dmabuf_import(ctx_t * ctx, uint32_t width, uint32_t height) {
+    // what screencopy_dmabuf_egl does every frame, plus the copy
+    copy_to_bo(ctx, width, height);
+    EGLImage image = import_bo(ctx, width, height);
+    ctx->image_target_texture(GL_TEXTURE_2D, image);
+    eglDestroyImage(ctx->egl_display, image);
+}
+
+static void upload_dmabuf_persistent(ctx_t * ctx, uint32_t width, uint32_t height) {
+    // a ring of imported buffers only pays for the copy
+    copy_to_bo(ctx, width, height);
+}
+
+static const method_t methods[] = {
+    { "teximage_rgba", false, false, false, setup_texture, upload_teximage_rgba },
+    { "teximage_bgra", true, false, false, setup_texture, upload_teximage_bgra },
+    { "subimage_rgba", false, false, false, setup_rgba_storage, upload_subimage_rgba },
+    { "subimage_bgra", true, false, false, setup_bgra_storage, upload_subimage_bgra },
+    { "subimage_strided", false, true, false, setup_rgba_storage, upload_subimage_strided },
+    { "dmabuf_import", false, false, true, setup_dmabuf, upload_dmabuf_import },
+    { "dmabuf_persistent", false, false, true, setup_dmabuf_persistent, upload_dmabuf_persistent }
+};
+
+// --- measurement ---
+
+static void draw(ctx_t * ctx) {
+    glBindTexture(GL_TEXTURE_2D, ctx->texture);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(ctx_t * ctx, const method_t * method, uint32_t width, uint32_t height) {
+    uint64_t * ns = malloc(ctx->reps * sizeof *ns);
+    if (ns == NULL) {
+        printf("[!] malloc: failed to allocate samples\n");
+        return;
+    }
+
+    method->setup(ctx, width, height);
+    for (long i = 0; i < ctx->warmup; i++) {
+        method->upload(ctx, width, height);
+        draw(ctx);
+    }
+    glFinish();
+
+    for (long i = 0; i < ctx->reps; i++) {
+        uint64_t start_ns = clock_now_ns();
+        method->upload(ctx, width, height);
+        draw(ctx);
+        glFinish();
+        ns[i] = clock_now_ns() - start_ns;
+    }
+
+    uint64_t start_ns = clock_now_ns();
+    for (long i = 0; i < ctx->reps; i++) {
+        method->upload(ctx, width, height);
+        draw(ctx);
+    }
+    glFinish();
+    uint64_t pipelined_ns = (clock_now_ns() - start_ns) / ctx->reps;
+
+    GLenum error = glGetError();
+    release_method(ctx);
+
+    qsort(ns, ctx->reps, sizeof *ns, compare_u64);
+    double bytes = (double)width * height * 4;
+    char resolution[32];
+    snprintf(resolution, sizeof resolution, "%ux%u", width, height);
+    printf("%-18s %-10s  sync min %8.3f ms  median %8.3f ms  pipelined %8.3f ms  %7.2f GB/s%s\n",
+        method->name, resolution,
+        ns[0] / 1e6, ns[ctx->reps / 2] / 1e6, pipelined_ns / 1e6,
+        pipelined_ns > 0 ? bytes / pipelined_ns : 0,
+        error != GL_NO_ERROR ? "  (GL error)" : ""
+    );
+
+    free(ns);
+}
+
+static bool method_selected(ctx_t * ctx, const method_t * method) {
+    if (ctx->filter == NULL) return true;
+
+    // comma separated list of method names
+    size_t length = strlen(method->name);
+    for (const char * entry = ctx->filter; entry != NULL; entry = strchr(entry, ',')) {
+        if (*entry == ',') entry++;
+        if (strncmp(entry, method->name, length) == 0 && (entry[length] == ',' || entry[length] == '\0')) return true;
+    }
+    return false;
+}
+
+static bool method_supported(ctx_t * ctx, const method_t * method) {
+    if (method->needs_bgra && !ctx->has_bgra) return false;
+    if (method->needs_unpack_subimage && !ctx->has_unpack_subimage) return false;
+    if (method->needs_dmabuf && !ctx->has_dmabuf) return false;
+    return true;
+}
+
+// --- setup ---
+
+static void parse_resolutions(ctx_t * ctx, const char * list) {
+    ctx->num_resolutions = 0;
+    for (const char * entry = list; entry != NULL && ctx->num_resolutions < MAX_RESOLUTIONS; entry = strchr(entry, ',')) {
+        if (*entry == ',') entry++;
+
+        unsigned width, height;
+        if (sscanf(entry, "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+            printf("[!] invalid resolution in %s\n", list);
+            exit_fail(ctx);
+        }
+        ctx->resolutions[ctx->num_resolutions++] = (resolution_t){ width, height };
+    }
+}
+
+static bool has_extension(const char * extensions, const char * name) {
+    size_t length = strlen(name);
+    for (const char * found = extensions; (found = strstr(found, name)) != NULL; found += length) {
+        if (found[length] == ' ' || found[length] == '\0') return true;
+    }
+    return false;
+}
+
+static void init_egl(ctx_t * ctx, const char * render_node) {
+    printf("[info] opening render node %s\n", render_node);
+    ctx->drm_fd = open(render_node, O_RDWR | O_CLOEXEC);
+    if (ctx->drm_fd < 0) {
+        printf("[!] could not open render node\n");
+        exit_fail(ctx);
+    }
+
+    ctx->gbm_device = gbm_create_device(ctx->drm_fd);
+    if (ctx->gbm_device == NULL) {
+        printf("[!] gbm: failed to create device\n");
+        exit_fail(ctx);
+    }
+
+    ctx->egl_display = eglGetPlatformDisplay(EGL_PLATFORM_GBM_KHR, ctx->gbm_device, NULL);
+    EGLint major, minor;
+    if (ctx->egl_display == EGL_NO_DISPLAY || eglInitialize(ctx->egl_display, &major, &minor) != EGL_TRUE) {
+        printf("[!] eglInitialize: failed to initialize EGL on the GBM platform\n");
+        exit_fail(ctx);
+    }
+    printf("[info] initialized EGL %d.%d\n", major, minor);
+
+    const char * egl_extensions = eglQueryString(ctx->egl_display, EGL_EXTENSIONS);
+    if (!has_extension(egl_extensions, "EGL_KHR_surfaceless_context")) {
+        printf("[!] EGL_KHR_surfaceless_context not supported\n");
+        exit_fail(ctx);
+    }
+    ctx->has_dmabuf = has_extension(egl_extensions, "EGL_EXT_image_dma_buf_import");
+    ctx->has_modifiers = has_extension(egl_extensions, "EGL_EXT_image_dma_buf_import_modifiers");
+
+    EGLint config_attribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs;
+    if (eglChooseConfig(ctx->egl_display, config_attribs, &config, 1, &num_configs) != EGL_TRUE || num_configs == 0) {
+        printf("[!] eglChooseConfig: failed to get EGL config\n");
+        exit_fail(ctx);
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+    eglBindAPI(EGL_OPENGL_ES_API);
+    ctx->egl_context = eglCreateContext(ctx->egl_display, config, EGL_NO_CONTEXT, context_attribs);
+    if (ctx->egl_context == EGL_NO_CONTEXT) {
+        printf("[!] eglCreateContext: failed to create EGL context\n");
+        exit_fail(ctx);
+    }
+    if (eglMakeCurrent(ctx->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx->egl_context) != EGL_TRUE) {
+        printf("[!] eglMakeCurrent: failed to activate surfaceless context\n");
+        exit_fail(ctx);
+    }
+
+    const char * gl_extensions = (const char *)glGetString(GL_EXTENSIONS);
+    ctx->has_bgra = has_extension(gl_extensions, "GL_EXT_texture_format_BGRA8888");
+    ctx->has_unpack_subimage = has_extension(gl_extensions, "GL_EXT_unpack_subimage");
+    ctx->image_target_texture = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (ctx->image_target_texture == NULL || !has_extension(gl_extensions, "GL_OES_EGL_image")) ctx->has_dmabuf = false;
+
+    printf("[info] GL renderer %s\n", glGetString(GL_RENDERER));
+    printf("[info] BGRA textures %s, unpack row length %s, dmabuf import %s\n",
+        ctx->has_bgra ? "yes" : "no", ctx->has_unpack_subimage ? "yes" : "no", ctx->has_dmabuf ? "yes" : "no"
+    );
+}
+
+static GLuint compile_shader(ctx_t * ctx, GLenum type, const char * source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char error_log[512];
+        glGetShaderInfoLog(shader, sizeof error_log, NULL, error_log);
+        printf("[!] shader compile error: %s\n", error_log);
+        glDeleteShader(shader);
+        exit_fail(ctx);
+    }
+
+    return shader;
+}
+
+static void init_gl(ctx_t * ctx) {
+    static const float vertex_array[] = {
+        -1.0, -1.0, 0.0, 0.0,
+         1.0, -1.0, 1.0, 0.0,
+         1.0,  1.0, 1.0, 1.0,
+        -1.0, -1.0, 0.0, 0.0,
+         1.0,  1.0, 1.0, 1.0,
+        -1.0,  1.0, 0.0, 1.0
+    };
+    static const char * vertex_source =
+        "attribute vec2 pos;\n"
+        "attribute vec2 texcoord;\n"
+        "varying vec2 v_texcoord;\n"
+        "void main() {\n"
+        "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+        "    v_texcoord = texcoord;\n"
+        "}\n";
+    static const char * fragment_source =
+        "precision mediump float;\n"
+        "uniform sampler2D tex;\n"
+        "varying vec2 v_texcoord;\n"
+        "void main() {\n"
+        "    gl_FragColor = texture2D(tex, v_texcoord);\n"
+        "}\n";
+
+    glGenBuffers(1, &ctx->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof vertex_array, vertex_array, GL_STATIC_DRAW);
+
+    GLuint vertex_shader = compile_shader(ctx, GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment_shader = compile_shader(ctx, GL_FRAGMENT_SHADER, fragment_source);
+    ctx->program = glCreateProgram();
+    glAttachShader(ctx->program, vertex_shader);
+    glAttachShader(ctx->program, fragment_shader);
+    glBindAttribLocation(ctx->program, 0, "pos");
+    glBindAttribLocation(ctx->program, 1, "texcoord");
+    glLinkProgram(ctx->program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint success;
+    glGetProgramiv(ctx->program, GL_LINK_STATUS, &success);
+    if (!success) {
+        printf("[!] shader link error\n");
+        exit_fail(ctx);
+    }
+    glUseProgram(ctx->program);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof (float), (void *)(0 * sizeof (float)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof (float), (void *)(2 * sizeof (float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    // small target, the draw only has to make the driver finish the upload
+    glGenTextures(1, &ctx->target_texture);
+    glBindTexture(GL_TEXTURE_2D, ctx->target_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TARGET_SIZE, TARGET_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glGenFramebuffers(1, &ctx->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, ctx->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ctx->target_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("[!] offscreen framebuffer incomplete\n");
+        exit_fail(ctx);
+    }
+    glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+}
+
+int main(void) {
+    ctx_t * ctx = calloc(1, sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->drm_fd = -1;
+    ctx->gbm_device = NULL;
+    ctx->egl_display = EGL_NO_DISPLAY;
+    ctx->egl_context = EGL_NO_CONTEXT;
+    ctx->bo = NULL;
+    ctx->bo_image = EGL_NO_IMAGE;
+    ctx->pixels = NULL;
+
+    ctx->warmup = option_long("WLEXP_UPLOAD_WARMUP", 5);
+    ctx->reps = option_long("WLEXP_UPLOAD_REPS", 50);
+    ctx->filter = option_string("WLEXP_UPLOAD_METHODS", NULL);
+    parse_resolutions(ctx, option_string("WLEXP_UPLOAD_RESOLUTIONS", "1280x720,1920x1080,3840x2160"));
+
+    if (ctx->warmup < 0 || ctx->reps <= 0) {
+        printf("[!] invalid repetition counts\n");
+        exit_fail(ctx);
+    }
+
+    uint32_t max_width = 0;
+    uint32_t max_height = 0;
+    for (size_t i = 0; i < ctx->num_resolutions; i++) {
+        if (ctx->resolutions[i].width > max_width) max_width = ctx->resolutions[i].width;
+        if (ctx->resolutions[i].height > max_height) max_height = ctx->resolutions[i].height;
+    }
+
+    // big enough for the padded rows of the strided method
+    ctx->pixels_capacity = (size_t)(max_width + STRIDE_PADDING) * max_height;
+    ctx->pixels = malloc(ctx->pixels_capacity * 4);
+    if (ctx->pixels == NULL) {
+        printf("[!] malloc: allocating pixels failed\n");
+        exit_fail(ctx);
+    }
+    pixels_fill_checkerboard(ctx->pixels, max_width + STRIDE_PADDING, max_height);
+
+    init_egl(ctx, option_string("WLEXP_UPLOAD_RENDER_NODE", "/dev/dri/renderD128"));
+    init_gl(ctx);
+
+    printf("[info] %ld warmup and %ld timed repetitions\n", ctx->warmup, ctx->reps);
+    for (size_t m = 0; m < sizeof methods / sizeof *methods; m++) {
+        if (!method_selected(ctx, &methods[m])) continue;
+        if (!method_supported(ctx, &methods[m])) {
+            printf("%-18s not supported\n", methods[m].name);
+            continue;
+        }
+
+        for (size_t r = 0; r < ctx->num_resolutions; r++) {
+            measure(ctx, &methods[m], ctx->resolutions[r].width, ctx->resolutions[r].height);
+        }
+    }
+
+    cleanup(ctx);
+}
@@ -0,0 +1,603 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+#include <xdg-shell.h>
+#include <linux-dmabuf-unstable-v1.h>
+#include <xf86drm.h>
+#include <gbm.h>
+#include <drm_fourcc.h>
+#include <options.h>
+#include <clock.h>
+#include <probe.h>
+
+// stress test of object lifetime handling: keeps pools of surfaces (with
+// xdg_toplevel roles) and buffers (shm or dmabuf) alive and replaces them
+// round-robin as fast as the compositor keeps up
+//
+// creation latency is measured per object where the protocol has an answer
+// for it (toplevel configure, linux-dmabuf created), and per batch of
+// requests followed by a sync otherwise. client memory growth is sampled
+// from /proc/self/statm, so leaks and allocator fragmentation show up as
+// resident growth over the run
+
+typedef struct {
+    uint64_t * values;
+    size_t count;
+    size_t capacity;
+} samples_t;
+
+typedef struct {
+    struct wl_surface * surface;
+    struct xdg_surface * xdg_surface;
+    struct xdg_toplevel * xdg_toplevel;
+    uint64_t created_ns;
+    bool configured;
+    struct ctx * ctx;
+} surface_slot_t;
+
+typedef struct {
+    struct wl_buffer * buffer;
+    struct gbm_bo * gbm_bo;
+    struct zwp_linux_buffer_params_v1 * params;
+    uint64_t created_ns;
+    struct ctx * ctx;
+} buffer_slot_t;
+
+typedef struct ctx {
+    struct wl_display * display;
+    struct wl_registry * registry;
+
+    struct wl_compositor * compositor;
+    uint32_t compositor_id;
+    struct xdg_wm_base * xdg_wm_base;
+    uint32_t xdg_wm_base_id;
+    struct wl_shm * shm;
+    uint32_t shm_id;
+    struct zwp_linux_dmabuf_v1 * linux_dmabuf;
+    uint32_t linux_dmabuf_id;
+
+    struct gbm_device * gbm_device;
+    int gbm_fd;
+    int shm_fd;
+    struct wl_shm_pool * shm_pool;
+
+    surface_slot_t * surfaces;
+    size_t num_surfaces;
+    size_t next_surface;
+    buffer_slot_t * buffers;
+    size_t num_buffers;
+    size_t next_buffer;
+
+    double seconds;
+    long batch;
+    long dmabuf_percent;
+    bool toplevels;
+    uint32_t buffer_size;
+
+    bool sync_done;
+    uint64_t created_surfaces;
+    uint64_t created_buffers;
+    uint64_t created_dmabufs;
+    uint64_t failed_dmabufs;
+
+    samples_t configure_ns;
+    samples_t dmabuf_ns;
+    samples_t shm_issue_ns;
+    samples_t round_ns;
+} ctx_t;
+
+static void destroy_surface_slot(surface_slot_t * slot) {
+    if (slot->xdg_toplevel != NULL) xdg_toplevel_destroy(slot->xdg_toplevel);
+    if (slot->xdg_surface != NULL) xdg_surface_destroy(slot->xdg_surface);
+    if (slot->surface != NULL) wl_surface_destroy(slot->surface);
+    slot->xdg_toplevel = NULL;
+    slot->xdg_surface = NULL;
+    slot->surface = NULL;
+}
+
+static void destroy_buffer_slot(buffer_slot_t * slot) {
+    if (slot->params != NULL) zwp_linux_buffer_params_v1_destroy(slot->params);
+    if (slot->buffer != NULL) wl_buffer_destroy(slot->buffer);
+    if (slot->gbm_bo != NULL) gbm_bo_destroy(slot->gbm_bo);
+    slot->params = NULL;
+    slot->buffer = NULL;
+    slot->gbm_bo = NULL;
+}
+
+static void cleanup(ctx_t * ctx) {
+    printf("[info] cleaning up\n");
+
+    if (ctx->surfaces != NULL) {
+        for (size_t i = 0; i < ctx->num_surfaces; i++) destroy_surface_slot(&ctx->surfaces[i]);
+        free(ctx->surfaces);
+    }
+    if (ctx->buffers != NULL) {
+        for (size_t i = 0; i < ctx->num_buffers; i++) destroy_buffer_slot(&ctx->buffers[i]);
+        free(ctx->buffers);
+    }
+
+    if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
+    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->gbm_device != NULL) gbm_device_destroy(ctx->gbm_device);
+    if (ctx->gbm_fd != -1) close(ctx->gbm_fd);
+
+    if (ctx->linux_dmabuf != NULL) zwp_linux_dmabuf_v1_destroy(ctx->linux_dmabuf);
+    if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
+    if (ctx->xdg_wm_base != NULL) xdg_wm_base_destroy(ctx->xdg_wm_base);
+    if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
+    if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->display != NULL) wl_display_disconnect(ctx->display);
+
+    free(ctx->configure_ns.values);
+    free(ctx->dmabuf_ns.values);
+    free(ctx->shm_issue_ns.values);
+    free(ctx->round_ns.values);
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- samples ---
+
+static void samples_add(ctx_t * ctx, samples_t * samples, uint64_t value) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity == 0 ? 4096 : samples->capacity * 2;
+        uint64_t * values = realloc(samples->values, capacity * sizeof *values);
+        if (values == NULL) {
+            printf("[!] realloc: failed to grow samples\n");
+            exit_fail(ctx);
+        }
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+
+    samples->values[samples->count++] = value;
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+static void samples_report(samples_t * samples, const char * name) {
+    if (samples->count == 0) {
+        printf("[churn] %-18s no samples\n", name);
+        return;
+    }
+
+    qsort(samples->values, samples->count, sizeof *samples->values, compare_u64);
+    printf("[churn] %-18s %8zu samples: p50 %8.1f us, p90 %8.1f us, p99 %8.1f us, max %8.1f us\n",
+        name, samples->count,
+        percentile(samples->values, samples->count, 50) / 1e3,
+        percentile(samples->values, samples->count, 90) / 1e3,
+        percentile(samples->values, samples->count, 99) / 1e3,
+        samples->values[samples->count - 1] / 1e3
+    );
+}
+
+static uint64_t resident_bytes(void) {
+    FILE * file = fopen("/proc/self/statm", "r");
+    if (file == NULL) return 0;
+
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(file, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(file);
+
+    return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+// --- wl_registry event handlers ---
+
+static void registry_event_add(
+    void * data, struct wl_registry * registry,
+    uint32_t id, const char * interface, uint32_t version
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][+] id=%08x %s v%d\n", id, interface, version);
+
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        if (ctx->compositor != NULL) {
+            printf("[!] wl_registry: duplicate compositor\n");
+            exit_fail(ctx);
+        }
+
+        ctx->compositor = (struct wl_compositor *)wl_registry_bind(registry, id, &wl_compositor_interface, 4);
+        ctx->compositor_id = id;
+    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        if (ctx->xdg_wm_base != NULL) {
+            printf("[!] wl_registry: duplicate xdg_wm_base\n");
+            exit_fail(ctx);
+        }
+
+        ctx->xdg_wm_base = (struct xdg_wm_base *)wl_registry_bind(registry, id, &xdg_wm_base_interface, 2);
+        ctx->xdg_wm_base_id = id;
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        if (ctx->shm != NULL) {
+            printf("[!] wl_registry: duplicate shm\n");
+            exit_fail(ctx);
+        }
+
+        ctx->shm = (struct wl_shm *)wl_registry_bind(registry, id, &wl_shm_interface, 1);
+        ctx->shm_id = id;
+    } else if (strcmp(interface, zwp_linux_dmabuf_v1_interface.name) == 0) {
+        if (ctx->linux_dmabuf != NULL) {
+            printf("[!] wl_registry: duplicate linux_dmabuf\n");
+            exit_fail(ctx);
+        }
+
+        ctx->linux_dmabuf = (struct zwp_linux_dmabuf_v1 *)wl_registry_bind(registry, id, &zwp_linux_dmabuf_v1_interface, 3);
+        ctx->linux_dmabuf_id = id;
+    }
+}
+
+static void registry_event_remove(
+    void * data, struct wl_registry * registry,
+    uint32_t id
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][-] id=%08x\n", id);
+
+    if (id == ctx->compositor_id || id == ctx->xdg_wm_base_id || id == ctx->shm_id || id == ctx->linux_dmabuf_id) {
+        printf("[!] wl_registry: required global disapperared\n");
+        exit_fail(ctx);
+    }
+
+    (void)registry;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_event_add,
+    .global_remove = registry_event_remove
+};
+
+// --- xdg_wm_base event handlers ---
+
+static void xdg_wm_base_event_ping(
+    void * data, struct xdg_wm_base * xdg_wm_base, uint32_t serial
+) {
+    xdg_wm_base_pong(xdg_wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener xdg_wm_base_listener = {
+    .ping = xdg_wm_base_event_ping
+};
+
+// --- xdg_surface event handlers ---
+
+static void xdg_surface_event_configure(
+    void * data, struct xdg_surface * xdg_surface, uint32_t serial
+) {
+    surface_slot_t * slot = (surface_slot_t *)data;
+    xdg_surface_ack_configure(xdg_surface, serial);
+
+    if (!slot->configured) {
+        slot->configured = true;
+        samples_add(slot->ctx, &slot->ctx->configure_ns, clock_now_ns() - slot->created_ns);
+    }
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_event_configure,
+};
+
+// --- zwp_linux_buffer_params_v1 event handlers ---
+
+static void linux_buffer_params_created(void * data, struct zwp_linux_buffer_params_v1 * params, struct wl_buffer * buffer) {
+    buffer_slot_t * slot = (buffer_slot_t *)data;
+    samples_add(slot->ctx, &slot->ctx->dmabuf_ns, clock_now_ns() - slot->created_ns);
+
+    slot->buffer = buffer;
+    zwp_linux_buffer_params_v1_destroy(slot->params);
+    slot->params = NULL;
+}
+
+static void linux_buffer_params_failed(void * data, struct zwp_linux_buffer_params_v1 * params) {
+    buffer_slot_t * slot = (buffer_slot_t *)data;
+    slot->ctx->failed_dmabufs++;
+
+    zwp_linux_buffer_params_v1_destroy(slot->params);
+    slot->params = NULL;
+}
+
+static const struct zwp_linux_buffer_params_v1_listener linux_buffer_params_listener = {
+    .created = linux_buffer_params_created,
+    .failed = linux_buffer_params_failed
+};
+
+// --- wl_callback event handlers ---
+
+static void wl_callback_done(void * data, struct wl_callback * callback, uint32_t callback_data) {
+    ctx_t * ctx = (ctx_t *)data;
+    ctx->sync_done = true;
+    wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener wl_callback_listener = {
+    .done = wl_callback_done
+};
+
+// --- churn ---
+
+static void churn_surface(ctx_t * ctx) {
+    surface_slot_t * slot = &ctx->surfaces[ctx->next_surface];
+    ctx->next_surface = (ctx->next_surface + 1) % ctx->num_surfaces;
+    destroy_surface_slot(slot);
+
+    slot->ctx = ctx;
+    slot->created_ns = clock_now_ns();
+    slot->configured = false;
+    slot->surface = wl_compositor_create_surface(ctx->compositor);
+
+    if (ctx->toplevels) {
+        slot->xdg_surface = xdg_wm_base_get_xdg_surface(ctx->xdg_wm_base, slot->surface);
+        xdg_surface_add_listener(slot->xdg_surface, &xdg_surface_listener, (void *)slot);
+        slot->xdg_toplevel = xdg_surface_get_toplevel(slot->xdg_surface);
+
+        // the initial commit asks for the first configure
+        wl_surface_commit(slot->surface);
+    }
+
+    ctx->created_surfaces++;
+}
+
+static void churn_buffer(ctx_t * ctx) {
+    size_t index = ctx->next_buffer;
+    buffer_slot_t * slot = &ctx->buffers[index];
+    ctx->next_buffer = (ctx->next_buffer + 1) % ctx->num_buffers;
+    destroy_buffer_slot(slot);
+
+    slot->ctx = ctx;
+    slot->created_ns = clock_now_ns();
+
+    bool dmabuf = ctx->gbm_device != NULL && (long)(ctx->created_buffers % 100) < ctx->dmabuf_percent;
+    ctx->created_buffers++;
+    if (dmabuf) {
+        slot->gbm_bo = gbm_bo_create(ctx->gbm_device, ctx->buffer_size, ctx->buffer_size, GBM_FORMAT_XRGB8888, GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+        if (slot->gbm_bo == NULL) {
+            ctx->failed_dmabufs++;
+            return;
+        }
+
+        int fd = gbm_bo_get_fd(slot->gbm_bo);
+        if (fd < 0) {
+            ctx->failed_dmabufs++;
+            return;
+        }
+
+        uint64_t modifier = gbm_bo_get_modifier(slot->gbm_bo);
+        slot->params = zwp_linux_dmabuf_v1_create_params(ctx->linux_dmabuf);
+        zwp_linux_buffer_params_v1_add_listener(slot->params, &linux_buffer_params_listener, (void *)slot);
+        zwp_linux_buffer_params_v1_add(slot->params, fd, 0, gbm_bo_get_offset(slot->gbm_bo, 0), gbm_bo_get_stride(slot->gbm_bo), modifier >> 32, modifier & 0xffffffff);
+        // the params request holds its own copy of the fd
+        close(fd);
+        zwp_linux_buffer_params_v1_create(slot->params, ctx->buffer_size, ctx->buffer_size, DRM_FORMAT_XRGB8888, 0);
+        ctx->created_dmabufs++;
+    } else {
+        // every slot has its own region of the pool, there is no answer to
+        // wait for, so only the client side cost is measured here
+        uint32_t stride = ctx->buffer_size * 4;
+        slot->buffer = wl_shm_pool_create_buffer(ctx->shm_pool, index * stride * ctx->buffer_size, ctx->buffer_size, ctx->buffer_size, stride, WL_SHM_FORMAT_XRGB8888);
+        samples_add(ctx, &ctx->shm_issue_ns, clock_now_ns() - slot->created_ns);
+    }
+}
+
+static void sync_roundtrip(ctx_t * ctx) {
+    ctx->sync_done = false;
+    struct wl_callback * callback = wl_display_sync(ctx->display);
+    wl_callback_add_listener(callback, &wl_callback_listener, (void *)ctx);
+
+    while (!ctx->sync_done) {
+        if (wl_display_dispatch(ctx->display) == -1) {
+            printf("[!] wl_display: dispatch failed\n");
+            exit_fail(ctx);
+        }
+    }
+}
+
+// --- setup ---
+
+static void create_gbm_device(ctx_t * ctx) {
+    drmDevice * devices[64];
+    char * render_node = NULL;
+
+    int n = drmGetDevices2(0, devices, sizeof(devices) / sizeof(devices[0]));
+    for (int i = 0; i < n; ++i) {
+        if (!(devices[i]->available_nodes & (1 << DRM_NODE_RENDER))) continue;
+
+        render_node = strdup(devices[i]->nodes[DRM_NODE_RENDER]);
+        break;
+    }
+    drmFreeDevices(devices, n);
+
+    if (render_node == NULL) {
+        printf("[!] no render node found, only creating shm buffers\n");
+        return;
+    }
+    printf("[info] using render node %s\n", render_node);
+
+    ctx->gbm_fd = open(render_node, O_RDWR | O_CLOEXEC);
+    free(render_node);
+    if (ctx->gbm_fd < 0) {
+        printf("[!] could not open render node, only creating shm buffers\n");
+        return;
+    }
+
+    ctx->gbm_device = gbm_create_device(ctx->gbm_fd);
+    if (ctx->gbm_device == NULL) {
+        printf("[!] gbm: failed to create device, only creating shm buffers\n");
+        close(ctx->gbm_fd);
+        ctx->gbm_fd = -1;
+    }
+}
+
+int main(void) {
+    probe_mark("start");
+    printf("[info] allocating context\n");
+    ctx_t * ctx = calloc(1, sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->display = NULL;
+    ctx->registry = NULL;
+    ctx->compositor = NULL;
+    ctx->xdg_wm_base = NULL;
+    ctx->shm = NULL;
+    ctx->linux_dmabuf = NULL;
+    ctx->gbm_device = NULL;
+    ctx->gbm_fd = -1;
+    ctx->shm_fd = -1;
+    ctx->shm_pool = NULL;
+    ctx->surfaces = NULL;
+    ctx->buffers = NULL;
+
+    ctx->seconds = option_double("WLEXP_CHURN_SECONDS", 5);
+    ctx->num_surfaces = option_long("WLEXP_CHURN_SURFACES", 64);
+    ctx->num_buffers = option_long("WLEXP_CHURN_BUFFERS", 256);
+    ctx->batch = option_long("WLEXP_CHURN_BATCH", 32);
+    ctx->dmabuf_percent = option_long("WLEXP_CHURN_DMABUF_PERCENT", 0);
+    ctx->toplevels = !option_flag("WLEXP_CHURN_NO_TOPLEVEL");
+    ctx->buffer_size = option_long("WLEXP_CHURN_BUFFER_SIZE", 64);
+
+    if (ctx->seconds <= 0 || ctx->num_surfaces == 0 || ctx->num_buffers == 0 || ctx->batch <= 0
+        || ctx->dmabuf_percent < 0 || ctx->dmabuf_percent > 100 || ctx->buffer_size == 0 || ctx->buffer_size > 4096
+        || (uint64_t)ctx->num_buffers * ctx->buffer_size * ctx->buffer_size * 4 > INT32_MAX
+    ) {
+        printf("[!] invalid churn options\n");
+        exit_fail(ctx);
+    }
+
+    ctx->surfaces = calloc(ctx->num_surfaces, sizeof *ctx->surfaces);
+    ctx->buffers = calloc(ctx->num_buffers, sizeof *ctx->buffers);
+    if (ctx->surfaces == NULL || ctx->buffers == NULL) {
+        printf("[!] calloc: allocating pools failed\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] connecting to display\n");
+    ctx->display = wl_display_connect(NULL);
+    if (ctx->display == NULL) {
+        printf("[!] wl_display: connect failed\n");
+        exit_fail(ctx);
+    }
+    probe_mark("connect");
+
+    printf("[info] getting registry\n");
+    ctx->registry = wl_display_get_registry(ctx->display);
+    wl_registry_add_listener(ctx->registry, &registry_listener, (void *)ctx);
+
+    printf("[info] waiting for events\n");
+    wl_display_roundtrip(ctx->display);
+
+    printf("[info] checking if protocols found\n");
+    if (ctx->compositor == NULL) {
+        printf("[!] wl_registry: no compositor found\n");
+        exit_fail(ctx);
+    } else if (ctx->xdg_wm_base == NULL) {
+        printf("[!] wl_registry: no xdg_wm_base found\n");
+        exit_fail(ctx);
+    } else if (ctx->shm == NULL) {
+        printf("[!] wl_registry: no shm found\n");
+        exit_fail(ctx);
+    }
+    probe_mark("registry");
+    xdg_wm_base_add_listener(ctx->xdg_wm_base, &xdg_wm_base_listener, (void *)ctx);
+
+    if (ctx->dmabuf_percent > 0) {
+        if (ctx->linux_dmabuf == NULL) {
+            printf("[!] wl_registry: no linux_dmabuf found, only creating shm buffers\n");
+        } else {
+            create_gbm_device(ctx);
+        }
+    }
+
+    printf("[info] creating shm pool\n");
+    size_t pool_size = ctx->num_buffers * ctx->buffer_size * ctx->buffer_size * 4;
+    ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
+    if (ctx->shm_fd == -1 || ftruncate(ctx->shm_fd, pool_size) == -1) {
+        printf("[!] memfd: failed to create shm file\n");
+        exit_fail(ctx);
+    }
+    ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, pool_size);
+
+    printf("[info] churning %zu surfaces%s and %zu %ux%u buffers (%ld%% dmabuf) for %.1f s\n",
+        ctx->num_surfaces, ctx->toplevels ? " with toplevels" : "",
+        ctx->num_buffers, ctx->buffer_size, ctx->buffer_size,
+        ctx->gbm_device != NULL ? ctx->dmabuf_percent : 0, ctx->seconds
+    );
+
+    uint64_t initial_rss = resident_bytes();
+    uint64_t max_rss = initial_rss;
+    uint64_t start_ns = clock_now_ns();
+    uint64_t end_ns = start_ns + (uint64_t)(ctx->seconds * 1e9);
+    uint64_t interval_start_ns = start_ns;
+    uint64_t interval_objects = 0;
+
+    while (true) {
+        uint64_t now_ns = clock_now_ns();
+        if (now_ns >= end_ns) break;
+
+        for (long i = 0; i < ctx->batch; i++) {
+            churn_surface(ctx);
+            churn_buffer(ctx);
+        }
+        sync_roundtrip(ctx);
+
+        uint64_t round_ns = clock_now_ns() - now_ns;
+        samples_add(ctx, &ctx->round_ns, round_ns / ctx->batch);
+        interval_objects += ctx->batch * 2;
+
+        // per second figures, to see rates collapse as the pools age
+        now_ns = clock_now_ns();
+        if (now_ns - interval_start_ns >= 1000000000) {
+            uint64_t rss = resident_bytes();
+            if (rss > max_rss) max_rss = rss;
+
+            printf("[churn] %6.1f s: %9.0f objects/s, rss %lu KiB\n",
+                (now_ns - start_ns) / 1e9, interval_objects * 1e9 / (now_ns - interval_start_ns), rss / 1024
+            );
+            interval_start_ns = now_ns;
+            interval_objects = 0;
+        }
+    }
+
+    uint64_t final_rss = resident_bytes();
+    if (final_rss > max_rss) max_rss = final_rss;
+    uint64_t objects = ctx->created_surfaces + ctx->created_buffers;
+
+    printf("[churn] created %lu surfaces and %lu buffers (%lu dmabuf, %lu failed)\n",
+        ctx->created_surfaces, ctx->created_buffers, ctx->created_dmabufs, ctx->failed_dmabufs
+    );
+    samples_report(&ctx->configure_ns, "toplevel configure");
+    samples_report(&ctx->dmabuf_ns, "dmabuf created");
+    samples_report(&ctx->shm_issue_ns, "shm buffer issue");
+    samples_report(&ctx->round_ns, "per pair, batched");
+    printf("[churn] rss: initial %lu KiB, max %lu KiB, final %lu KiB, %.1f bytes growth per 1000 objects\n",
+        initial_rss / 1024, max_rss / 1024, final_rss / 1024,
+        objects > 0 ? ((double)final_rss - initial_rss) * 1000 / objects : 0
+    );
+
+    cleanup(ctx);
+}
@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <options.h>
+#include <clock.h>
+#include <accounting.h>
+
+static const char * stage_names[ACCOUNTING_STAGE_COUNT] = {
+    [ACCOUNTING_STAGE_REQUEST] = "request",
+    [ACCOUNTING_STAGE_COPY] = "copy",
+    [ACCOUNTING_STAGE_PROCESS] = "process"
+};
+
+static const char * syscall_names[ACCOUNTING_SYSCALL_COUNT] = {
+    [ACCOUNTING_SYSCALL_MMAP] = "mmap",
+    [ACCOUNTING_SYSCALL_MUNMAP] = "munmap",
+    [ACCOUNTING_SYSCALL_MREMAP] = "mremap",
+    [ACCOUNTING_SYSCALL_FTRUNCATE] = "ftruncate",
+    [ACCOUNTING_SYSCALL_MEMFD_CREATE] = "memfd_create"
+};
+
+static struct {
+    bool enabled;
+    int display_fd;
+    bool has_reader;
+    pthread_t reader;
+
+    accounting_counters_t counters;
+
+    bool frame_active;
+    uint64_t frame;
+    uint64_t frame_start_ns;
+    accounting_stage_t stage;
+    bool stage_active;
+    accounting_counters_t stage_start;
+    accounting_counters_t stages[ACCOUNTING_STAGE_COUNT];
+
+    uint64_t frames;
+    uint64_t total_latency_ns;
+    accounting_counters_t frame_totals;
+} state = { .display_fd = -1 };
+
+#define COUNT(field) __atomic_fetch_add(&state.counters.field, 1, __ATOMIC_RELAXED)
+#define COUNT_N(field, n) __atomic_fetch_add(&state.counters.field, (n), __ATOMIC_RELAXED)
+
+// --- counter snapshots ---
+
+void accounting_init(struct wl_display * display) {
+    state.display_fd = wl_display_get_fd(display);
+    state.enabled = option_flag("WLEXP_ACCOUNTING");
+    if (state.enabled) {
+        printf("[accounting] per-frame accounting enabled\n");
+    }
+}
+
+void accounting_snapshot(accounting_counters_t * counters) {
+    counters->requests = __atomic_load_n(&state.counters.requests, __ATOMIC_RELAXED);
+    counters->bytes_sent = __atomic_load_n(&state.counters.bytes_sent, __ATOMIC_RELAXED);
+    counters->flushes = __atomic_load_n(&state.counters.flushes, __ATOMIC_RELAXED);
+    counters->reads = __atomic_load_n(&state.counters.reads, __ATOMIC_RELAXED);
+    counters->bytes_received = __atomic_load_n(&state.counters.bytes_received, __ATOMIC_RELAXED);
+    counters->dispatches = __atomic_load_n(&state.counters.dispatches, __ATOMIC_RELAXED);
+    counters->roundtrips = __atomic_load_n(&state.counters.roundtrips, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < ACCOUNTING_SYSCALL_COUNT; i++) {
+        counters->syscalls[i] = __atomic_load_n(&state.counters.syscalls[i], __ATOMIC_RELAXED);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    counters->minor_faults = usage.ru_minflt;
+    counters->major_faults = usage.ru_majflt;
+}
+
+static void counters_add_delta(accounting_counters_t * total, const accounting_counters_t * end, const accounting_counters_t * start) {
+    total->requests += end->requests - start->requests;
+    total->bytes_sent += end->bytes_sent - start->bytes_sent;
+    total->flushes += end->flushes - start->flushes;
+    total->reads += end->reads - start->reads;
+    total->bytes_received += end->bytes_received - start->bytes_received;
+    total->dispatches += end->dispatches - start->dispatches;
+    total->roundtrips += end->roundtrips - start->roundtrips;
+    total->minor_faults += end->minor_faults - start->minor_faults;
+    total->major_faults += end->major_faults - start->major_faults;
+    for (size_t i = 0; i < ACCOUNTING_SYSCALL_COUNT; i++) {
+        total->syscalls[i] += end->syscalls[i] - start->syscalls[i];
+    }
+}
+
+static void print_counters(const char * name, const accounting_counters_t * counters) {
+    printf(" | %s: %lu req, %lu flush, %lu read, %lu dispatch, %lu roundtrip, %lu+%lu faults",
+        name, counters->requests, counters->flushes, counters->reads,
+        counters->dispatches, counters->roundtrips,
+        counters->minor_faults, counters->major_faults
+    );
+
+    for (size_t i = 0; i < ACCOUNTING_SYSCALL_COUNT; i++) {
+        if (counters->syscalls[i] == 0) continue;
+        printf(", %lu %s", counters->syscalls[i], syscall_names[i]);
+    }
+}
+
+// --- frame stages ---
+
+static void end_stage(void) {
+    if (!state.stage_active) return;
+    state.stage_active = false;
+
+    accounting_counters_t now;
+    accounting_snapshot(&now);
+    counters_add_delta(&state.stages[state.stage], &now, &state.stage_start);
+}
+
+void accounting_begin_frame(void) {
+    if (!state.enabled) return;
+
+    memset(state.stages, 0, sizeof state.stages);
+    state.frame_active = true;
+    state.frame_start_ns = clock_now_ns();
+    accounting_begin_stage(ACCOUNTING_STAGE_REQUEST);
+}
+
+void accounting_begin_stage(accounting_stage_t stage) {
+    if (!state.enabled) return;
+    if (!state.frame_active) return;
+
+    end_stage();
+    state.stage = stage;
+    state.stage_active = true;
+    accounting_snapshot(&state.stage_start);
+}
+
+void accounting_end_frame(void) {
+    if (!state.enabled) return;
+    if (!state.frame_active) return;
+
+    end_stage();
+    state.frame_active = false;
+
+    uint64_t latency_ns = clock_now_ns() - state.frame_start_ns;
+    state.total_latency_ns += latency_ns;
+    state.frames++;
+
+    printf("[accounting] frame %lu: latency %.3f ms", state.frame, latency_ns / 1e6);
+    for (size_t stage = 0; stage < ACCOUNTING_STAGE_COUNT; stage++) {
+        print_counters(stage_names[stage], &state.stages[stage]);
+
+        accounting_counters_t zero = { 0 };
+        counters_add_delta(&state.frame_totals, &state.stages[stage], &zero);
+    }
+    printf("\n");
+
+    state.frame++;
+}
+
+void accounting_report(void) {
+    if (!state.enabled) return;
+
+    accounting_counters_t total;
+    accounting_snapshot(&total);
+
+    printf("[accounting] summary:\n");
+    printf("[accounting]   process: %lu requests (%lu bytes), %lu explicit flushes, %lu reads (%lu bytes), %lu dispatches, %lu roundtrips\n",
+        total.requests, total.bytes_sent, total.flushes,
+        total.reads, total.bytes_received, total.dispatches, total.roundtrips
+    );
+    for (size_t i = 0; i < ACCOUNTING_SYSCALL_COUNT; i++) {
+        printf("[accounting]   process: %lu %s\n", total.syscalls[i], syscall_names[i]);
+    }
+
+    if (state.frames == 0) return;
+
+    accounting_counters_t * frames = &state.frame_totals;
+    double n = state.frames;
+    printf("[accounting]   per frame (n=%lu): latency %.3f ms, %.1f requests, %.1f explicit flushes, %.1f reads, %.1f roundtrips, %.1f minor faults, %.1f major faults\n",
+        state.frames, state.total_latency_ns / 1e6 / n,
+        frames->requests / n, frames->flushes / n, frames->reads / n,
+        frames->roundtrips / n, frames->minor_faults / n, frames->major_faults / n
+    );
+}
+
+// --- wrapped calls, see --wrap in CMakeLists.txt ---
+
+// the request stubs of the protocol headers are inlined into the callers,
+// their arguments can only be passed on as an array in signature order
+#define MAX_REQUEST_ARGS 20
+
+// strings and arrays are sent with their length and padded to 32 bits
+static uint64_t padded_size(size_t size) {
+    return 4 + ((size + 3) & ~(size_t)3);
+}
+
+struct wl_proxy * __wrap_wl_proxy_marshal_flags(struct wl_proxy * proxy, uint32_t opcode, const struct wl_interface * interface, uint32_t version, uint32_t flags, ...) {
+    COUNT(requests);
+
+    union wl_argument args[MAX_REQUEST_ARGS];
+    size_t count = 0;
+    const char * signature = wl_proxy_get_interface(proxy)->methods[opcode].signature;
+
+    // the size of the request on the wire, sender id, opcode and size first.
+    // fds go along as ancillary data
+    uint64_t size = 8;
+
+    va_list ap;
+    va_start(ap, flags);
+    for (const char * type = signature; *type != '\0' && count < MAX_REQUEST_ARGS; type++) {
+        switch (*type) {
+            case 'i': args[count++].i = va_arg(ap, int32_t); size += 4; break;
+            case 'u': args[count++].u = va_arg(ap, uint32_t); size += 4; break;
+            case 'f': args[count++].f = va_arg(ap, wl_fixed_t); size += 4; break;
+            case 's':
+                args[count].s = va_arg(ap, const char *);
+                size += args[count].s != NULL ? padded_size(strlen(args[count].s) + 1) : 4;
+                count++;
+                break;
+            case 'o': args[count++].o = va_arg(ap, struct wl_object *); size += 4; break;
+            case 'n': args[count++].o = va_arg(ap, struct wl_object *); size += 4; break;
+            case 'a':
+                args[count].a = va_arg(ap, struct wl_array *);
+                size += args[count].a != NULL ? padded_size(args[count].a->size) : 4;
+                count++;
+                break;
+            case 'h': args[count++].h = va_arg(ap, int32_t); break;
+            // since-version digits and nullable markers
+            default: break;
+        }
+    }
+    va_end(ap);
+
+    // libwayland flushes these on its own as well, so the bytes are counted
+    // when they are queued rather than in wl_display_flush
+    COUNT_N(bytes_sent, size);
+    return wl_proxy_marshal_array_flags(proxy, opcode, interface, version, flags, args);
+}
+
+int __real_wl_display_flush(struct wl_display * display);
+int __wrap_wl_display_flush(struct wl_display * display) {
+    int result = __real_wl_display_flush(display);
+    if (result > 0) COUNT(flushes);
+    return result;
+}
+
+int __real_wl_display_dispatch(struct wl_display * display);
+int __wrap_wl_display_dispatch(struct wl_display * display) {
+    COUNT(dispatches);
+    return __real_wl_display_dispatch(display);
+}
+
+void accounting_reader_thread(void) {
+    state.reader = pthread_self();
+    __atomic_store_n(&state.has_reader, true, __ATOMIC_RELEASE);
+}
+
+// one read of the socket by an event loop or the reader thread. libwayland
+// lets only the last of the threads that prepared a read take the data, the
+// others wait for it, so with a reader thread only its reads are counted
+int __real_wl_display_read_events(struct wl_display * display);
+int __wrap_wl_display_read_events(struct wl_display * display) {
+    bool counted = !__atomic_load_n(&state.has_reader, __ATOMIC_ACQUIRE) || pthread_equal(state.reader, pthread_self());
+
+    // what is waiting on the socket is what the read takes, up to the size
+    // of the connection buffer
+    int queued = 0;
+    if (!counted || !state.enabled || ioctl(state.display_fd, FIONREAD, &queued) != 0) queued = 0;
+
+    int result = __real_wl_display_read_events(display);
+    if (result == 0 && queued > 0) {
+        COUNT(reads);
+        COUNT_N(bytes_received, (uint64_t)queued);
+    }
+    return result;
+}
+
+int __real_wl_display_roundtrip(struct wl_display * display);
+int __wrap_wl_display_roundtrip(struct wl_display * display) {
+    COUNT(roundtrips);
+    return __real_wl_display_roundtrip(display);
+}
+
+void * __real_mmap(void * addr, size_t length, int prot, int flags, int fd, off_t offset);
+void * __wrap_mmap(void * addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    COUNT(syscalls[ACCOUNTING_SYSCALL_MMAP]);
+    return __real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+int __real_munmap(void * addr, size_t length);
+int __wrap_munmap(void * addr, size_t length) {
+    COUNT(syscalls[ACCOUNTING_SYSCALL_MUNMAP]);
+    return __real_munmap(addr, length);
+}
+
+void * __real_mremap(void * old_address, size_t old_size, size_t new_size, int flags, ...);
+void * __wrap_mremap(void * old_address, size_t old_size, size_t new_size, int flags, ...) {
+    COUNT(syscalls[ACCOUNTING_SYSCALL_MREMAP]);
+
+    void * new_address = NULL;
+    if (flags & MREMAP_FIXED) {
+        va_list args;
+        va_start(args, flags);
+        new_address = va_arg(args, void *);
+        va_end(args);
+    }
+
+    return __real_mremap(old_address, old_size, new_size, flags, new_address);
+}
+
+int __real_ftruncate(int fd, off_t length);
+int __wrap_ftruncate(int fd, off_t length) {
+    COUNT(syscalls[ACCOUNTING_SYSCALL_FTRUNCATE]);
+    return __real_ftruncate(fd, length);
+}
+
+int __real_memfd_create(const char * name, unsigned int flags);
+int __wrap_memfd_create(const char * name, unsigned int flags) {
+    COUNT(syscalls[ACCOUNTING_SYSCALL_MEMFD_CREATE]);
+    return __real_memfd_create(name, flags);
+}
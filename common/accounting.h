@@ -0,0 +1,69 @@
+#ifndef COMMON_ACCOUNTING_H
+#define COMMON_ACCOUNTING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+// per-frame accounting of hidden costs of the capture clients: wayland
+// requests sent, socket flushes and reads, roundtrips, page faults, and a
+// few selected syscalls
+//
+// everything is counted by linking with --wrap (see CMakeLists.txt), which
+// only counts calls made by the experiments and the common code, not by
+// libraries. requests and the bytes they take on the wire are counted in
+// wl_proxy_marshal_flags, which the protocol headers inline into the
+// experiments. flushes and reads are the explicit wl_display_flush and
+// wl_display_read_events calls of the event loops that moved data, the
+// flushes and reads libwayland does on its own inside wl_display_dispatch
+// and wl_display_roundtrip only show up as dispatches and roundtrips. the
+// counters are atomic, a reader thread adds to the same ones as the
+// dispatch thread
+
+typedef enum {
+    ACCOUNTING_SYSCALL_MMAP,
+    ACCOUNTING_SYSCALL_MUNMAP,
+    ACCOUNTING_SYSCALL_MREMAP,
+    ACCOUNTING_SYSCALL_FTRUNCATE,
+    ACCOUNTING_SYSCALL_MEMFD_CREATE,
+    ACCOUNTING_SYSCALL_COUNT
+} accounting_syscall_t;
+
+typedef enum {
+    ACCOUNTING_STAGE_REQUEST,
+    ACCOUNTING_STAGE_COPY,
+    ACCOUNTING_STAGE_PROCESS,
+    ACCOUNTING_STAGE_COUNT
+} accounting_stage_t;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t bytes_sent;
+    uint64_t flushes;
+    uint64_t reads;
+    uint64_t bytes_received;
+    uint64_t dispatches;
+    uint64_t roundtrips;
+    uint64_t minor_faults;
+    uint64_t major_faults;
+    uint64_t syscalls[ACCOUNTING_SYSCALL_COUNT];
+} accounting_counters_t;
+
+// enabled with WLEXP_ACCOUNTING=1, counting itself is always on
+void accounting_init(struct wl_display * display);
+
+// snapshot of the process-wide counters, with page faults of the calling thread
+void accounting_snapshot(accounting_counters_t * counters);
+
+// frames are split into stages, each stage ends when the next one begins
+void accounting_begin_frame(void);
+void accounting_begin_stage(accounting_stage_t stage);
+void accounting_end_frame(void);
+
+void accounting_report(void);
+
+// the calling thread reads the socket for all others, from now on only its
+// reads are counted
+void accounting_reader_thread(void);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <options.h>
+#include <clock.h>
+#include <bench_stats.h>
+
+static struct {
+    bool initialized;
+    uint64_t frame_limit;
+    const char * output;
+
+    uint64_t * latency_ns;
+    uint64_t requested_ns;
+    uint64_t first_end_ns;
+    uint64_t last_end_ns;
+    uint64_t frames;
+    uint64_t failed;
+    uint64_t bytes_copied;
+} bench;
+
+void bench_stats_init(void) {
+    long frames = option_long("WLEXP_FRAMES", 0);
+    bench.frame_limit = frames > 0 ? frames : 0;
+    bench.output = option_string("WLEXP_BENCH_OUTPUT", NULL);
+
+    if (bench.frame_limit > 0) {
+        bench.latency_ns = malloc(bench.frame_limit * sizeof *bench.latency_ns);
+        if (bench.latency_ns == NULL) {
+            printf("[!] bench: failed to allocate latency samples\n");
+            bench.frame_limit = 0;
+        }
+    }
+
+    bench.initialized = true;
+}
+
+bool bench_stats_active(void) {
+    return bench.frame_limit > 0;
+}
+
+void bench_stats_begin_frame(void) {
+    bench.requested_ns = clock_now_ns();
+}
+
+bool bench_stats_end_frame(uint64_t bytes_copied) {
+    uint64_t now_ns = clock_now_ns();
+    if (bench.frames == 0) bench.first_end_ns = now_ns;
+    bench.last_end_ns = now_ns;
+    bench.bytes_copied += bytes_copied;
+
+    if (bench.frame_limit == 0) {
+        bench.frames++;
+        return false;
+    }
+
+    bench.latency_ns[bench.frames] = now_ns - bench.requested_ns;
+    bench.frames++;
+    if (bench.frames < bench.frame_limit) return false;
+
+    printf("[info] captured %lu frames, stopping\n", bench.frames);
+    return true;
+}
+
+bool bench_stats_fail_frame(void) {
+    bench.failed++;
+    return bench_stats_active();
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    if (count == 0) return 0;
+
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+void bench_stats_report(void) {
+    if (!bench.initialized) return;
+
+    if (bench.output != NULL) {
+        FILE * file = fopen(bench.output, "w");
+        if (file == NULL) {
+            printf("[!] bench: failed to open %s\n", bench.output);
+        } else {
+            size_t count = bench.frame_limit > 0 ? bench.frames : 0;
+            if (count > 0) qsort(bench.latency_ns, count, sizeof *bench.latency_ns, compare_u64);
+
+            // the first frame includes buffer allocation, so the sustained
+            // rate is measured between the first and the last frame
+            double fps = 0;
+            if (bench.frames > 1 && bench.last_end_ns > bench.first_end_ns) {
+                fps = (bench.frames - 1) * 1e9 / (bench.last_end_ns - bench.first_end_ns);
+            }
+
+            fprintf(file,
+                "{\"frames\": %lu, \"failed\": %lu, \"fps\": %.3f, "
+                "\"latency_ns\": {\"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu}, "
+                "\"bytes_copied\": %lu, \"bytes_per_frame\": %lu}\n",
+                bench.frames, bench.failed, fps,
+                percentile(bench.latency_ns, count, 50), percentile(bench.latency_ns, count, 90),
+                percentile(bench.latency_ns, count, 99), percentile(bench.latency_ns, count, 100),
+                bench.bytes_copied, bench.frames > 0 ? bench.bytes_copied / bench.frames : 0
+            );
+            fclose(file);
+        }
+    }
+
+    free(bench.latency_ns);
+    bench.latency_ns = NULL;
+    bench.initialized = false;
+}
@@ -0,0 +1,33 @@
+#ifndef COMMON_BENCH_STATS_H
+#define COMMON_BENCH_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// machine readable statistics of a capture client run, used by the bench
+// harness (bench/bench.c)
+//
+// WLEXP_FRAMES=N makes a client capture N frames and exit, WLEXP_BENCH_OUTPUT
+// names a file the statistics are written to as a single JSON object. unlike
+// frame_stats, every latency sample is kept so percentiles cover the whole run
+
+// reads WLEXP_FRAMES and WLEXP_BENCH_OUTPUT
+void bench_stats_init(void);
+
+// true if a frame limit was set, clients keep capturing until it is reached
+bool bench_stats_active(void);
+
+// a capture was requested
+void bench_stats_begin_frame(void);
+
+// the requested capture was processed, with the number of pixel bytes
+// written or uploaded for it, returns true once the frame limit is reached
+bool bench_stats_end_frame(uint64_t bytes_copied);
+
+// the requested capture failed, returns true if the run should end
+bool bench_stats_fail_frame(void);
+
+// writes the statistics if WLEXP_BENCH_OUTPUT is set and frees the samples
+void bench_stats_report(void);
+
+#endif
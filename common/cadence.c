@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <options.h>
+#include <cadence.h>
+
+static int verbose = -1;
+
+static bool is_verbose(void) {
+    if (verbose == -1) verbose = option_flag("WLEXP_CADENCE");
+    return verbose;
+}
+
+void cadence_init(cadence_t * cadence) {
+    cadence->refresh_mhz = 0;
+    cadence->period_ns = 0;
+    cadence->last_ready_ns = 0;
+    cadence->frames = 0;
+    cadence->intervals = 0;
+    cadence->total_interval_ns = 0;
+    cadence->min_interval_ns = UINT64_MAX;
+    cadence->max_interval_ns = 0;
+    cadence->dropped = 0;
+    cadence->duplicated = 0;
+    cadence->late = 0;
+    cadence->max_delay_ns = 0;
+}
+
+void cadence_set_refresh(cadence_t * cadence, int32_t refresh_mhz) {
+    if (refresh_mhz <= 0) {
+        cadence->refresh_mhz = 0;
+        cadence->period_ns = 0;
+        return;
+    }
+
+    cadence->refresh_mhz = refresh_mhz;
+    cadence->period_ns = 1000000000000 / (uint64_t)refresh_mhz;
+}
+
+void cadence_restart(cadence_t * cadence) {
+    cadence->last_ready_ns = 0;
+}
+
+void cadence_frame(cadence_t * cadence, const char * name, uint64_t ready_ns, uint64_t received_ns) {
+    cadence->frames++;
+
+    uint64_t delay_ns = received_ns > ready_ns ? received_ns - ready_ns : 0;
+    if (delay_ns > cadence->max_delay_ns) cadence->max_delay_ns = delay_ns;
+
+    uint64_t last_ready_ns = cadence->last_ready_ns;
+    cadence->last_ready_ns = ready_ns;
+
+    uint64_t period_ns = cadence->period_ns;
+    if (period_ns != 0 && delay_ns > period_ns) {
+        cadence->late++;
+        if (is_verbose()) {
+            printf("[cadence] %s: frame %lu late, handled %.3f ms after its timestamp\n", name, cadence->frames, delay_ns / 1e6);
+        }
+    }
+
+    if (last_ready_ns == 0) return;
+    if (ready_ns < last_ready_ns) {
+        // timestamps from before a restart or of another clock, start over
+        if (is_verbose()) printf("[cadence] %s: timestamp went backwards\n", name);
+        return;
+    }
+
+    uint64_t interval_ns = ready_ns - last_ready_ns;
+    cadence->intervals++;
+    cadence->total_interval_ns += interval_ns;
+    if (interval_ns < cadence->min_interval_ns) cadence->min_interval_ns = interval_ns;
+    if (interval_ns > cadence->max_interval_ns) cadence->max_interval_ns = interval_ns;
+
+    if (period_ns == 0) return;
+
+    if (interval_ns < period_ns / 2) {
+        cadence->duplicated++;
+        if (is_verbose()) {
+            printf("[cadence] %s: frame %lu duplicated, %.3f ms after the previous one\n", name, cadence->frames, interval_ns / 1e6);
+        }
+        return;
+    }
+
+    // round to the nearest whole number of refresh periods
+    uint64_t periods = (interval_ns + period_ns / 2) / period_ns;
+    if (periods > 1) {
+        cadence->dropped += periods - 1;
+        if (is_verbose()) {
+            printf("[cadence] %s: dropped %lu frames before frame %lu, interval %.3f ms\n", name, periods - 1, cadence->frames, interval_ns / 1e6);
+        }
+    }
+}
+
+void cadence_report(const cadence_t * cadence, const char * name) {
+    if (!is_verbose() || cadence->frames == 0) return;
+
+    printf("[cadence] %s summary: %lu frames", name, cadence->frames);
+    if (cadence->refresh_mhz != 0) {
+        printf(" at %u.%03u Hz", cadence->refresh_mhz / 1000, cadence->refresh_mhz % 1000);
+    } else {
+        printf(" at unknown refresh");
+    }
+    printf(", %lu dropped, %lu duplicated, %lu late (max delay %.3f ms)\n",
+        cadence->dropped, cadence->duplicated, cadence->late, cadence->max_delay_ns / 1e6
+    );
+
+    if (cadence->intervals == 0) return;
+
+    double mean_ns = (double)cadence->total_interval_ns / cadence->intervals;
+    printf("[cadence] %s intervals: mean %.3f ms (%.2f fps), min %.3f ms, max %.3f ms",
+        name, mean_ns / 1e6, 1e9 / mean_ns, cadence->min_interval_ns / 1e6, cadence->max_interval_ns / 1e6
+    );
+    if (cadence->period_ns != 0) {
+        // share of refreshes that made it into a capture
+        uint64_t refreshes = cadence->total_interval_ns / cadence->period_ns;
+        if (refreshes != 0) printf(", captured %.1f%% of refreshes", 100.0 * cadence->intervals / refreshes);
+    }
+    printf("\n");
+}
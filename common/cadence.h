@@ -0,0 +1,50 @@
+#ifndef COMMON_CADENCE_H
+#define COMMON_CADENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// frame cadence of one output, measured from the ready timestamps of
+// consecutive captures against the refresh rate of the current wl_output mode
+//
+// - dropped: the interval spans more than one refresh period, every extra
+//   period is a frame the panel showed that we never captured
+// - duplicated: the interval is shorter than half a period, so both frames
+//   belong to the same refresh
+// - late: the ready event was handled more than one period after its
+//   timestamp, so the client is falling behind the panel
+//
+// counters are always kept, WLEXP_CADENCE=1 prints every anomaly as it
+// happens and a summary per output when the client exits
+
+typedef struct {
+    uint32_t refresh_mhz;
+    uint64_t period_ns;
+
+    uint64_t last_ready_ns;
+    uint64_t frames;
+    uint64_t intervals;
+    uint64_t total_interval_ns;
+    uint64_t min_interval_ns;
+    uint64_t max_interval_ns;
+
+    uint64_t dropped;
+    uint64_t duplicated;
+    uint64_t late;
+    uint64_t max_delay_ns;
+} cadence_t;
+
+void cadence_init(cadence_t * cadence);
+
+// refresh in mHz as sent by wl_output.mode, 0 if unknown
+void cadence_set_refresh(cadence_t * cadence, int32_t refresh_mhz);
+
+// forget the previous timestamp, e.g. when capture moves to another output
+void cadence_restart(cadence_t * cadence);
+
+// ready_ns is the frame timestamp, received_ns when the client handled it
+void cadence_frame(cadence_t * cadence, const char * name, uint64_t ready_ns, uint64_t received_ns);
+
+void cadence_report(const cadence_t * cadence, const char * name);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <options.h>
+#include <clock.h>
+#include <capture_scheduler.h>
+
+// used until the output sent its mode
+#define FALLBACK_REFRESH_MHZ 60000
+
+static void update_interval(capture_scheduler_t * scheduler, int32_t refresh_mhz) {
+    if (refresh_mhz <= 0) refresh_mhz = FALLBACK_REFRESH_MHZ;
+    if ((uint32_t)refresh_mhz == scheduler->refresh_mhz) return;
+
+    scheduler->refresh_mhz = refresh_mhz;
+    scheduler->period_ns = 1000000000000ull / refresh_mhz;
+
+    // the nearest whole number of refreshes, never faster than every refresh
+    double refresh_hz = refresh_mhz / 1000.0;
+    scheduler->divisor = 1;
+    if (scheduler->target_fps > 0 && scheduler->target_fps < refresh_hz) {
+        scheduler->divisor = (uint32_t)lround(refresh_hz / scheduler->target_fps);
+    }
+
+    printf("[scheduler] output refresh %.3f Hz, capturing every %u refresh(es), %.3f fps\n",
+        refresh_hz, scheduler->divisor, refresh_hz / scheduler->divisor
+    );
+}
+
+static void timer_expired(void * data, uint64_t expirations) {
+    capture_scheduler_t * scheduler = (capture_scheduler_t *)data;
+    if (scheduler->in_flight) return;
+
+    uint64_t now_ns = clock_now_ns();
+    uint64_t wakeup_ns = now_ns > scheduler->deadline_ns ? now_ns - scheduler->deadline_ns : 0;
+    scheduler->wakeups++;
+    scheduler->total_wakeup_ns += wakeup_ns;
+    if (wakeup_ns > scheduler->max_wakeup_ns) scheduler->max_wakeup_ns = wakeup_ns;
+
+    scheduler->capture(scheduler->data);
+}
+
+bool capture_scheduler_init(capture_scheduler_t * scheduler, event_loop_t * loop, capture_scheduler_func_t capture, void * data) {
+    scheduler->capture = capture;
+    scheduler->data = data;
+    scheduler->target_fps = option_double("WLEXP_PACED_FPS", 0);
+    scheduler->offset_ns = option_long("WLEXP_PACED_OFFSET_US", 1000) * 1000;
+    scheduler->refresh_mhz = 0;
+    scheduler->period_ns = 0;
+    scheduler->divisor = 1;
+    scheduler->in_flight = false;
+    scheduler->deadline_ns = 0;
+
+    scheduler->captures = 0;
+    scheduler->failed = 0;
+    scheduler->late = 0;
+    scheduler->skipped_periods = 0;
+    scheduler->wakeups = 0;
+    scheduler->total_wakeup_ns = 0;
+    scheduler->max_wakeup_ns = 0;
+
+    scheduler->timer = event_loop_add_timer(loop, timer_expired, scheduler);
+    if (scheduler->timer == NULL) return false;
+
+    update_interval(scheduler, 0);
+    return true;
+}
+
+void capture_scheduler_finish(capture_scheduler_t * scheduler) {
+    event_source_remove(scheduler->timer);
+    scheduler->timer = NULL;
+}
+
+void capture_scheduler_begin(capture_scheduler_t * scheduler) {
+    scheduler->in_flight = true;
+    event_source_timer_update(scheduler->timer, 0, 0);
+}
+
+static void arm(capture_scheduler_t * scheduler, uint64_t deadline_ns) {
+    // a deadline that already passed would capture the same repaint again,
+    // move on to the next expected one instead, in whole intervals so the
+    // captures stay on the same refreshes
+    uint64_t now_ns = clock_now_ns();
+    if (deadline_ns <= now_ns) {
+        uint64_t interval_ns = scheduler->divisor * scheduler->period_ns;
+        uint64_t intervals = (now_ns - deadline_ns) / interval_ns + 1;
+        deadline_ns += intervals * interval_ns;
+        scheduler->skipped_periods += intervals * scheduler->divisor;
+        scheduler->late++;
+    }
+
+    scheduler->in_flight = false;
+    scheduler->deadline_ns = deadline_ns;
+    event_source_timer_update(scheduler->timer, deadline_ns, 0);
+}
+
+void capture_scheduler_ready(capture_scheduler_t * scheduler, uint64_t ready_ns, int32_t refresh_mhz) {
+    scheduler->captures++;
+    update_interval(scheduler, refresh_mhz);
+    // a request copies the repaint after it, so it is made just after the
+    // refresh before the one to capture
+    arm(scheduler, ready_ns + (scheduler->divisor - 1) * scheduler->period_ns + scheduler->offset_ns);
+}
+
+void capture_scheduler_failed(capture_scheduler_t * scheduler) {
+    scheduler->failed++;
+    arm(scheduler, clock_now_ns() + (scheduler->divisor - 1) * scheduler->period_ns + scheduler->offset_ns);
+}
+
+void capture_scheduler_report(const capture_scheduler_t * scheduler) {
+    printf("[scheduler] %lu captures, %lu failed, %lu late by %lu refreshes, timer wakeup mean %.3f ms, max %.3f ms\n",
+        scheduler->captures, scheduler->failed, scheduler->late, scheduler->skipped_periods,
+        scheduler->wakeups > 0 ? scheduler->total_wakeup_ns / 1e6 / scheduler->wakeups : 0, scheduler->max_wakeup_ns / 1e6
+    );
+}
@@ -0,0 +1,65 @@
+#ifndef COMMON_CAPTURE_SCHEDULER_H
+#define COMMON_CAPTURE_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <event_loop.h>
+
+// paces continuous capture to the refresh of the captured output instead of
+// requesting the next frame as soon as the last one is ready
+//
+// a timer is phase locked to the ready timestamps: after a frame that was
+// ready at T, the next capture is requested at
+// T + (divisor - 1) * period + offset, just after the repaint before the one
+// to capture, since a request copies the next repaint. the period
+// comes from wl_output.mode, the divisor from the target rate, so 30 fps on
+// a 144 Hz output captures every 5th refresh. only one capture is in flight
+// at a time, so requests never pile up in the compositor
+//
+// WLEXP_PACED=1 enables it in screencopy_shm, WLEXP_PACED_FPS=N sets the
+// target rate (0 for every refresh), WLEXP_PACED_OFFSET_US the delay after
+// the expected repaint (default 1000)
+
+typedef void (*capture_scheduler_func_t)(void * data);
+
+typedef struct {
+    event_source_t * timer;
+    capture_scheduler_func_t capture;
+    void * data;
+
+    double target_fps;
+    uint64_t offset_ns;
+    uint32_t refresh_mhz;
+    uint64_t period_ns;
+    uint32_t divisor;
+
+    bool in_flight;
+    uint64_t deadline_ns;
+
+    uint64_t captures;
+    uint64_t failed;
+    uint64_t late;
+    uint64_t skipped_periods;
+    uint64_t wakeups;
+    uint64_t total_wakeup_ns;
+    uint64_t max_wakeup_ns;
+} capture_scheduler_t;
+
+// reads the options and adds a timer to the loop, capture is called whenever
+// the next frame should be requested
+bool capture_scheduler_init(capture_scheduler_t * scheduler, event_loop_t * loop, capture_scheduler_func_t capture, void * data);
+void capture_scheduler_finish(capture_scheduler_t * scheduler);
+
+// a capture was requested, by the scheduler or anything else
+void capture_scheduler_begin(capture_scheduler_t * scheduler);
+
+// the capture was ready at ready_ns, refresh in mHz as sent by
+// wl_output.mode or 0 if unknown
+void capture_scheduler_ready(capture_scheduler_t * scheduler, uint64_t ready_ns, int32_t refresh_mhz);
+
+// the capture failed, retry one interval later
+void capture_scheduler_failed(capture_scheduler_t * scheduler);
+
+void capture_scheduler_report(const capture_scheduler_t * scheduler);
+
+#endif
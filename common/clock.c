@@ -0,0 +1,19 @@
+#include <time.h>
+#include <clock.h>
+
+uint64_t clock_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t clock_thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t clock_from_ready(uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
+    uint64_t sec = ((uint64_t)sec_hi << 32) | sec_lo;
+    return sec * 1000000000 + nsec;
+}
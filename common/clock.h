@@ -0,0 +1,16 @@
+#ifndef COMMON_CLOCK_H
+#define COMMON_CLOCK_H
+
+#include <stdint.h>
+
+// CLOCK_MONOTONIC in nanoseconds, the clock domain of screencopy and
+// export-dmabuf ready timestamps
+uint64_t clock_now_ns(void);
+
+// CPU time consumed by the calling thread in nanoseconds
+uint64_t clock_thread_cpu_ns(void);
+
+// converts the split timestamp of the ready events to nanoseconds
+uint64_t clock_from_ready(uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec);
+
+#endif
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <resources.h>
+#include <event_loop.h>
+
+#define MAX_EVENTS 16
+
+typedef enum {
+    SOURCE_DISPLAY,
+    SOURCE_FD,
+    SOURCE_TIMER,
+    SOURCE_SIGNAL
+} source_kind_t;
+
+struct event_source {
+    event_loop_t * loop;
+    source_kind_t kind;
+    int fd;
+    bool owns_fd;
+
+    event_loop_fd_func_t fd_func;
+    event_loop_timer_func_t timer_func;
+    event_loop_signal_func_t signal_func;
+    void * data;
+
+    bool removed;
+    struct wl_list link;
+};
+
+struct event_loop {
+    struct wl_display * display;
+    int epoll_fd;
+    event_source_t display_source;
+    uint32_t display_events;
+
+    struct wl_list /*event_source_t*/ sources;
+    struct wl_list /*event_source_t*/ removed;
+};
+
+event_loop_t * event_loop_create(struct wl_display * display) {
+    event_loop_t * loop = calloc(1, sizeof (event_loop_t));
+    if (loop == NULL) {
+        printf("[!] event_loop: failed to allocate loop\n");
+        return NULL;
+    }
+
+    loop->display = display;
+    wl_list_init(&loop->sources);
+    wl_list_init(&loop->removed);
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1) {
+        printf("[!] event_loop: failed to create epoll instance\n");
+        free(loop);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, loop->epoll_fd, 0);
+    if (display == NULL) return loop;
+
+    loop->display_source.loop = loop;
+    loop->display_source.kind = SOURCE_DISPLAY;
+    loop->display_source.fd = wl_display_get_fd(display);
+    loop->display_events = EPOLLIN;
+
+    struct epoll_event event = { .events = loop->display_events, .data.ptr = &loop->display_source };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->display_source.fd, &event) == -1) {
+        printf("[!] event_loop: failed to watch the wayland socket\n");
+        close(loop->epoll_fd);
+        resource_untrack(RESOURCE_FD, loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+static void free_removed(event_loop_t * loop) {
+    event_source_t *source, *source_next;
+    wl_list_for_each_safe(source, source_next, &loop->removed, link) {
+        wl_list_remove(&source->link);
+        free(source);
+    }
+}
+
+void event_loop_destroy(event_loop_t * loop) {
+    if (loop == NULL) return;
+
+    event_source_t *source, *source_next;
+    wl_list_for_each_safe(source, source_next, &loop->sources, link) {
+        event_source_remove(source);
+    }
+    free_removed(loop);
+
+    close(loop->epoll_fd);
+    resource_untrack(RESOURCE_FD, loop->epoll_fd);
+    free(loop);
+}
+
+// --- sources ---
+
+static event_source_t * add_source(event_loop_t * loop, source_kind_t kind, int fd, bool owns_fd, uint32_t events, void * data) {
+    event_source_t * source = calloc(1, sizeof (event_source_t));
+    if (source == NULL) {
+        printf("[!] event_loop: failed to allocate source\n");
+        return NULL;
+    }
+
+    source->loop = loop;
+    source->kind = kind;
+    source->fd = fd;
+    source->owns_fd = owns_fd;
+    source->data = data;
+
+    struct epoll_event event = { .events = events, .data.ptr = source };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        printf("[!] event_loop: failed to watch fd %d\n", fd);
+        free(source);
+        return NULL;
+    }
+
+    wl_list_insert(loop->sources.prev, &source->link);
+    return source;
+}
+
+event_source_t * event_loop_add_fd(event_loop_t * loop, int fd, uint32_t events, event_loop_fd_func_t func, void * data) {
+    event_source_t * source = add_source(loop, SOURCE_FD, fd, false, events, data);
+    if (source == NULL) return NULL;
+
+    source->fd_func = func;
+    return source;
+}
+
+bool event_source_fd_update(event_source_t * source, uint32_t events) {
+    struct epoll_event event = { .events = events, .data.ptr = source };
+    return epoll_ctl(source->loop->epoll_fd, EPOLL_CTL_MOD, source->fd, &event) == 0;
+}
+
+event_source_t * event_loop_add_timer(event_loop_t * loop, event_loop_timer_func_t func, void * data) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        printf("[!] event_loop: failed to create timerfd\n");
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, fd, 0);
+
+    event_source_t * source = add_source(loop, SOURCE_TIMER, fd, true, EPOLLIN, data);
+    if (source == NULL) {
+        close(fd);
+        resource_untrack(RESOURCE_FD, fd);
+        return NULL;
+    }
+
+    source->timer_func = func;
+    return source;
+}
+
+bool event_source_timer_update(event_source_t * source, uint64_t deadline_ns, uint64_t interval_ns) {
+    struct itimerspec spec = {
+        .it_value = { .tv_sec = deadline_ns / 1000000000, .tv_nsec = deadline_ns % 1000000000 },
+        .it_interval = { .tv_sec = interval_ns / 1000000000, .tv_nsec = interval_ns % 1000000000 }
+    };
+    return timerfd_settime(source->fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0;
+}
+
+event_source_t * event_loop_add_signal(event_loop_t * loop, int signal, event_loop_signal_func_t func, void * data) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signal);
+
+    // blocked before the signalfd exists, so no signal slips through
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        printf("[!] event_loop: failed to block signal %d\n", signal);
+        return NULL;
+    }
+
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        printf("[!] event_loop: failed to create signalfd\n");
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, fd, 0);
+
+    event_source_t * source = add_source(loop, SOURCE_SIGNAL, fd, true, EPOLLIN, data);
+    if (source == NULL) {
+        close(fd);
+        resource_untrack(RESOURCE_FD, fd);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+        return NULL;
+    }
+
+    source->signal_func = func;
+    return source;
+}
+
+void event_source_remove(event_source_t * source) {
+    if (source == NULL || source->removed) return;
+    event_loop_t * loop = source->loop;
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    if (source->owns_fd) {
+        close(source->fd);
+        resource_untrack(RESOURCE_FD, source->fd);
+    }
+
+    // events for it may still be pending in the current iteration
+    source->removed = true;
+    wl_list_remove(&source->link);
+    wl_list_insert(&loop->removed, &source->link);
+}
+
+// --- dispatching ---
+
+static void dispatch_source(event_source_t * source, uint32_t events) {
+    switch (source->kind) {
+        case SOURCE_FD:
+            source->fd_func(source->data, source->fd, events);
+            break;
+
+        case SOURCE_TIMER: {
+            // nothing to read if the timer was rearmed since it fired
+            uint64_t expirations;
+            if (read(source->fd, &expirations, sizeof expirations) != sizeof expirations) break;
+            source->timer_func(source->data, expirations);
+            break;
+        }
+
+        case SOURCE_SIGNAL: {
+            struct signalfd_siginfo info;
+            if (read(source->fd, &info, sizeof info) != sizeof info) break;
+            source->signal_func(source->data, info.ssi_signo);
+            break;
+        }
+
+        case SOURCE_DISPLAY:
+            break;
+    }
+}
+
+// one iteration of a loop without a wayland connection
+static bool dispatch_sources(event_loop_t * loop, int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (count == -1) return errno == EINTR;
+
+    for (int i = 0; i < count; i++) {
+        event_source_t * source = events[i].data.ptr;
+        if (source->removed) continue;
+        dispatch_source(source, events[i].events);
+    }
+
+    free_removed(loop);
+    return true;
+}
+
+bool event_loop_dispatch(event_loop_t * loop, int timeout_ms) {
+    if (loop->display == NULL) return dispatch_sources(loop, timeout_ms);
+
+    while (wl_display_prepare_read(loop->display) != 0) {
+        if (wl_display_dispatch_pending(loop->display) == -1) return false;
+    }
+
+    // a full socket buffer is not an error, wait until it drains instead
+    uint32_t display_events = EPOLLIN;
+    if (wl_display_flush(loop->display) == -1) {
+        if (errno != EAGAIN) {
+            wl_display_cancel_read(loop->display);
+            return false;
+        }
+        display_events |= EPOLLOUT;
+    }
+
+    if (display_events != loop->display_events) {
+        struct epoll_event event = { .events = display_events, .data.ptr = &loop->display_source };
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, loop->display_source.fd, &event);
+        loop->display_events = display_events;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (count == -1) {
+        wl_display_cancel_read(loop->display);
+        return errno == EINTR;
+    }
+
+    bool readable = false;
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.ptr != &loop->display_source) continue;
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) readable = true;
+    }
+
+    if (readable) {
+        if (wl_display_read_events(loop->display) == -1) return false;
+    } else {
+        wl_display_cancel_read(loop->display);
+    }
+    if (wl_display_dispatch_pending(loop->display) == -1) return false;
+
+    for (int i = 0; i < count; i++) {
+        event_source_t * source = events[i].data.ptr;
+        if (source->removed) continue;
+        dispatch_source(source, events[i].events);
+    }
+
+    free_removed(loop);
+    return true;
+}
+
+bool event_loop_run(event_loop_t * loop, const bool * closing) {
+    while (!*closing) {
+        if (!event_loop_dispatch(loop, -1)) return false;
+    }
+    return true;
+}
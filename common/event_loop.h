@@ -0,0 +1,58 @@
+#ifndef COMMON_EVENT_LOOP_H
+#define COMMON_EVENT_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+// epoll based main loop of the clients, waiting on the wayland socket
+// together with timers, signals and any other fds, modelled after
+// wl_event_loop of the server side
+//
+// every iteration prepares a read of the wayland socket, flushes pending
+// requests, waits, then reads and dispatches wayland events before calling
+// the handlers of other sources. a flush that fails with EAGAIN because the
+// socket buffer is full waits for the socket to become writable instead of
+// blocking or losing requests
+//
+// sources may be removed from within any handler, they are freed once the
+// current iteration is done
+
+typedef struct event_loop event_loop_t;
+typedef struct event_source event_source_t;
+
+// events is the EPOLLIN / EPOLLOUT / EPOLLERR / EPOLLHUP mask that fired
+typedef void (*event_loop_fd_func_t)(void * data, int fd, uint32_t events);
+// expirations is the number of timer periods since the last call
+typedef void (*event_loop_timer_func_t)(void * data, uint64_t expirations);
+typedef void (*event_loop_signal_func_t)(void * data, int signal);
+
+// without a display, e.g. for tools that only use the other sources
+event_loop_t * event_loop_create(struct wl_display * display);
+// removes all remaining sources, does not disconnect the display
+void event_loop_destroy(event_loop_t * loop);
+
+// the fd stays owned by the caller
+event_source_t * event_loop_add_fd(event_loop_t * loop, int fd, uint32_t events, event_loop_fd_func_t func, void * data);
+bool event_source_fd_update(event_source_t * source, uint32_t events);
+
+// timers start disarmed, deadlines are CLOCK_MONOTONIC nanoseconds as
+// returned by clock_now_ns, a deadline of 0 disarms the timer
+event_source_t * event_loop_add_timer(event_loop_t * loop, event_loop_timer_func_t func, void * data);
+bool event_source_timer_update(event_source_t * source, uint64_t deadline_ns, uint64_t interval_ns);
+
+// blocks the signal for the whole process and delivers it through the loop,
+// it stays blocked after removal so that a second one arriving during cleanup
+// does not kill the client before its reports are printed
+event_source_t * event_loop_add_signal(event_loop_t * loop, int signal, event_loop_signal_func_t func, void * data);
+
+void event_source_remove(event_source_t * source);
+
+// one iteration, timeout_ms as for epoll_wait, false if the wayland
+// connection failed
+bool event_loop_dispatch(event_loop_t * loop, int timeout_ms);
+
+// iterates until *closing is set by a handler or the connection fails
+bool event_loop_run(event_loop_t * loop, const bool * closing);
+
+#endif
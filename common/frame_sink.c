@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <options.h>
+#include <clock.h>
+#include <resources.h>
+#include <thread.h>
+#include <frame_sink.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+#define MAX_QUEUE 64
+#define MAX_THREADS 16
+
+typedef enum {
+    BACKEND_IO_URING,
+    BACKEND_PWRITE
+} backend_t;
+
+typedef struct {
+    bool used;
+    size_t pool_offset;
+    size_t size;
+    size_t written;
+    uint64_t file_offset;
+    uint64_t submitted_ns;
+    int error;
+} job_t;
+
+struct frame_sink {
+    backend_t backend;
+    int fd;
+    bool direct;
+    uint64_t file_offset;
+    int event_fd;
+    event_source_t * source;
+    frame_sink_done_func_t done;
+    void * data;
+
+    uint8_t * pool;
+    size_t pool_size;
+
+    job_t jobs[MAX_QUEUE];
+    uint32_t depth;
+    uint32_t in_flight;
+
+    // io_uring
+    int ring_fd;
+    void * sq_ring;
+    size_t sq_ring_size;
+    void * cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe * sqes;
+    size_t sqes_size;
+    uint32_t * sq_tail;
+    uint32_t sq_mask;
+    uint32_t * sq_array;
+    uint32_t * cq_head;
+    uint32_t * cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe * cqes;
+    bool fixed_buffer;
+
+    // pwrite thread pool, job indices queued for the workers and back
+    pthread_t threads[MAX_THREADS];
+    size_t num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t pending[MAX_QUEUE];
+    uint32_t pending_first;
+    uint32_t pending_count;
+    uint32_t completed[MAX_QUEUE];
+    uint32_t completed_count;
+    bool stopping;
+
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t dropped;
+    uint64_t failed;
+    uint32_t max_in_flight;
+    uint64_t total_write_ns;
+    uint64_t max_write_ns;
+    uint64_t start_ns;
+};
+
+// --- io_uring ---
+
+static int io_uring_setup(uint32_t entries, struct io_uring_params * params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int ring_fd, uint32_t opcode, const void * arg, uint32_t nr_args) {
+    return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static bool ring_init(frame_sink_t * sink) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof params);
+    sink->ring_fd = io_uring_setup(sink->depth, &params);
+    if (sink->ring_fd == -1) {
+        printf("[!] frame_sink: io_uring_setup failed: %s\n", strerror(errno));
+        return false;
+    }
+    resource_track(RESOURCE_FD, sink->ring_fd, 0);
+
+    sink->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (uint32_t);
+    sink->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (sink->cq_ring_size > sink->sq_ring_size) sink->sq_ring_size = sink->cq_ring_size;
+        sink->cq_ring_size = sink->sq_ring_size;
+    }
+
+    sink->sq_ring = mmap(NULL, sink->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sink->ring_fd, IORING_OFF_SQ_RING);
+    if (sink->sq_ring == MAP_FAILED) {
+        sink->sq_ring = NULL;
+        printf("[!] frame_sink: failed to map submission ring\n");
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sink->cq_ring = sink->sq_ring;
+    } else {
+        sink->cq_ring = mmap(NULL, sink->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sink->ring_fd, IORING_OFF_CQ_RING);
+        if (sink->cq_ring == MAP_FAILED) {
+            sink->cq_ring = NULL;
+            printf("[!] frame_sink: failed to map completion ring\n");
+            return false;
+        }
+    }
+
+    sink->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+    sink->sqes = mmap(NULL, sink->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sink->ring_fd, IORING_OFF_SQES);
+    if (sink->sqes == MAP_FAILED) {
+        sink->sqes = NULL;
+        printf("[!] frame_sink: failed to map submission entries\n");
+        return false;
+    }
+
+    uint8_t * sq = (uint8_t *)sink->sq_ring;
+    uint8_t * cq = (uint8_t *)sink->cq_ring;
+    sink->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    sink->sq_mask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    sink->sq_array = (uint32_t *)(sq + params.sq_off.array);
+    sink->cq_head = (uint32_t *)(cq + params.cq_off.head);
+    sink->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    sink->cq_mask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    sink->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // completions wake the event loop
+    if (io_uring_register(sink->ring_fd, IORING_REGISTER_EVENTFD, &sink->event_fd, 1) == -1) {
+        printf("[!] frame_sink: failed to register eventfd: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static void ring_finish(frame_sink_t * sink) {
+    if (sink->sqes != NULL) munmap(sink->sqes, sink->sqes_size);
+    if (sink->cq_ring != NULL && sink->cq_ring != sink->sq_ring) munmap(sink->cq_ring, sink->cq_ring_size);
+    if (sink->sq_ring != NULL) munmap(sink->sq_ring, sink->sq_ring_size);
+    if (sink->ring_fd != -1) {
+        close(sink->ring_fd);
+        resource_untrack(RESOURCE_FD, sink->ring_fd);
+    }
+    sink->sqes = NULL;
+    sink->cq_ring = NULL;
+    sink->sq_ring = NULL;
+    sink->ring_fd = -1;
+}
+
+static bool ring_submit(frame_sink_t * sink, uint32_t index) {
+    job_t * job = &sink->jobs[index];
+
+    // only this thread produces, so the tail is not raced
+    uint32_t tail = *sink->sq_tail;
+    struct io_uring_sqe * sqe = &sink->sqes[tail & sink->sq_mask];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = sink->fixed_buffer ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = sink->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(sink->pool + job->pool_offset + job->written);
+    sqe->len = job->size - job->written;
+    sqe->off = job->file_offset + job->written;
+    sqe->buf_index = 0;
+    sqe->user_data = index;
+    sink->sq_array[tail & sink->sq_mask] = tail & sink->sq_mask;
+    __atomic_store_n(sink->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while (io_uring_enter(sink->ring_fd, 1, 0, 0) == -1) {
+        if (errno == EINTR) continue;
+        printf("[!] frame_sink: io_uring_enter failed: %s\n", strerror(errno));
+        // nothing was consumed, take the entry back
+        __atomic_store_n(sink->sq_tail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+// --- pwrite thread pool ---
+
+static void wake_loop(frame_sink_t * sink) {
+    uint64_t value = 1;
+    // only fails if the counter is about to overflow, it is readable then
+    if (write(sink->event_fd, &value, sizeof value) == -1) return;
+}
+
+static void * worker_main(void * data) {
+    frame_sink_t * sink = (frame_sink_t *)data;
+
+    pthread_mutex_lock(&sink->lock);
+    while (true) {
+        while (sink->pending_count == 0 && !sink->stopping) pthread_cond_wait(&sink->cond, &sink->lock);
+        if (sink->pending_count == 0) break;
+
+        uint32_t index = sink->pending[sink->pending_first];
+        sink->pending_first = (sink->pending_first + 1) % MAX_QUEUE;
+        sink->pending_count--;
+        pthread_mutex_unlock(&sink->lock);
+
+        job_t * job = &sink->jobs[index];
+        while (job->written < job->size) {
+            ssize_t result = pwrite(sink->fd, sink->pool + job->pool_offset + job->written, job->size - job->written, job->file_offset + job->written);
+            if (result == -1 && errno == EINTR) continue;
+            if (result <= 0) {
+                job->error = result == 0 ? EIO : errno;
+                break;
+            }
+            job->written += result;
+        }
+
+        pthread_mutex_lock(&sink->lock);
+        sink->completed[sink->completed_count++] = index;
+        wake_loop(sink);
+    }
+    pthread_mutex_unlock(&sink->lock);
+
+    return NULL;
+}
+
+static bool pool_init(frame_sink_t * sink) {
+    long threads = option_long("WLEXP_RECORD_THREADS", 2);
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    for (long i = 0; i < threads; i++) {
+        if (thread_create(&sink->threads[i], worker_main, sink) != 0) break;
+        sink->num_threads++;
+    }
+
+    if (sink->num_threads == 0) {
+        printf("[!] frame_sink: failed to create writer threads\n");
+        return false;
+    }
+    return true;
+}
+
+static void pool_finish(frame_sink_t * sink) {
+    pthread_mutex_lock(&sink->lock);
+    sink->stopping = true;
+    pthread_cond_broadcast(&sink->cond);
+    pthread_mutex_unlock(&sink->lock);
+
+    for (size_t i = 0; i < sink->num_threads; i++) pthread_join(sink->threads[i], NULL);
+    sink->num_threads = 0;
+}
+
+// --- completions ---
+
+static void complete_job(frame_sink_t * sink, uint32_t index) {
+    job_t * job = &sink->jobs[index];
+    uint64_t write_ns = clock_now_ns() - job->submitted_ns;
+    bool ok = job->error == 0;
+
+    if (ok) {
+        sink->frames++;
+        sink->bytes += job->size;
+        sink->total_write_ns += write_ns;
+        if (write_ns > sink->max_write_ns) sink->max_write_ns = write_ns;
+    } else {
+        printf("[!] frame_sink: write failed: %s\n", strerror(job->error));
+        sink->failed++;
+    }
+
+    job->used = false;
+    sink->in_flight--;
+    sink->done(sink->data, job->pool_offset, ok);
+}
+
+static void reap(frame_sink_t * sink) {
+    uint64_t value;
+    if (read(sink->event_fd, &value, sizeof value) == -1 && errno != EAGAIN) {
+        printf("[!] frame_sink: failed to read eventfd\n");
+    }
+
+    if (sink->backend == BACKEND_PWRITE) {
+        uint32_t completed[MAX_QUEUE];
+        pthread_mutex_lock(&sink->lock);
+        uint32_t count = sink->completed_count;
+        memcpy(completed, sink->completed, count * sizeof *completed);
+        sink->completed_count = 0;
+        pthread_mutex_unlock(&sink->lock);
+
+        for (uint32_t i = 0; i < count; i++) complete_job(sink, completed[i]);
+        return;
+    }
+
+    uint32_t head = *sink->cq_head;
+    uint32_t tail = __atomic_load_n(sink->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe * cqe = &sink->cqes[head & sink->cq_mask];
+        uint32_t index = (uint32_t)cqe->user_data;
+        job_t * job = &sink->jobs[index];
+
+        if (cqe->res < 0) {
+            job->error = -cqe->res;
+        } else if (cqe->res == 0) {
+            job->error = EIO;
+        } else {
+            job->written += cqe->res;
+        }
+
+        // a short write continues where it stopped
+        if (job->error == 0 && job->written < job->size && ring_submit(sink, index)) continue;
+        if (job->error == 0 && job->written < job->size) job->error = EIO;
+        complete_job(sink, index);
+    }
+    __atomic_store_n(sink->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void event_fd_readable(void * data, int fd, uint32_t events) {
+    frame_sink_t * sink = (frame_sink_t *)data;
+    reap(sink);
+}
+
+// --- frame_sink ---
+
+frame_sink_t * frame_sink_create(const char * path, event_loop_t * loop, frame_sink_done_func_t done, void * data) {
+    frame_sink_t * sink = calloc(1, sizeof (frame_sink_t));
+    if (sink == NULL) {
+        printf("[!] frame_sink: failed to allocate sink\n");
+        return NULL;
+    }
+
+    sink->fd = -1;
+    sink->event_fd = -1;
+    sink->ring_fd = -1;
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->cond, NULL);
+    sink->done = done;
+    sink->data = data;
+    sink->direct = option_flag("WLEXP_RECORD_DIRECT");
+    sink->depth = option_long("WLEXP_RECORD_QUEUE", 8);
+    if (sink->depth < 1) sink->depth = 1;
+    if (sink->depth > MAX_QUEUE) sink->depth = MAX_QUEUE;
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (sink->direct ? O_DIRECT : 0);
+    sink->fd = open(path, flags, 0644);
+    if (sink->fd == -1) {
+        printf("[!] frame_sink: failed to open %s: %s\n", path, strerror(errno));
+        free(sink);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, sink->fd, 0);
+
+    sink->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sink->event_fd == -1) {
+        printf("[!] frame_sink: failed to create eventfd\n");
+        frame_sink_destroy(sink);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, sink->event_fd, 0);
+
+    const char * backend = option_string("WLEXP_RECORD_BACKEND", "io_uring");
+    sink->backend = BACKEND_PWRITE;
+    if (strcmp(backend, "pwrite") != 0) {
+        if (ring_init(sink)) {
+            sink->backend = BACKEND_IO_URING;
+        } else {
+            printf("[!] frame_sink: io_uring unavailable, falling back to pwrite\n");
+            ring_finish(sink);
+        }
+    }
+    if (sink->backend == BACKEND_PWRITE && !pool_init(sink)) {
+        frame_sink_destroy(sink);
+        return NULL;
+    }
+
+    sink->source = event_loop_add_fd(loop, sink->event_fd, EPOLLIN, event_fd_readable, sink);
+    if (sink->source == NULL) {
+        printf("[!] frame_sink: failed to watch eventfd\n");
+        frame_sink_destroy(sink);
+        return NULL;
+    }
+
+    printf("[frame_sink] recording to %s with %s, %u writes in flight%s\n",
+        path, sink->backend == BACKEND_IO_URING ? "io_uring" : "a pwrite thread pool",
+        sink->depth, sink->direct ? ", O_DIRECT" : ""
+    );
+    sink->start_ns = clock_now_ns();
+    return sink;
+}
+
+void frame_sink_destroy(frame_sink_t * sink) {
+    if (sink == NULL) return;
+
+    if (sink->in_flight > 0) frame_sink_flush(sink);
+    if (sink->num_threads > 0) pool_finish(sink);
+    ring_finish(sink);
+
+    if (sink->source != NULL) {
+        double seconds = (clock_now_ns() - sink->start_ns) / 1e9;
+        printf("[frame_sink] %lu frames, %.1f MiB written at %.1f MiB/s, %lu dropped (queue full), %lu failed, up to %u in flight\n",
+            sink->frames, sink->bytes / 1048576.0, seconds > 0 ? sink->bytes / 1048576.0 / seconds : 0,
+            sink->dropped, sink->failed, sink->max_in_flight
+        );
+        printf("[frame_sink] write latency mean %.3f ms, max %.3f ms\n",
+            sink->frames > 0 ? sink->total_write_ns / 1e6 / sink->frames : 0, sink->max_write_ns / 1e6
+        );
+        event_source_remove(sink->source);
+    }
+
+    if (sink->event_fd != -1) {
+        close(sink->event_fd);
+        resource_untrack(RESOURCE_FD, sink->event_fd);
+    }
+    if (sink->fd != -1) {
+        close(sink->fd);
+        resource_untrack(RESOURCE_FD, sink->fd);
+    }
+    pthread_cond_destroy(&sink->cond);
+    pthread_mutex_destroy(&sink->lock);
+    free(sink);
+}
+
+bool frame_sink_set_pool(frame_sink_t * sink, void * base, size_t size) {
+    if (sink->in_flight > 0) frame_sink_flush(sink);
+
+    if (sink->backend == BACKEND_IO_URING && sink->fixed_buffer) {
+        io_uring_register(sink->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        sink->fixed_buffer = false;
+    }
+
+    sink->pool = (uint8_t *)base;
+    sink->pool_size = size;
+    if (sink->backend != BACKEND_IO_URING) return true;
+
+    // pins the pages once instead of on every write
+    struct iovec iov = { .iov_base = base, .iov_len = size };
+    if (io_uring_register(sink->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == -1) {
+        printf("[!] frame_sink: failed to register shm pool (%s), using unregistered writes\n", strerror(errno));
+        return false;
+    }
+    sink->fixed_buffer = true;
+    return true;
+}
+
+bool frame_sink_write(frame_sink_t * sink, size_t pool_offset, size_t size) {
+    if (sink->direct) size = (size + FRAME_SINK_ALIGNMENT - 1) & ~(size_t)(FRAME_SINK_ALIGNMENT - 1);
+    if (pool_offset + size > sink->pool_size) {
+        printf("[!] frame_sink: write outside of the pool\n");
+        sink->failed++;
+        return false;
+    }
+
+    if (sink->in_flight == sink->depth) {
+        sink->dropped++;
+        return false;
+    }
+
+    uint32_t index = 0;
+    while (sink->jobs[index].used) index++;
+
+    job_t * job = &sink->jobs[index];
+    job->used = true;
+    job->pool_offset = pool_offset;
+    job->size = size;
+    job->written = 0;
+    job->file_offset = sink->file_offset;
+    job->submitted_ns = clock_now_ns();
+    job->error = 0;
+
+    if (sink->backend == BACKEND_IO_URING) {
+        if (!ring_submit(sink, index)) {
+            job->used = false;
+            sink->failed++;
+            return false;
+        }
+    } else {
+        pthread_mutex_lock(&sink->lock);
+        sink->pending[(sink->pending_first + sink->pending_count) % MAX_QUEUE] = index;
+        sink->pending_count++;
+        pthread_cond_signal(&sink->cond);
+        pthread_mutex_unlock(&sink->lock);
+    }
+
+    sink->file_offset += size;
+    sink->in_flight++;
+    if (sink->in_flight > sink->max_in_flight) sink->max_in_flight = sink->in_flight;
+    return true;
+}
+
+void frame_sink_flush(frame_sink_t * sink) {
+    struct pollfd fd = { .fd = sink->event_fd, .events = POLLIN };
+    while (sink->in_flight > 0) {
+        if (poll(&fd, 1, -1) == -1 && errno != EINTR) {
+            printf("[!] frame_sink: failed to wait for writes\n");
+            return;
+        }
+        reap(sink);
+    }
+}
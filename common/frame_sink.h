@@ -0,0 +1,51 @@
+#ifndef COMMON_FRAME_SINK_H
+#define COMMON_FRAME_SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <event_loop.h>
+
+// records captured frames to a file without ever blocking the event loop
+//
+// frames are written straight out of the mapped shm pool, appended one after
+// the other. the io_uring backend registers the pool as a fixed buffer and
+// submits WRITE_FIXED requests, falling back to plain WRITE when the pool
+// cannot be registered (e.g. RLIMIT_MEMLOCK). without io_uring (old kernel,
+// disabled by sysctl or seccomp) a small thread pool calls pwrite instead.
+// either way completions are reported through an eventfd on the event loop,
+// and the pool range of a frame may only be reused once its write completed
+//
+// at most WLEXP_RECORD_QUEUE writes are in flight, a frame that does not
+// fit is dropped instead of queued. with WLEXP_RECORD_DIRECT=1 the file is
+// opened with O_DIRECT, which needs every frame to start at a multiple of
+// FRAME_SINK_ALIGNMENT in the pool, and the length of every write is rounded
+// up to it, so the caller has to leave room for that
+//
+// WLEXP_RECORD=path enables it in screencopy_shm, WLEXP_RECORD_BACKEND=pwrite
+// skips io_uring, WLEXP_RECORD_THREADS=2 sets the size of the thread pool
+
+#define FRAME_SINK_ALIGNMENT 4096
+
+typedef struct frame_sink frame_sink_t;
+
+// called on the event loop once the frame at pool_offset was written, or
+// failed to be
+typedef void (*frame_sink_done_func_t)(void * data, size_t pool_offset, bool ok);
+
+frame_sink_t * frame_sink_create(const char * path, event_loop_t * loop, frame_sink_done_func_t done, void * data);
+// waits for all pending writes, then prints throughput and drop counts
+void frame_sink_destroy(frame_sink_t * sink);
+
+// the pool was (re)mapped, waits for pending writes first
+bool frame_sink_set_pool(frame_sink_t * sink, void * base, size_t size);
+
+// queues a write of size bytes at pool_offset, false if the queue is full
+// and the frame was dropped
+bool frame_sink_write(frame_sink_t * sink, size_t pool_offset, size_t size);
+
+// blocks until every pending write completed, e.g. before the pool is
+// remapped, completions are delivered before it returns
+void frame_sink_flush(frame_sink_t * sink);
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include <clock.h>
+#include <frame_stats.h>
+
+void frame_stats_init(frame_stats_t * stats) {
+    memset(stats, 0, sizeof *stats);
+}
+
+void frame_stats_begin(frame_stats_t * stats) {
+    if (stats->in_flight == FRAME_STATS_MAX_IN_FLIGHT) {
+        // a request that never completed, forget it
+        frame_stats_cancel(stats);
+    }
+
+    size_t slot = (stats->in_flight_first + stats->in_flight) % FRAME_STATS_MAX_IN_FLIGHT;
+    stats->requested_ns[slot] = clock_now_ns();
+    stats->in_flight++;
+}
+
+void frame_stats_end(frame_stats_t * stats) {
+    if (stats->in_flight == 0) return;
+
+    uint64_t now_ns = clock_now_ns();
+    uint64_t requested_ns = stats->requested_ns[stats->in_flight_first];
+    stats->in_flight_first = (stats->in_flight_first + 1) % FRAME_STATS_MAX_IN_FLIGHT;
+    stats->in_flight--;
+
+    stats->latency_ns[stats->next] = now_ns - requested_ns;
+    stats->presented_ns[stats->next] = now_ns;
+    stats->next = (stats->next + 1) % FRAME_STATS_SAMPLES;
+    if (stats->count < FRAME_STATS_SAMPLES) stats->count++;
+    stats->frames++;
+}
+
+void frame_stats_cancel(frame_stats_t * stats) {
+    if (stats->in_flight == 0) return;
+
+    stats->in_flight_first = (stats->in_flight_first + 1) % FRAME_STATS_MAX_IN_FLIGHT;
+    stats->in_flight--;
+    stats->cancelled++;
+}
+
+double frame_stats_fps(const frame_stats_t * stats) {
+    if (stats->count == 0) return 0;
+
+    uint64_t now_ns = clock_now_ns();
+    size_t frames = 0;
+    for (size_t i = 0; i < stats->count; i++) {
+        size_t index = (stats->next + FRAME_STATS_SAMPLES - 1 - i) % FRAME_STATS_SAMPLES;
+        if (now_ns - stats->presented_ns[index] > 1000000000) break;
+        frames++;
+    }
+
+    return frames;
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void frame_stats_percentiles(const frame_stats_t * stats, const double * percentiles, uint64_t * out, size_t count) {
+    if (stats->count == 0) {
+        for (size_t i = 0; i < count; i++) out[i] = 0;
+        return;
+    }
+
+    uint64_t sorted[FRAME_STATS_SAMPLES];
+    memcpy(sorted, stats->latency_ns, stats->count * sizeof *sorted);
+    qsort(sorted, stats->count, sizeof *sorted, compare_u64);
+
+    for (size_t i = 0; i < count; i++) {
+        // nearest rank
+        size_t rank = (size_t)(percentiles[i] / 100.0 * stats->count + 0.5);
+        if (rank > 0) rank--;
+        if (rank >= stats->count) rank = stats->count - 1;
+        out[i] = sorted[rank];
+    }
+}
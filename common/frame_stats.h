@@ -0,0 +1,47 @@
+#ifndef COMMON_FRAME_STATS_H
+#define COMMON_FRAME_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// rolling frame rate and latency statistics of a capture client, latency
+// being the time from requesting a capture to having presented it
+//
+// only the last FRAME_STATS_SAMPLES frames are kept, percentiles are
+// computed on demand, so adding a frame is constant time
+
+#define FRAME_STATS_SAMPLES 256
+#define FRAME_STATS_MAX_IN_FLIGHT 8
+
+typedef struct {
+    uint64_t requested_ns[FRAME_STATS_MAX_IN_FLIGHT];
+    size_t in_flight_first;
+    size_t in_flight;
+
+    uint64_t latency_ns[FRAME_STATS_SAMPLES];
+    uint64_t presented_ns[FRAME_STATS_SAMPLES];
+    size_t next;
+    size_t count;
+
+    uint64_t frames;
+    uint64_t cancelled;
+} frame_stats_t;
+
+void frame_stats_init(frame_stats_t * stats);
+
+// a capture was requested
+void frame_stats_begin(frame_stats_t * stats);
+
+// the oldest requested capture was presented
+void frame_stats_end(frame_stats_t * stats);
+
+// the oldest requested capture failed or was cancelled
+void frame_stats_cancel(frame_stats_t * stats);
+
+// frames presented during the last second
+double frame_stats_fps(const frame_stats_t * stats);
+
+// fills out[i] with the percentile[i] latency (0-100) in nanoseconds
+void frame_stats_percentiles(const frame_stats_t * stats, const double * percentiles, uint64_t * out, size_t count);
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <options.h>
+#include <clock.h>
+#include <gpu_timer.h>
+
+#ifndef GL_QUERY_RESULT_EXT
+#define GL_QUERY_RESULT_EXT 0x8866
+#endif
+
+static const char * stage_names[GPU_TIMER_STAGE_COUNT] = {
+    [GPU_TIMER_STAGE_UPLOAD] = "upload",
+    [GPU_TIMER_STAGE_DRAW] = "draw",
+    [GPU_TIMER_STAGE_HUD] = "hud",
+    [GPU_TIMER_STAGE_SWAP] = "swap"
+};
+
+static bool has_gl_extension(const char * name) {
+    const char * extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if (extensions == NULL) return false;
+
+    size_t length = strlen(name);
+    const char * pos = extensions;
+    while ((pos = strstr(pos, name)) != NULL) {
+        bool start = pos == extensions || pos[-1] == ' ';
+        bool end = pos[length] == ' ' || pos[length] == '\0';
+        if (start && end) return true;
+        pos += length;
+    }
+
+    return false;
+}
+
+static void add_sample(gpu_timer_t * timer, gpu_timer_stage_t stage, uint64_t ns) {
+    gpu_timer_total_t * total = &timer->totals[stage];
+    if (total->count == 0 || ns < total->min_ns) total->min_ns = ns;
+    if (ns > total->max_ns) total->max_ns = ns;
+    total->total_ns += ns;
+    total->count++;
+}
+
+void gpu_timer_init(gpu_timer_t * timer) {
+    memset(timer, 0, sizeof *timer);
+    timer->enabled = option_flag("WLEXP_GPU_TIMER");
+    if (!timer->enabled) return;
+
+    if (has_gl_extension("GL_EXT_disjoint_timer_query")) {
+        timer->glGenQueriesEXT = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress("glGenQueriesEXT");
+        timer->glDeleteQueriesEXT = (PFNGLDELETEQUERIESEXTPROC)eglGetProcAddress("glDeleteQueriesEXT");
+        timer->glBeginQueryEXT = (PFNGLBEGINQUERYEXTPROC)eglGetProcAddress("glBeginQueryEXT");
+        timer->glEndQueryEXT = (PFNGLENDQUERYEXTPROC)eglGetProcAddress("glEndQueryEXT");
+        timer->glGetQueryObjectuivEXT = (PFNGLGETQUERYOBJECTUIVEXTPROC)eglGetProcAddress("glGetQueryObjectuivEXT");
+        timer->glGetQueryObjectui64vEXT = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+
+        timer->use_queries =
+            timer->glGenQueriesEXT != NULL && timer->glDeleteQueriesEXT != NULL &&
+            timer->glBeginQueryEXT != NULL && timer->glEndQueryEXT != NULL &&
+            timer->glGetQueryObjectuivEXT != NULL && timer->glGetQueryObjectui64vEXT != NULL;
+    }
+
+    if (timer->use_queries) {
+        printf("[gpu_timer] using GL_EXT_disjoint_timer_query, results delayed by %d frames\n", GPU_TIMER_FRAMES);
+        for (size_t i = 0; i < GPU_TIMER_FRAMES; i++) {
+            timer->glGenQueriesEXT(GPU_TIMER_STAGE_COUNT, timer->slots[i].queries);
+        }
+
+        // reading GL_GPU_DISJOINT_EXT resets it, start from a clean state
+        GLint disjoint;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    } else {
+        printf("[gpu_timer] no GL_EXT_disjoint_timer_query, falling back to glFinish timing\n");
+    }
+}
+
+void gpu_timer_destroy(gpu_timer_t * timer) {
+    if (!timer->enabled) return;
+
+    if (timer->use_queries) {
+        for (size_t i = 0; i < GPU_TIMER_FRAMES; i++) {
+            timer->glDeleteQueriesEXT(GPU_TIMER_STAGE_COUNT, timer->slots[i].queries);
+        }
+    }
+
+    timer->enabled = false;
+}
+
+static bool slot_available(gpu_timer_t * timer, gpu_timer_slot_t * slot) {
+    for (size_t stage = 0; stage < GPU_TIMER_STAGE_COUNT; stage++) {
+        if (!slot->used[stage]) continue;
+
+        GLuint available = GL_FALSE;
+        timer->glGetQueryObjectuivEXT(slot->queries[stage], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (available != GL_TRUE) return false;
+    }
+
+    return true;
+}
+
+static void read_slot(gpu_timer_t * timer, gpu_timer_slot_t * slot) {
+    uint64_t ns[GPU_TIMER_STAGE_COUNT] = { 0 };
+    for (size_t stage = 0; stage < GPU_TIMER_STAGE_COUNT; stage++) {
+        if (!slot->used[stage]) continue;
+
+        GLuint64 elapsed = 0;
+        timer->glGetQueryObjectui64vEXT(slot->queries[stage], GL_QUERY_RESULT_EXT, &elapsed);
+        ns[stage] = elapsed;
+        add_sample(timer, stage, elapsed);
+    }
+
+    printf("[gpu_timer] frame %lu: upload %.3f ms, draw %.3f ms, hud %.3f ms, swap %.3f ms (gpu)\n",
+        slot->frame, ns[GPU_TIMER_STAGE_UPLOAD] / 1e6, ns[GPU_TIMER_STAGE_DRAW] / 1e6,
+        ns[GPU_TIMER_STAGE_HUD] / 1e6, ns[GPU_TIMER_STAGE_SWAP] / 1e6
+    );
+}
+
+void gpu_timer_begin_frame(gpu_timer_t * timer) {
+    if (!timer->enabled) return;
+
+    if (timer->use_queries) {
+        bool available[GPU_TIMER_FRAMES] = { false };
+        bool any_available = false;
+        for (size_t i = 0; i < GPU_TIMER_FRAMES; i++) {
+            if (!timer->slots[i].pending) continue;
+            available[i] = slot_available(timer, &timer->slots[i]);
+            any_available = any_available || available[i];
+        }
+
+        // reading GL_GPU_DISJOINT_EXT resets it, so it is read once per pass,
+        // after the availability checks. a disjoint event (e.g. a GPU
+        // frequency change) since the last pass may have hit any query that
+        // was in flight, which makes all of them meaningless
+        GLint disjoint = GL_FALSE;
+        if (any_available) glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        if (disjoint) {
+            for (size_t i = 0; i < GPU_TIMER_FRAMES; i++) {
+                if (!timer->slots[i].pending) continue;
+                timer->slots[i].pending = false;
+                timer->frames_disjoint++;
+            }
+        }
+
+        // collect every slot that already has results, oldest first
+        for (size_t i = 1; i <= GPU_TIMER_FRAMES; i++) {
+            size_t index = (timer->frame + i) % GPU_TIMER_FRAMES;
+            gpu_timer_slot_t * slot = &timer->slots[index];
+            if (!slot->pending || !available[index]) continue;
+            read_slot(timer, slot);
+            slot->pending = false;
+        }
+
+        // the slot about to be reused is still in flight, drop it instead of waiting
+        timer->current = &timer->slots[timer->frame % GPU_TIMER_FRAMES];
+        if (timer->current->pending) {
+            timer->frames_dropped++;
+        }
+
+        memset(timer->current->used, 0, sizeof timer->current->used);
+        timer->current->pending = false;
+        timer->current->frame = timer->frame;
+    }
+
+    timer->frame++;
+}
+
+void gpu_timer_begin_stage(gpu_timer_t * timer, gpu_timer_stage_t stage) {
+    if (!timer->enabled) return;
+    if (timer->stage_active) gpu_timer_end_stage(timer);
+
+    timer->active_stage = stage;
+    timer->stage_active = true;
+
+    if (timer->use_queries) {
+        if (timer->current == NULL) return;
+        timer->glBeginQueryEXT(GL_TIME_ELAPSED_EXT, timer->current->queries[stage]);
+        timer->current->used[stage] = true;
+    } else {
+        glFinish();
+        timer->stage_start_ns = clock_now_ns();
+    }
+}
+
+void gpu_timer_end_stage(gpu_timer_t * timer) {
+    if (!timer->enabled) return;
+    if (!timer->stage_active) return;
+    timer->stage_active = false;
+
+    if (timer->use_queries) {
+        if (timer->current == NULL) return;
+        timer->glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+        timer->current->pending = true;
+    } else {
+        glFinish();
+        uint64_t ns = clock_now_ns() - timer->stage_start_ns;
+        add_sample(timer, timer->active_stage, ns);
+        printf("[gpu_timer] frame %lu: %s %.3f ms (glFinish)\n", timer->frame - 1, stage_names[timer->active_stage], ns / 1e6);
+    }
+}
+
+double gpu_timer_frame_mean_ns(const gpu_timer_t * timer) {
+    if (!timer->enabled) return 0;
+
+    double mean_ns = 0;
+    for (size_t stage = 0; stage < GPU_TIMER_STAGE_COUNT; stage++) {
+        const gpu_timer_total_t * total = &timer->totals[stage];
+        if (total->count > 0) mean_ns += (double)total->total_ns / total->count;
+    }
+    return mean_ns;
+}
+
+void gpu_timer_report(gpu_timer_t * timer) {
+    if (!timer->enabled) return;
+
+    printf("[gpu_timer] summary (%s):\n", timer->use_queries ? "timer queries" : "glFinish");
+    for (size_t stage = 0; stage < GPU_TIMER_STAGE_COUNT; stage++) {
+        gpu_timer_total_t * total = &timer->totals[stage];
+        if (total->count == 0) {
+            printf("[gpu_timer]   %-6s no samples\n", stage_names[stage]);
+            continue;
+        }
+
+        printf("[gpu_timer]   %-6s n=%lu avg %.3f ms, min %.3f ms, max %.3f ms\n",
+            stage_names[stage], total->count,
+            total->total_ns / 1e6 / total->count, total->min_ns / 1e6, total->max_ns / 1e6
+        );
+    }
+
+    if (timer->use_queries) {
+        printf("[gpu_timer]   dropped %lu frames (results not ready), %lu disjoint\n", timer->frames_dropped, timer->frames_disjoint);
+    }
+}
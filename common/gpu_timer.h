@@ -0,0 +1,83 @@
+#ifndef COMMON_GPU_TIMER_H
+#define COMMON_GPU_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+// GPU-side timing of the import/upload, draw, HUD overlay and swap stages of
+// the EGL clients, using GL_EXT_disjoint_timer_query where available
+//
+// query results are read back GPU_TIMER_FRAMES frames later, and only if they
+// are already available, so timing never stalls the pipeline. without the
+// extension (e.g. llvmpipe), the timer falls back to bracketing each stage
+// with glFinish and measuring CPU time, which does stall, but still gives
+// numbers on software renderers
+
+#define GPU_TIMER_FRAMES 4
+
+typedef enum {
+    GPU_TIMER_STAGE_UPLOAD,
+    GPU_TIMER_STAGE_DRAW,
+    // only used with WLEXP_HUD, so the overlay does not count as drawing
+    GPU_TIMER_STAGE_HUD,
+    GPU_TIMER_STAGE_SWAP,
+    GPU_TIMER_STAGE_COUNT
+} gpu_timer_stage_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+} gpu_timer_total_t;
+
+typedef struct {
+    GLuint queries[GPU_TIMER_STAGE_COUNT];
+    bool used[GPU_TIMER_STAGE_COUNT];
+    bool pending;
+    uint64_t frame;
+} gpu_timer_slot_t;
+
+typedef struct {
+    bool enabled;
+    bool use_queries;
+
+    PFNGLGENQUERIESEXTPROC glGenQueriesEXT;
+    PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT;
+    PFNGLBEGINQUERYEXTPROC glBeginQueryEXT;
+    PFNGLENDQUERYEXTPROC glEndQueryEXT;
+    PFNGLGETQUERYOBJECTUIVEXTPROC glGetQueryObjectuivEXT;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+
+    gpu_timer_slot_t slots[GPU_TIMER_FRAMES];
+    gpu_timer_slot_t * current;
+    uint64_t frame;
+
+    gpu_timer_stage_t active_stage;
+    bool stage_active;
+    uint64_t stage_start_ns;
+
+    gpu_timer_total_t totals[GPU_TIMER_STAGE_COUNT];
+    uint64_t frames_dropped;
+    uint64_t frames_disjoint;
+} gpu_timer_t;
+
+// enabled with WLEXP_GPU_TIMER=1, needs a current GL context
+void gpu_timer_init(gpu_timer_t * timer);
+void gpu_timer_destroy(gpu_timer_t * timer);
+
+// collects finished results of earlier frames, then starts a new frame
+void gpu_timer_begin_frame(gpu_timer_t * timer);
+
+// stages of a frame must not overlap
+void gpu_timer_begin_stage(gpu_timer_t * timer, gpu_timer_stage_t stage);
+void gpu_timer_end_stage(gpu_timer_t * timer);
+
+// mean time of a frame over all stages, 0 without samples
+double gpu_timer_frame_mean_ns(const gpu_timer_t * timer);
+
+void gpu_timer_report(gpu_timer_t * timer);
+
+#endif
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <options.h>
+#include <clock.h>
+#include <resources.h>
+#include <hud.h>
+
+#define HUD_FONT_FIRST ' '
+#define HUD_FONT_LAST '_'
+#define HUD_GLYPH_WIDTH 5
+#define HUD_GLYPH_HEIGHT 7
+#define HUD_CELL_WIDTH (HUD_GLYPH_WIDTH + 1)
+#define HUD_CELL_HEIGHT (HUD_GLYPH_HEIGHT + 2)
+#define HUD_PADDING 3
+
+// one byte per column, least significant bit at the top
+static const uint8_t font[HUD_FONT_LAST - HUD_FONT_FIRST + 1][HUD_GLYPH_WIDTH] = {
+    [' ' - HUD_FONT_FIRST] = { 0x00, 0x00, 0x00, 0x00, 0x00 },
+    ['%' - HUD_FONT_FIRST] = { 0x23, 0x13, 0x08, 0x64, 0x62 },
+    ['(' - HUD_FONT_FIRST] = { 0x00, 0x1c, 0x22, 0x41, 0x00 },
+    [')' - HUD_FONT_FIRST] = { 0x00, 0x41, 0x22, 0x1c, 0x00 },
+    ['+' - HUD_FONT_FIRST] = { 0x08, 0x08, 0x3e, 0x08, 0x08 },
+    [',' - HUD_FONT_FIRST] = { 0x00, 0x50, 0x30, 0x00, 0x00 },
+    ['-' - HUD_FONT_FIRST] = { 0x08, 0x08, 0x08, 0x08, 0x08 },
+    ['.' - HUD_FONT_FIRST] = { 0x00, 0x60, 0x60, 0x00, 0x00 },
+    ['/' - HUD_FONT_FIRST] = { 0x20, 0x10, 0x08, 0x04, 0x02 },
+    ['0' - HUD_FONT_FIRST] = { 0x3e, 0x51, 0x49, 0x45, 0x3e },
+    ['1' - HUD_FONT_FIRST] = { 0x00, 0x42, 0x7f, 0x40, 0x00 },
+    ['2' - HUD_FONT_FIRST] = { 0x42, 0x61, 0x51, 0x49, 0x46 },
+    ['3' - HUD_FONT_FIRST] = { 0x21, 0x41, 0x45, 0x4b, 0x31 },
+    ['4' - HUD_FONT_FIRST] = { 0x18, 0x14, 0x12, 0x7f, 0x10 },
+    ['5' - HUD_FONT_FIRST] = { 0x27, 0x45, 0x45, 0x45, 0x39 },
+    ['6' - HUD_FONT_FIRST] = { 0x3c, 0x4a, 0x49, 0x49, 0x30 },
+    ['7' - HUD_FONT_FIRST] = { 0x01, 0x71, 0x09, 0x05, 0x03 },
+    ['8' - HUD_FONT_FIRST] = { 0x36, 0x49, 0x49, 0x49, 0x36 },
+    ['9' - HUD_FONT_FIRST] = { 0x06, 0x49, 0x49, 0x29, 0x1e },
+    [':' - HUD_FONT_FIRST] = { 0x00, 0x36, 0x36, 0x00, 0x00 },
+    ['=' - HUD_FONT_FIRST] = { 0x14, 0x14, 0x14, 0x14, 0x14 },
+    ['@' - HUD_FONT_FIRST] = { 0x32, 0x49, 0x79, 0x41, 0x3e },
+    ['A' - HUD_FONT_FIRST] = { 0x7e, 0x11, 0x11, 0x11, 0x7e },
+    ['B' - HUD_FONT_FIRST] = { 0x7f, 0x49, 0x49, 0x49, 0x36 },
+    ['C' - HUD_FONT_FIRST] = { 0x3e, 0x41, 0x41, 0x41, 0x22 },
+    ['D' - HUD_FONT_FIRST] = { 0x7f, 0x41, 0x41, 0x22, 0x1c },
+    ['E' - HUD_FONT_FIRST] = { 0x7f, 0x49, 0x49, 0x49, 0x41 },
+    ['F' - HUD_FONT_FIRST] = { 0x7f, 0x09, 0x09, 0x01, 0x01 },
+    ['G' - HUD_FONT_FIRST] = { 0x3e, 0x41, 0x41, 0x51, 0x32 },
+    ['H' - HUD_FONT_FIRST] = { 0x7f, 0x08, 0x08, 0x08, 0x7f },
+    ['I' - HUD_FONT_FIRST] = { 0x00, 0x41, 0x7f, 0x41, 0x00 },
+    ['J' - HUD_FONT_FIRST] = { 0x20, 0x40, 0x41, 0x3f, 0x01 },
+    ['K' - HUD_FONT_FIRST] = { 0x7f, 0x08, 0x14, 0x22, 0x41 },
+    ['L' - HUD_FONT_FIRST] = { 0x7f, 0x40, 0x40, 0x40, 0x40 },
+    ['M' - HUD_FONT_FIRST] = { 0x7f, 0x02, 0x04, 0x02, 0x7f },
+    ['N' - HUD_FONT_FIRST] = { 0x7f, 0x04, 0x08, 0x10, 0x7f },
+    ['O' - HUD_FONT_FIRST] = { 0x3e, 0x41, 0x41, 0x41, 0x3e },
+    ['P' - HUD_FONT_FIRST] = { 0x7f, 0x09, 0x09, 0x09, 0x06 },
+    ['Q' - HUD_FONT_FIRST] = { 0x3e, 0x41, 0x51, 0x21, 0x5e },
+    ['R' - HUD_FONT_FIRST] = { 0x7f, 0x09, 0x19, 0x29, 0x46 },
+    ['S' - HUD_FONT_FIRST] = { 0x46, 0x49, 0x49, 0x49, 0x31 },
+    ['T' - HUD_FONT_FIRST] = { 0x01, 0x01, 0x7f, 0x01, 0x01 },
+    ['U' - HUD_FONT_FIRST] = { 0x3f, 0x40, 0x40, 0x40, 0x3f },
+    ['V' - HUD_FONT_FIRST] = { 0x1f, 0x20, 0x40, 0x20, 0x1f },
+    ['W' - HUD_FONT_FIRST] = { 0x7f, 0x20, 0x18, 0x20, 0x7f },
+    ['X' - HUD_FONT_FIRST] = { 0x63, 0x14, 0x08, 0x14, 0x63 },
+    ['Y' - HUD_FONT_FIRST] = { 0x03, 0x04, 0x78, 0x04, 0x03 },
+    ['Z' - HUD_FONT_FIRST] = { 0x61, 0x51, 0x49, 0x45, 0x43 },
+    ['_' - HUD_FONT_FIRST] = { 0x40, 0x40, 0x40, 0x40, 0x40 },
+};
+
+static const uint8_t text_color[4] = { 0xff, 0xff, 0xff, 0xff };
+static const uint8_t background_color[4] = { 0x18, 0x18, 0x18, 0xff };
+
+static void bind_layout(void) {
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof (float), (void *)(0 * sizeof (float)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof (float), (void *)(2 * sizeof (float)));
+}
+
+void hud_init(hud_t * hud) {
+    memset(hud, 0, sizeof *hud);
+    hud->enabled = option_flag("WLEXP_HUD");
+    if (!hud->enabled) return;
+
+    hud->width = 2 * HUD_PADDING + HUD_COLUMNS * HUD_CELL_WIDTH;
+    hud->height = 2 * HUD_PADDING + HUD_LINES * HUD_CELL_HEIGHT;
+    hud->pixels = malloc(hud->width * hud->height * 4);
+    if (hud->pixels == NULL) {
+        printf("[hud] failed to allocate HUD pixels, HUD disabled\n");
+        hud->enabled = false;
+        return;
+    }
+
+    GLint previous_texture;
+    GLint previous_buffer;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous_buffer);
+
+    glGenTextures(1, &hud->texture);
+    resource_track(RESOURCE_GL_TEXTURE, hud->texture, hud->width * hud->height * 4);
+    glBindTexture(GL_TEXTURE_2D, hud->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, hud->width, hud->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glGenBuffers(1, &hud->vbo);
+    resource_track(RESOURCE_GL_BUFFER, hud->vbo, 6 * 4 * sizeof (float));
+    glBindBuffer(GL_ARRAY_BUFFER, hud->vbo);
+    glBufferData(GL_ARRAY_BUFFER, 6 * 4 * sizeof (float), NULL, GL_DYNAMIC_DRAW);
+
+    glBindTexture(GL_TEXTURE_2D, previous_texture);
+    glBindBuffer(GL_ARRAY_BUFFER, previous_buffer);
+
+    hud->dirty = true;
+    printf("[hud] HUD enabled\n");
+}
+
+void hud_destroy(hud_t * hud) {
+    if (!hud->enabled) return;
+
+    glDeleteTextures(1, &hud->texture);
+    resource_untrack(RESOURCE_GL_TEXTURE, hud->texture);
+    glDeleteBuffers(1, &hud->vbo);
+    resource_untrack(RESOURCE_GL_BUFFER, hud->vbo);
+    free(hud->pixels);
+
+    hud->enabled = false;
+}
+
+bool hud_update_due(hud_t * hud) {
+    if (!hud->enabled) return false;
+
+    uint64_t now_ns = clock_now_ns();
+    if (hud->last_update_ns != 0 && now_ns - hud->last_update_ns < HUD_UPDATE_INTERVAL_NS) return false;
+
+    hud->last_update_ns = now_ns;
+    return true;
+}
+
+void hud_set_line(hud_t * hud, int line, const char * format, ...) {
+    if (!hud->enabled || line < 0 || line >= HUD_LINES) return;
+
+    char text[HUD_COLUMNS + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof text, format, args);
+    va_end(args);
+
+    if (strcmp(text, hud->lines[line]) == 0) return;
+
+    memcpy(hud->lines[line], text, sizeof text);
+    hud->dirty = true;
+}
+
+static void fill(hud_t * hud, uint32_t x, uint32_t y, const uint8_t color[4]) {
+    memcpy(&hud->pixels[(y * hud->width + x) * 4], color, 4);
+}
+
+static void rasterize(hud_t * hud) {
+    for (uint32_t y = 0; y < hud->height; y++) {
+        for (uint32_t x = 0; x < hud->width; x++) fill(hud, x, y, background_color);
+    }
+
+    uint32_t columns = 0;
+    for (int line = 0; line < HUD_LINES; line++) {
+        uint32_t length = strlen(hud->lines[line]);
+        if (length > columns) columns = length;
+
+        for (uint32_t column = 0; column < length; column++) {
+            char c = hud->lines[line][column];
+            if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+            if (c < HUD_FONT_FIRST || c > HUD_FONT_LAST) continue;
+
+            const uint8_t * glyph = font[c - HUD_FONT_FIRST];
+            uint32_t origin_x = HUD_PADDING + column * HUD_CELL_WIDTH;
+            uint32_t origin_y = HUD_PADDING + line * HUD_CELL_HEIGHT;
+            for (uint32_t x = 0; x < HUD_GLYPH_WIDTH; x++) {
+                for (uint32_t y = 0; y < HUD_GLYPH_HEIGHT; y++) {
+                    if (glyph[x] & (1 << y)) fill(hud, origin_x + x, origin_y + y, text_color);
+                }
+            }
+        }
+    }
+
+    hud->columns = columns;
+}
+
+static void update_quad(hud_t * hud, uint32_t viewport_width, uint32_t viewport_height) {
+    // only the used part of the texture, anchored to the top left corner
+    uint32_t used_width = hud->columns == 0 ? 0 : 2 * HUD_PADDING + hud->columns * HUD_CELL_WIDTH;
+    float s = (float)used_width / hud->width;
+    float x0 = -1.0;
+    float y0 = 1.0;
+    float x1 = x0 + 2.0 * used_width * HUD_SCALE / viewport_width;
+    float y1 = y0 - 2.0 * hud->height * HUD_SCALE / viewport_height;
+
+    const float vertices[] = {
+        x0, y1, 0.0, 1.0,
+        x1, y1, s,   1.0,
+        x0, y0, 0.0, 0.0,
+        x0, y0, 0.0, 0.0,
+        x1, y1, s,   1.0,
+        x1, y0, s,   0.0
+    };
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof vertices, vertices);
+}
+
+void hud_draw(hud_t * hud, uint32_t viewport_width, uint32_t viewport_height) {
+    if (!hud->enabled || viewport_width == 0 || viewport_height == 0) return;
+
+    GLint previous_texture;
+    GLint previous_buffer;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous_buffer);
+
+    glBindTexture(GL_TEXTURE_2D, hud->texture);
+    glBindBuffer(GL_ARRAY_BUFFER, hud->vbo);
+
+    bool resized = viewport_width != hud->viewport_width || viewport_height != hud->viewport_height;
+    if (hud->dirty) {
+        rasterize(hud);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, hud->width, hud->height, GL_RGBA, GL_UNSIGNED_BYTE, hud->pixels);
+    }
+    if (hud->dirty || resized) {
+        update_quad(hud, viewport_width, viewport_height);
+        hud->dirty = false;
+        hud->viewport_width = viewport_width;
+        hud->viewport_height = viewport_height;
+    }
+
+    bind_layout();
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    glBindTexture(GL_TEXTURE_2D, previous_texture);
+    glBindBuffer(GL_ARRAY_BUFFER, previous_buffer);
+    bind_layout();
+}
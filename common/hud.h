@@ -0,0 +1,57 @@
+#ifndef COMMON_HUD_H
+#define COMMON_HUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <GLES2/gl2.h>
+
+// text overlay for the EGL clients, enabled with WLEXP_HUD=1
+//
+// the text is rasterized on the CPU from a built-in 5x7 bitmap font into a
+// small texture, and only when a line actually changed; every other frame
+// the HUD costs one textured quad drawn with the client's own shader program,
+// which must take an interleaved vec2 position and vec2 texcoord like the
+// program of the EGL clients
+//
+// lowercase letters are drawn as uppercase, characters missing from the
+// font as blanks
+
+#define HUD_LINES 6
+#define HUD_COLUMNS 48
+#define HUD_SCALE 2
+#define HUD_UPDATE_INTERVAL_NS 250000000
+
+typedef struct {
+    bool enabled;
+    GLuint texture;
+    GLuint vbo;
+
+    uint8_t * pixels;
+    uint32_t width;
+    uint32_t height;
+
+    char lines[HUD_LINES][HUD_COLUMNS + 1];
+    uint32_t columns;
+    bool dirty;
+    uint64_t last_update_ns;
+    uint32_t viewport_width;
+    uint32_t viewport_height;
+} hud_t;
+
+// needs the client's GL context to be current
+void hud_init(hud_t * hud);
+void hud_destroy(hud_t * hud);
+
+// rate limits changing values (e.g. FPS) so the text is not re-rasterized
+// every frame, returns true at most once per HUD_UPDATE_INTERVAL_NS
+bool hud_update_due(hud_t * hud);
+
+// printf-style, only marks the HUD dirty if the text of the line changed
+void hud_set_line(hud_t * hud, int line, const char * format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// draws the HUD into the top left corner of the current viewport, restores
+// the bound texture and vertex buffer afterwards
+void hud_draw(hud_t * hud, uint32_t viewport_width, uint32_t viewport_height);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <options.h>
+#include <clock.h>
+#include <idle_throttle.h>
+
+// weight of the newest frame interval in the moving average
+#define INTERVAL_EWMA_ALPHA 0.1
+
+static void update_interval(idle_throttle_t * throttle, uint64_t interval_ns) {
+    if (interval_ns == 0) return;
+
+    if (throttle->active_interval_ns == 0) {
+        throttle->active_interval_ns = interval_ns;
+    } else {
+        throttle->active_interval_ns += INTERVAL_EWMA_ALPHA * (interval_ns - throttle->active_interval_ns);
+    }
+}
+
+static uint64_t avoided_captures(const idle_throttle_t * throttle, uint64_t idle_ns, uint64_t captures) {
+    if (throttle->active_interval_ns == 0) return 0;
+
+    // what the rate before the idle period would have captured meanwhile
+    uint64_t expected = (uint64_t)(idle_ns / throttle->active_interval_ns);
+    return expected > captures ? expected - captures : 0;
+}
+
+static void end_idle(idle_throttle_t * throttle, uint64_t idle_ns) {
+    throttle->total_idle_ns += idle_ns;
+    throttle->avoided_captures += avoided_captures(throttle, idle_ns, throttle->idle_frames);
+    throttle->idle_frames = 0;
+}
+
+static void timer_expired(void * data, uint64_t expirations) {
+    idle_throttle_t * throttle = (idle_throttle_t *)data;
+    throttle->capture(throttle->data);
+}
+
+bool idle_throttle_init(idle_throttle_t * throttle, event_loop_t * loop, idle_throttle_func_t capture, void * data) {
+    throttle->capture = capture;
+    throttle->data = data;
+    throttle->idle_after_ns = option_long("WLEXP_IDLE_AFTER_MS", 500) * 1000000;
+    throttle->poll_ns = option_long("WLEXP_IDLE_POLL_MS", 250) * 1000000;
+
+    throttle->idle = false;
+    throttle->idle_since_ns = 0;
+    throttle->last_change_ns = clock_now_ns();
+    throttle->last_frame_ns = 0;
+    throttle->active_interval_ns = 0;
+    throttle->idle_frames = 0;
+    throttle->process_start_ns = 0;
+
+    throttle->changed = 0;
+    throttle->unchanged = 0;
+    throttle->processed = 0;
+    throttle->idle_periods = 0;
+    throttle->total_idle_ns = 0;
+    throttle->idle_captures = 0;
+    throttle->avoided_captures = 0;
+    throttle->process_cpu_ns = 0;
+
+    throttle->timer = event_loop_add_timer(loop, timer_expired, throttle);
+    return throttle->timer != NULL;
+}
+
+void idle_throttle_finish(idle_throttle_t * throttle) {
+    event_source_remove(throttle->timer);
+    throttle->timer = NULL;
+}
+
+bool idle_throttle_frame(idle_throttle_t * throttle, bool changed) {
+    uint64_t now_ns = clock_now_ns();
+    uint64_t gap_ns = throttle->last_frame_ns != 0 ? now_ns - throttle->last_frame_ns : 0;
+    throttle->last_frame_ns = now_ns;
+
+    if (!changed) {
+        throttle->unchanged++;
+        if (throttle->idle) {
+            throttle->idle_frames++;
+            throttle->idle_captures++;
+        } else if (now_ns - throttle->last_change_ns >= throttle->idle_after_ns) {
+            printf("[idle] no change for %.3f ms, polling every %.3f ms\n",
+                (now_ns - throttle->last_change_ns) / 1e6, throttle->poll_ns / 1e6
+            );
+            throttle->idle = true;
+            throttle->idle_since_ns = now_ns;
+            throttle->idle_periods++;
+        } else {
+            update_interval(throttle, gap_ns);
+        }
+        return false;
+    }
+
+    throttle->changed++;
+    if (throttle->idle) {
+        printf("[idle] changed after %.3f ms idle, back to full rate\n", (now_ns - throttle->idle_since_ns) / 1e6);
+        throttle->idle = false;
+        end_idle(throttle, now_ns - throttle->idle_since_ns);
+    } else if (gap_ns >= throttle->idle_after_ns) {
+        // the compositor held the frame back until something changed
+        throttle->idle_periods++;
+        end_idle(throttle, gap_ns);
+    } else {
+        update_interval(throttle, gap_ns);
+    }
+
+    throttle->last_change_ns = now_ns;
+    return true;
+}
+
+void idle_throttle_begin_processing(idle_throttle_t * throttle) {
+    throttle->process_start_ns = clock_thread_cpu_ns();
+}
+
+void idle_throttle_end_processing(idle_throttle_t * throttle) {
+    throttle->process_cpu_ns += clock_thread_cpu_ns() - throttle->process_start_ns;
+    throttle->processed++;
+}
+
+void idle_throttle_next(idle_throttle_t * throttle) {
+    if (!throttle->idle) {
+        throttle->capture(throttle->data);
+        return;
+    }
+
+    event_source_timer_update(throttle->timer, clock_now_ns() + throttle->poll_ns, 0);
+}
+
+void idle_throttle_report(const idle_throttle_t * throttle, double gpu_frame_ns) {
+    // an idle period still running at exit
+    uint64_t idle_ns = throttle->total_idle_ns;
+    uint64_t avoided = throttle->avoided_captures;
+    if (throttle->idle) {
+        uint64_t current_ns = clock_now_ns() - throttle->idle_since_ns;
+        idle_ns += current_ns;
+        avoided += avoided_captures(throttle, current_ns, throttle->idle_frames);
+    }
+
+    printf("[idle] %lu changed and %lu unchanged frames, %lu idle periods over %.3f s, %lu polls while idle, ~%lu captures avoided\n",
+        throttle->changed, throttle->unchanged, throttle->idle_periods, idle_ns / 1e9,
+        throttle->idle_captures, avoided
+    );
+
+    if (throttle->processed == 0) return;
+
+    // every unchanged or avoided frame would have been processed like the
+    // changed ones
+    uint64_t saved_frames = throttle->unchanged + avoided;
+    double cpu_frame_ns = (double)throttle->process_cpu_ns / throttle->processed;
+    if (gpu_frame_ns > 0) {
+        printf("[idle] processing took %.3f ms CPU and %.3f ms GPU per frame, ~%.1f ms CPU and ~%.1f ms GPU saved\n",
+            cpu_frame_ns / 1e6, gpu_frame_ns / 1e6, saved_frames * cpu_frame_ns / 1e6, saved_frames * gpu_frame_ns / 1e6
+        );
+    } else {
+        printf("[idle] processing took %.3f ms CPU per frame, ~%.1f ms CPU saved\n",
+            cpu_frame_ns / 1e6, saved_frames * cpu_frame_ns / 1e6
+        );
+    }
+}
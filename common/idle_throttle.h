@@ -0,0 +1,71 @@
+#ifndef COMMON_IDLE_THROTTLE_H
+#define COMMON_IDLE_THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <event_loop.h>
+
+// stops capture work while the captured output shows the same picture
+//
+// a frame is unchanged when copy_with_damage reported no damage for it, or
+// when export-dmabuf handed out the same buffer as for the frame before.
+// unchanged frames are not processed at all. after WLEXP_IDLE_AFTER_MS
+// without a change the output is idle, and the next capture is only
+// requested every WLEXP_IDLE_POLL_MS instead of right away; the first
+// changed frame restores the full rate. a compositor may also hold back an
+// undamaged copy_with_damage frame until something changes, a wait that
+// long counts as idle as well
+//
+// the thread CPU time (and GPU time, where measured) of processing changed
+// frames estimates the work saved on unchanged frames and on the captures
+// the idle periods avoided at the rate captured before
+//
+// WLEXP_IDLE=1 enables it in screencopy_shm and export_dmabuf_egl
+
+typedef void (*idle_throttle_func_t)(void * data);
+
+typedef struct {
+    event_source_t * timer;
+    idle_throttle_func_t capture;
+    void * data;
+
+    uint64_t idle_after_ns;
+    uint64_t poll_ns;
+
+    bool idle;
+    uint64_t idle_since_ns;
+    uint64_t last_change_ns;
+    uint64_t last_frame_ns;
+    double active_interval_ns;
+    uint64_t idle_frames;
+    uint64_t process_start_ns;
+
+    uint64_t changed;
+    uint64_t unchanged;
+    uint64_t processed;
+    uint64_t idle_periods;
+    uint64_t total_idle_ns;
+    uint64_t idle_captures;
+    uint64_t avoided_captures;
+    uint64_t process_cpu_ns;
+} idle_throttle_t;
+
+// reads the options and adds a timer to the loop, capture is called whenever
+// the next frame should be requested
+bool idle_throttle_init(idle_throttle_t * throttle, event_loop_t * loop, idle_throttle_func_t capture, void * data);
+void idle_throttle_finish(idle_throttle_t * throttle);
+
+// a frame is ready, returns true if it changed and has to be processed
+bool idle_throttle_frame(idle_throttle_t * throttle, bool changed);
+
+// brackets the processing of a changed frame
+void idle_throttle_begin_processing(idle_throttle_t * throttle);
+void idle_throttle_end_processing(idle_throttle_t * throttle);
+
+// requests the next capture, right away unless the output is idle
+void idle_throttle_next(idle_throttle_t * throttle);
+
+// gpu_frame_ns is the mean GPU time of processing a frame, 0 if unknown
+void idle_throttle_report(const idle_throttle_t * throttle, double gpu_frame_ns);
+
+#endif
@@ -0,0 +1,38 @@
+#include <stdlib.h>
+#include <string.h>
+#include <options.h>
+
+bool option_flag(const char * name) {
+    const char * value = getenv(name);
+    if (value == NULL) return false;
+    if (value[0] == '\0') return false;
+    if (strcmp(value, "0") == 0) return false;
+    if (strcmp(value, "false") == 0) return false;
+    return true;
+}
+
+long option_long(const char * name, long fallback) {
+    const char * value = getenv(name);
+    if (value == NULL || value[0] == '\0') return fallback;
+
+    char * end;
+    long result = strtol(value, &end, 0);
+    if (*end != '\0') return fallback;
+    return result;
+}
+
+double option_double(const char * name, double fallback) {
+    const char * value = getenv(name);
+    if (value == NULL || value[0] == '\0') return fallback;
+
+    char * end;
+    double result = strtod(value, &end);
+    if (*end != '\0') return fallback;
+    return result;
+}
+
+const char * option_string(const char * name, const char * fallback) {
+    const char * value = getenv(name);
+    if (value == NULL || value[0] == '\0') return fallback;
+    return value;
+}
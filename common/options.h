@@ -0,0 +1,21 @@
+#ifndef COMMON_OPTIONS_H
+#define COMMON_OPTIONS_H
+
+#include <stdbool.h>
+
+// experiment options are passed through WLEXP_* environment variables, so the
+// experiments themselves keep their plain `int main(void)` entry points
+
+// true if the variable is set to anything other than "", "0", or "false"
+bool option_flag(const char * name);
+
+// integer value of the variable, or fallback if unset or unparseable
+long option_long(const char * name, long fallback);
+
+// floating point value of the variable, or fallback if unset or unparseable
+double option_double(const char * name, double fallback);
+
+// string value of the variable, or fallback if unset or empty
+const char * option_string(const char * name, const char * fallback);
+
+#endif
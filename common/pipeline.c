@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <clock.h>
+#include <resources.h>
+#include <thread.h>
+#include <pipeline.h>
+
+#define CACHE_LINE_SIZE 64
+#define MAX_STAGE_THREADS 16
+
+// a bounded queue of frame pointers, a NULL entry ends the stream
+//
+// the semaphores count free slots and queued frames, which makes a full or
+// empty queue block and orders the slot accesses between producer and
+// consumer. with a single producer and a single consumer each side just
+// advances its own index. otherwise the indices are claimed atomically, and
+// a per-slot sequence number tells whether the claimed slot was already
+// written (or read) by whoever claimed it one lap earlier
+typedef struct {
+    pipeline_frame_t ** items;
+    uint64_t * sequences;
+    uint32_t capacity;
+    bool shared;
+
+    sem_t free_slots;
+    sem_t queued;
+
+    _Alignas(CACHE_LINE_SIZE) uint64_t head;
+    _Alignas(CACHE_LINE_SIZE) uint64_t tail;
+} queue_t;
+
+struct stage;
+
+typedef struct {
+    // written by the stage thread only, read after it was joined
+    _Alignas(CACHE_LINE_SIZE) uint64_t frames;
+    uint64_t dropped;
+    uint64_t busy_ns;
+    uint64_t queued_ns;
+    uint64_t blocked_ns;
+
+    pthread_t thread;
+    struct stage * stage;
+} stage_thread_t;
+
+typedef struct stage {
+    pipeline_t * pipeline;
+    struct stage * next;
+    char name[32];
+    pipeline_stage_func_t func;
+    void * data;
+
+    uint32_t num_threads;
+    uint32_t num_started;
+    uint32_t running;
+    stage_thread_t * threads;
+    queue_t input;
+} stage_t;
+
+struct pipeline {
+    pipeline_release_func_t release;
+    void * data;
+
+    pipeline_frame_t * frames;
+    uint32_t num_frames;
+    stage_t stages[PIPELINE_MAX_STAGES];
+    uint32_t num_stages;
+    bool started;
+
+    // frames leaving the pipeline, towards the event loop
+    queue_t done;
+    int event_fd;
+    event_source_t * source;
+
+    uint64_t start_ns;
+    uint64_t submitted;
+    uint64_t refused;
+    uint64_t completed;
+    uint64_t dropped;
+    uint64_t total_latency_ns;
+    uint64_t max_latency_ns;
+};
+
+// --- queue ---
+
+static bool queue_init(queue_t * queue, uint32_t capacity, bool shared) {
+    queue->capacity = capacity;
+    queue->shared = shared;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->items = calloc(capacity, sizeof (pipeline_frame_t *));
+    queue->sequences = calloc(capacity, sizeof (uint64_t));
+    if (queue->items == NULL || queue->sequences == NULL) {
+        free(queue->items);
+        free(queue->sequences);
+        queue->items = NULL;
+        queue->sequences = NULL;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < capacity; i++) queue->sequences[i] = i;
+    sem_init(&queue->free_slots, 0, capacity);
+    sem_init(&queue->queued, 0, 0);
+    return true;
+}
+
+static void queue_finish(queue_t * queue) {
+    if (queue->items == NULL) return;
+
+    sem_destroy(&queue->free_slots);
+    sem_destroy(&queue->queued);
+    free(queue->items);
+    free(queue->sequences);
+    queue->items = NULL;
+    queue->sequences = NULL;
+}
+
+static void semaphore_wait(sem_t * semaphore) {
+    while (sem_wait(semaphore) == -1 && errno == EINTR);
+}
+
+// called after a free slot was taken from the semaphore
+static void queue_put(queue_t * queue, pipeline_frame_t * frame) {
+    if (!queue->shared) {
+        queue->items[queue->tail++ % queue->capacity] = frame;
+    } else {
+        uint64_t position = __atomic_fetch_add(&queue->tail, 1, __ATOMIC_RELAXED);
+        uint32_t slot = position % queue->capacity;
+        // the consumer one lap earlier may still be reading the slot
+        while (__atomic_load_n(&queue->sequences[slot], __ATOMIC_ACQUIRE) != position) sched_yield();
+        queue->items[slot] = frame;
+        __atomic_store_n(&queue->sequences[slot], position + 1, __ATOMIC_RELEASE);
+    }
+
+    sem_post(&queue->queued);
+}
+
+// called after a queued frame was taken from the semaphore
+static pipeline_frame_t * queue_take(queue_t * queue) {
+    pipeline_frame_t * frame;
+    if (!queue->shared) {
+        frame = queue->items[queue->head++ % queue->capacity];
+    } else {
+        uint64_t position = __atomic_fetch_add(&queue->head, 1, __ATOMIC_RELAXED);
+        uint32_t slot = position % queue->capacity;
+        // the producer may still be writing the slot
+        while (__atomic_load_n(&queue->sequences[slot], __ATOMIC_ACQUIRE) != position + 1) sched_yield();
+        frame = queue->items[slot];
+        __atomic_store_n(&queue->sequences[slot], position + queue->capacity, __ATOMIC_RELEASE);
+    }
+
+    sem_post(&queue->free_slots);
+    return frame;
+}
+
+static void queue_push(queue_t * queue, pipeline_frame_t * frame) {
+    semaphore_wait(&queue->free_slots);
+    queue_put(queue, frame);
+}
+
+static bool queue_try_push(queue_t * queue, pipeline_frame_t * frame) {
+    if (sem_trywait(&queue->free_slots) == -1) return false;
+    queue_put(queue, frame);
+    return true;
+}
+
+static pipeline_frame_t * queue_pop(queue_t * queue) {
+    semaphore_wait(&queue->queued);
+    return queue_take(queue);
+}
+
+static bool queue_try_pop(queue_t * queue, pipeline_frame_t ** frame) {
+    if (sem_trywait(&queue->queued) == -1) return false;
+    *frame = queue_take(queue);
+    return true;
+}
+
+// --- stages ---
+
+static void finish_frame(pipeline_t * pipeline, pipeline_frame_t * frame, bool completed) {
+    // the done queue holds every frame, so this never blocks
+    frame->completed = completed;
+    queue_push(&pipeline->done, frame);
+
+    uint64_t value = 1;
+    if (write(pipeline->event_fd, &value, sizeof value) == -1) return;
+}
+
+static void * stage_main(void * data) {
+    stage_thread_t * thread = (stage_thread_t *)data;
+    stage_t * stage = thread->stage;
+    pipeline_t * pipeline = stage->pipeline;
+
+    while (true) {
+        pipeline_frame_t * frame = queue_pop(&stage->input);
+        if (frame == NULL) break;
+
+        uint64_t start_ns = clock_now_ns();
+        thread->queued_ns += start_ns - frame->enqueued_ns;
+        bool keep = stage->func(stage->data, frame);
+        uint64_t end_ns = clock_now_ns();
+        thread->busy_ns += end_ns - start_ns;
+        thread->frames++;
+
+        if (!keep) {
+            thread->dropped++;
+            finish_frame(pipeline, frame, false);
+        } else if (stage->next == NULL) {
+            finish_frame(pipeline, frame, true);
+        } else {
+            frame->enqueued_ns = end_ns;
+            queue_push(&stage->next->input, frame);
+            thread->blocked_ns += clock_now_ns() - end_ns;
+        }
+    }
+
+    // the last thread of a stage to see the end passes it on
+    if (__atomic_sub_fetch(&stage->running, 1, __ATOMIC_ACQ_REL) == 0 && stage->next != NULL) {
+        for (uint32_t i = 0; i < stage->next->num_started; i++) queue_push(&stage->next->input, NULL);
+    }
+
+    return NULL;
+}
+
+static void stage_report(stage_t * stage, double seconds) {
+    uint64_t frames = 0, dropped = 0, busy_ns = 0, queued_ns = 0, blocked_ns = 0;
+    for (uint32_t i = 0; i < stage->num_started; i++) {
+        frames += stage->threads[i].frames;
+        dropped += stage->threads[i].dropped;
+        busy_ns += stage->threads[i].busy_ns;
+        queued_ns += stage->threads[i].queued_ns;
+        blocked_ns += stage->threads[i].blocked_ns;
+    }
+    if (frames == 0) {
+        printf("[pipeline] %s: no frames\n", stage->name);
+        return;
+    }
+
+    // busy time over the time all threads of the stage were there for
+    double utilization = seconds > 0 ? busy_ns / 1e9 / seconds / stage->num_started : 0;
+    printf("[pipeline] %s: %u threads, %lu frames, %lu dropped, %.3f ms busy, %.3f ms queued, %.3f ms blocked per frame, %.0f%% busy\n",
+        stage->name, stage->num_started, frames, dropped,
+        busy_ns / 1e6 / frames, queued_ns / 1e6 / frames, blocked_ns / 1e6 / frames, utilization * 100
+    );
+}
+
+// --- completions ---
+
+static void release_frames(pipeline_t * pipeline) {
+    pipeline_frame_t * frame;
+    while (queue_try_pop(&pipeline->done, &frame)) {
+        if (frame->completed) {
+            uint64_t latency_ns = clock_now_ns() - frame->submitted_ns;
+            pipeline->completed++;
+            pipeline->total_latency_ns += latency_ns;
+            if (latency_ns > pipeline->max_latency_ns) pipeline->max_latency_ns = latency_ns;
+        } else {
+            pipeline->dropped++;
+        }
+
+        pipeline->release(pipeline->data, frame, frame->completed);
+    }
+}
+
+static void event_fd_readable(void * data, int fd, uint32_t events) {
+    pipeline_t * pipeline = (pipeline_t *)data;
+
+    uint64_t value;
+    if (read(fd, &value, sizeof value) == -1) return;
+    release_frames(pipeline);
+}
+
+// --- pipeline ---
+
+pipeline_t * pipeline_create(event_loop_t * loop, uint32_t num_frames, pipeline_release_func_t release, void * data) {
+    pipeline_t * pipeline = calloc(1, sizeof (pipeline_t));
+    if (pipeline == NULL) {
+        printf("[!] pipeline: failed to allocate pipeline\n");
+        return NULL;
+    }
+
+    pipeline->release = release;
+    pipeline->data = data;
+    pipeline->event_fd = -1;
+    pipeline->num_frames = num_frames;
+    pipeline->frames = calloc(num_frames, sizeof (pipeline_frame_t));
+    if (pipeline->frames == NULL) {
+        printf("[!] pipeline: failed to allocate frames\n");
+        pipeline_destroy(pipeline);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < num_frames; i++) pipeline->frames[i].index = i;
+
+    pipeline->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pipeline->event_fd == -1) {
+        printf("[!] pipeline: failed to create eventfd\n");
+        pipeline_destroy(pipeline);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, pipeline->event_fd, 0);
+
+    pipeline->source = event_loop_add_fd(loop, pipeline->event_fd, EPOLLIN, event_fd_readable, pipeline);
+    if (pipeline->source == NULL) {
+        printf("[!] pipeline: failed to watch eventfd\n");
+        pipeline_destroy(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+void pipeline_destroy(pipeline_t * pipeline) {
+    if (pipeline == NULL) return;
+
+    if (pipeline->started) {
+        stage_t * first = &pipeline->stages[0];
+        for (uint32_t i = 0; i < first->num_started; i++) queue_push(&first->input, NULL);
+        for (uint32_t i = 0; i < pipeline->num_stages; i++) {
+            stage_t * stage = &pipeline->stages[i];
+            for (uint32_t j = 0; j < stage->num_started; j++) pthread_join(stage->threads[j].thread, NULL);
+        }
+        release_frames(pipeline);
+
+        double seconds = (clock_now_ns() - pipeline->start_ns) / 1e9;
+        for (uint32_t i = 0; i < pipeline->num_stages; i++) stage_report(&pipeline->stages[i], seconds);
+        printf("[pipeline] %lu frames submitted, %lu completed at %.1f fps, %lu dropped by stages, %lu refused (first stage busy)\n",
+            pipeline->submitted, pipeline->completed, seconds > 0 ? pipeline->completed / seconds : 0,
+            pipeline->dropped, pipeline->refused
+        );
+        printf("[pipeline] submit to release latency mean %.3f ms, max %.3f ms\n",
+            pipeline->completed > 0 ? pipeline->total_latency_ns / 1e6 / pipeline->completed : 0, pipeline->max_latency_ns / 1e6
+        );
+    }
+
+    for (uint32_t i = 0; i < pipeline->num_stages; i++) {
+        queue_finish(&pipeline->stages[i].input);
+        free(pipeline->stages[i].threads);
+    }
+    queue_finish(&pipeline->done);
+
+    if (pipeline->source != NULL) event_source_remove(pipeline->source);
+    if (pipeline->event_fd != -1) {
+        close(pipeline->event_fd);
+        resource_untrack(RESOURCE_FD, pipeline->event_fd);
+    }
+    if (pipeline->frames != NULL) {
+        for (uint32_t i = 0; i < pipeline->num_frames; i++) {
+            free(pipeline->frames[i].scratch);
+            free(pipeline->frames[i].bytes);
+        }
+        free(pipeline->frames);
+    }
+    free(pipeline);
+}
+
+bool pipeline_add_stage(pipeline_t * pipeline, const char * name, uint32_t threads, uint32_t queue_depth, pipeline_stage_func_t func, void * data) {
+    if (pipeline->started || pipeline->num_stages == PIPELINE_MAX_STAGES) {
+        printf("[!] pipeline: cannot add stage %s\n", name);
+        return false;
+    }
+
+    stage_t * stage = &pipeline->stages[pipeline->num_stages];
+    stage->pipeline = pipeline;
+    stage->next = NULL;
+    snprintf(stage->name, sizeof stage->name, "%s", name);
+    stage->func = func;
+    stage->data = data;
+    stage->num_threads = threads < 1 ? 1 : threads > MAX_STAGE_THREADS ? MAX_STAGE_THREADS : threads;
+    stage->num_started = 0;
+    stage->running = 0;
+    stage->threads = NULL;
+    // the input queue is set up in pipeline_start, once the producers are known
+    // no more frames than exist can ever wait in it
+    stage->input.capacity = queue_depth < 1 ? 1 : queue_depth > pipeline->num_frames ? pipeline->num_frames : queue_depth;
+    stage->input.items = NULL;
+
+    if (pipeline->num_stages > 0) pipeline->stages[pipeline->num_stages - 1].next = stage;
+    pipeline->num_stages++;
+    return true;
+}
+
+bool pipeline_start(pipeline_t * pipeline) {
+    if (pipeline->num_stages == 0) {
+        printf("[!] pipeline: no stages\n");
+        return false;
+    }
+
+    // the event loop thread is the only producer of the first queue and the
+    // only consumer of the done queue, which every stage drops frames into
+    uint32_t producers = 1;
+    uint32_t total_threads = 0;
+    for (uint32_t i = 0; i < pipeline->num_stages; i++) {
+        stage_t * stage = &pipeline->stages[i];
+        if (!queue_init(&stage->input, stage->input.capacity, producers > 1 || stage->num_threads > 1)) {
+            printf("[!] pipeline: failed to allocate queue of stage %s\n", stage->name);
+            return false;
+        }
+        producers = stage->num_threads;
+        total_threads += stage->num_threads;
+    }
+    if (!queue_init(&pipeline->done, pipeline->num_frames, total_threads > 1)) {
+        printf("[!] pipeline: failed to allocate done queue\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pipeline->num_stages; i++) {
+        stage_t * stage = &pipeline->stages[i];
+        stage->threads = aligned_alloc(CACHE_LINE_SIZE, stage->num_threads * sizeof (stage_thread_t));
+        if (stage->threads == NULL) {
+            printf("[!] pipeline: failed to allocate threads of stage %s\n", stage->name);
+            return false;
+        }
+        memset(stage->threads, 0, stage->num_threads * sizeof (stage_thread_t));
+    }
+
+    bool ok = true;
+    for (uint32_t i = 0; i < pipeline->num_stages && ok; i++) {
+        stage_t * stage = &pipeline->stages[i];
+        for (uint32_t j = 0; j < stage->num_threads; j++) {
+            stage->threads[j].stage = stage;
+            if (thread_create(&stage->threads[j].thread, stage_main, &stage->threads[j]) != 0) {
+                ok = stage->num_started > 0;
+                break;
+            }
+            stage->num_started++;
+        }
+        stage->running = stage->num_started;
+    }
+
+    // stages that already run are ended through pipeline_destroy
+    pipeline->started = pipeline->stages[0].num_started > 0;
+    if (!ok) {
+        printf("[!] pipeline: failed to start stage threads\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pipeline->num_stages; i++) {
+        stage_t * stage = &pipeline->stages[i];
+        printf("[pipeline] stage %s: %u threads, %u frames queued at most, %s queue\n",
+            stage->name, stage->num_started, stage->input.capacity, stage->input.shared ? "shared" : "single producer/consumer"
+        );
+    }
+    pipeline->start_ns = clock_now_ns();
+    return true;
+}
+
+uint32_t pipeline_num_frames(const pipeline_t * pipeline) {
+    return pipeline->num_frames;
+}
+
+pipeline_frame_t * pipeline_get_frame(pipeline_t * pipeline, uint32_t index) {
+    return &pipeline->frames[index];
+}
+
+bool pipeline_submit(pipeline_t * pipeline, pipeline_frame_t * frame) {
+    frame->size = 0;
+    frame->submitted_ns = clock_now_ns();
+    frame->enqueued_ns = frame->submitted_ns;
+    if (!queue_try_push(&pipeline->stages[0].input, frame)) {
+        pipeline->refused++;
+        return false;
+    }
+
+    pipeline->submitted++;
+    return true;
+}
+
+uint32_t * pipeline_frame_scratch(pipeline_frame_t * frame, size_t pixels) {
+    if (pixels > frame->scratch_capacity) {
+        uint32_t * scratch = realloc(frame->scratch, pixels * sizeof (uint32_t));
+        if (scratch == NULL) return NULL;
+        frame->scratch = scratch;
+        frame->scratch_capacity = pixels;
+    }
+
+    return frame->scratch;
+}
+
+uint8_t * pipeline_frame_bytes(pipeline_frame_t * frame, size_t size) {
+    if (size > frame->bytes_capacity) {
+        uint8_t * bytes = realloc(frame->bytes, size);
+        if (bytes == NULL) return NULL;
+        frame->bytes = bytes;
+        frame->bytes_capacity = size;
+    }
+
+    return frame->bytes;
+}
@@ -0,0 +1,96 @@
+#ifndef COMMON_PIPELINE_H
+#define COMMON_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <event_loop.h>
+
+// runs captured frames through a chain of processing stages off the event
+// loop, e.g. convert, scale, encode and write to a file
+//
+// the pipeline owns a fixed set of frames. the capture code points a frame
+// at the pixels it captured, without copying them, and submits it from the
+// event loop thread. from there on only the frame pointer moves, through a
+// bounded queue in front of every stage. each stage runs on its own threads.
+// a stage that finds its output queue full blocks until the next stage
+// catches up, so a slow stage pushes back on the ones before it, and in the
+// end on pipeline_submit, which refuses frames instead of blocking the loop.
+// every stage works on a different frame at the same time
+//
+// a queue between two single-threaded stages is a single-producer,
+// single-consumer ring, other queues use per-slot sequence numbers to allow
+// several producers and consumers. stages with several threads may reorder
+// frames, frame sequence numbers are left intact for restoring the order
+//
+// once a frame left the last stage, or a stage dropped it, the release
+// callback hands it back to the capture code on the event loop thread
+
+#define PIPELINE_MAX_STAGES 8
+
+typedef struct {
+    uint32_t * pixels;
+    uint32_t width;
+    uint32_t height;
+    // in pixels
+    uint32_t stride;
+} pipeline_image_t;
+
+typedef struct {
+    // fixed, e.g. to find the capture buffer the frame points at
+    uint32_t index;
+
+    // set by the capture code before pipeline_submit
+    uint64_t sequence;
+    uint64_t timestamp_ns;
+    pipeline_image_t image;
+
+    // owned by the frame and kept across submits, for stages that cannot
+    // work in place, see pipeline_frame_scratch
+    uint32_t * scratch;
+    size_t scratch_capacity;
+
+    // encoded output, size is reset by pipeline_submit
+    uint8_t * bytes;
+    size_t size;
+    size_t bytes_capacity;
+
+    // set by the pipeline
+    uint64_t submitted_ns;
+    uint64_t enqueued_ns;
+    bool completed;
+} pipeline_frame_t;
+
+typedef struct pipeline pipeline_t;
+
+// called on a stage thread, returns false to drop the frame
+typedef bool (*pipeline_stage_func_t)(void * data, pipeline_frame_t * frame);
+
+// called on the event loop thread, completed is false for dropped frames
+typedef void (*pipeline_release_func_t)(void * data, pipeline_frame_t * frame, bool completed);
+
+pipeline_t * pipeline_create(event_loop_t * loop, uint32_t num_frames, pipeline_release_func_t release, void * data);
+// lets queued frames run through all stages, releases them, joins the stage
+// threads and prints per-stage timing
+void pipeline_destroy(pipeline_t * pipeline);
+
+// stages run in the order they were added, queue_depth frames may wait in
+// front of the stage, at most as many as the pipeline has. threads is
+// limited to 16
+bool pipeline_add_stage(pipeline_t * pipeline, const char * name, uint32_t threads, uint32_t queue_depth, pipeline_stage_func_t func, void * data);
+bool pipeline_start(pipeline_t * pipeline);
+
+uint32_t pipeline_num_frames(const pipeline_t * pipeline);
+pipeline_frame_t * pipeline_get_frame(pipeline_t * pipeline, uint32_t index);
+
+// never blocks, false if the first stage is still busy with earlier frames,
+// the frame then stays with the caller. a frame must not be submitted again
+// before it was released
+bool pipeline_submit(pipeline_t * pipeline, pipeline_frame_t * frame);
+
+// grow the buffers of a frame if needed, keeping them for the next frames,
+// NULL if out of memory
+uint32_t * pipeline_frame_scratch(pipeline_frame_t * frame, size_t pixels);
+uint8_t * pipeline_frame_bytes(pipeline_frame_t * frame, size_t size);
+
+#endif
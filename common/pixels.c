@@ -0,0 +1,110 @@
+#include <string.h>
+#include <pixels.h>
+
+void pixels_fill_checkerboard(uint32_t * pixels, uint32_t width, uint32_t height) {
+    for (size_t i = 0, y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++, i++) {
+            uint32_t color;
+            if ((x % 2) ^ (y % 2)) {
+                color = 0xffffffff; // white
+            } else {
+                color = 0x00000000; // black
+            }
+
+            pixels[i] = color;
+        }
+    }
+}
+
+void pixels_swizzle_rb(uint32_t * dst, const uint32_t * src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t pixel = src[i];
+        dst[i] = (pixel & 0xff00ff00) | ((pixel >> 16) & 0xff) | ((pixel & 0xff) << 16);
+    }
+}
+
+#define HASH_PRIME_1 0x9e3779b185ebca87
+#define HASH_PRIME_2 0xc2b2ae3d27d4eb4f
+#define HASH_PRIME_3 0x165667b19e3779f9
+#define HASH_PRIME_4 0x85ebca77c2b2ae63
+
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// the xxh64 round, one multiply on the dependency chain of a lane per word
+static inline uint64_t hash_round(uint64_t lane, uint64_t word) {
+    return rotate_left(lane + word * HASH_PRIME_2, 31) * HASH_PRIME_1;
+}
+
+uint64_t pixels_hash(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride) {
+    // separate variables rather than an array, so they stay in registers
+    uint64_t lane0 = HASH_PRIME_1 + HASH_PRIME_2;
+    uint64_t lane1 = HASH_PRIME_2;
+    uint64_t lane2 = 0;
+    uint64_t lane3 = -HASH_PRIME_1;
+
+    for (size_t y = 0; y < height; y++) {
+        const uint32_t * row = pixels + y * stride;
+        size_t x = 0;
+        for (; x + 8 <= width; x += 8) {
+            // two pixels per word, rows need not be 8 byte aligned
+            uint64_t words[4];
+            memcpy(words, row + x, sizeof words);
+            lane0 = hash_round(lane0, words[0]);
+            lane1 = hash_round(lane1, words[1]);
+            lane2 = hash_round(lane2, words[2]);
+            lane3 = hash_round(lane3, words[3]);
+        }
+        for (; x < width; x++) lane0 = hash_round(lane0, row[x]);
+    }
+
+    uint64_t hash = rotate_left(lane0, 1) + rotate_left(lane1, 7) + rotate_left(lane2, 12) + rotate_left(lane3, 18);
+    hash = (hash ^ hash_round(0, lane0)) * HASH_PRIME_1 + HASH_PRIME_4;
+    hash = (hash ^ hash_round(0, lane1)) * HASH_PRIME_1 + HASH_PRIME_4;
+    hash = (hash ^ hash_round(0, lane2)) * HASH_PRIME_1 + HASH_PRIME_4;
+    hash = (hash ^ hash_round(0, lane3)) * HASH_PRIME_1 + HASH_PRIME_4;
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void pixels_downscale_2x(uint32_t * dst, uint32_t dst_stride, const uint32_t * src, uint32_t src_stride, uint32_t width, uint32_t height) {
+    for (size_t y = 0; y < height / 2; y++) {
+        const uint32_t * top = src + 2 * y * src_stride;
+        const uint32_t * bottom = top + src_stride;
+        uint32_t * row = dst + y * dst_stride;
+        for (size_t x = 0; x < width / 2; x++) {
+            uint32_t a = top[2 * x], b = top[2 * x + 1], c = bottom[2 * x], d = bottom[2 * x + 1];
+            // two channels at a time, four 8 bit values fit a 16 bit lane
+            uint32_t even = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff);
+            uint32_t odd = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) + ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff);
+            row[x] = ((even >> 2) & 0x00ff00ff) | (((odd >> 2) & 0x00ff00ff) << 8);
+        }
+    }
+}
+
+size_t pixels_encode_rle(uint8_t * dst, const uint32_t * src, uint32_t width, uint32_t height, uint32_t stride) {
+    size_t size = 0;
+    for (size_t y = 0; y < height; y++) {
+        const uint32_t * row = src + y * stride;
+        for (size_t x = 0; x < width;) {
+            uint32_t pixel = row[x];
+            size_t run = 1;
+            while (run < 256 && x + run < width && row[x + run] == pixel) run++;
+
+            dst[size++] = run - 1;
+            dst[size++] = pixel;
+            dst[size++] = pixel >> 8;
+            dst[size++] = pixel >> 16;
+            dst[size++] = pixel >> 24;
+            x += run;
+        }
+    }
+
+    return size;
+}
@@ -0,0 +1,33 @@
+#ifndef COMMON_PIXELS_H
+#define COMMON_PIXELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CPU pixel kernels of the experiments, kept out of the clients so they can
+// be measured on their own by the microbench target (bench/microbench.c)
+
+// fills a tightly packed XRGB8888 buffer with a one pixel checkerboard,
+// white where x and y differ in parity and black elsewhere
+void pixels_fill_checkerboard(uint32_t * pixels, uint32_t width, uint32_t height);
+
+// converts 32 bit pixels between XRGB8888 and XBGR8888 (or ARGB8888 and
+// ABGR8888) by swapping the red and blue channels, dst may equal src
+void pixels_swizzle_rb(uint32_t * dst, const uint32_t * src, size_t count);
+
+// 64 bit hash of the pixels of a region, stride in pixels. it takes two
+// pixels at a time into four independent xxh64 style lanes, so the multiplies
+// overlap and a core hashes about as fast as it can read the frame
+uint64_t pixels_hash(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride);
+
+// halves width and height of a 32 bit image by averaging every 2x2 block per
+// channel, an odd last row or column is left out, strides in pixels
+void pixels_downscale_2x(uint32_t * dst, uint32_t dst_stride, const uint32_t * src, uint32_t src_stride, uint32_t width, uint32_t height);
+
+// run-length encodes the rows of a 32 bit image as a run length minus one
+// byte followed by the little endian pixel, dst must have room for
+// PIXELS_RLE_MAX_SIZE, returns the encoded size
+#define PIXELS_RLE_MAX_SIZE(width, height) ((size_t)(width) * (height) * 5)
+size_t pixels_encode_rle(uint8_t * dst, const uint32_t * src, uint32_t width, uint32_t height, uint32_t stride);
+
+#endif
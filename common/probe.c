@@ -0,0 +1,45 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <options.h>
+#include <clock.h>
+#include <probe.h>
+
+#define PROBE_MAX_PHASES 32
+
+static int probe_fd = -1;
+static bool probe_initialized = false;
+static const char * probe_phases[PROBE_MAX_PHASES];
+static size_t probe_num_phases = 0;
+
+static bool probe_first(const char * phase) {
+    for (size_t i = 0; i < probe_num_phases; i++) {
+        if (strcmp(probe_phases[i], phase) == 0) return false;
+    }
+
+    if (probe_num_phases < PROBE_MAX_PHASES) probe_phases[probe_num_phases++] = phase;
+    return true;
+}
+
+void probe_mark(const char * phase) {
+    if (!probe_initialized) {
+        probe_initialized = true;
+
+        const char * path = option_string("WLEXP_PROBE", NULL);
+        if (path != NULL) {
+            probe_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (probe_fd == -1) printf("[!] probe: failed to open %s\n", path);
+        }
+    }
+
+    if (probe_fd == -1) return;
+
+    // taken first, so the bookkeeping is not part of the phase
+    uint64_t now_ns = clock_now_ns();
+    if (!probe_first(phase)) return;
+
+    dprintf(probe_fd, "%s %lu\n", phase, now_ns);
+}
@@ -0,0 +1,19 @@
+#ifndef COMMON_PROBE_H
+#define COMMON_PROBE_H
+
+// startup phase timestamps for the startup benchmark (bench/startup.c)
+//
+// with WLEXP_PROBE=path every mark appends a "<phase> <ns>" line with the
+// CLOCK_MONOTONIC time to path, written unbuffered so marks survive the
+// process being killed right after. without it, marks cost one branch
+//
+// only the first mark of each phase is recorded, so marks can sit on paths
+// that run every frame
+//
+// phases used by the experiments, in the order they happen:
+//   start, connect, registry, dmabuf_feedback, gbm_device, egl_init,
+//   shader, configure, first_frame
+
+void probe_mark(const char * phase);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <options.h>
+#include <clock.h>
+#include <rate_controller.h>
+
+// weight of the newest drain time in the moving average
+#define DRAIN_EWMA_ALPHA 0.2
+#define PRINT_INTERVAL_NS 1000000000
+
+static uint64_t interval_ns(const rate_controller_t * rate) {
+    return (uint64_t)(1e9 / rate->rate_fps);
+}
+
+static void decrease(rate_controller_t * rate, uint64_t now_ns) {
+    // one slow burst only backs off once
+    if (rate->last_decrease_ns != 0 && now_ns - rate->last_decrease_ns < rate->budget_ns) return;
+
+    rate->last_decrease_ns = now_ns;
+    rate->rate_fps *= rate->backoff;
+    if (rate->rate_fps < rate->min_fps) rate->rate_fps = rate->min_fps;
+    if (rate->rate_fps < rate->lowest_fps) rate->lowest_fps = rate->rate_fps;
+    rate->decreases++;
+}
+
+static void increase(rate_controller_t * rate) {
+    rate->rate_fps += rate->step_fps;
+    if (rate->rate_fps > rate->max_fps) rate->rate_fps = rate->max_fps;
+}
+
+static void schedule(rate_controller_t * rate) {
+    if (rate->capturing) return;
+
+    uint64_t now_ns = clock_now_ns();
+    if (rate->in_flight >= rate->max_in_flight) {
+        // the next drain schedules again
+        if (!rate->waiting) {
+            rate->waiting = true;
+            rate->waiting_since_ns = now_ns;
+            decrease(rate, now_ns);
+        }
+        event_source_timer_update(rate->timer, 0, 0);
+        return;
+    }
+
+    if (rate->waiting) {
+        // captures the current rate would have made while every buffer was held
+        rate->waiting = false;
+        rate->dropped += (uint64_t)((now_ns - rate->waiting_since_ns) * rate->rate_fps / 1e9);
+    }
+
+    // a deadline that already passed fires right away
+    uint64_t deadline_ns = rate->last_request_ns + interval_ns(rate);
+    if (deadline_ns < now_ns) deadline_ns = now_ns;
+    event_source_timer_update(rate->timer, deadline_ns, 0);
+}
+
+static void timer_expired(void * data, uint64_t expirations) {
+    rate_controller_t * rate = (rate_controller_t *)data;
+    if (!rate_controller_can_capture(rate)) return;
+
+    rate->capture(rate->data);
+}
+
+bool rate_controller_init(rate_controller_t * rate, event_loop_t * loop, uint32_t max_in_flight, rate_controller_func_t capture, void * data) {
+    rate->capture = capture;
+    rate->data = data;
+    rate->min_fps = option_double("WLEXP_RATE_MIN_FPS", 1);
+    rate->max_fps = option_double("WLEXP_RATE_MAX_FPS", 60);
+    rate->step_fps = option_double("WLEXP_RATE_STEP_FPS", 1);
+    rate->backoff = option_double("WLEXP_RATE_BACKOFF", 0.75);
+    rate->budget_ns = option_long("WLEXP_RATE_BUDGET_MS", 33) * 1000000;
+    rate->max_in_flight = max_in_flight > 0 ? max_in_flight : 1;
+
+    if (rate->min_fps <= 0) rate->min_fps = 1;
+    if (rate->max_fps < rate->min_fps) rate->max_fps = rate->min_fps;
+    if (rate->backoff <= 0 || rate->backoff >= 1) rate->backoff = 0.75;
+
+    rate->rate_fps = rate->max_fps;
+    rate->in_flight = 0;
+    rate->capturing = false;
+    rate->waiting = false;
+    rate->waiting_since_ns = 0;
+    rate->last_request_ns = 0;
+    rate->last_decrease_ns = 0;
+    rate->last_print_ns = 0;
+    rate->drain_ewma_ns = 0;
+
+    rate->requested = 0;
+    rate->submitted = 0;
+    rate->drained = 0;
+    rate->dropped = 0;
+    rate->failed = 0;
+    rate->decreases = 0;
+    rate->total_drain_ns = 0;
+    rate->max_drain_ns = 0;
+    rate->lowest_fps = rate->rate_fps;
+
+    rate->timer = event_loop_add_timer(loop, timer_expired, rate);
+    if (rate->timer == NULL) return false;
+
+    printf("[rate] %.1f to %.1f fps, %u buffers, drain budget %.3f ms\n",
+        rate->min_fps, rate->max_fps, rate->max_in_flight, rate->budget_ns / 1e6
+    );
+    return true;
+}
+
+void rate_controller_finish(rate_controller_t * rate) {
+    event_source_remove(rate->timer);
+    rate->timer = NULL;
+}
+
+bool rate_controller_can_capture(const rate_controller_t * rate) {
+    return !rate->capturing && rate->in_flight < rate->max_in_flight;
+}
+
+void rate_controller_begin(rate_controller_t * rate) {
+    rate->capturing = true;
+    rate->requested++;
+    rate->last_request_ns = clock_now_ns();
+    event_source_timer_update(rate->timer, 0, 0);
+}
+
+void rate_controller_submitted(rate_controller_t * rate) {
+    rate->capturing = false;
+    rate->in_flight++;
+    rate->submitted++;
+
+    uint64_t now_ns = clock_now_ns();
+    if (now_ns - rate->last_print_ns >= PRINT_INTERVAL_NS) {
+        rate->last_print_ns = now_ns;
+        printf("[rate] %.1f fps, %u/%u buffers held, drain %.3f ms, %lu dropped\n",
+            rate->rate_fps, rate->in_flight, rate->max_in_flight, rate->drain_ewma_ns / 1e6, rate->dropped
+        );
+    }
+
+    schedule(rate);
+}
+
+void rate_controller_drained(rate_controller_t * rate, uint64_t drain_ns) {
+    if (rate->in_flight > 0) rate->in_flight--;
+    rate->drained++;
+    rate->total_drain_ns += drain_ns;
+    if (drain_ns > rate->max_drain_ns) rate->max_drain_ns = drain_ns;
+
+    if (rate->drained == 1) {
+        rate->drain_ewma_ns = drain_ns;
+    } else {
+        rate->drain_ewma_ns += DRAIN_EWMA_ALPHA * (drain_ns - rate->drain_ewma_ns);
+    }
+
+    if (drain_ns > rate->budget_ns) {
+        decrease(rate, clock_now_ns());
+    } else {
+        increase(rate);
+    }
+
+    schedule(rate);
+}
+
+void rate_controller_discarded(rate_controller_t * rate) {
+    if (rate->in_flight > 0) rate->in_flight--;
+    schedule(rate);
+}
+
+void rate_controller_failed(rate_controller_t * rate) {
+    rate->capturing = false;
+    rate->failed++;
+    schedule(rate);
+}
+
+void rate_controller_report(const rate_controller_t * rate) {
+    printf("[rate] %lu requested, %lu submitted, %lu failed, %lu dropped, %lu rate decreases\n",
+        rate->requested, rate->submitted, rate->failed, rate->dropped, rate->decreases
+    );
+    printf("[rate] final rate %.1f fps, lowest %.1f fps, drain mean %.3f ms, max %.3f ms\n",
+        rate->rate_fps, rate->lowest_fps,
+        rate->drained > 0 ? rate->total_drain_ns / 1e6 / rate->drained : 0, rate->max_drain_ns / 1e6
+    );
+}
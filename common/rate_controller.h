@@ -0,0 +1,85 @@
+#ifndef COMMON_RATE_CONTROLLER_H
+#define COMMON_RATE_CONTROLLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <event_loop.h>
+
+// adapts the capture rate of continuous capture to how fast the consumer of
+// the captured buffers gives them back
+//
+// the consumer holds at most max_in_flight buffers. once it holds all of
+// them, no capture is requested until one comes back, and every capture the
+// current rate would have made meanwhile is counted as dropped, so frames are
+// skipped early instead of queueing behind a slow consumer. the time from
+// when the consumer could give a buffer back until it does is the drain time
+// (for a compositor, from the commit of the next buffer to the release):
+// a drain over the budget, or running out of buffers, cuts the rate by the
+// backoff factor, every drain within the budget raises it by the step again
+// (AIMD). latency is bounded by max_in_flight buffers at the current rate
+//
+// WLEXP_RATE_CONTROL=1 enables it in screencopy_shm, WLEXP_RATE_MIN_FPS=1,
+// WLEXP_RATE_MAX_FPS=60, WLEXP_RATE_BUDGET_MS=33, WLEXP_RATE_STEP_FPS=1 and
+// WLEXP_RATE_BACKOFF=0.75 tune it
+
+typedef void (*rate_controller_func_t)(void * data);
+
+typedef struct {
+    event_source_t * timer;
+    rate_controller_func_t capture;
+    void * data;
+
+    double min_fps;
+    double max_fps;
+    double step_fps;
+    double backoff;
+    uint64_t budget_ns;
+    uint32_t max_in_flight;
+
+    double rate_fps;
+    uint32_t in_flight;
+    bool capturing;
+    bool waiting;
+    uint64_t waiting_since_ns;
+    uint64_t last_request_ns;
+    uint64_t last_decrease_ns;
+    uint64_t last_print_ns;
+    double drain_ewma_ns;
+
+    uint64_t requested;
+    uint64_t submitted;
+    uint64_t drained;
+    uint64_t dropped;
+    uint64_t failed;
+    uint64_t decreases;
+    uint64_t total_drain_ns;
+    uint64_t max_drain_ns;
+    double lowest_fps;
+} rate_controller_t;
+
+// reads the options and adds a timer to the loop, capture is called whenever
+// the next frame should be requested
+bool rate_controller_init(rate_controller_t * rate, event_loop_t * loop, uint32_t max_in_flight, rate_controller_func_t capture, void * data);
+void rate_controller_finish(rate_controller_t * rate);
+
+// true if a buffer is free for another capture
+bool rate_controller_can_capture(const rate_controller_t * rate);
+
+// a capture was requested, by the controller or anything else
+void rate_controller_begin(rate_controller_t * rate);
+
+// the captured buffer was handed to the consumer
+void rate_controller_submitted(rate_controller_t * rate);
+
+// the consumer gave a buffer back drain_ns after it could have
+void rate_controller_drained(rate_controller_t * rate, uint64_t drain_ns);
+
+// a buffer held by the consumer is gone without being given back
+void rate_controller_discarded(rate_controller_t * rate);
+
+// the capture failed, retry one interval later
+void rate_controller_failed(rate_controller_t * rate);
+
+void rate_controller_report(const rate_controller_t * rate);
+
+#endif
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <resources.h>
+#include <accounting.h>
+#include <thread.h>
+#include <reader_thread.h>
+
+#define MAX_QUEUES 8
+
+struct reader_queue {
+    reader_thread_t * reader;
+    struct wl_event_queue * queue;
+    int event_fd;
+};
+
+struct reader_thread {
+    struct wl_display * display;
+    // private and always empty, only used to prepare reads
+    struct wl_event_queue * queue;
+    int stop_fd;
+    pthread_t thread;
+    bool started;
+
+    reader_queue_t queues[MAX_QUEUES];
+    size_t num_queues;
+};
+
+reader_thread_t * reader_thread_create(struct wl_display * display) {
+    reader_thread_t * reader = calloc(1, sizeof (reader_thread_t));
+    if (reader == NULL) {
+        printf("[!] reader_thread: failed to allocate reader\n");
+        return NULL;
+    }
+
+    reader->display = display;
+    reader->queue = wl_display_create_queue(display);
+    if (reader->queue == NULL) {
+        printf("[!] reader_thread: failed to create event queue\n");
+        free(reader);
+        return NULL;
+    }
+
+    reader->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reader->stop_fd == -1) {
+        printf("[!] reader_thread: failed to create eventfd\n");
+        wl_event_queue_destroy(reader->queue);
+        free(reader);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, reader->stop_fd, 0);
+
+    return reader;
+}
+
+reader_queue_t * reader_thread_add_queue(reader_thread_t * reader) {
+    if (reader->started || reader->num_queues == MAX_QUEUES) {
+        printf("[!] reader_thread: cannot add another queue\n");
+        return NULL;
+    }
+
+    reader_queue_t * queue = &reader->queues[reader->num_queues];
+    queue->reader = reader;
+    queue->queue = wl_display_create_queue(reader->display);
+    if (queue->queue == NULL) {
+        printf("[!] reader_thread: failed to create event queue\n");
+        return NULL;
+    }
+
+    queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->event_fd == -1) {
+        printf("[!] reader_thread: failed to create eventfd\n");
+        wl_event_queue_destroy(queue->queue);
+        return NULL;
+    }
+    resource_track(RESOURCE_FD, queue->event_fd, 0);
+
+    reader->num_queues++;
+    return queue;
+}
+
+static void wake_queues(reader_thread_t * reader) {
+    uint64_t value = 1;
+    for (size_t i = 0; i < reader->num_queues; i++) {
+        // only fails if the counter is about to overflow, it is readable then
+        if (write(reader->queues[i].event_fd, &value, sizeof value) == -1) continue;
+    }
+}
+
+static void * reader_main(void * data) {
+    reader_thread_t * reader = (reader_thread_t *)data;
+    accounting_reader_thread();
+
+    struct pollfd fds[] = {
+        { .fd = wl_display_get_fd(reader->display), .events = POLLIN },
+        { .fd = reader->stop_fd, .events = POLLIN }
+    };
+
+    while (true) {
+        if (wl_display_prepare_read_queue(reader->display, reader->queue) != 0) {
+            if (wl_display_dispatch_queue_pending(reader->display, reader->queue) == -1) break;
+            continue;
+        }
+
+        // requests of the consumers are flushed here as well, so they are
+        // not held back by a consumer that is busy
+        fds[0].events = POLLIN;
+        if (wl_display_flush(reader->display) == -1) {
+            if (errno != EAGAIN) {
+                wl_display_cancel_read(reader->display);
+                break;
+            }
+            fds[0].events |= POLLOUT;
+        }
+
+        if (poll(fds, 2, -1) == -1) {
+            wl_display_cancel_read(reader->display);
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            wl_display_cancel_read(reader->display);
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            if (wl_display_read_events(reader->display) == -1) break;
+            wake_queues(reader);
+        } else {
+            wl_display_cancel_read(reader->display);
+        }
+    }
+
+    // consumers find a failed connection on their next dispatch
+    wake_queues(reader);
+    return NULL;
+}
+
+bool reader_thread_start(reader_thread_t * reader) {
+    if (thread_create(&reader->thread, reader_main, reader) != 0) {
+        printf("[!] reader_thread: failed to create thread\n");
+        return false;
+    }
+
+    reader->started = true;
+    return true;
+}
+
+void reader_thread_destroy(reader_thread_t * reader) {
+    if (reader == NULL) return;
+
+    if (reader->started) {
+        uint64_t value = 1;
+        if (write(reader->stop_fd, &value, sizeof value) == -1) {
+            printf("[!] reader_thread: failed to stop reader\n");
+        }
+        pthread_join(reader->thread, NULL);
+    }
+
+    for (size_t i = 0; i < reader->num_queues; i++) {
+        close(reader->queues[i].event_fd);
+        resource_untrack(RESOURCE_FD, reader->queues[i].event_fd);
+        wl_event_queue_destroy(reader->queues[i].queue);
+    }
+
+    close(reader->stop_fd);
+    resource_untrack(RESOURCE_FD, reader->stop_fd);
+    wl_event_queue_destroy(reader->queue);
+    free(reader);
+}
+
+struct wl_event_queue * reader_queue_get_queue(reader_queue_t * queue) {
+    return queue->queue;
+}
+
+int reader_queue_get_fd(reader_queue_t * queue) {
+    return queue->event_fd;
+}
+
+int reader_queue_dispatch(reader_queue_t * queue) {
+    // cleared before dispatching, events queued meanwhile wake us again
+    uint64_t value;
+    if (read(queue->event_fd, &value, sizeof value) == -1 && errno != EAGAIN) return -1;
+
+    return wl_display_dispatch_queue_pending(queue->reader->display, queue->queue);
+}
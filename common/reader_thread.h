@@ -0,0 +1,43 @@
+#ifndef COMMON_READER_THREAD_H
+#define COMMON_READER_THREAD_H
+
+#include <stdbool.h>
+#include <wayland-client.h>
+
+// a thread that does nothing but read the wayland socket, so that slow
+// processing in a listener never leaves the compositor writing into a full
+// socket buffer
+//
+// the reader only sorts incoming events into their event queues, every
+// consumer dispatches its own queue on its own thread once the eventfd of
+// the queue becomes readable. the default queue keeps working as before,
+// libwayland lets any number of threads prepare a read at the same time
+//
+// objects meant for a consumer queue have to be created through a
+// wl_proxy_create_wrapper wrapper assigned to that queue, otherwise the
+// reader may dispatch their first events into the default queue before
+// wl_proxy_set_queue is called
+
+typedef struct reader_thread reader_thread_t;
+typedef struct reader_queue reader_queue_t;
+
+reader_thread_t * reader_thread_create(struct wl_display * display);
+
+// queues should be added before the reader is started
+reader_queue_t * reader_thread_add_queue(reader_thread_t * reader);
+bool reader_thread_start(reader_thread_t * reader);
+
+// stops and joins the reader and destroys all queues, proxies still
+// assigned to them must be destroyed first
+void reader_thread_destroy(reader_thread_t * reader);
+
+struct wl_event_queue * reader_queue_get_queue(reader_queue_t * queue);
+
+// readable whenever events may have been queued, e.g. for event_loop_add_fd
+int reader_queue_get_fd(reader_queue_t * queue);
+
+// dispatches the queued events on the calling thread without blocking,
+// -1 if the connection failed
+int reader_queue_dispatch(reader_queue_t * queue);
+
+#endif
@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <options.h>
+#include <clock.h>
+#include <realtime.h>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+#define PROBE_INTERVAL_NS 1000000
+
+static struct {
+    // any of the options is applied
+    bool active;
+    // frame delays are collected, also for a baseline run without options
+    bool measuring;
+    bool prefault;
+
+    uint64_t * delay_ns;
+    size_t count;
+    size_t capacity;
+    struct rusage start_usage;
+} realtime;
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    if (count == 0) return 0;
+
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+// how late short absolute sleeps wake up, the same kind of wakeup as a
+// ready event arriving while the client waits in epoll
+static void probe_wakeups(const char * name, long count) {
+    if (count <= 0) return;
+
+    uint64_t * lateness_ns = malloc(count * sizeof *lateness_ns);
+    if (lateness_ns == NULL) {
+        printf("[!] realtime: failed to allocate probe samples\n");
+        return;
+    }
+
+    for (long i = 0; i < count; i++) {
+        uint64_t deadline_ns = clock_now_ns() + PROBE_INTERVAL_NS;
+        struct timespec deadline = { .tv_sec = deadline_ns / 1000000000, .tv_nsec = deadline_ns % 1000000000 };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+
+        uint64_t now_ns = clock_now_ns();
+        lateness_ns[i] = now_ns > deadline_ns ? now_ns - deadline_ns : 0;
+    }
+
+    qsort(lateness_ns, count, sizeof *lateness_ns, compare_u64);
+    printf("[realtime] wakeup latency %-6s p50 %7.1f us, p99 %7.1f us, max %7.1f us\n",
+        name, percentile(lateness_ns, count, 50) / 1e3,
+        percentile(lateness_ns, count, 99) / 1e3, lateness_ns[count - 1] / 1e3
+    );
+    free(lateness_ns);
+}
+
+static void apply_scheduler(const char * policy_name) {
+    int policy;
+    if (strcmp(policy_name, "fifo") == 0) {
+        policy = SCHED_FIFO;
+    } else if (strcmp(policy_name, "rr") == 0) {
+        policy = SCHED_RR;
+    } else {
+        printf("[!] realtime: unknown scheduling policy %s\n", policy_name);
+        return;
+    }
+
+    long priority = option_long("WLEXP_SCHED_PRIORITY", 10);
+    if (priority < sched_get_priority_min(policy)) priority = sched_get_priority_min(policy);
+    if (priority > sched_get_priority_max(policy)) priority = sched_get_priority_max(policy);
+
+    // pid 0 is the calling thread only
+    struct sched_param param = { .sched_priority = priority };
+    if (sched_setscheduler(0, policy, &param) == -1) {
+        if (errno == EPERM) {
+            printf("[!] realtime: SCHED_%s not permitted, needs CAP_SYS_NICE or RLIMIT_RTPRIO >= %ld, staying on SCHED_OTHER\n",
+                policy == SCHED_FIFO ? "FIFO" : "RR", priority
+            );
+        } else {
+            printf("[!] realtime: sched_setscheduler failed: %s\n", strerror(errno));
+        }
+        return;
+    }
+
+    printf("[realtime] running on SCHED_%s priority %ld\n", policy == SCHED_FIFO ? "FIFO" : "RR", priority);
+}
+
+static void apply_affinity(const char * list) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    // comma separated CPUs and ranges, e.g. 2,4-5
+    const char * entry = list;
+    while (*entry != '\0') {
+        char * end;
+        long first = strtol(entry, &end, 10);
+        long last = first;
+        if (end == entry || first < 0) {
+            printf("[!] realtime: invalid CPU list %s\n", list);
+            return;
+        }
+        if (*end == '-') {
+            entry = end + 1;
+            last = strtol(entry, &end, 10);
+            if (end == entry || last < first) {
+                printf("[!] realtime: invalid CPU list %s\n", list);
+                return;
+            }
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &set);
+
+        if (*end != ',' && *end != '\0') {
+            printf("[!] realtime: invalid CPU list %s\n", list);
+            return;
+        }
+        entry = *end == ',' ? end + 1 : end;
+    }
+
+    if (sched_setaffinity(0, sizeof set, &set) == -1) {
+        printf("[!] realtime: sched_setaffinity failed: %s\n", strerror(errno));
+        return;
+    }
+
+    printf("[realtime] pinned to CPUs %s\n", list);
+}
+
+void realtime_init(void) {
+    const char * policy = option_string("WLEXP_SCHED", NULL);
+    const char * cpus = option_string("WLEXP_CPUS", NULL);
+    bool lock = option_flag("WLEXP_MLOCK");
+    realtime.prefault = option_flag("WLEXP_PREFAULT");
+
+    realtime.active = policy != NULL || cpus != NULL || lock || realtime.prefault;
+    realtime.measuring = realtime.active || option_string("WLEXP_REALTIME_PROBE", NULL) != NULL;
+    if (!realtime.measuring) return;
+
+    long probes = option_long("WLEXP_REALTIME_PROBE", 200);
+    if (!realtime.active) {
+        // the before half of a comparison with a run that sets options
+        printf("[realtime] no scheduling options set, measuring the baseline\n");
+        probe_wakeups("before", probes);
+        getrusage(RUSAGE_SELF, &realtime.start_usage);
+        return;
+    }
+
+    probe_wakeups("before", probes);
+
+    if (policy != NULL) apply_scheduler(policy);
+    if (cpus != NULL) apply_affinity(cpus);
+    if (lock) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+            printf("[!] realtime: mlockall failed: %s, RLIMIT_MEMLOCK may be too low\n", strerror(errno));
+        } else {
+            printf("[realtime] locked all current and future mappings\n");
+        }
+    }
+
+    probe_wakeups("after", probes);
+    getrusage(RUSAGE_SELF, &realtime.start_usage);
+}
+
+bool realtime_active(void) {
+    return realtime.active;
+}
+
+void realtime_prefault(void * address, size_t size) {
+    if (!realtime.prefault || address == NULL || size == 0) return;
+
+    if (madvise(address, size, MADV_POPULATE_WRITE) == 0) return;
+
+    // before linux 5.14, touch every page without changing its contents
+    long page_size = sysconf(_SC_PAGESIZE);
+    volatile uint8_t * bytes = (volatile uint8_t *)address;
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        bytes[offset] = bytes[offset];
+    }
+}
+
+void realtime_frame(uint64_t ready_ns) {
+    if (!realtime.measuring) return;
+
+    uint64_t now_ns = clock_now_ns();
+    if (realtime.count == realtime.capacity) {
+        size_t capacity = realtime.capacity == 0 ? 1024 : realtime.capacity * 2;
+        uint64_t * delay_ns = realloc(realtime.delay_ns, capacity * sizeof *delay_ns);
+        if (delay_ns == NULL) {
+            printf("[!] realtime: failed to grow delay samples\n");
+            return;
+        }
+        realtime.delay_ns = delay_ns;
+        realtime.capacity = capacity;
+    }
+
+    realtime.delay_ns[realtime.count++] = now_ns > ready_ns ? now_ns - ready_ns : 0;
+}
+
+void realtime_report(void) {
+    if (!realtime.measuring) return;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("[realtime] %ld involuntary context switches, %ld minor and %ld major page faults\n",
+        usage.ru_nivcsw - realtime.start_usage.ru_nivcsw,
+        usage.ru_minflt - realtime.start_usage.ru_minflt,
+        usage.ru_majflt - realtime.start_usage.ru_majflt
+    );
+
+    size_t count = realtime.count;
+    if (count > 0) {
+        double sum = 0, sum_squares = 0;
+        for (size_t i = 0; i < count; i++) {
+            sum += realtime.delay_ns[i];
+            sum_squares += (double)realtime.delay_ns[i] * realtime.delay_ns[i];
+        }
+        double mean = sum / count;
+        double variance = sum_squares / count - mean * mean;
+
+        qsort(realtime.delay_ns, count, sizeof *realtime.delay_ns, compare_u64);
+        uint64_t p50 = percentile(realtime.delay_ns, count, 50);
+        uint64_t p99 = percentile(realtime.delay_ns, count, 99);
+        printf("[realtime] ready to handled (%s) over %zu frames: p50 %.3f ms, p99 %.3f ms, max %.3f ms, stddev %.3f ms, jitter (p99 - p50) %.3f ms\n",
+            realtime.active ? "options applied" : "baseline", count, p50 / 1e6, p99 / 1e6, realtime.delay_ns[count - 1] / 1e6,
+            sqrt(variance > 0 ? variance : 0) / 1e6, (p99 - p50) / 1e6
+        );
+    }
+
+    free(realtime.delay_ns);
+    realtime.delay_ns = NULL;
+    realtime.count = 0;
+    realtime.capacity = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef COMMON_REALTIME_H
+#define COMMON_REALTIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// scheduling options for the thread that dispatches captures, against being
+// descheduled long enough under background load to miss frames
+//
+// - WLEXP_SCHED=fifo|rr: SCHED_FIFO or SCHED_RR at WLEXP_SCHED_PRIORITY,
+//   falling back to SCHED_OTHER with a warning without CAP_SYS_NICE or an
+//   RLIMIT_RTPRIO that allows it
+// - WLEXP_CPUS=2,4-5: pin the thread to these CPUs
+// - WLEXP_MLOCK=1: mlockall the process, current and future mappings
+// - WLEXP_PREFAULT=1: fault in the shm pools whenever they are (re)mapped
+//
+// threads created afterwards inherit policy and CPU set. when any option is
+// set, the wakeup latency of short sleeps is probed before and after they
+// are applied, and the delay from the ready timestamp of every frame to the
+// client handling it is reported at exit. setting WLEXP_REALTIME_PROBE
+// without any option measures the same for a baseline run to compare with
+
+// reads the options and applies them to the calling thread
+void realtime_init(void);
+// true if any option is applied, not for a baseline run
+bool realtime_active(void);
+
+// prefaults a mapping if WLEXP_PREFAULT is set
+void realtime_prefault(void * address, size_t size);
+
+// the frame with this ready timestamp is being handled now
+void realtime_frame(uint64_t ready_ns);
+
+// prints the ready-to-handled jitter, involuntary context switches and
+// page faults of the run, and frees the samples
+void realtime_report(void);
+
+#endif
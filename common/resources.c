@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <options.h>
+#include <resources.h>
+
+typedef struct {
+    resource_kind_t kind;
+    uintptr_t handle;
+    size_t bytes;
+    const char * file;
+    int line;
+} resource_t;
+
+static const char * kind_names[RESOURCE_KIND_COUNT] = {
+    [RESOURCE_FD] = "fd",
+    [RESOURCE_MAPPING] = "mapping",
+    [RESOURCE_GBM_BO] = "gbm_bo",
+    [RESOURCE_WL_BUFFER] = "wl_buffer",
+    [RESOURCE_EGL_IMAGE] = "EGLImage",
+    [RESOURCE_GL_TEXTURE] = "gl texture",
+    [RESOURCE_GL_BUFFER] = "gl buffer",
+    [RESOURCE_GL_PROGRAM] = "gl program"
+};
+
+static struct {
+    resource_t * resources;
+    size_t length;
+    size_t capacity;
+    resource_stats_t stats[RESOURCE_KIND_COUNT];
+    int verbose;
+} state = { .verbose = -1 };
+
+static bool verbose(void) {
+    if (state.verbose == -1) state.verbose = option_flag("WLEXP_RESOURCES");
+    return state.verbose;
+}
+
+static resource_t * find(resource_kind_t kind, uintptr_t handle) {
+    // newest first, short-lived resources are usually at the end
+    for (size_t i = state.length; i > 0; i--) {
+        resource_t * resource = &state.resources[i - 1];
+        if (resource->kind == kind && resource->handle == handle) return resource;
+    }
+    return NULL;
+}
+
+void resource_track_at(resource_kind_t kind, uintptr_t handle, size_t bytes, const char * file, int line) {
+    if (state.length == state.capacity) {
+        size_t capacity = state.capacity == 0 ? 64 : state.capacity * 2;
+        resource_t * resources = realloc(state.resources, capacity * sizeof *resources);
+        if (resources == NULL) {
+            printf("[resources] failed to grow resource table, not tracking %s\n", kind_names[kind]);
+            return;
+        }
+        state.resources = resources;
+        state.capacity = capacity;
+    }
+
+    resource_t * resource = &state.resources[state.length++];
+    resource->kind = kind;
+    resource->handle = handle;
+    resource->bytes = bytes;
+    resource->file = file;
+    resource->line = line;
+
+    resource_stats_t * stats = &state.stats[kind];
+    stats->created++;
+    stats->live++;
+    stats->bytes += bytes;
+    if (stats->live > stats->high_water) stats->high_water = stats->live;
+    if (stats->bytes > stats->bytes_high_water) stats->bytes_high_water = stats->bytes;
+}
+
+void resource_untrack_at(resource_kind_t kind, uintptr_t handle) {
+    resource_t * resource = find(kind, handle);
+    if (resource == NULL) return;
+
+    resource_stats_t * stats = &state.stats[kind];
+    stats->live--;
+    stats->bytes -= resource->bytes;
+
+    *resource = state.resources[--state.length];
+}
+
+void resource_retrack_at(resource_kind_t kind, uintptr_t old_handle, uintptr_t new_handle, size_t bytes, const char * file, int line) {
+    resource_untrack_at(kind, old_handle);
+    resource_track_at(kind, new_handle, bytes, file, line);
+    state.stats[kind].created--;
+}
+
+void resource_get_stats(resource_kind_t kind, resource_stats_t * stats) {
+    *stats = state.stats[kind];
+}
+
+void resources_print_live(void) {
+    if (!verbose()) return;
+
+    printf("[resources] live:");
+    for (size_t kind = 0; kind < RESOURCE_KIND_COUNT; kind++) {
+        resource_stats_t * stats = &state.stats[kind];
+        if (stats->created == 0) continue;
+
+        printf(" %s %zu (max %zu)", kind_names[kind], stats->live, stats->high_water);
+        if (stats->bytes_high_water != 0) {
+            printf(" %.1f KiB (max %.1f KiB)", stats->bytes / 1024.0, stats->bytes_high_water / 1024.0);
+        }
+        printf(",");
+    }
+    printf("\n");
+}
+
+void resources_report(void) {
+    if (verbose()) {
+        printf("[resources] summary:\n");
+        for (size_t kind = 0; kind < RESOURCE_KIND_COUNT; kind++) {
+            resource_stats_t * stats = &state.stats[kind];
+            if (stats->created == 0) continue;
+
+            printf("[resources]   %-10s created %zu, live %zu, max live %zu, max %.1f KiB\n",
+                kind_names[kind], stats->created, stats->live, stats->high_water, stats->bytes_high_water / 1024.0
+            );
+        }
+    }
+
+    if (state.length != 0) {
+        printf("[resources] %zu leaked resources:\n", state.length);
+        for (size_t i = 0; i < state.length; i++) {
+            resource_t * resource = &state.resources[i];
+            printf("[resources]   %s %#lx (%zu bytes) created at %s:%d\n",
+                kind_names[resource->kind], (unsigned long)resource->handle, resource->bytes,
+                resource->file, resource->line
+            );
+        }
+    }
+
+    free(state.resources);
+    state.resources = NULL;
+    state.length = 0;
+    state.capacity = 0;
+}
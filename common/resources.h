@@ -0,0 +1,55 @@
+#ifndef COMMON_RESOURCES_H
+#define COMMON_RESOURCES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// tracking of fds, mappings, and GPU buffers with their creation sites, so
+// that fd and memory growth of long capture sessions is measurable
+//
+// tracking is always on and cheap, leaks are reported when the client exits;
+// WLEXP_RESOURCES=1 additionally prints live counts after every frame
+
+typedef enum {
+    RESOURCE_FD,
+    RESOURCE_MAPPING,
+    RESOURCE_GBM_BO,
+    RESOURCE_WL_BUFFER,
+    RESOURCE_EGL_IMAGE,
+    RESOURCE_GL_TEXTURE,
+    RESOURCE_GL_BUFFER,
+    RESOURCE_GL_PROGRAM,
+    RESOURCE_KIND_COUNT
+} resource_kind_t;
+
+typedef struct {
+    size_t live;
+    size_t high_water;
+    size_t created;
+    size_t bytes;
+    size_t bytes_high_water;
+} resource_stats_t;
+
+#define resource_track(kind, handle, bytes) \
+    resource_track_at((kind), (uintptr_t)(handle), (bytes), __FILE__, __LINE__)
+#define resource_untrack(kind, handle) \
+    resource_untrack_at((kind), (uintptr_t)(handle))
+#define resource_retrack(kind, old_handle, new_handle, bytes) \
+    resource_retrack_at((kind), (uintptr_t)(old_handle), (uintptr_t)(new_handle), (bytes), __FILE__, __LINE__)
+
+void resource_track_at(resource_kind_t kind, uintptr_t handle, size_t bytes, const char * file, int line);
+void resource_untrack_at(resource_kind_t kind, uintptr_t handle);
+
+// for resources that change handle or size in place, e.g. mremap
+void resource_retrack_at(resource_kind_t kind, uintptr_t old_handle, uintptr_t new_handle, size_t bytes, const char * file, int line);
+
+void resource_get_stats(resource_kind_t kind, resource_stats_t * stats);
+
+// one line of live counts, only if WLEXP_RESOURCES=1
+void resources_print_live(void);
+
+// high-water marks and every resource still alive, call at the very end of cleanup
+void resources_report(void);
+
+#endif
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <options.h>
+#include <clock.h>
+#include <thread.h>
+#include <task_pool.h>
+
+#define CACHE_LINE_SIZE 64
+#define MAX_WORKERS 64
+// halving a range pushes at most one entry per bit of the task count
+#define DEQUE_CAPACITY 64
+#define BANDS_PER_WORKER 4
+
+typedef struct {
+    // owner end, only written by the owning worker
+    _Alignas(CACHE_LINE_SIZE) int64_t bottom;
+    // thief end, advanced with compare and swap by owner and thieves alike
+    _Alignas(CACHE_LINE_SIZE) int64_t top;
+    // [first, last) task ranges packed as first << 32 | last
+    uint64_t ranges[DEQUE_CAPACITY];
+
+    // only touched by the owning worker while a job runs
+    _Alignas(CACHE_LINE_SIZE) uint64_t tasks;
+    uint64_t steals;
+    uint64_t failed_steals;
+    uint32_t random;
+
+    pthread_t thread;
+    task_pool_t * pool;
+} worker_t;
+
+struct task_pool {
+    worker_t * workers;
+    uint32_t num_workers;
+    uint32_t num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t generation;
+    bool stopping;
+
+    task_func_t func;
+    void * data;
+
+    // tasks of the current job that did not finish yet
+    _Alignas(CACHE_LINE_SIZE) uint32_t remaining;
+
+    _Alignas(CACHE_LINE_SIZE) uint64_t jobs;
+    uint64_t job_tasks;
+    uint64_t total_job_ns;
+    uint64_t max_job_ns;
+};
+
+// --- deque ---
+
+static bool deque_push(worker_t * worker, uint32_t first, uint32_t last) {
+    int64_t bottom = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&worker->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= DEQUE_CAPACITY) return false;
+
+    __atomic_store_n(&worker->ranges[bottom % DEQUE_CAPACITY], (uint64_t)first << 32 | last, __ATOMIC_RELAXED);
+    // publishes the entry, and the job it belongs to, to thieves
+    __atomic_store_n(&worker->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool deque_pop(worker_t * worker, uint64_t * range) {
+    int64_t bottom = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&worker->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&worker->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&worker->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *range = __atomic_load_n(&worker->ranges[bottom % DEQUE_CAPACITY], __ATOMIC_RELAXED);
+    if (top < bottom) return true;
+
+    // the last entry, a thief may be taking it at the same time
+    bool won = __atomic_compare_exchange_n(&worker->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+static bool deque_steal(worker_t * victim, uint64_t * range) {
+    int64_t top = __atomic_load_n(&victim->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&victim->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) return false;
+
+    *range = __atomic_load_n(&victim->ranges[top % DEQUE_CAPACITY], __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(&victim->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// --- workers ---
+
+static uint32_t next_random(worker_t * worker) {
+    // xorshift32, only used to spread thieves over the victims
+    uint32_t x = worker->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->random = x;
+    return x;
+}
+
+static bool steal(task_pool_t * pool, worker_t * worker, uint64_t * range) {
+    uint32_t start = next_random(worker) % pool->num_workers;
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        worker_t * victim = &pool->workers[(start + i) % pool->num_workers];
+        if (victim == worker) continue;
+
+        if (deque_steal(victim, range)) {
+            worker->steals++;
+            return true;
+        }
+    }
+
+    worker->failed_steals++;
+    return false;
+}
+
+static void run_range(task_pool_t * pool, worker_t * worker, uint64_t range) {
+    uint32_t first = range >> 32;
+    uint32_t last = (uint32_t)range;
+
+    // leave the upper halves to thieves, a full deque runs the rest here
+    while (last - first > 1) {
+        uint32_t middle = first + (last - first) / 2;
+        if (!deque_push(worker, middle, last)) break;
+        last = middle;
+    }
+
+    for (uint32_t i = first; i < last; i++) pool->func(pool->data, i);
+    worker->tasks += last - first;
+    __atomic_fetch_sub(&pool->remaining, last - first, __ATOMIC_ACQ_REL);
+}
+
+static void work(task_pool_t * pool, worker_t * worker) {
+    while (__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) > 0) {
+        uint64_t range;
+        if (deque_pop(worker, &range) || steal(pool, worker, &range)) {
+            run_range(pool, worker, range);
+        } else {
+            // the remaining tasks run elsewhere and may still be split
+            sched_yield();
+        }
+    }
+}
+
+static void * worker_main(void * data) {
+    worker_t * worker = (worker_t *)data;
+    task_pool_t * pool = worker->pool;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        if (pool->generation == seen) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        work(pool, worker);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static uint32_t default_workers(void) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == -1) return 1;
+    return CPU_COUNT(&set);
+}
+
+// --- task_pool ---
+
+task_pool_t * task_pool_create(void) {
+    long workers = option_long("WLEXP_TASK_THREADS", default_workers());
+    if (workers < 1) workers = 1;
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+
+    task_pool_t * pool = aligned_alloc(CACHE_LINE_SIZE, sizeof (task_pool_t));
+    worker_t * worker_array = aligned_alloc(CACHE_LINE_SIZE, workers * sizeof (worker_t));
+    if (pool == NULL || worker_array == NULL) {
+        printf("[!] task_pool: failed to allocate pool\n");
+        free(pool);
+        free(worker_array);
+        return NULL;
+    }
+
+    memset(pool, 0, sizeof (task_pool_t));
+    memset(worker_array, 0, workers * sizeof (worker_t));
+    pool->workers = worker_array;
+    pool->num_workers = workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].random = 0x9e3779b9 * (i + 1);
+    }
+
+    // worker 0 is the calling thread
+    for (uint32_t i = 1; i < pool->num_workers; i++) {
+        if (thread_create(&pool->workers[i].thread, worker_main, &pool->workers[i]) != 0) break;
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads + 1 < pool->num_workers) {
+        printf("[!] task_pool: only started %u of %u worker threads\n", pool->num_threads, pool->num_workers - 1);
+        pool->num_workers = pool->num_threads + 1;
+    }
+
+    printf("[task_pool] %u workers\n", pool->num_workers);
+    return pool;
+}
+
+void task_pool_destroy(task_pool_t * pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 1; i <= pool->num_threads; i++) pthread_join(pool->workers[i].thread, NULL);
+
+    if (pool->jobs > 0) {
+        printf("[task_pool] %lu jobs of %.1f tasks on %u workers, mean %.3f ms, max %.3f ms\n",
+            pool->jobs, (double)pool->job_tasks / pool->jobs, pool->num_workers,
+            pool->total_job_ns / 1e6 / pool->jobs, pool->max_job_ns / 1e6
+        );
+        for (uint32_t i = 0; i < pool->num_workers; i++) {
+            worker_t * worker = &pool->workers[i];
+            printf("[task_pool] worker %u: %lu tasks, %lu steals, %lu failed steal rounds\n",
+                i, worker->tasks, worker->steals, worker->failed_steals
+            );
+        }
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+uint32_t task_pool_num_workers(const task_pool_t * pool) {
+    return pool->num_workers;
+}
+
+void task_pool_run(task_pool_t * pool, uint32_t count, task_func_t func, void * data) {
+    if (count == 0) return;
+    uint64_t start_ns = clock_now_ns();
+
+    pool->func = func;
+    pool->data = data;
+    if (pool->num_workers == 1) {
+        for (uint32_t i = 0; i < count; i++) func(data, i);
+        pool->workers[0].tasks += count;
+    } else {
+        __atomic_store_n(&pool->remaining, count, __ATOMIC_RELAXED);
+        deque_push(&pool->workers[0], 0, count);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->generation++;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, &pool->workers[0]);
+    }
+
+    uint64_t job_ns = clock_now_ns() - start_ns;
+    pool->jobs++;
+    pool->job_tasks += count;
+    pool->total_job_ns += job_ns;
+    if (job_ns > pool->max_job_ns) pool->max_job_ns = job_ns;
+}
+
+// --- regions ---
+
+typedef struct {
+    task_region_func_t func;
+    void * data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t columns;
+} region_job_t;
+
+static void run_region(void * data, uint32_t index) {
+    region_job_t * job = (region_job_t *)data;
+
+    task_region_t region;
+    region.x = (index % job->columns) * job->tile_width;
+    region.y = (index / job->columns) * job->tile_height;
+    region.width = job->width - region.x < job->tile_width ? job->width - region.x : job->tile_width;
+    region.height = job->height - region.y < job->tile_height ? job->height - region.y : job->tile_height;
+    job->func(job->data, index, region);
+}
+
+uint32_t task_pool_band_count(const task_pool_t * pool, uint32_t height) {
+    uint32_t bands = pool->num_workers == 1 ? 1 : pool->num_workers * BANDS_PER_WORKER;
+    if (bands > height) bands = height;
+    return bands;
+}
+
+void task_pool_for_bands(task_pool_t * pool, uint32_t width, uint32_t height, task_region_func_t func, void * data) {
+    uint32_t bands = task_pool_band_count(pool, height);
+    if (bands == 0) return;
+
+    // rounded up, so the band count above is never exceeded
+    uint32_t rows = (height + bands - 1) / bands;
+    task_pool_for_tiles(pool, width, height, width, rows, func, data);
+}
+
+uint32_t task_pool_tile_count(uint32_t width, uint32_t height, uint32_t tile_width, uint32_t tile_height) {
+    if (width == 0 || height == 0 || tile_width == 0 || tile_height == 0) return 0;
+    return ((width + tile_width - 1) / tile_width) * ((height + tile_height - 1) / tile_height);
+}
+
+void task_pool_for_tiles(task_pool_t * pool, uint32_t width, uint32_t height, uint32_t tile_width, uint32_t tile_height, task_region_func_t func, void * data) {
+    uint32_t count = task_pool_tile_count(width, height, tile_width, tile_height);
+    if (count == 0) return;
+
+    region_job_t job;
+    job.func = func;
+    job.data = data;
+    job.width = width;
+    job.height = height;
+    job.tile_width = tile_width;
+    job.tile_height = tile_height;
+    job.columns = (width + tile_width - 1) / tile_width;
+    task_pool_run(pool, count, run_region, &job);
+}
@@ -0,0 +1,56 @@
+#ifndef COMMON_TASK_POOL_H
+#define COMMON_TASK_POOL_H
+
+#include <stdint.h>
+
+// a work-stealing thread pool for splitting the CPU work on one frame
+//
+// task_pool_run runs a fork/join job of count tasks and returns once all of
+// them ran. the calling thread takes part as worker 0 and pushes the whole
+// index range onto its own deque. every worker pops ranges from the bottom
+// of its own deque, and until a range is down to a single task it pushes the
+// upper half back and keeps the lower one. idle workers steal from the top
+// of other deques, where the largest ranges are, so the job spreads over the
+// pool in a few steals and uneven tasks balance out. the deques are
+// Chase-Lev deques of fixed size, the ends and the per-worker counters each
+// sit on their own cache line
+//
+// WLEXP_TASK_THREADS sets the number of workers including the calling
+// thread, by default one per CPU the process may run on (see WLEXP_CPUS).
+// with a single worker the tasks simply run in order on the calling thread
+
+typedef struct task_pool task_pool_t;
+
+typedef void (*task_func_t)(void * data, uint32_t index);
+
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} task_region_t;
+
+// index numbers the regions of a frame, e.g. for per-region results that are
+// combined after the job returned
+typedef void (*task_region_func_t)(void * data, uint32_t index, task_region_t region);
+
+task_pool_t * task_pool_create(void);
+// prints the job times and per-worker task and steal counts
+void task_pool_destroy(task_pool_t * pool);
+
+uint32_t task_pool_num_workers(const task_pool_t * pool);
+
+// must not be called from inside a task or from two threads at once
+void task_pool_run(task_pool_t * pool, uint32_t count, task_func_t func, void * data);
+
+// splits a frame into full-width bands of rows, a few per worker so that
+// stealing can even out slow bands
+uint32_t task_pool_band_count(const task_pool_t * pool, uint32_t height);
+void task_pool_for_bands(task_pool_t * pool, uint32_t width, uint32_t height, task_region_func_t func, void * data);
+
+// splits a frame into tiles in row-major order, the last column and row of
+// tiles may be smaller
+uint32_t task_pool_tile_count(uint32_t width, uint32_t height, uint32_t tile_width, uint32_t tile_height);
+void task_pool_for_tiles(task_pool_t * pool, uint32_t width, uint32_t height, uint32_t tile_width, uint32_t tile_height, task_region_func_t func, void * data);
+
+#endif
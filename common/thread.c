@@ -0,0 +1,12 @@
+#include <signal.h>
+#include <thread.h>
+
+int thread_create(pthread_t * thread, void * (*func)(void * data), void * data) {
+    // the mask is inherited by the new thread
+    sigset_t mask, old_mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+    int error = pthread_create(thread, NULL, func, data);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return error;
+}
@@ -0,0 +1,15 @@
+#ifndef COMMON_THREAD_H
+#define COMMON_THREAD_H
+
+#include <pthread.h>
+
+// helper threads of the common modules, e.g. task pool workers, pipeline
+// stages and frame sink writers
+//
+// they are created with every signal blocked, so that SIGINT and SIGTERM
+// always reach the thread running the event loop and its signalfd
+
+// returns the pthread_create error, 0 on success
+int thread_create(pthread_t * thread, void * (*func)(void * data), void * data);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <options.h>
+#include <clock.h>
+#include <timestamp_pattern.h>
+
+#define COLOR_BLACK 0xff000000
+#define COLOR_WHITE 0xffffffff
+#define COLOR_GREEN 0xff00ff00
+#define COLOR_MAGENTA 0xffff00ff
+
+#define MARKER_CELLS 4
+#define DATA_CELLS 64
+#define CRC_CELLS 8
+
+typedef enum {
+    CELL_BLACK,
+    CELL_WHITE,
+    CELL_GREEN,
+    CELL_MAGENTA,
+    CELL_UNKNOWN
+} cell_t;
+
+static uint8_t crc8(uint64_t value) {
+    uint8_t crc = 0;
+    for (int byte = 7; byte >= 0; byte--) {
+        crc ^= (value >> (byte * 8)) & 0xff;
+        for (int bit = 0; bit < 8; bit++) crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+// cell contents in grid order: start marker, timestamp, crc, end marker
+static void pattern_cells(uint64_t timestamp_ns, cell_t * cells) {
+    size_t cell = 0;
+    for (size_t i = 0; i < MARKER_CELLS; i++) cells[cell++] = i % 2 == 0 ? CELL_MAGENTA : CELL_GREEN;
+    for (int bit = DATA_CELLS - 1; bit >= 0; bit--) cells[cell++] = (timestamp_ns >> bit) & 1 ? CELL_WHITE : CELL_BLACK;
+
+    uint8_t crc = crc8(timestamp_ns);
+    for (int bit = CRC_CELLS - 1; bit >= 0; bit--) cells[cell++] = (crc >> bit) & 1 ? CELL_WHITE : CELL_BLACK;
+    for (size_t i = 0; i < MARKER_CELLS; i++) cells[cell++] = i % 2 == 0 ? CELL_GREEN : CELL_MAGENTA;
+}
+
+void timestamp_pattern_encode(uint32_t * pixels, uint32_t stride, uint64_t timestamp_ns) {
+    static const uint32_t colors[] = { COLOR_BLACK, COLOR_WHITE, COLOR_GREEN, COLOR_MAGENTA };
+    cell_t cells[TIMESTAMP_PATTERN_COLUMNS * TIMESTAMP_PATTERN_ROWS];
+    pattern_cells(timestamp_ns, cells);
+
+    for (uint32_t y = 0; y < TIMESTAMP_PATTERN_HEIGHT; y++) {
+        uint32_t * row = pixels + (size_t)y * stride;
+        const cell_t * row_cells = cells + (y / TIMESTAMP_PATTERN_BLOCK) * TIMESTAMP_PATTERN_COLUMNS;
+        for (uint32_t x = 0; x < TIMESTAMP_PATTERN_WIDTH; x++) {
+            row[x] = colors[row_cells[x / TIMESTAMP_PATTERN_BLOCK]];
+        }
+    }
+}
+
+// thresholds leave room for compositors that blend or dither
+static cell_t classify(uint32_t pixel) {
+    uint32_t c0 = (pixel >> 16) & 0xff;
+    uint32_t c1 = (pixel >> 8) & 0xff;
+    uint32_t c2 = pixel & 0xff;
+
+    bool high0 = c0 > 160, high1 = c1 > 160, high2 = c2 > 160;
+    bool low0 = c0 < 96, low1 = c1 < 96, low2 = c2 < 96;
+    if (high0 && high1 && high2) return CELL_WHITE;
+    if (low0 && low1 && low2) return CELL_BLACK;
+    if (low0 && high1 && low2) return CELL_GREEN;
+    if (high0 && low1 && high2) return CELL_MAGENTA;
+    return CELL_UNKNOWN;
+}
+
+// rows are pitch bytes apart, negative for bottom-up buffers
+static uint32_t pixel_at(const uint8_t * rows, ptrdiff_t pitch, uint32_t x, uint32_t y) {
+    return *(const uint32_t *)(rows + (ptrdiff_t)y * pitch + (size_t)x * 4);
+}
+
+static bool read_at(const uint8_t * rows, ptrdiff_t pitch, uint32_t x0, uint32_t y0, uint64_t * timestamp_ns) {
+    cell_t cells[TIMESTAMP_PATTERN_COLUMNS * TIMESTAMP_PATTERN_ROWS];
+    for (uint32_t row = 0; row < TIMESTAMP_PATTERN_ROWS; row++) {
+        for (uint32_t column = 0; column < TIMESTAMP_PATTERN_COLUMNS; column++) {
+            uint32_t x = x0 + column * TIMESTAMP_PATTERN_BLOCK + TIMESTAMP_PATTERN_BLOCK / 2;
+            uint32_t y = y0 + row * TIMESTAMP_PATTERN_BLOCK + TIMESTAMP_PATTERN_BLOCK / 2;
+            cells[row * TIMESTAMP_PATTERN_COLUMNS + column] = classify(pixel_at(rows, pitch, x, y));
+        }
+    }
+
+    uint64_t value = 0;
+    uint8_t crc = 0;
+    const cell_t * data = cells + MARKER_CELLS;
+    for (size_t i = 0; i < DATA_CELLS + CRC_CELLS; i++) {
+        if (data[i] != CELL_WHITE && data[i] != CELL_BLACK) return false;
+        if (i < DATA_CELLS) {
+            value = (value << 1) | (data[i] == CELL_WHITE);
+        } else {
+            crc = (crc << 1) | (data[i] == CELL_WHITE);
+        }
+    }
+
+    // markers included, so a damaged pattern never passes by chance
+    cell_t expected[TIMESTAMP_PATTERN_COLUMNS * TIMESTAMP_PATTERN_ROWS];
+    pattern_cells(value, expected);
+    for (size_t i = 0; i < TIMESTAMP_PATTERN_COLUMNS * TIMESTAMP_PATTERN_ROWS; i++) {
+        if (cells[i] != expected[i]) return false;
+    }
+    if (crc != crc8(value)) return false;
+
+    *timestamp_ns = value;
+    return true;
+}
+
+bool timestamp_pattern_decode(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride, bool y_invert, uint64_t * timestamp_ns) {
+    // the producer window rarely moves, try where it was found last first
+    static uint32_t last_x = 0;
+    static uint32_t last_y = 0;
+
+    if (width < TIMESTAMP_PATTERN_WIDTH || height < TIMESTAMP_PATTERN_HEIGHT) return false;
+    uint32_t max_x = width - TIMESTAMP_PATTERN_WIDTH;
+    uint32_t max_y = height - TIMESTAMP_PATTERN_HEIGHT;
+
+    // an inverted buffer is scanned from its last row up, so the pattern is
+    // found at the same position either way
+    const uint8_t * rows = (const uint8_t *)pixels;
+    ptrdiff_t pitch = stride;
+    if (y_invert) {
+        rows += (size_t)(height - 1) * stride;
+        pitch = -pitch;
+    }
+
+    if (last_x <= max_x && last_y <= max_y && read_at(rows, pitch, last_x, last_y, timestamp_ns)) return true;
+
+    // the first magenta pixel of the start marker in scan order is the top
+    // left corner of the pattern
+    for (uint32_t y = 0; y <= max_y; y++) {
+        for (uint32_t x = 0; x <= max_x; x++) {
+            if (classify(pixel_at(rows, pitch, x, y)) != CELL_MAGENTA) continue;
+            if (classify(pixel_at(rows, pitch, x + TIMESTAMP_PATTERN_BLOCK, y)) != CELL_GREEN) continue;
+            if (!read_at(rows, pitch, x, y, timestamp_ns)) continue;
+
+            last_x = x;
+            last_y = y;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// --- latency statistics ---
+
+static struct {
+    bool active;
+    uint64_t * ready_latency_ns;
+    uint64_t * processed_latency_ns;
+    size_t count;
+    size_t capacity;
+
+    uint64_t last_timestamp_ns;
+    uint64_t frames;
+    uint64_t missing;
+    uint64_t repeated;
+} latency;
+
+void timestamp_latency_init(void) {
+    latency.active = option_flag("WLEXP_TIMESTAMP");
+}
+
+bool timestamp_latency_active(void) {
+    return latency.active;
+}
+
+void timestamp_latency_frame(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride, bool y_invert, uint64_t ready_ns) {
+    if (!latency.active) return;
+    latency.frames++;
+
+    uint64_t timestamp_ns;
+    if (!timestamp_pattern_decode(pixels, width, height, stride, y_invert, &timestamp_ns)) {
+        latency.missing++;
+        return;
+    }
+    uint64_t processed_ns = clock_now_ns();
+
+    // the producer did not commit since the last capture, the latency of the
+    // old stamp says nothing about this frame
+    if (timestamp_ns == latency.last_timestamp_ns) {
+        latency.repeated++;
+        return;
+    }
+    latency.last_timestamp_ns = timestamp_ns;
+
+    if (latency.count == latency.capacity) {
+        size_t capacity = latency.capacity == 0 ? 1024 : latency.capacity * 2;
+        uint64_t * ready = realloc(latency.ready_latency_ns, capacity * sizeof *ready);
+        if (ready != NULL) latency.ready_latency_ns = ready;
+        uint64_t * processed = realloc(latency.processed_latency_ns, capacity * sizeof *processed);
+        if (processed != NULL) latency.processed_latency_ns = processed;
+
+        if (ready == NULL || processed == NULL) {
+            printf("[!] timestamp: failed to grow latency samples\n");
+            return;
+        }
+        latency.capacity = capacity;
+    }
+
+    latency.ready_latency_ns[latency.count] = ready_ns > timestamp_ns ? ready_ns - timestamp_ns : 0;
+    latency.processed_latency_ns[latency.count] = processed_ns - timestamp_ns;
+    latency.count++;
+}
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    if (count == 0) return 0;
+
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+static void report_distribution(const char * name, uint64_t * samples, size_t count) {
+    qsort(samples, count, sizeof *samples, compare_u64);
+    printf("[timestamp] %-18s min %7.3f ms, p50 %7.3f ms, p90 %7.3f ms, p99 %7.3f ms, max %7.3f ms\n",
+        name, samples[0] / 1e6,
+        percentile(samples, count, 50) / 1e6, percentile(samples, count, 90) / 1e6,
+        percentile(samples, count, 99) / 1e6, samples[count - 1] / 1e6
+    );
+}
+
+void timestamp_latency_report(void) {
+    if (!latency.active) return;
+
+    printf("[timestamp] %lu frames: %zu stamped, %lu repeated, %lu without pattern\n",
+        latency.frames, latency.count, latency.repeated, latency.missing
+    );
+    if (latency.count > 0) {
+        report_distribution("render to ready", latency.ready_latency_ns, latency.count);
+        report_distribution("render to client", latency.processed_latency_ns, latency.count);
+    }
+
+    free(latency.ready_latency_ns);
+    free(latency.processed_latency_ns);
+    latency.ready_latency_ns = NULL;
+    latency.processed_latency_ns = NULL;
+    latency.count = 0;
+    latency.capacity = 0;
+}
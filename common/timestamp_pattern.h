@@ -0,0 +1,45 @@
+#ifndef COMMON_TIMESTAMP_PATTERN_H
+#define COMMON_TIMESTAMP_PATTERN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// CLOCK_MONOTONIC timestamps carried in the pixels of a frame, for measuring
+// the latency from a producer rendering a frame to a capture client seeing it
+//
+// the pattern is a grid of TIMESTAMP_PATTERN_BLOCK sized blocks: a start
+// marker of alternating magenta and green blocks, the 64 timestamp bits as
+// white (1) and black (0) blocks, a CRC-8 of the timestamp and an end marker.
+// all colors survive swapping red and blue, so the decoder does not need to
+// know whether the capture is XRGB or XBGR, and the CRC rejects frames the
+// compositor read while the producer was writing the pattern
+//
+// WLEXP_TIMESTAMP=1 makes fractional_scale_checkerboard stamp every frame it
+// commits, and the shm screencopy clients decode the stamp of every capture
+
+#define TIMESTAMP_PATTERN_BLOCK 4
+#define TIMESTAMP_PATTERN_COLUMNS 10
+#define TIMESTAMP_PATTERN_ROWS 8
+#define TIMESTAMP_PATTERN_WIDTH (TIMESTAMP_PATTERN_BLOCK * TIMESTAMP_PATTERN_COLUMNS)
+#define TIMESTAMP_PATTERN_HEIGHT (TIMESTAMP_PATTERN_BLOCK * TIMESTAMP_PATTERN_ROWS)
+
+// writes the pattern to the top left corner of a 32 bit buffer, stride in pixels
+void timestamp_pattern_encode(uint32_t * pixels, uint32_t stride, uint64_t timestamp_ns);
+
+// finds the pattern anywhere in a 32 bit buffer, stride in bytes, returns
+// false if there is none or it is damaged. y_invert reads the rows
+// bottom-up, as for screencopy frames flagged Y_INVERT
+bool timestamp_pattern_decode(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride, bool y_invert, uint64_t * timestamp_ns);
+
+// latency statistics of the capture clients, reads WLEXP_TIMESTAMP
+void timestamp_latency_init(void);
+bool timestamp_latency_active(void);
+
+// decodes a captured frame, ready_ns being its ready timestamp, and records
+// the latency to it and to now
+void timestamp_latency_frame(const uint32_t * pixels, uint32_t width, uint32_t height, uint32_t stride, bool y_invert, uint64_t ready_ns);
+
+// prints the latency distribution and frees the samples
+void timestamp_latency_report(void);
+
+#endif
@@ -1,13 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <wayland-client.h>
+#include <probe.h>
 
 int main(void) {
+    probe_mark("start");
     struct wl_display * display = wl_display_connect(NULL);
     if (display == NULL) {
         printf("[!] wl_display_connect\n");
         exit(1);
     }
+    probe_mark("connect");
 
     wl_display_disconnect(display);
 }
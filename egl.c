@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <wayland-util.h>
@@ -14,6 +15,9 @@
 #include <xdg-shell.h>
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
+#include <options.h>
+#include <probe.h>
+#include <clock.h>
 
 typedef struct {
     struct wl_display * display;
@@ -44,11 +48,37 @@ typedef struct {
     uint32_t width;
     uint32_t height;
     bool egl_initialized;
+
+    bool animate;
+    uint64_t animate_seconds;
+    struct wl_callback * frame_callback;
+    uint64_t callback_ns;
+    uint64_t first_frame_ns;
+    uint64_t last_frame_ns;
+    uint64_t frames;
+    uint64_t total_callback_to_swap_ns;
+    uint64_t max_callback_to_swap_ns;
+    uint64_t interval_start_ns;
+    uint64_t interval_frames;
+    uint64_t interval_callback_to_swap_ns;
 } ctx_t;
 
+static void print_animation_report(ctx_t * ctx) {
+    if (!ctx->animate || ctx->frames == 0) return;
+
+    // counted from the first swap, which is not a frame of its own
+    double elapsed_s = (ctx->last_frame_ns - ctx->first_frame_ns) / 1e9;
+    printf("[animate] %lu frames, %.1f fps, callback to swap mean %.3f ms, max %.3f ms\n",
+        ctx->frames, elapsed_s > 0 ? ctx->frames / elapsed_s : 0,
+        ctx->total_callback_to_swap_ns / 1e6 / ctx->frames, ctx->max_callback_to_swap_ns / 1e6
+    );
+}
+
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    print_animation_report(ctx);
+    if (ctx->frame_callback != NULL) wl_callback_destroy(ctx->frame_callback);
     if (ctx->egl_context != EGL_NO_SURFACE) eglDestroyContext(ctx->egl_display, ctx->egl_context);
     if (ctx->egl_surface != EGL_NO_SURFACE) eglDestroySurface(ctx->egl_display, ctx->egl_surface);
     if (ctx->egl_window != EGL_NO_SURFACE) wl_egl_window_destroy(ctx->egl_window);
@@ -153,6 +183,7 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
 // --- configure callbacks ---
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -237,14 +268,17 @@ static void xdg_toplevel_event_configure(
         printf("[info] resizing EGL window\n");
         wl_egl_window_resize(ctx->egl_window, width, height, 0, 0);
 
-        printf("[info] clearing frame\n");
-        glClearColor(1.0, 1.0, 0.0, 1.0);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glFlush();
-
-        if (eglSwapBuffers(ctx->egl_display, ctx->egl_surface) != EGL_TRUE) {
-            printf("[!] eglSwapBuffers: failed to swap buffers\n");
-            exit_fail(ctx);
+        // when animating, the next frame callback draws at the new size
+        if (!ctx->animate) {
+            printf("[info] clearing frame\n");
+            glClearColor(1.0, 1.0, 0.0, 1.0);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glFlush();
+
+            if (eglSwapBuffers(ctx->egl_display, ctx->egl_surface) != EGL_TRUE) {
+                printf("[!] eglSwapBuffers: failed to swap buffers\n");
+                exit_fail(ctx);
+            }
         }
     }
 
@@ -271,6 +305,67 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
     .close = xdg_toplevel_event_close
 };
 
+// --- animation ---
+
+static void request_frame(ctx_t * ctx);
+
+static void render_frame(ctx_t * ctx) {
+    // requested before the swap, so it applies to the commit eglSwapBuffers does
+    request_frame(ctx);
+
+    double t = (clock_now_ns() - ctx->first_frame_ns) / 1e9;
+    glClearColor(0.5 + 0.5 * sin(t * 2.0), 0.5 + 0.5 * sin(t * 2.0 + 2.1), 0.5 + 0.5 * sin(t * 2.0 + 4.2), 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (eglSwapBuffers(ctx->egl_display, ctx->egl_surface) != EGL_TRUE) {
+        printf("[!] eglSwapBuffers: failed to swap buffers\n");
+        exit_fail(ctx);
+    }
+
+    uint64_t now_ns = clock_now_ns();
+    uint64_t callback_to_swap_ns = now_ns - ctx->callback_ns;
+    ctx->frames++;
+    ctx->last_frame_ns = now_ns;
+    ctx->total_callback_to_swap_ns += callback_to_swap_ns;
+    if (callback_to_swap_ns > ctx->max_callback_to_swap_ns) ctx->max_callback_to_swap_ns = callback_to_swap_ns;
+    ctx->interval_frames++;
+    ctx->interval_callback_to_swap_ns += callback_to_swap_ns;
+
+    if (now_ns - ctx->interval_start_ns >= 1000000000) {
+        printf("[animate] %.1f fps, callback to swap mean %.3f ms\n",
+            ctx->interval_frames * 1e9 / (now_ns - ctx->interval_start_ns),
+            ctx->interval_callback_to_swap_ns / 1e6 / ctx->interval_frames
+        );
+        ctx->interval_start_ns = now_ns;
+        ctx->interval_frames = 0;
+        ctx->interval_callback_to_swap_ns = 0;
+    }
+
+    if (ctx->animate_seconds > 0 && now_ns - ctx->first_frame_ns >= ctx->animate_seconds * 1000000000) {
+        printf("[info] animation time elapsed, closing\n");
+        ctx->closing = true;
+    }
+}
+
+static void frame_callback_done(void * data, struct wl_callback * callback, uint32_t time) {
+    ctx_t * ctx = (ctx_t *)data;
+    ctx->callback_ns = clock_now_ns();
+
+    wl_callback_destroy(callback);
+    ctx->frame_callback = NULL;
+
+    render_frame(ctx);
+}
+
+static const struct wl_callback_listener frame_callback_listener = {
+    .done = frame_callback_done
+};
+
+static void request_frame(ctx_t * ctx) {
+    ctx->frame_callback = wl_surface_frame(ctx->surface);
+    wl_callback_add_listener(ctx->frame_callback, &frame_callback_listener, (void *)ctx);
+}
+
 // --- egl initialization ---
 
 void init_egl(ctx_t * ctx) {
@@ -288,6 +383,7 @@ void init_egl(ctx_t * ctx) {
         exit_fail(ctx);
     }
     printf("[info] initialized EGL %d.%d\n", major, minor);
+    probe_mark("egl_init");
 
     EGLint num_configs;
     printf("[info] getting number of EGL configs\n");
@@ -339,6 +435,15 @@ void init_egl(ctx_t * ctx) {
         exit_fail(ctx);
     }
 
+    if (ctx->animate) {
+        // frame callbacks pace the loop, a blocking swap would only add latency
+        printf("[info] disabling swap interval\n");
+        if (eglSwapInterval(ctx->egl_display, 0) != EGL_TRUE) {
+            printf("[!] eglSwapInterval: failed to set swap interval\n");
+        }
+        request_frame(ctx);
+    }
+
     printf("[info] clearing frame\n");
     glClearColor(1.0, 1.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -348,11 +453,16 @@ void init_egl(ctx_t * ctx) {
         printf("[!] eglSwapBuffers: failed to swap buffers\n");
         exit_fail(ctx);
     }
+    probe_mark("first_frame");
+
+    ctx->first_frame_ns = clock_now_ns();
+    ctx->interval_start_ns = ctx->first_frame_ns;
 
     ctx->egl_initialized = true;
 }
 
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
@@ -381,6 +491,20 @@ int main(void) {
     ctx->height = 1;
     ctx->egl_initialized = false;
 
+    ctx->animate = option_flag("WLEXP_ANIMATE");
+    long animate_seconds = option_long("WLEXP_ANIMATE_SECONDS", 0);
+    ctx->animate_seconds = animate_seconds > 0 ? animate_seconds : 0;
+    ctx->frame_callback = NULL;
+    ctx->callback_ns = 0;
+    ctx->first_frame_ns = 0;
+    ctx->last_frame_ns = 0;
+    ctx->frames = 0;
+    ctx->total_callback_to_swap_ns = 0;
+    ctx->max_callback_to_swap_ns = 0;
+    ctx->interval_start_ns = 0;
+    ctx->interval_frames = 0;
+    ctx->interval_callback_to_swap_ns = 0;
+
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
         exit_fail(ctx);
@@ -392,6 +516,7 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -411,6 +536,7 @@ int main(void) {
         printf("[!] wl_registry: no xdg_wm_base found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating surface\n");
     ctx->surface = wl_compositor_create_surface(ctx->compositor);
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/mman.h>
 #include <wayland-util.h>
 #include <wayland-client-core.h>
@@ -14,10 +15,21 @@
 #include <linux-dmabuf-unstable-v1.h>
 #include <wlr-export-dmabuf-unstable-v1.h>
 #include <drm_fourcc.h>
+#include <options.h>
+#include <probe.h>
+#include <accounting.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <cadence.h>
+#include <event_loop.h>
+#include <realtime.h>
 
 typedef struct {
     struct wl_output * proxy;
     size_t id;
+    char name[32];
+    cadence_t cadence;
     struct wl_list link;
 } output_t;
 
@@ -30,6 +42,7 @@ typedef struct {
 typedef struct {
     struct wl_display * display;
     struct wl_registry * registry;
+    event_loop_t * event_loop;
 
     struct wl_compositor * compositor;
     struct wl_shm * shm;
@@ -67,6 +80,7 @@ typedef struct {
     struct xdg_surface * xdg_surface;
     struct xdg_toplevel * xdg_toplevel;
     struct zwlr_export_dmabuf_frame_v1 * dmabuf_frame;
+    struct wl_output * capture_output;
 
     uint32_t last_surface_serial;
     uint32_t win_width;
@@ -75,27 +89,45 @@ typedef struct {
     bool xdg_toplevel_configured;
     bool configured;
     bool closing;
+    bool continuous;
 } ctx_t;
 
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    accounting_report();
+    bench_stats_report();
+    realtime_report();
+
     if (ctx->dmabuf_frame != NULL) zwlr_export_dmabuf_frame_v1_destroy(ctx->dmabuf_frame);
     if (ctx->xdg_toplevel != NULL) xdg_toplevel_destroy(ctx->xdg_toplevel);
     if (ctx->xdg_surface != NULL) xdg_surface_destroy(ctx->xdg_surface);
     if (ctx->viewport != NULL) wp_viewport_destroy(ctx->viewport);
     if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
 
-    if (ctx->dmabuf_buffer != NULL) wl_buffer_destroy(ctx->dmabuf_buffer);
+    if (ctx->dmabuf_buffer != NULL) {
+        wl_buffer_destroy(ctx->dmabuf_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer);
+    }
     if (ctx->dmabuf_params != NULL) zwp_linux_buffer_params_v1_destroy(ctx->dmabuf_params);
 
-    if (ctx->shm_buffer != NULL) wl_buffer_destroy(ctx->shm_buffer);
+    if (ctx->shm_buffer != NULL) {
+        wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
+    }
     if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
-    if (ctx->shm_pixels != NULL) munmap(ctx->shm_pixels, ctx->shm_size);
-    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
 
     output_t *output, *output_next;
     wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        cadence_report(&output->cadence, output->name);
         wl_list_remove(&output->link);
         wl_output_destroy(output->proxy);
         free(output);
@@ -108,8 +140,11 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
     if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
     if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
     if (ctx->display != NULL) wl_display_disconnect(ctx->display);
 
+    resources_report();
+
     free(ctx);
 }
 
@@ -118,6 +153,33 @@ static void exit_fail(ctx_t * ctx) {
     exit(1);
 }
 
+// --- wl_output event handlers ---
+
+static void wl_output_event_geometry(
+    void * data, struct wl_output * proxy,
+    int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+    int32_t subpixel, const char * make, const char * model, int32_t transform
+) {
+    output_t * output = (output_t *)data;
+    printf("[wl_output] geometry: %s -> %s %s\n", output->name, make, model);
+}
+
+static void wl_output_event_mode(
+    void * data, struct wl_output * proxy,
+    uint32_t flags, int32_t width, int32_t height, int32_t refresh
+) {
+    output_t * output = (output_t *)data;
+    if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+
+    printf("[wl_output] mode: %s -> %dx%d@%d.%03d\n", output->name, width, height, refresh / 1000, refresh % 1000);
+    cadence_set_refresh(&output->cadence, refresh);
+}
+
+static const struct wl_output_listener wl_output_listener = {
+    .geometry = wl_output_event_geometry,
+    .mode = wl_output_event_mode
+};
+
 // --- wl_registry event handlers ---
 
 static void registry_event_add(
@@ -185,7 +247,10 @@ static void registry_event_add(
         printf("[info] binding output\n");
         output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
         output->id = id;
+        snprintf(output->name, sizeof output->name, "output %zu", id);
+        cadence_init(&output->cadence);
         wl_list_insert(&ctx->outputs, &output->link);
+        wl_output_add_listener(output->proxy, &wl_output_listener, (void *)output);
     }
 }
 
@@ -218,6 +283,8 @@ static void registry_event_remove(
         output_t *output, *output_next;
         wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
             if (output->id == id) {
+                if (ctx->capture_output == output->proxy) ctx->capture_output = NULL;
+                cadence_report(&output->cadence, output->name);
                 wl_list_remove(&output->link);
                 wl_output_destroy(output->proxy);
                 free(output);
@@ -235,11 +302,14 @@ static const struct wl_registry_listener registry_listener = {
 
 // --- zwlr_export_dmabuf_frame_v1 event handlers ---
 
+static void request_capture(ctx_t * ctx);
+
 static void zwlr_export_dmabuf_frame_frame(void * data, struct zwlr_export_dmabuf_frame_v1 * frame,
     uint32_t width, uint32_t height, uint32_t offset_x, uint32_t offset_y, uint32_t buffer_flags, uint32_t flags, uint32_t format, uint32_t modifier_hi, uint32_t modifier_lo, uint32_t num_objects
 ) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] frame %dx%d+%d+%d@%c%c%c%c with modifier %lx, buffer flags %x, flags %x, planes %d\n", width, height, offset_x, offset_y, PRINT_DRM_FORMAT(format), ((uint64_t)modifier_hi << 32) | modifier_lo, buffer_flags, flags, num_objects);
+    accounting_begin_stage(ACCOUNTING_STAGE_COPY);
 
     if (ctx->dmabuf_params != NULL) {
         zwp_linux_buffer_params_v1_destroy(ctx->dmabuf_params);
@@ -260,9 +330,14 @@ static void zwlr_export_dmabuf_frame_object(void * data, struct zwlr_export_dmab
 ) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] object %d@%d -> %d,%d\n", plane_index, fd, offset, stride);
+    resource_track(RESOURCE_FD, fd, size);
 
     printf("[info] adding dmabuf plane object\n");
     zwp_linux_buffer_params_v1_add(ctx->dmabuf_params, fd, plane_index, offset, stride, ctx->dmabuf_modifier_hi, ctx->dmabuf_modifier_lo);
+
+    // the params request holds its own copy of the fd
+    close(fd);
+    resource_untrack(RESOURCE_FD, fd);
 }
 
 static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabuf_frame_v1 * frame,
@@ -270,13 +345,22 @@ static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabu
 ) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] ready\n");
+    accounting_begin_stage(ACCOUNTING_STAGE_PROCESS);
+
+    if (ctx->capture_output != NULL) {
+        output_t * output = (output_t *)wl_output_get_user_data(ctx->capture_output);
+        cadence_frame(&output->cadence, output->name, clock_from_ready(sec_hi, sec_lo, nsec), clock_now_ns());
+    }
+    realtime_frame(clock_from_ready(sec_hi, sec_lo, nsec));
 
     if (ctx->dmabuf_buffer != NULL) {
         wl_buffer_destroy(ctx->dmabuf_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer);
     }
 
     printf("[info] creating dmabuf buffer\n");
     ctx->dmabuf_buffer = zwp_linux_buffer_params_v1_create_immed(ctx->dmabuf_params, ctx->dmabuf_width, ctx->dmabuf_height, ctx->dmabuf_format, ctx->dmabuf_flags);
+    resource_track(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer, 0);
 
     printf("[info] attaching buffer to surface\n");
     wl_surface_attach(ctx->surface, ctx->dmabuf_buffer, 0, 0);
@@ -286,11 +370,24 @@ static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabu
 
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    accounting_end_frame();
+    probe_mark("first_frame");
+    resources_print_live();
+
+    // the exported buffer is displayed in place, nothing is copied
+    if (bench_stats_end_frame(0)) {
+        ctx->closing = true;
+    } else if (ctx->continuous || bench_stats_active()) {
+        printf("[info] requesting next frame\n");
+        request_capture(ctx);
+    }
 }
 
 static void zwlr_export_dmabuf_frame_cancel(void * data, struct zwlr_export_dmabuf_frame_v1 * frame, uint32_t reason) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] cancel %d\n", reason);
+
+    if (bench_stats_fail_frame()) ctx->closing = true;
 }
 
 static const struct zwlr_export_dmabuf_frame_v1_listener zwlr_export_dmabuf_frame_listener = {
@@ -302,16 +399,35 @@ static const struct zwlr_export_dmabuf_frame_v1_listener zwlr_export_dmabuf_fram
 
 // --- wl_surface event handlers ---
 
+static void request_capture(ctx_t * ctx) {
+    if (ctx->dmabuf_frame != NULL) {
+        zwlr_export_dmabuf_frame_v1_destroy(ctx->dmabuf_frame);
+        ctx->dmabuf_frame = NULL;
+    }
+
+    if (ctx->capture_output == NULL) {
+        printf("[info] no output to capture\n");
+        return;
+    }
+
+    accounting_begin_frame();
+    bench_stats_begin_frame();
+    ctx->dmabuf_frame = zwlr_export_dmabuf_manager_v1_capture_output(ctx->export_dmabuf, 0, ctx->capture_output);
+    zwlr_export_dmabuf_frame_v1_add_listener(ctx->dmabuf_frame, &zwlr_export_dmabuf_frame_listener, (void *)ctx);
+}
+
 static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[wl_surface] enter\n");
 
-    if (ctx->dmabuf_frame != NULL) {
-        zwlr_export_dmabuf_frame_v1_destroy(ctx->dmabuf_frame);
+    if (ctx->capture_output != output) {
+        // intervals across a switch between outputs are meaningless
+        output_t * entry = (output_t *)wl_output_get_user_data(output);
+        cadence_restart(&entry->cadence);
     }
 
-    ctx->dmabuf_frame = zwlr_export_dmabuf_manager_v1_capture_output(ctx->export_dmabuf, 0, output);
-    zwlr_export_dmabuf_frame_v1_add_listener(ctx->dmabuf_frame, &zwlr_export_dmabuf_frame_listener, (void *)ctx);
+    ctx->capture_output = output;
+    request_capture(ctx);
 }
 
 static const struct wl_surface_listener wl_surface_listener = {
@@ -344,6 +460,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         if (ctx->shm_buffer != NULL) {
             printf("[info] destroying old shm buffer\n");
             wl_buffer_destroy(ctx->shm_buffer);
+            resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
             ctx->shm_buffer = NULL;
         }
 
@@ -359,6 +476,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
             printf("[!] mremap: failed to remap shm file\n");
             exit_fail(ctx);
         }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
         ctx->shm_pixels = (uint32_t *)new_pixels;
         ctx->shm_size = size;
 
@@ -372,6 +490,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
     if (ctx->shm_buffer != NULL) {
         printf("[info] destroying old shm buffer\n");
         wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
         ctx->shm_buffer = NULL;
     }
 
@@ -381,6 +500,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         printf("[!] wl_shm_pool: failed to create buffer\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_WL_BUFFER, ctx->shm_buffer, 0);
 }
 
 
@@ -404,6 +524,7 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -511,11 +632,21 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
     .close = xdg_toplevel_event_close
 };
 
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
+    ctx->event_loop = NULL;
 
     ctx->compositor = NULL;
     ctx->compositor_id = 0;
@@ -552,6 +683,7 @@ int main(void) {
     ctx->xdg_surface = NULL;
     ctx->xdg_toplevel = NULL;
     ctx->dmabuf_frame = NULL;
+    ctx->capture_output = NULL;
 
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
@@ -560,6 +692,7 @@ int main(void) {
     ctx->xdg_toplevel_configured = false;
     ctx->configured = false;
     ctx->closing = false;
+    ctx->continuous = option_flag("WLEXP_CONTINUOUS");
 
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
@@ -572,6 +705,12 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
+
+    printf("[info] initializing accounting\n");
+    accounting_init(ctx->display);
+    bench_stats_init();
+    realtime_init();
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -600,6 +739,7 @@ int main(void) {
         printf("[!] wl_registry: no export_dmabuf found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -607,6 +747,7 @@ int main(void) {
         printf("[!] memfd_create: failed to create shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
 
     printf("[info] resizing shm file\n");
     ctx->shm_size = 1;
@@ -622,6 +763,7 @@ int main(void) {
         printf("[!] mmap: failed to map shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
 
     printf("[info] creating shm pool\n");
     ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
@@ -682,8 +824,26 @@ int main(void) {
         exit_fail(ctx);
     }
 
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
     printf("[info] entering event loop\n");
-    while (wl_display_dispatch(ctx->display) != -1 && !ctx->closing) {}
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
     printf("[info] exiting event loop\n");
 
     cleanup(ctx);
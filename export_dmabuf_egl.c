@@ -4,7 +4,10 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
 #include <wayland-util.h>
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
@@ -20,10 +23,27 @@
 #include <GLES2/gl2ext.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <options.h>
+#include <probe.h>
+#include <gpu_timer.h>
+#include <accounting.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <cadence.h>
+#include <frame_stats.h>
+#include <hud.h>
+#include <event_loop.h>
+#include <realtime.h>
+#include <idle_throttle.h>
+#include <task_pool.h>
+#include <pixels.h>
 
 typedef struct {
     struct wl_output * proxy;
     size_t id;
+    char name[32];
+    cadence_t cadence;
     struct wl_list link;
 } output_t;
 
@@ -36,6 +56,7 @@ typedef struct {
 typedef struct {
     struct wl_display * display;
     struct wl_registry * registry;
+    event_loop_t * event_loop;
 
     struct wl_compositor * compositor;
     struct wl_shm * shm;
@@ -65,12 +86,18 @@ typedef struct {
     uint32_t dmabuf_modifier_lo;
     uint32_t dmabuf_modifier_hi;
     uint32_t dmabuf_flags;
+    int dmabuf_fds[4];
+    uint32_t dmabuf_objects;
+    uint32_t dmabuf_size;
+    uint32_t dmabuf_offset;
+    uint32_t dmabuf_stride;
 
     struct wl_surface * surface;
     struct wp_viewport * viewport;
     struct xdg_surface * xdg_surface;
     struct xdg_toplevel * xdg_toplevel;
     struct zwlr_export_dmabuf_frame_v1 * dmabuf_frame;
+    struct wl_output * capture_output;
 
     EGLDisplay egl_display;
     EGLContext egl_context;
@@ -80,7 +107,18 @@ typedef struct {
     GLuint egl_vbo;
     GLuint egl_texture;
     GLuint egl_shader_program;
+    gpu_timer_t gpu_timer;
+    frame_stats_t frame_stats;
+    hud_t hud;
     EGLAttrib * egl_image_attribs;
+    idle_throttle_t idle;
+    task_pool_t * tasks;
+    uint32_t diff_tile_size;
+    uint32_t num_tiles;
+    uint64_t * tile_hashes;
+    uint64_t * next_tile_hashes;
+    bool diff_valid;
+    bool diff_unreadable;
 
     uint32_t last_surface_serial;
     uint32_t win_width;
@@ -89,33 +127,73 @@ typedef struct {
     bool xdg_toplevel_configured;
     bool configured;
     bool closing;
+    bool continuous;
+    bool idle_throttle;
 } ctx_t;
 
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    accounting_report();
+    bench_stats_report();
+    realtime_report();
+    if (ctx->idle.timer != NULL) {
+        idle_throttle_report(&ctx->idle, gpu_timer_frame_mean_ns(&ctx->gpu_timer));
+        idle_throttle_finish(&ctx->idle);
+    }
+    if (ctx->tasks != NULL) task_pool_destroy(ctx->tasks);
+    free(ctx->tile_hashes);
+    free(ctx->next_tile_hashes);
+    gpu_timer_report(&ctx->gpu_timer);
+    gpu_timer_destroy(&ctx->gpu_timer);
+    hud_destroy(&ctx->hud);
+
     if (ctx->egl_image_attribs != NULL) free(ctx->egl_image_attribs);
-    if (ctx->egl_shader_program != 0) glDeleteProgram(ctx->egl_shader_program);
-    if (ctx->egl_texture != 0) glDeleteTextures(1, &ctx->egl_texture);
-    if (ctx->egl_vbo != 0) glDeleteBuffers(1, &ctx->egl_vbo);
+    if (ctx->egl_shader_program != 0) {
+        glDeleteProgram(ctx->egl_shader_program);
+        resource_untrack(RESOURCE_GL_PROGRAM, ctx->egl_shader_program);
+    }
+    if (ctx->egl_texture != 0) {
+        glDeleteTextures(1, &ctx->egl_texture);
+        resource_untrack(RESOURCE_GL_TEXTURE, ctx->egl_texture);
+    }
+    if (ctx->egl_vbo != 0) {
+        glDeleteBuffers(1, &ctx->egl_vbo);
+        resource_untrack(RESOURCE_GL_BUFFER, ctx->egl_vbo);
+    }
     if (ctx->egl_context != EGL_NO_SURFACE) eglDestroyContext(ctx->egl_display, ctx->egl_context);
     if (ctx->egl_surface != EGL_NO_SURFACE) eglDestroySurface(ctx->egl_display, ctx->egl_surface);
     if (ctx->egl_window != EGL_NO_SURFACE) wl_egl_window_destroy(ctx->egl_window);
     if (ctx->egl_display != EGL_NO_DISPLAY) eglTerminate(ctx->egl_display);
 
     if (ctx->dmabuf_frame != NULL) zwlr_export_dmabuf_frame_v1_destroy(ctx->dmabuf_frame);
+    for (size_t i = 0; i < 4; i++) {
+        if (ctx->dmabuf_fds[i] == -1) continue;
+        close(ctx->dmabuf_fds[i]);
+        resource_untrack(RESOURCE_FD, ctx->dmabuf_fds[i]);
+    }
     if (ctx->xdg_toplevel != NULL) xdg_toplevel_destroy(ctx->xdg_toplevel);
     if (ctx->xdg_surface != NULL) xdg_surface_destroy(ctx->xdg_surface);
     if (ctx->viewport != NULL) wp_viewport_destroy(ctx->viewport);
     if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
 
-    if (ctx->shm_buffer != NULL) wl_buffer_destroy(ctx->shm_buffer);
+    if (ctx->shm_buffer != NULL) {
+        wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
+    }
     if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
-    if (ctx->shm_pixels != NULL) munmap(ctx->shm_pixels, ctx->shm_size);
-    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
 
     output_t *output, *output_next;
     wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        cadence_report(&output->cadence, output->name);
         wl_list_remove(&output->link);
         wl_output_destroy(output->proxy);
         free(output);
@@ -128,8 +206,11 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
     if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
     if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
     if (ctx->display != NULL) wl_display_disconnect(ctx->display);
 
+    resources_report();
+
     free(ctx);
 }
 
@@ -138,6 +219,33 @@ static void exit_fail(ctx_t * ctx) {
     exit(1);
 }
 
+// --- wl_output event handlers ---
+
+static void wl_output_event_geometry(
+    void * data, struct wl_output * proxy,
+    int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+    int32_t subpixel, const char * make, const char * model, int32_t transform
+) {
+    output_t * output = (output_t *)data;
+    printf("[wl_output] geometry: %s -> %s %s\n", output->name, make, model);
+}
+
+static void wl_output_event_mode(
+    void * data, struct wl_output * proxy,
+    uint32_t flags, int32_t width, int32_t height, int32_t refresh
+) {
+    output_t * output = (output_t *)data;
+    if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+
+    printf("[wl_output] mode: %s -> %dx%d@%d.%03d\n", output->name, width, height, refresh / 1000, refresh % 1000);
+    cadence_set_refresh(&output->cadence, refresh);
+}
+
+static const struct wl_output_listener wl_output_listener = {
+    .geometry = wl_output_event_geometry,
+    .mode = wl_output_event_mode
+};
+
 // --- wl_registry event handlers ---
 
 static void registry_event_add(
@@ -205,7 +313,10 @@ static void registry_event_add(
         printf("[info] binding output\n");
         output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
         output->id = id;
+        snprintf(output->name, sizeof output->name, "output %zu", id);
+        cadence_init(&output->cadence);
         wl_list_insert(&ctx->outputs, &output->link);
+        wl_output_add_listener(output->proxy, &wl_output_listener, (void *)output);
     }
 }
 
@@ -238,6 +349,8 @@ static void registry_event_remove(
         output_t *output, *output_next;
         wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
             if (output->id == id) {
+                if (ctx->capture_output == output->proxy) ctx->capture_output = NULL;
+                cadence_report(&output->cadence, output->name);
                 wl_list_remove(&output->link);
                 wl_output_destroy(output->proxy);
                 free(output);
@@ -255,6 +368,17 @@ static const struct wl_registry_listener registry_listener = {
 
 // --- zwlr_export_dmabuf_frame_v1 event handlers ---
 
+static void request_capture(ctx_t * ctx);
+
+static void close_dmabuf_fds(ctx_t * ctx) {
+    for (size_t i = 0; i < 4; i++) {
+        if (ctx->dmabuf_fds[i] == -1) continue;
+        close(ctx->dmabuf_fds[i]);
+        resource_untrack(RESOURCE_FD, ctx->dmabuf_fds[i]);
+        ctx->dmabuf_fds[i] = -1;
+    }
+}
+
 static const EGLAttrib fd_attribs[] = {
     EGL_DMA_BUF_PLANE0_FD_EXT,
     EGL_DMA_BUF_PLANE1_FD_EXT,
@@ -295,6 +419,7 @@ static void zwlr_export_dmabuf_frame_frame(void * data, struct zwlr_export_dmabu
 ) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] frame %dx%d+%d+%d@%c%c%c%c with modifier %lx, buffer flags %x, flags %x, planes %d\n", width, height, offset_x, offset_y, PRINT_DRM_FORMAT(format), ((uint64_t)modifier_hi << 32) | modifier_lo, buffer_flags, flags, num_objects);
+    accounting_begin_stage(ACCOUNTING_STAGE_COPY);
 
     if (ctx->egl_image_attribs != NULL) {
         free(ctx->egl_image_attribs);
@@ -324,6 +449,7 @@ static void zwlr_export_dmabuf_frame_frame(void * data, struct zwlr_export_dmabu
     ctx->dmabuf_flags = buffer_flags;
     ctx->dmabuf_modifier_hi = modifier_hi;
     ctx->dmabuf_modifier_lo = modifier_lo;
+    ctx->dmabuf_objects = num_objects;
 }
 
 static void zwlr_export_dmabuf_frame_object(void * data, struct zwlr_export_dmabuf_frame_v1 * frame,
@@ -332,6 +458,25 @@ static void zwlr_export_dmabuf_frame_object(void * data, struct zwlr_export_dmab
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] object %d@%d -> %d,%d\n", plane_index, fd, offset, stride);
 
+    if (index >= 4 || plane_index >= 4) {
+        printf("[error] too many dmabuf objects\n");
+        close(fd);
+        exit_fail(ctx);
+    }
+
+    if (ctx->dmabuf_fds[index] != -1) {
+        close(ctx->dmabuf_fds[index]);
+        resource_untrack(RESOURCE_FD, ctx->dmabuf_fds[index]);
+    }
+    ctx->dmabuf_fds[index] = fd;
+    resource_track(RESOURCE_FD, fd, size);
+
+    if (index == 0) {
+        ctx->dmabuf_size = size;
+        ctx->dmabuf_offset = offset;
+        ctx->dmabuf_stride = stride;
+    }
+
     printf("[info] adding dmabuf plane object to attribs\n");
     int i = 6 + 10 * plane_index;
     EGLAttrib * image_attribs = ctx->egl_image_attribs;
@@ -347,11 +492,128 @@ static void zwlr_export_dmabuf_frame_object(void * data, struct zwlr_export_dmab
     image_attribs[i++] = ctx->dmabuf_modifier_hi;
 }
 
+// --- frame diff ---
+
+typedef struct {
+    const uint32_t * pixels;
+    uint32_t stride;
+    uint64_t * hashes;
+} diff_job_t;
+
+static void hash_tile(void * data, uint32_t index, task_region_t tile) {
+    diff_job_t * job = (diff_job_t *)data;
+    const uint32_t * pixels = job->pixels + (size_t)tile.y * job->stride + tile.x;
+    job->hashes[index] = pixels_hash(pixels, tile.width, tile.height, job->stride);
+}
+
+// which buffer a compositor exports says nothing about its contents, it may
+// hand out any buffer of its swapchain, so frames are compared by the tile
+// hashes of WLEXP_DIFF. only linear single plane buffers can be read on the
+// CPU, any other frame counts as changed
+static bool diff_frame(ctx_t * ctx) {
+    uint64_t modifier = ((uint64_t)ctx->dmabuf_modifier_hi << 32) | ctx->dmabuf_modifier_lo;
+    size_t frame_size = (size_t)ctx->dmabuf_offset + (size_t)ctx->dmabuf_stride * ctx->dmabuf_height;
+    bool readable = modifier == DRM_FORMAT_MOD_LINEAR && ctx->dmabuf_objects == 1 &&
+        ctx->dmabuf_stride >= ctx->dmabuf_width * 4 && frame_size <= ctx->dmabuf_size;
+    if (!readable) {
+        if (!ctx->diff_unreadable) printf("[!] idle: modifier %lx cannot be read, every frame counts as changed\n", modifier);
+        ctx->diff_unreadable = true;
+        return true;
+    }
+
+    uint32_t tiles = task_pool_tile_count(ctx->dmabuf_width, ctx->dmabuf_height, ctx->diff_tile_size, ctx->diff_tile_size);
+    if (tiles != ctx->num_tiles) {
+        free(ctx->tile_hashes);
+        free(ctx->next_tile_hashes);
+        ctx->tile_hashes = malloc(tiles * sizeof (uint64_t));
+        ctx->next_tile_hashes = malloc(tiles * sizeof (uint64_t));
+        if (ctx->tile_hashes == NULL || ctx->next_tile_hashes == NULL) {
+            printf("[!] malloc: failed to allocate tile hashes\n");
+            exit_fail(ctx);
+        }
+        ctx->num_tiles = tiles;
+        ctx->diff_valid = false;
+    }
+
+    int fd = ctx->dmabuf_fds[0];
+    uint8_t * map = mmap(NULL, frame_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("[!] mmap: failed to map dmabuf\n");
+        ctx->diff_valid = false;
+        return true;
+    }
+
+    // fails on memfds, which need no synchronization
+    struct dma_buf_sync sync = { .flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+    ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+    uint64_t start_ns = clock_now_ns();
+    diff_job_t job;
+    job.pixels = (const uint32_t *)(map + ctx->dmabuf_offset);
+    job.stride = ctx->dmabuf_stride / 4;
+    job.hashes = ctx->next_tile_hashes;
+    task_pool_for_tiles(ctx->tasks, ctx->dmabuf_width, ctx->dmabuf_height, ctx->diff_tile_size, ctx->diff_tile_size, hash_tile, &job);
+
+    sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+    ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+    munmap(map, frame_size);
+
+    uint32_t changed = 0;
+    for (uint32_t i = 0; i < tiles; i++) {
+        if (!ctx->diff_valid || ctx->next_tile_hashes[i] != ctx->tile_hashes[i]) changed++;
+    }
+    uint64_t * hashes = ctx->tile_hashes;
+    ctx->tile_hashes = ctx->next_tile_hashes;
+    ctx->next_tile_hashes = hashes;
+    ctx->diff_valid = true;
+
+    printf("[diff] %u of %u tiles changed, hashed in %.3f ms\n", changed, tiles, (clock_now_ns() - start_ns) / 1e6);
+    return changed > 0;
+}
+
+static void update_hud(ctx_t * ctx) {
+    if (!hud_update_due(&ctx->hud)) return;
+
+    static const double percentiles[] = { 50, 90, 99 };
+    uint64_t latency_ns[3];
+    frame_stats_percentiles(&ctx->frame_stats, percentiles, latency_ns, 3);
+
+    hud_set_line(&ctx->hud, 0, "FPS %.1f (%lu FRAMES)", frame_stats_fps(&ctx->frame_stats), ctx->frame_stats.frames);
+    hud_set_line(&ctx->hud, 1, "LATENCY MS P50 %.2f P90 %.2f P99 %.2f", latency_ns[0] / 1e6, latency_ns[1] / 1e6, latency_ns[2] / 1e6);
+    hud_set_line(&ctx->hud, 2, "IN FLIGHT %zu, %lu FAILED", ctx->frame_stats.in_flight, ctx->frame_stats.cancelled);
+    hud_set_line(&ctx->hud, 3, "%ux%u %c%c%c%c MOD %lx", ctx->dmabuf_width, ctx->dmabuf_height, PRINT_DRM_FORMAT(ctx->dmabuf_format), ((uint64_t)ctx->dmabuf_modifier_hi << 32) | ctx->dmabuf_modifier_lo);
+    hud_set_line(&ctx->hud, 4, "EXPORT DMABUF + EGLIMAGE");
+}
+
 static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabuf_frame_v1 * frame,
     uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec
 ) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] ready\n");
+    accounting_begin_stage(ACCOUNTING_STAGE_PROCESS);
+
+    if (ctx->capture_output != NULL) {
+        output_t * output = (output_t *)wl_output_get_user_data(ctx->capture_output);
+        cadence_frame(&output->cadence, output->name, clock_from_ready(sec_hi, sec_lo, nsec), clock_now_ns());
+    }
+    realtime_frame(clock_from_ready(sec_hi, sec_lo, nsec));
+
+    if (ctx->idle_throttle && !idle_throttle_frame(&ctx->idle, diff_frame(ctx))) {
+        free(ctx->egl_image_attribs);
+        ctx->egl_image_attribs = NULL;
+        close_dmabuf_fds(ctx);
+
+        // the window already shows this picture
+        frame_stats_end(&ctx->frame_stats);
+        accounting_end_frame();
+        if (bench_stats_end_frame(0)) {
+            ctx->closing = true;
+        } else {
+            idle_throttle_next(&ctx->idle);
+        }
+        return;
+    }
+    if (ctx->idle_throttle) idle_throttle_begin_processing(&ctx->idle);
 
     printf("[info] setting source viewport\n");
     wp_viewport_set_source(ctx->viewport, 0, 0, wl_fixed_from_int(ctx->dmabuf_width), wl_fixed_from_int(ctx->dmabuf_height));
@@ -359,6 +621,8 @@ static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabu
     glViewport(0, 0, ctx->dmabuf_width, ctx->dmabuf_height);
 
     printf("[info] import dmabuf\n");
+    gpu_timer_begin_frame(&ctx->gpu_timer);
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_UPLOAD);
     // create EGLImage from dmabuf with attribute array
     EGLImage frame_image = eglCreateImage(ctx->egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, ctx->egl_image_attribs);
     free(ctx->egl_image_attribs);
@@ -368,6 +632,7 @@ static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabu
         printf("[error] error = %x\n", eglGetError());
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_EGL_IMAGE, frame_image, 0);
 
     // convert EGLImage to GL texture
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
@@ -376,25 +641,55 @@ static void zwlr_export_dmabuf_frame_ready(void * data, struct zwlr_export_dmabu
 
     // destroy temporary image
     eglDestroyImage(ctx->egl_display, frame_image);
+    resource_untrack(RESOURCE_EGL_IMAGE, frame_image);
+
+    // the imported image keeps its own reference to the dmabuf
+    close_dmabuf_fds(ctx);
 
     printf("[info] drawing texture\n");
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_DRAW);
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
     glClear(GL_COLOR_BUFFER_BIT);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
+    if (ctx->hud.enabled) gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_HUD);
+    update_hud(ctx);
+    hud_draw(&ctx->hud, ctx->dmabuf_width, ctx->dmabuf_height);
+
     printf("[info] swapping buffers\n");
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_SWAP);
     if (eglSwapBuffers(ctx->egl_display, ctx->egl_surface) != EGL_TRUE) {
         printf("[!] eglSwapBuffers: failed to swap buffers\n");
         exit_fail(ctx);
     }
+    gpu_timer_end_stage(&ctx->gpu_timer);
+    frame_stats_end(&ctx->frame_stats);
 
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    if (ctx->idle_throttle) idle_throttle_end_processing(&ctx->idle);
+    accounting_end_frame();
+    probe_mark("first_frame");
+    resources_print_live();
+
+    // the exported buffer is imported in place, nothing is copied
+    if (bench_stats_end_frame(0)) {
+        ctx->closing = true;
+    } else if (ctx->idle_throttle) {
+        idle_throttle_next(&ctx->idle);
+    } else if (ctx->continuous || bench_stats_active()) {
+        printf("[info] requesting next frame\n");
+        request_capture(ctx);
+    }
 }
 
 static void zwlr_export_dmabuf_frame_cancel(void * data, struct zwlr_export_dmabuf_frame_v1 * frame, uint32_t reason) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[dmabuf_frame] cancel %d\n", reason);
+
+    frame_stats_cancel(&ctx->frame_stats);
+    close_dmabuf_fds(ctx);
+    if (bench_stats_fail_frame()) ctx->closing = true;
 }
 
 static const struct zwlr_export_dmabuf_frame_v1_listener zwlr_export_dmabuf_frame_listener = {
@@ -406,16 +701,39 @@ static const struct zwlr_export_dmabuf_frame_v1_listener zwlr_export_dmabuf_fram
 
 // --- wl_surface event handlers ---
 
+static void request_capture(ctx_t * ctx) {
+    if (ctx->dmabuf_frame != NULL) {
+        zwlr_export_dmabuf_frame_v1_destroy(ctx->dmabuf_frame);
+        ctx->dmabuf_frame = NULL;
+    }
+
+    // a frame destroyed before it was presented
+    if (ctx->frame_stats.in_flight != 0) frame_stats_cancel(&ctx->frame_stats);
+
+    if (ctx->capture_output == NULL) {
+        printf("[info] no output to capture\n");
+        return;
+    }
+
+    accounting_begin_frame();
+    bench_stats_begin_frame();
+    frame_stats_begin(&ctx->frame_stats);
+    ctx->dmabuf_frame = zwlr_export_dmabuf_manager_v1_capture_output(ctx->export_dmabuf, 0, ctx->capture_output);
+    zwlr_export_dmabuf_frame_v1_add_listener(ctx->dmabuf_frame, &zwlr_export_dmabuf_frame_listener, (void *)ctx);
+}
+
 static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[wl_surface] enter\n");
 
-    if (ctx->dmabuf_frame != NULL) {
-        zwlr_export_dmabuf_frame_v1_destroy(ctx->dmabuf_frame);
+    if (ctx->capture_output != output) {
+        // intervals across a switch between outputs are meaningless
+        output_t * entry = (output_t *)wl_output_get_user_data(output);
+        cadence_restart(&entry->cadence);
     }
 
-    ctx->dmabuf_frame = zwlr_export_dmabuf_manager_v1_capture_output(ctx->export_dmabuf, 0, output);
-    zwlr_export_dmabuf_frame_v1_add_listener(ctx->dmabuf_frame, &zwlr_export_dmabuf_frame_listener, (void *)ctx);
+    ctx->capture_output = output;
+    request_capture(ctx);
 }
 
 static const struct wl_surface_listener wl_surface_listener = {
@@ -448,6 +766,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         if (ctx->shm_buffer != NULL) {
             printf("[info] destroying old shm buffer\n");
             wl_buffer_destroy(ctx->shm_buffer);
+            resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
             ctx->shm_buffer = NULL;
         }
 
@@ -463,6 +782,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
             printf("[!] mremap: failed to remap shm file\n");
             exit_fail(ctx);
         }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
         ctx->shm_pixels = (uint32_t *)new_pixels;
         ctx->shm_size = size;
 
@@ -476,6 +796,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
     if (ctx->shm_buffer != NULL) {
         printf("[info] destroying old shm buffer\n");
         wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
         ctx->shm_buffer = NULL;
     }
 
@@ -485,6 +806,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         printf("[!] wl_shm_pool: failed to create buffer\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_WL_BUFFER, ctx->shm_buffer, 0);
 }
 
 
@@ -508,6 +830,7 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -651,11 +974,28 @@ const char * fragment_shader =
     "}\n"
 ;
 
+// --- idle throttle ---
+
+static void throttled_capture(void * data) {
+    ctx_t * ctx = (ctx_t *)data;
+    request_capture(ctx);
+}
+
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
+    ctx->event_loop = NULL;
 
     ctx->compositor = NULL;
     ctx->compositor_id = 0;
@@ -685,11 +1025,17 @@ int main(void) {
     ctx->dmabuf_modifier_lo = 0;
     ctx->dmabuf_modifier_hi = 0;
     ctx->dmabuf_flags = 0;
+    for (size_t i = 0; i < 4; i++) ctx->dmabuf_fds[i] = -1;
+    ctx->dmabuf_objects = 0;
+    ctx->dmabuf_size = 0;
+    ctx->dmabuf_offset = 0;
+    ctx->dmabuf_stride = 0;
 
     ctx->surface = NULL;
     ctx->xdg_surface = NULL;
     ctx->xdg_toplevel = NULL;
     ctx->dmabuf_frame = NULL;
+    ctx->capture_output = NULL;
 
     ctx->egl_display = EGL_NO_DISPLAY;
     ctx->egl_context = EGL_NO_CONTEXT;
@@ -698,7 +1044,19 @@ int main(void) {
     ctx->egl_vbo = -1;
     ctx->egl_texture = -1;
     ctx->egl_shader_program = -1;
+    memset(&ctx->gpu_timer, 0, sizeof ctx->gpu_timer);
+    frame_stats_init(&ctx->frame_stats);
+    memset(&ctx->hud, 0, sizeof ctx->hud);
     ctx->egl_image_attribs = NULL;
+    ctx->idle.timer = NULL;
+    ctx->tasks = NULL;
+    ctx->diff_tile_size = option_long("WLEXP_DIFF_TILE", 64);
+    if (ctx->diff_tile_size < 8) ctx->diff_tile_size = 8;
+    ctx->num_tiles = 0;
+    ctx->tile_hashes = NULL;
+    ctx->next_tile_hashes = NULL;
+    ctx->diff_valid = false;
+    ctx->diff_unreadable = false;
 
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
@@ -707,6 +1065,8 @@ int main(void) {
     ctx->xdg_toplevel_configured = false;
     ctx->configured = false;
     ctx->closing = false;
+    ctx->continuous = option_flag("WLEXP_CONTINUOUS");
+    ctx->idle_throttle = option_flag("WLEXP_IDLE");
 
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
@@ -719,6 +1079,36 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
+
+    printf("[info] initializing accounting\n");
+    accounting_init(ctx->display);
+    bench_stats_init();
+    realtime_init();
+
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    // the first capture is requested while waiting for configure below
+    if (ctx->idle_throttle) {
+        printf("[info] creating idle throttle\n");
+        if (!idle_throttle_init(&ctx->idle, ctx->event_loop, throttled_capture, ctx)) {
+            printf("[!] idle_throttle: failed to create timer\n");
+            exit_fail(ctx);
+        }
+
+        // after realtime_init, so the workers share the pinned CPUs
+        printf("[info] creating task pool\n");
+        ctx->tasks = task_pool_create();
+        if (ctx->tasks == NULL) {
+            printf("[!] task_pool: failed to create task pool\n");
+            exit_fail(ctx);
+        }
+    }
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -747,6 +1137,7 @@ int main(void) {
         printf("[!] wl_registry: no export_dmabuf found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -754,6 +1145,7 @@ int main(void) {
         printf("[!] memfd_create: failed to create shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
 
     printf("[info] resizing shm file\n");
     ctx->shm_size = 1;
@@ -769,6 +1161,7 @@ int main(void) {
         printf("[!] mmap: failed to map shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
 
     printf("[info] creating shm pool\n");
     ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
@@ -843,6 +1236,7 @@ int main(void) {
         exit_fail(ctx);
     }
     printf("[info] initialized EGL %d.%d\n", major, minor);
+    probe_mark("egl_init");
 
     EGLint num_configs;
     printf("[info] getting number of EGL configs\n");
@@ -894,11 +1288,13 @@ int main(void) {
 
     printf("[info] create vertex buffer object\n");
     glGenBuffers(1, &ctx->egl_vbo);
+    resource_track(RESOURCE_GL_BUFFER, ctx->egl_vbo, sizeof vertex_array);
     glBindBuffer(GL_ARRAY_BUFFER, ctx->egl_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof vertex_array, vertex_array, GL_STATIC_DRAW);
 
     printf("[info] create texture and set scaling mode\n");
     glGenTextures(1, &ctx->egl_texture);
+    resource_track(RESOURCE_GL_TEXTURE, ctx->egl_texture, 0);
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -939,6 +1335,7 @@ int main(void) {
 
     printf("[info] create shader program and get pointers to shader uniforms\n");
     ctx->egl_shader_program = glCreateProgram();
+    resource_track(RESOURCE_GL_PROGRAM, ctx->egl_shader_program, 0);
     glAttachShader(ctx->egl_shader_program, vertex_shader);
     glAttachShader(ctx->egl_shader_program, fragment_shader);
     glLinkProgram(ctx->egl_shader_program);
@@ -947,10 +1344,10 @@ int main(void) {
         printf("[error] failed to link shader program\n");
         glDeleteShader(vertex_shader);
         glDeleteShader(fragment_shader);
-        glDeleteProgram(ctx->egl_shader_program);
         exit_fail(ctx);
     }
     glUseProgram(ctx->egl_shader_program);
+    probe_mark("shader");
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
@@ -961,6 +1358,12 @@ int main(void) {
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
 
+    printf("[info] initializing gpu timer\n");
+    gpu_timer_init(&ctx->gpu_timer);
+
+    printf("[info] initializing HUD\n");
+    hud_init(&ctx->hud);
+
     printf("[info] clearing frame\n");
     glClearColor(1.0, 1.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -972,8 +1375,19 @@ int main(void) {
         exit_fail(ctx);
     }
 
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
     printf("[info] entering event loop\n");
-    while (wl_display_dispatch(ctx->display) != -1 && !ctx->closing) {}
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
     printf("[info] exiting event loop\n");
 
     cleanup(ctx);
@@ -12,6 +12,11 @@
 #include <xdg-shell.h>
 #include <viewporter.h>
 #include <fractional-scale-v1.h>
+#include <options.h>
+#include <clock.h>
+#include <pixels.h>
+#include <probe.h>
+#include <timestamp_pattern.h>
 
 typedef struct {
     struct wl_output * proxy;
@@ -54,6 +59,9 @@ typedef struct ctx {
     struct xdg_toplevel * xdg_toplevel;
     double preferred_scale;
 
+    bool timestamps;
+    struct wl_callback * frame_callback;
+
     uint32_t last_surface_serial;
     uint32_t win_width;
     uint32_t win_height;
@@ -66,6 +74,7 @@ typedef struct ctx {
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    if (ctx->frame_callback != NULL) wl_callback_destroy(ctx->frame_callback);
     if (ctx->xdg_toplevel != NULL) xdg_toplevel_destroy(ctx->xdg_toplevel);
     if (ctx->xdg_surface != NULL) xdg_surface_destroy(ctx->xdg_surface);
     if (ctx->fractional_scale != NULL) wp_fractional_scale_v1_destroy(ctx->fractional_scale);
@@ -287,18 +296,7 @@ static void resize_shm_buffer(ctx_t * ctx) {
         wl_shm_pool_resize(ctx->shm_pool, size);
     }
 
-    for (size_t i = 0, y = 0; y < height; y++) {
-        for (size_t x = 0; x < width; x++, i++) {
-            uint32_t color;
-            if ((x % 2) ^ (y % 2)) {
-                color = 0xffffffff; // white
-            } else {
-                color = 0x00000000; // black
-            }
-
-            ctx->shm_pixels[i] = color;
-        }
-    }
+    pixels_fill_checkerboard(ctx->shm_pixels, width, height);
 
     ctx->shm_width = width;
     ctx->shm_height = height;
@@ -356,14 +354,58 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_event_ping
 };
 
+// --- timestamp frames ---
+
+static void request_frame(ctx_t * ctx);
+
+// redraws the timestamp pattern over the checkerboard, the caller commits
+static void stamp_frame(ctx_t * ctx) {
+    if (ctx->shm_width < TIMESTAMP_PATTERN_WIDTH || ctx->shm_height < TIMESTAMP_PATTERN_HEIGHT) return;
+
+    // taken right before the commit, so the latency starts at the commit
+    timestamp_pattern_encode(ctx->shm_pixels, ctx->shm_width, clock_now_ns());
+    wl_surface_attach(ctx->surface, ctx->shm_buffer, 0, 0);
+    wl_surface_damage_buffer(ctx->surface, 0, 0, TIMESTAMP_PATTERN_WIDTH, TIMESTAMP_PATTERN_HEIGHT);
+}
+
+// --- wl_callback event handlers ---
+
+static void frame_callback_done(void * data, struct wl_callback * callback, uint32_t callback_data) {
+    ctx_t * ctx = (ctx_t *)data;
+    wl_callback_destroy(callback);
+    ctx->frame_callback = NULL;
+
+    stamp_frame(ctx);
+    request_frame(ctx);
+    wl_surface_commit(ctx->surface);
+}
+
+static const struct wl_callback_listener frame_callback_listener = {
+    .done = frame_callback_done
+};
+
+static void request_frame(ctx_t * ctx) {
+    ctx->frame_callback = wl_surface_frame(ctx->surface);
+    wl_callback_add_listener(ctx->frame_callback, &frame_callback_listener, (void *)ctx);
+}
+
 // --- configure callbacks ---
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
+    // a resize redraws the checkerboard, the pattern goes back on top and
+    // the first configure starts the frame callback chain
+    if (ctx->timestamps) {
+        stamp_frame(ctx);
+        if (ctx->frame_callback == NULL) request_frame(ctx);
+    }
+
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    probe_mark("first_frame");
 
     ctx->xdg_surface_configured = false;
     ctx->xdg_toplevel_configured = false;
@@ -471,6 +513,7 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 };
 
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
@@ -503,6 +546,9 @@ int main(void) {
     ctx->xdg_toplevel = NULL;
     ctx->preferred_scale = 1.0;
 
+    ctx->timestamps = option_flag("WLEXP_TIMESTAMP");
+    ctx->frame_callback = NULL;
+
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
     ctx->win_height = 0;
@@ -522,6 +568,7 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -547,6 +594,7 @@ int main(void) {
         printf("[!] wl_registry: no xdg_wm_base found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -0,0 +1,590 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <wayland-util.h>
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+#include <xdg-shell.h>
+#include <options.h>
+#include <clock.h>
+#include <probe.h>
+
+// synthetic compositor load, derived from application.c: opens a number of
+// shm windows that animate through frame callbacks, each damaging a band that
+// moves down the window every frame
+//
+// with WLEXP_LOAD_PROCESSES=1 every window gets its own process and
+// connection, otherwise all windows share one connection. every window
+// reports the frame rate it achieved, so running this next to a capture
+// client shows how both degrade as the compositor gets busier
+
+#define NUM_BUFFERS 2
+#define BACKGROUND 0xff202020
+
+struct ctx;
+
+typedef struct {
+    struct wl_buffer * buffer;
+    uint32_t * pixels;
+    bool busy;
+    // band drawn into this buffer last time, cleared before drawing the next
+    int32_t band_y;
+} load_buffer_t;
+
+typedef struct {
+    struct ctx * ctx;
+    size_t index;
+
+    struct wl_surface * surface;
+    struct xdg_surface * xdg_surface;
+    struct xdg_toplevel * xdg_toplevel;
+    struct wl_callback * frame_callback;
+
+    struct wl_shm_pool * shm_pool;
+    uint32_t * shm_pixels;
+    size_t shm_size;
+    int shm_fd;
+    load_buffer_t buffers[NUM_BUFFERS];
+    uint32_t width;
+    uint32_t height;
+    int32_t band_height;
+    int32_t band_y;
+    bool full_damage;
+
+    bool configured;
+    uint64_t frames;
+    uint64_t stalls;
+    uint64_t first_frame_ns;
+    uint64_t last_frame_ns;
+    uint64_t last_draw_ns;
+} window_t;
+
+typedef struct ctx {
+    struct wl_display * display;
+    struct wl_registry * registry;
+
+    struct wl_compositor * compositor;
+    struct wl_shm * shm;
+    struct xdg_wm_base * xdg_wm_base;
+    uint32_t compositor_id;
+    uint32_t shm_id;
+    uint32_t xdg_wm_base_id;
+
+    window_t * windows;
+    size_t num_windows;
+    size_t first_window;
+
+    uint32_t default_width;
+    uint32_t default_height;
+    double fps;
+    long damage_percent;
+    double seconds;
+    bool closing;
+} ctx_t;
+
+static void destroy_window_buffers(window_t * window) {
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        if (window->buffers[i].buffer != NULL) wl_buffer_destroy(window->buffers[i].buffer);
+        window->buffers[i].buffer = NULL;
+        window->buffers[i].busy = false;
+    }
+}
+
+static void cleanup(ctx_t * ctx) {
+    printf("[info] cleaning up\n");
+
+    if (ctx->windows != NULL) {
+        for (size_t i = 0; i < ctx->num_windows; i++) {
+            window_t * window = &ctx->windows[i];
+            if (window->frame_callback != NULL) wl_callback_destroy(window->frame_callback);
+            if (window->xdg_toplevel != NULL) xdg_toplevel_destroy(window->xdg_toplevel);
+            if (window->xdg_surface != NULL) xdg_surface_destroy(window->xdg_surface);
+            if (window->surface != NULL) wl_surface_destroy(window->surface);
+
+            destroy_window_buffers(window);
+            if (window->shm_pool != NULL) wl_shm_pool_destroy(window->shm_pool);
+            if (window->shm_pixels != NULL) munmap(window->shm_pixels, window->shm_size);
+            if (window->shm_fd != -1) close(window->shm_fd);
+        }
+        free(ctx->windows);
+    }
+
+    if (ctx->xdg_wm_base != NULL) xdg_wm_base_destroy(ctx->xdg_wm_base);
+    if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
+    if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
+    if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->display != NULL) wl_display_disconnect(ctx->display);
+
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- wl_registry event handlers ---
+
+static void registry_event_add(
+    void * data, struct wl_registry * registry,
+    uint32_t id, const char * interface, uint32_t version
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][+] id=%08x %s v%d\n", id, interface, version);
+
+    if (strcmp(interface, "wl_compositor") == 0) {
+        if (ctx->compositor != NULL) {
+            printf("[!] wl_registry: duplicate compositor\n");
+            exit_fail(ctx);
+        }
+
+        ctx->compositor = (struct wl_compositor *)wl_registry_bind(registry, id, &wl_compositor_interface, 4);
+        ctx->compositor_id = id;
+    } else if (strcmp(interface, "wl_shm") == 0) {
+        if (ctx->shm != NULL) {
+            printf("[!] wl_registry: duplicate shm\n");
+            exit_fail(ctx);
+        }
+
+        ctx->shm = (struct wl_shm *)wl_registry_bind(registry, id, &wl_shm_interface, 1);
+        ctx->shm_id = id;
+    } else if (strcmp(interface, "xdg_wm_base") == 0) {
+        if (ctx->xdg_wm_base != NULL) {
+            printf("[!] wl_registry: duplicate xdg_wm_base\n");
+            exit_fail(ctx);
+        }
+
+        ctx->xdg_wm_base = (struct xdg_wm_base *)wl_registry_bind(registry, id, &xdg_wm_base_interface, 2);
+        ctx->xdg_wm_base_id = id;
+    }
+}
+
+static void registry_event_remove(
+    void * data, struct wl_registry * registry,
+    uint32_t id
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][-] id=%08x\n", id);
+
+    if (id == ctx->compositor_id) {
+        printf("[!] wl_registry: compositor disapperared\n");
+        exit_fail(ctx);
+    } else if (id == ctx->shm_id) {
+        printf("[!] wl_registry: shm disapperared\n");
+        exit_fail(ctx);
+    } else if (id == ctx->xdg_wm_base_id) {
+        printf("[!] wl_registry: xdg_wm_base disapperared\n");
+        exit_fail(ctx);
+    }
+
+    (void)registry;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_event_add,
+    .global_remove = registry_event_remove
+};
+
+// --- xdg_wm_base event handlers ---
+
+static void xdg_wm_base_event_ping(
+    void * data, struct xdg_wm_base * xdg_wm_base, uint32_t serial
+) {
+    xdg_wm_base_pong(xdg_wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener xdg_wm_base_listener = {
+    .ping = xdg_wm_base_event_ping
+};
+
+// --- wl_buffer event handlers ---
+
+static void wl_buffer_release(void * data, struct wl_buffer * buffer) {
+    load_buffer_t * load_buffer = (load_buffer_t *)data;
+    load_buffer->busy = false;
+}
+
+static const struct wl_buffer_listener wl_buffer_listener = {
+    .release = wl_buffer_release
+};
+
+// --- drawing ---
+
+static void fill_band(window_t * window, load_buffer_t * buffer, int32_t y, uint32_t color) {
+    for (int32_t row = y; row < y + window->band_height && row < (int32_t)window->height; row++) {
+        uint32_t * line = buffer->pixels + (size_t)row * window->width;
+        for (uint32_t x = 0; x < window->width; x++) line[x] = color;
+    }
+}
+
+static void request_frame(window_t * window);
+
+// draws the next band into a free buffer and commits it, a frame is skipped
+// when the compositor still holds both buffers
+static void draw_frame(window_t * window) {
+    load_buffer_t * buffer = NULL;
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        if (!window->buffers[i].busy) {
+            buffer = &window->buffers[i];
+            break;
+        }
+    }
+
+    if (buffer == NULL) {
+        window->stalls++;
+        request_frame(window);
+        wl_surface_commit(window->surface);
+        return;
+    }
+
+    int32_t previous_y = window->band_y;
+    window->band_y += window->band_height;
+    if (window->band_y >= (int32_t)window->height) window->band_y = 0;
+
+    // everything outside the band is background, in both buffers
+    if (buffer->band_y >= 0) fill_band(window, buffer, buffer->band_y, BACKGROUND);
+    uint32_t color = 0xff000000 | ((window->frames * 0x050301 + window->index * 0x402010) & 0xffffff);
+    fill_band(window, buffer, window->band_y, color);
+    buffer->band_y = window->band_y;
+
+    // compared to the last committed buffer, the old band became background
+    // and the new band appeared
+    wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+    if (window->full_damage) {
+        wl_surface_damage_buffer(window->surface, 0, 0, window->width, window->height);
+        window->full_damage = false;
+    } else {
+        wl_surface_damage_buffer(window->surface, 0, previous_y, window->width, window->band_height);
+        wl_surface_damage_buffer(window->surface, 0, window->band_y, window->width, window->band_height);
+    }
+    request_frame(window);
+    wl_surface_commit(window->surface);
+    buffer->busy = true;
+
+    uint64_t now_ns = clock_now_ns();
+    if (window->frames == 0) window->first_frame_ns = now_ns;
+    window->last_frame_ns = now_ns;
+    window->last_draw_ns = now_ns;
+    window->frames++;
+}
+
+// --- wl_callback event handlers ---
+
+static void frame_callback_done(void * data, struct wl_callback * callback, uint32_t callback_data) {
+    window_t * window = (window_t *)data;
+    ctx_t * ctx = window->ctx;
+    wl_callback_destroy(callback);
+    window->frame_callback = NULL;
+
+    // below the refresh rate, callbacks keep coming through empty commits
+    // until the next frame is due
+    uint64_t interval_ns = ctx->fps > 0 ? (uint64_t)(1e9 / ctx->fps) : 0;
+    if (clock_now_ns() - window->last_draw_ns + 500000 < interval_ns) {
+        request_frame(window);
+        wl_surface_commit(window->surface);
+        return;
+    }
+
+    draw_frame(window);
+}
+
+static const struct wl_callback_listener frame_callback_listener = {
+    .done = frame_callback_done
+};
+
+static void request_frame(window_t * window) {
+    window->frame_callback = wl_surface_frame(window->surface);
+    wl_callback_add_listener(window->frame_callback, &frame_callback_listener, (void *)window);
+}
+
+// --- configure callbacks ---
+
+static void window_resize(window_t * window, uint32_t width, uint32_t height) {
+    ctx_t * ctx = window->ctx;
+    uint32_t stride = width * 4;
+    size_t buffer_size = (size_t)stride * height;
+    size_t size = buffer_size * NUM_BUFFERS;
+
+    destroy_window_buffers(window);
+
+    if (size > window->shm_size) {
+        if (ftruncate(window->shm_fd, size) == -1) {
+            printf("[!] ftruncate: failed to resize shm file\n");
+            exit_fail(ctx);
+        }
+
+        void * new_pixels = mremap(window->shm_pixels, window->shm_size, size, MREMAP_MAYMOVE);
+        if (new_pixels == MAP_FAILED) {
+            printf("[!] mremap: failed to remap shm file\n");
+            exit_fail(ctx);
+        }
+        window->shm_pixels = (uint32_t *)new_pixels;
+        window->shm_size = size;
+        wl_shm_pool_resize(window->shm_pool, size);
+    }
+
+    window->width = width;
+    window->height = height;
+    window->band_height = height * ctx->damage_percent / 100;
+    if (window->band_height < 1) window->band_height = 1;
+    window->band_y = 0;
+    window->full_damage = true;
+
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        load_buffer_t * buffer = &window->buffers[i];
+        buffer->pixels = window->shm_pixels + i * buffer_size / 4;
+        buffer->band_y = -1;
+        for (size_t p = 0; p < buffer_size / 4; p++) buffer->pixels[p] = BACKGROUND;
+
+        buffer->buffer = wl_shm_pool_create_buffer(window->shm_pool, i * buffer_size, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+        if (buffer->buffer == NULL) {
+            printf("[!] wl_shm_pool: failed to create buffer\n");
+            exit_fail(ctx);
+        }
+        wl_buffer_add_listener(buffer->buffer, &wl_buffer_listener, (void *)buffer);
+    }
+}
+
+// --- xdg_surface event handlers ---
+
+static void xdg_surface_event_configure(
+    void * data, struct xdg_surface * xdg_surface, uint32_t serial
+) {
+    window_t * window = (window_t *)data;
+    xdg_surface_ack_configure(xdg_surface, serial);
+
+    if (!window->configured) {
+        window->configured = true;
+        if (window->index == 0) probe_mark("configure");
+
+        // the first frame starts the frame callback chain
+        draw_frame(window);
+        if (window->index == 0) probe_mark("first_frame");
+    }
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_event_configure,
+};
+
+// --- xdg_toplevel event handlers ---
+
+static void xdg_toplevel_event_configure(
+    void * data, struct xdg_toplevel * xdg_toplevel,
+    int32_t width, int32_t height, struct wl_array * states
+) {
+    window_t * window = (window_t *)data;
+    ctx_t * ctx = window->ctx;
+
+    if (width == 0) width = ctx->default_width;
+    if (height == 0) height = ctx->default_height;
+
+    // a resize replaces both buffers, the next frame is damaged completely
+    if (width != window->width || height != window->height) {
+        window_resize(window, width, height);
+    }
+}
+
+static void xdg_toplevel_event_close(
+    void * data, struct xdg_toplevel * xdg_toplevel
+) {
+    window_t * window = (window_t *)data;
+    printf("[xdg_toplevel] close window %zu\n", window->ctx->first_window + window->index);
+    window->ctx->closing = true;
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+    .configure = xdg_toplevel_event_configure,
+    .close = xdg_toplevel_event_close
+};
+
+// --- setup ---
+
+static void create_window(ctx_t * ctx, window_t * window) {
+    window->shm_fd = memfd_create("wl_shm_buffer", 0);
+    if (window->shm_fd == -1 || ftruncate(window->shm_fd, 4) == -1) {
+        printf("[!] memfd_create: failed to create shm file\n");
+        exit_fail(ctx);
+    }
+
+    window->shm_size = 4;
+    window->shm_pixels = (uint32_t *)mmap(NULL, window->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, window->shm_fd, 0);
+    if (window->shm_pixels == MAP_FAILED) {
+        window->shm_pixels = NULL;
+        printf("[!] mmap: failed to map shm file\n");
+        exit_fail(ctx);
+    }
+
+    window->shm_pool = wl_shm_create_pool(ctx->shm, window->shm_fd, window->shm_size);
+    window->surface = wl_compositor_create_surface(ctx->compositor);
+    window->xdg_surface = xdg_wm_base_get_xdg_surface(ctx->xdg_wm_base, window->surface);
+    xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener, (void *)window);
+    window->xdg_toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+    xdg_toplevel_add_listener(window->xdg_toplevel, &xdg_toplevel_listener, (void *)window);
+
+    char title[64];
+    snprintf(title, sizeof title, "load window %zu", ctx->first_window + window->index);
+    xdg_toplevel_set_app_id(window->xdg_toplevel, "load_generator");
+    xdg_toplevel_set_title(window->xdg_toplevel, title);
+
+    wl_surface_commit(window->surface);
+}
+
+// dispatches events for at most timeout_ms, returns false if the connection failed
+static bool dispatch_timeout(ctx_t * ctx, int timeout_ms) {
+    while (wl_display_prepare_read(ctx->display) != 0) {
+        if (wl_display_dispatch_pending(ctx->display) == -1) return false;
+    }
+
+    if (wl_display_flush(ctx->display) == -1 && errno != EAGAIN) {
+        wl_display_cancel_read(ctx->display);
+        return false;
+    }
+
+    struct pollfd pfd = { .fd = wl_display_get_fd(ctx->display), .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        wl_display_cancel_read(ctx->display);
+        return true;
+    }
+
+    if (wl_display_read_events(ctx->display) == -1) return false;
+    return wl_display_dispatch_pending(ctx->display) != -1;
+}
+
+static void print_report(ctx_t * ctx) {
+    for (size_t i = 0; i < ctx->num_windows; i++) {
+        window_t * window = &ctx->windows[i];
+        double elapsed_s = (window->last_frame_ns - window->first_frame_ns) / 1e9;
+        double fps = window->frames > 1 && elapsed_s > 0 ? (window->frames - 1) / elapsed_s : 0;
+
+        printf("[load] window %zu: %ux%u, %lu frames, %.1f fps (target %.1f), %lu stalls, damage %dx%d per frame\n",
+            ctx->first_window + i, window->width, window->height,
+            window->frames, fps, ctx->fps, window->stalls,
+            window->width, window->band_height * 2
+        );
+    }
+}
+
+static void run_windows(size_t first_window, size_t num_windows) {
+    probe_mark("start");
+    ctx_t * ctx = calloc(1, sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->display = NULL;
+    ctx->registry = NULL;
+    ctx->compositor = NULL;
+    ctx->shm = NULL;
+    ctx->xdg_wm_base = NULL;
+    ctx->first_window = first_window;
+    ctx->num_windows = num_windows;
+    ctx->default_width = option_long("WLEXP_LOAD_WIDTH", 640);
+    ctx->default_height = option_long("WLEXP_LOAD_HEIGHT", 480);
+    ctx->fps = option_double("WLEXP_LOAD_FPS", 60);
+    ctx->damage_percent = option_long("WLEXP_LOAD_DAMAGE", 25);
+    ctx->seconds = option_double("WLEXP_LOAD_SECONDS", 10);
+    ctx->closing = false;
+
+    if (ctx->default_width == 0 || ctx->default_height == 0 || ctx->fps < 0
+        || ctx->damage_percent < 1 || ctx->damage_percent > 50 || ctx->seconds < 0
+    ) {
+        printf("[!] invalid load options\n");
+        exit_fail(ctx);
+    }
+
+    ctx->windows = calloc(num_windows, sizeof *ctx->windows);
+    if (ctx->windows == NULL) {
+        printf("[!] calloc: allocating windows failed\n");
+        exit_fail(ctx);
+    }
+    for (size_t i = 0; i < num_windows; i++) {
+        ctx->windows[i].ctx = ctx;
+        ctx->windows[i].index = i;
+        ctx->windows[i].shm_fd = -1;
+    }
+
+    ctx->display = wl_display_connect(NULL);
+    if (ctx->display == NULL) {
+        printf("[!] wl_display: connect failed\n");
+        exit_fail(ctx);
+    }
+    probe_mark("connect");
+
+    ctx->registry = wl_display_get_registry(ctx->display);
+    wl_registry_add_listener(ctx->registry, &registry_listener, (void *)ctx);
+    wl_display_roundtrip(ctx->display);
+
+    if (ctx->compositor == NULL) {
+        printf("[!] wl_registry: no compositor found\n");
+        exit_fail(ctx);
+    } else if (ctx->shm == NULL) {
+        printf("[!] wl_registry: no shm found\n");
+        exit_fail(ctx);
+    } else if (ctx->xdg_wm_base == NULL) {
+        printf("[!] wl_registry: no xdg_wm_base found\n");
+        exit_fail(ctx);
+    }
+    probe_mark("registry");
+    xdg_wm_base_add_listener(ctx->xdg_wm_base, &xdg_wm_base_listener, (void *)ctx);
+
+    printf("[info] opening windows %zu to %zu\n", first_window, first_window + num_windows - 1);
+    for (size_t i = 0; i < num_windows; i++) create_window(ctx, &ctx->windows[i]);
+
+    uint64_t end_ns = ctx->seconds > 0 ? clock_now_ns() + (uint64_t)(ctx->seconds * 1e9) : UINT64_MAX;
+    while (!ctx->closing && clock_now_ns() < end_ns) {
+        if (!dispatch_timeout(ctx, 100)) {
+            printf("[!] wl_display: dispatch failed\n");
+            exit_fail(ctx);
+        }
+    }
+
+    print_report(ctx);
+    cleanup(ctx);
+}
+
+int main(void) {
+    long windows = option_long("WLEXP_LOAD_WINDOWS", 4);
+    if (windows <= 0) {
+        printf("[!] invalid load options\n");
+        exit(1);
+    }
+
+    if (!option_flag("WLEXP_LOAD_PROCESSES")) {
+        run_windows(0, windows);
+        return 0;
+    }
+
+    // one connection per window, the children report on their own
+    bool failed = false;
+    printf("[info] starting %ld processes\n", windows);
+    fflush(stdout);
+    for (long i = 0; i < windows; i++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            printf("[!] fork: failed to start window process %ld\n", i);
+            failed = true;
+            break;
+        } else if (pid == 0) {
+            run_windows(i, 1);
+            exit(0);
+        }
+    }
+
+    int status = 0;
+    while (wait(&status) != -1) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -4,6 +4,7 @@
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
+#include <probe.h>
 
 typedef struct {
     struct wl_display * display;
@@ -64,6 +65,7 @@ static const struct wl_registry_listener registry_listener = {
 };
 
 int main(void) {
+    probe_mark("start");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
@@ -80,6 +82,7 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
 
     ctx->registry = wl_display_get_registry(ctx->display);
     wl_registry_add_listener(ctx->registry, &registry_listener, (void *)ctx);
@@ -90,6 +93,7 @@ int main(void) {
         printf("[!] wl_registry: no compositor found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     cleanup(ctx);
 }
@@ -0,0 +1,320 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+#include <options.h>
+#include <clock.h>
+#include <probe.h>
+
+// measures the raw cost of talking to the compositor: wl_display.sync round
+// trip latency, and the rate of small requests (damage_buffer + commit on a
+// role-less surface) at increasing batch sizes until the socket saturates
+//
+// batches are flushed explicitly and stay below the 4 KiB libwayland
+// connection buffer, so the implicit flush libwayland does on a full buffer
+// never hits EAGAIN, which older versions treat as a fatal error
+
+#define MAX_BATCH 64
+#define REQUEST_PAIR_BYTES 32
+
+typedef struct {
+    struct wl_display * display;
+    struct wl_registry * registry;
+
+    struct wl_compositor * compositor;
+    uint32_t compositor_id;
+    uint32_t compositor_version;
+
+    struct wl_surface * surface;
+
+    int fd;
+    bool sync_done;
+    uint64_t sync_done_ns;
+
+    long syncs;
+    double seconds;
+    uint64_t * latency_ns;
+} ctx_t;
+
+typedef struct {
+    uint64_t pairs;
+    uint64_t flushes;
+    uint64_t eagain;
+    uint64_t blocked_ns;
+    int outq_high_water;
+} throughput_t;
+
+static void cleanup(ctx_t * ctx) {
+    printf("[info] cleaning up\n");
+    if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
+    if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
+    if (ctx->display != NULL) wl_display_disconnect(ctx->display);
+    free(ctx->latency_ns);
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- wl_registry event handlers ---
+
+static void registry_event_add(
+    void * data, struct wl_registry * registry,
+    uint32_t id, const char * interface, uint32_t version
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][+] id=%08x %s v%d\n", id, interface, version);
+
+    if (strcmp(interface, "wl_compositor") == 0) {
+        if (ctx->compositor != NULL) {
+            printf("[!] wl_registry: duplicate compositor\n");
+            exit_fail(ctx);
+        }
+
+        // damage_buffer needs version 4
+        ctx->compositor_version = version < 4 ? version : 4;
+        ctx->compositor = (struct wl_compositor *)wl_registry_bind(registry, id, &wl_compositor_interface, ctx->compositor_version);
+        ctx->compositor_id = id;
+    }
+}
+
+static void registry_event_remove(
+    void * data, struct wl_registry * registry,
+    uint32_t id
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][-] id=%08x\n", id);
+
+    if (id == ctx->compositor_id) {
+        printf("[!] wl_registry: compositor disapperared\n");
+        exit_fail(ctx);
+    }
+
+    (void)registry;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_event_add,
+    .global_remove = registry_event_remove
+};
+
+// --- wl_callback event handlers ---
+
+static void wl_callback_done(void * data, struct wl_callback * callback, uint32_t callback_data) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    // taken before anything else runs, dispatch is what is being measured
+    ctx->sync_done_ns = clock_now_ns();
+    ctx->sync_done = true;
+    wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener wl_callback_listener = {
+    .done = wl_callback_done
+};
+
+// --- measurements ---
+
+static int compare_u64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t * sorted, size_t count, double percentile) {
+    // nearest rank, as in frame_stats
+    size_t rank = (size_t)(percentile / 100.0 * count + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+// sends a sync and dispatches until its callback arrived, returns the
+// time from sending to the callback
+static uint64_t sync_roundtrip(ctx_t * ctx) {
+    ctx->sync_done = false;
+
+    uint64_t start_ns = clock_now_ns();
+    struct wl_callback * callback = wl_display_sync(ctx->display);
+    wl_callback_add_listener(callback, &wl_callback_listener, (void *)ctx);
+
+    while (!ctx->sync_done) {
+        if (wl_display_dispatch(ctx->display) == -1) {
+            printf("[!] wl_display: dispatch failed\n");
+            exit_fail(ctx);
+        }
+    }
+
+    return ctx->sync_done_ns - start_ns;
+}
+
+static void measure_sync_latency(ctx_t * ctx) {
+    printf("[info] measuring %ld sync round trips\n", ctx->syncs);
+
+    // the first round trips warm up both ends
+    for (long i = 0; i < 10; i++) sync_roundtrip(ctx);
+    for (long i = 0; i < ctx->syncs; i++) ctx->latency_ns[i] = sync_roundtrip(ctx);
+
+    qsort(ctx->latency_ns, ctx->syncs, sizeof *ctx->latency_ns, compare_u64);
+    printf("[sync] %ld round trips: min %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+        ctx->syncs, ctx->latency_ns[0] / 1e3,
+        percentile(ctx->latency_ns, ctx->syncs, 50) / 1e3,
+        percentile(ctx->latency_ns, ctx->syncs, 90) / 1e3,
+        percentile(ctx->latency_ns, ctx->syncs, 99) / 1e3,
+        ctx->latency_ns[ctx->syncs - 1] / 1e3
+    );
+}
+
+static int socket_outq(ctx_t * ctx) {
+    int bytes = 0;
+    if (ioctl(ctx->fd, SIOCOUTQ, &bytes) == -1) return 0;
+    return bytes;
+}
+
+// flushes the connection, waiting for the socket to drain whenever the
+// kernel send buffer is full
+static void flush_blocking(ctx_t * ctx, throughput_t * result) {
+    while (wl_display_flush(ctx->display) == -1) {
+        if (errno != EAGAIN) {
+            printf("[!] wl_display: flush failed\n");
+            exit_fail(ctx);
+        }
+
+        result->eagain++;
+        uint64_t start_ns = clock_now_ns();
+        struct pollfd pfd = { .fd = ctx->fd, .events = POLLOUT };
+        poll(&pfd, 1, -1);
+        result->blocked_ns += clock_now_ns() - start_ns;
+    }
+    result->flushes++;
+
+    int outq = socket_outq(ctx);
+    if (outq > result->outq_high_water) result->outq_high_water = outq;
+}
+
+static void measure_throughput(ctx_t * ctx, uint32_t batch) {
+    throughput_t result = { 0 };
+
+    uint64_t start_ns = clock_now_ns();
+    uint64_t end_ns = start_ns + (uint64_t)(ctx->seconds * 1e9);
+    while (clock_now_ns() < end_ns) {
+        for (uint32_t i = 0; i < batch; i++) {
+            if (ctx->compositor_version >= 4) {
+                wl_surface_damage_buffer(ctx->surface, 0, 0, 1, 1);
+            } else {
+                wl_surface_damage(ctx->surface, 0, 0, 1, 1);
+            }
+            wl_surface_commit(ctx->surface);
+        }
+        result.pairs += batch;
+        flush_blocking(ctx, &result);
+
+        // events are not expected, but must not pile up either
+        wl_display_dispatch_pending(ctx->display);
+    }
+
+    // requests only count once the compositor processed them
+    sync_roundtrip(ctx);
+    uint64_t elapsed_ns = clock_now_ns() - start_ns;
+
+    printf("[throughput] batch %2u: %9.0f requests/s, %7.1f MB/s, %lu flushes, %lu EAGAIN, %.1f ms blocked, SIOCOUTQ high water %d bytes\n",
+        batch, result.pairs * 2 * 1e9 / elapsed_ns,
+        result.pairs * REQUEST_PAIR_BYTES * 1e3 / elapsed_ns,
+        result.flushes, result.eagain, result.blocked_ns / 1e6, result.outq_high_water
+    );
+}
+
+static void print_socket_buffers(ctx_t * ctx) {
+    int sndbuf = 0;
+    int rcvbuf = 0;
+    socklen_t length = sizeof sndbuf;
+    getsockopt(ctx->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &length);
+    length = sizeof rcvbuf;
+    getsockopt(ctx->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &length);
+
+    printf("[info] socket buffers: SO_SNDBUF %d bytes, SO_RCVBUF %d bytes\n", sndbuf, rcvbuf);
+}
+
+int main(void) {
+    probe_mark("start");
+    printf("[info] allocating context\n");
+    ctx_t * ctx = malloc(sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->display = NULL;
+    ctx->registry = NULL;
+    ctx->compositor = NULL;
+    ctx->compositor_id = 0;
+    ctx->compositor_version = 0;
+    ctx->surface = NULL;
+    ctx->fd = -1;
+    ctx->sync_done = false;
+    ctx->sync_done_ns = 0;
+    ctx->syncs = option_long("WLEXP_ROUNDTRIP_SYNCS", 1000);
+    ctx->seconds = option_double("WLEXP_ROUNDTRIP_SECONDS", 1);
+    ctx->latency_ns = NULL;
+
+    if (ctx->syncs <= 0 || ctx->seconds <= 0) {
+        printf("[!] invalid round trip options\n");
+        exit_fail(ctx);
+    }
+
+    ctx->latency_ns = malloc(ctx->syncs * sizeof *ctx->latency_ns);
+    if (ctx->latency_ns == NULL) {
+        printf("[!] malloc: allocating latency samples failed\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] connecting to display\n");
+    ctx->display = wl_display_connect(NULL);
+    if (ctx->display == NULL) {
+        printf("[!] wl_display: connect failed\n");
+        exit_fail(ctx);
+    }
+    probe_mark("connect");
+    ctx->fd = wl_display_get_fd(ctx->display);
+
+    printf("[info] getting registry\n");
+    ctx->registry = wl_display_get_registry(ctx->display);
+    wl_registry_add_listener(ctx->registry, &registry_listener, (void *)ctx);
+
+    printf("[info] waiting for events\n");
+    wl_display_roundtrip(ctx->display);
+
+    printf("[info] checking if protocols found\n");
+    if (ctx->compositor == NULL) {
+        printf("[!] wl_registry: no compositor found\n");
+        exit_fail(ctx);
+    }
+    probe_mark("registry");
+
+    printf("[info] creating surface\n");
+    ctx->surface = wl_compositor_create_surface(ctx->compositor);
+    if (ctx->surface == NULL) {
+        printf("[!] wl_compositor: failed to create surface\n");
+        exit_fail(ctx);
+    }
+
+    print_socket_buffers(ctx);
+    measure_sync_latency(ctx);
+
+    printf("[info] measuring request throughput, %.1f s per batch size\n", ctx->seconds);
+    for (uint32_t batch = 1; batch <= MAX_BATCH; batch *= 2) measure_throughput(ctx, batch);
+
+    cleanup(ctx);
+}
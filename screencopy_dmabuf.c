@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/mman.h>
 #include <wayland-util.h>
 #include <wayland-client-core.h>
@@ -17,10 +18,21 @@
 #include <drm_fourcc.h>
 #include <gbm.h>
 #include <fcntl.h>
+#include <options.h>
+#include <probe.h>
+#include <accounting.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <cadence.h>
+#include <event_loop.h>
+#include <realtime.h>
 
 typedef struct {
     struct wl_output * proxy;
     size_t id;
+    char name[32];
+    cadence_t cadence;
     struct wl_list link;
 } output_t;
 
@@ -51,6 +63,7 @@ typedef struct {
 typedef struct {
     struct wl_display * display;
     struct wl_registry * registry;
+    event_loop_t * event_loop;
 
     struct wl_compositor * compositor;
     struct wl_shm * shm;
@@ -91,6 +104,7 @@ typedef struct {
     struct xdg_surface * xdg_surface;
     struct xdg_toplevel * xdg_toplevel;
     struct zwlr_screencopy_frame_v1 * screencopy_frame;
+    struct wl_output * capture_output;
 
     uint32_t last_surface_serial;
     uint32_t win_width;
@@ -99,23 +113,45 @@ typedef struct {
     bool xdg_toplevel_configured;
     bool configured;
     bool closing;
+    bool continuous;
 } ctx_t;
 
+static void destroy_gbm_device(struct gbm_device * device) {
+    // gbm does not take ownership of the render node fd
+    int fd = gbm_device_get_fd(device);
+    gbm_device_destroy(device);
+    close(fd);
+    resource_untrack(RESOURCE_FD, fd);
+}
+
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    accounting_report();
+    bench_stats_report();
+    realtime_report();
+
     if (ctx->screencopy_frame != NULL) zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
     if (ctx->xdg_toplevel != NULL) xdg_toplevel_destroy(ctx->xdg_toplevel);
     if (ctx->xdg_surface != NULL) xdg_surface_destroy(ctx->xdg_surface);
     if (ctx->viewport != NULL) wp_viewport_destroy(ctx->viewport);
     if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
 
-    if (ctx->dmabuf_buffer != NULL) wl_buffer_destroy(ctx->dmabuf_buffer);
+    if (ctx->dmabuf_buffer != NULL) {
+        wl_buffer_destroy(ctx->dmabuf_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer);
+    }
     if (ctx->dmabuf_feedback != NULL) zwp_linux_dmabuf_feedback_v1_destroy(ctx->dmabuf_feedback);
 
-    if (ctx->dmabuf_format_table != NULL) munmap(ctx->dmabuf_format_table, ctx->dmabuf_format_table_length * sizeof (dmabuf_format_table_entry_t));
-    if (ctx->gbm_bo != NULL) gbm_bo_destroy(ctx->gbm_bo);
-    if (ctx->gbm_main_device != NULL) gbm_device_destroy(ctx->gbm_main_device);
+    if (ctx->dmabuf_format_table != NULL) {
+        munmap(ctx->dmabuf_format_table, ctx->dmabuf_format_table_length * sizeof (dmabuf_format_table_entry_t));
+        resource_untrack(RESOURCE_MAPPING, ctx->dmabuf_format_table);
+    }
+    if (ctx->gbm_bo != NULL) {
+        gbm_bo_destroy(ctx->gbm_bo);
+        resource_untrack(RESOURCE_GBM_BO, ctx->gbm_bo);
+    }
+    if (ctx->gbm_main_device != NULL) destroy_gbm_device(ctx->gbm_main_device);
 
     dmabuf_format_modifiers_t *entry, *entry_next;
     wl_list_for_each_safe(entry, entry_next, &ctx->dmabuf_format_modifiers, link) {
@@ -124,13 +160,23 @@ static void cleanup(ctx_t * ctx) {
         free(entry);
     }
 
-    if (ctx->shm_buffer != NULL) wl_buffer_destroy(ctx->shm_buffer);
+    if (ctx->shm_buffer != NULL) {
+        wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
+    }
     if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
-    if (ctx->shm_pixels != NULL) munmap(ctx->shm_pixels, ctx->shm_size);
-    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
 
     output_t *output, *output_next;
     wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        cadence_report(&output->cadence, output->name);
         wl_list_remove(&output->link);
         wl_output_destroy(output->proxy);
         free(output);
@@ -143,8 +189,11 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
     if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
     if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
     if (ctx->display != NULL) wl_display_disconnect(ctx->display);
 
+    resources_report();
+
     free(ctx);
 }
 
@@ -153,6 +202,33 @@ static void exit_fail(ctx_t * ctx) {
     exit(1);
 }
 
+// --- wl_output event handlers ---
+
+static void wl_output_event_geometry(
+    void * data, struct wl_output * proxy,
+    int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+    int32_t subpixel, const char * make, const char * model, int32_t transform
+) {
+    output_t * output = (output_t *)data;
+    printf("[wl_output] geometry: %s -> %s %s\n", output->name, make, model);
+}
+
+static void wl_output_event_mode(
+    void * data, struct wl_output * proxy,
+    uint32_t flags, int32_t width, int32_t height, int32_t refresh
+) {
+    output_t * output = (output_t *)data;
+    if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+
+    printf("[wl_output] mode: %s -> %dx%d@%d.%03d\n", output->name, width, height, refresh / 1000, refresh % 1000);
+    cadence_set_refresh(&output->cadence, refresh);
+}
+
+static const struct wl_output_listener wl_output_listener = {
+    .geometry = wl_output_event_geometry,
+    .mode = wl_output_event_mode
+};
+
 // --- wl_registry event handlers ---
 
 static void registry_event_add(
@@ -220,7 +296,10 @@ static void registry_event_add(
         printf("[info] binding output\n");
         output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
         output->id = id;
+        snprintf(output->name, sizeof output->name, "output %zu", id);
+        cadence_init(&output->cadence);
         wl_list_insert(&ctx->outputs, &output->link);
+        wl_output_add_listener(output->proxy, &wl_output_listener, (void *)output);
     }
 }
 
@@ -253,6 +332,8 @@ static void registry_event_remove(
         output_t *output, *output_next;
         wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
             if (output->id == id) {
+                if (ctx->capture_output == output->proxy) ctx->capture_output = NULL;
+                cadence_report(&output->cadence, output->name);
                 wl_list_remove(&output->link);
                 wl_output_destroy(output->proxy);
                 free(output);
@@ -304,7 +385,15 @@ static struct gbm_device * create_gbm_device(ctx_t * ctx, drmDevice *device) {
     }
 
     free(render_node);
-    return gbm_create_device(fd);
+    resource_track(RESOURCE_FD, fd, 0);
+
+    struct gbm_device * gbm_device = gbm_create_device(fd);
+    if (gbm_device == NULL) {
+        close(fd);
+        resource_untrack(RESOURCE_FD, fd);
+    }
+
+    return gbm_device;
 }
 
 static void linux_dmabuf_feedback_main_device(void * data, struct zwp_linux_dmabuf_feedback_v1 * feedback, struct wl_array * device) {
@@ -312,7 +401,8 @@ static void linux_dmabuf_feedback_main_device(void * data, struct zwp_linux_dmab
     printf("[linux_dmabuf_feedback] main device\n");
 
     if (ctx->gbm_main_device != NULL) {
-        gbm_device_destroy(ctx->gbm_main_device);
+        destroy_gbm_device(ctx->gbm_main_device);
+        ctx->gbm_main_device = NULL;
     }
 
     if (device->size != sizeof (dev_t)) {
@@ -333,6 +423,7 @@ static void linux_dmabuf_feedback_main_device(void * data, struct zwp_linux_dmab
     if (ctx->gbm_main_device == NULL) {
         printf("[error] failed to open gbm device\n");
     }
+    probe_mark("gbm_device");
 
     drmFreeDevices(&drm_device, 1);
 }
@@ -343,20 +434,27 @@ static void linux_dmabuf_feedback_format_table(void * data, struct zwp_linux_dma
 
     if (size % sizeof (dmabuf_format_table_entry_t) != 0) {
         printf("[error] dmabuf format table is not a whole number of entries\n");
+        close(fd);
         exit_fail(ctx);
     }
 
     if (ctx->dmabuf_format_table != NULL) {
         munmap(ctx->dmabuf_format_table, ctx->dmabuf_format_table_length * sizeof (dmabuf_format_table_entry_t));
+        resource_untrack(RESOURCE_MAPPING, ctx->dmabuf_format_table);
     }
 
     ctx->dmabuf_format_table = (dmabuf_format_table_entry_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
     ctx->dmabuf_format_table_length = size / sizeof (dmabuf_format_table_entry_t);
+
+    // the mapping stays valid after the fd is closed
+    close(fd);
+
     if (ctx->dmabuf_format_table == MAP_FAILED) {
         printf("[error] failed to map format table\n");
         ctx->dmabuf_format_table = NULL;
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->dmabuf_format_table, size);
 }
 
 static void linux_dmabuf_feedback_tranche_target_device(void * data, struct zwp_linux_dmabuf_feedback_v1 * feedback, struct wl_array * device) {
@@ -467,6 +565,8 @@ static void linux_dmabuf_feedback_tranche_done(void * data, struct zwp_linux_dma
 static void linux_dmabuf_feedback_done(void * data, struct zwp_linux_dmabuf_feedback_v1 * feedback) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[linux_dmabuf_feedback] done\n");
+
+    probe_mark("dmabuf_feedback");
 }
 
 static const struct zwp_linux_dmabuf_feedback_v1_listener linux_dmabuf_feedback_listener = {
@@ -481,6 +581,8 @@ static const struct zwp_linux_dmabuf_feedback_v1_listener linux_dmabuf_feedback_
 
 // --- zwlr_screencopy_frame_v1 event handlers ---
 
+static void request_capture(ctx_t * ctx);
+
 static void zwlr_screencopy_frame_buffer_shm(void * data, struct zwlr_screencopy_frame_v1 * frame, enum wl_shm_format format, uint32_t width, uint32_t height, uint32_t stride) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] buffer shm %dx%d+%d@%c%c%c%c\n", width, height, stride, PRINT_WL_SHM_FORMAT(format));
@@ -494,10 +596,14 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
 
     if (ctx->dmabuf_buffer != NULL) {
         wl_buffer_destroy(ctx->dmabuf_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer);
+        ctx->dmabuf_buffer = NULL;
     }
 
     if (ctx->gbm_bo != NULL) {
         gbm_bo_destroy(ctx->gbm_bo);
+        resource_untrack(RESOURCE_GBM_BO, ctx->gbm_bo);
+        ctx->gbm_bo = NULL;
     }
 
     ctx->dmabuf_width = width;
@@ -526,29 +632,47 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
         modifiers, modifiers_length,
         GBM_BO_USE_RENDERING
     );
+    if (ctx->gbm_bo == NULL) {
+        printf("[error] failed to create gbm buffer object\n");
+        exit_fail(ctx);
+    }
+    resource_track(RESOURCE_GBM_BO, ctx->gbm_bo, (size_t)gbm_bo_get_stride(ctx->gbm_bo) * height);
 
     struct zwp_linux_buffer_params_v1 * params = zwp_linux_dmabuf_v1_create_params(ctx->linux_dmabuf);
     printf("[info] dmabuf %dx%d@%c%c%c%c with modifier %lx\n", width, height, PRINT_DRM_FORMAT(format), gbm_bo_get_modifier(ctx->gbm_bo));
 
     for (int plane = 0; plane < gbm_bo_get_plane_count(ctx->gbm_bo); plane++) {
+        int plane_fd = gbm_bo_get_fd_for_plane(ctx->gbm_bo, plane);
+        if (plane_fd == -1) {
+            printf("[error] failed to export plane %d of gbm buffer object\n", plane);
+            zwp_linux_buffer_params_v1_destroy(params);
+            exit_fail(ctx);
+        }
+        resource_track(RESOURCE_FD, plane_fd, 0);
         zwp_linux_buffer_params_v1_add(
             params,
-            gbm_bo_get_fd_for_plane(ctx->gbm_bo, plane),
+            plane_fd,
             plane,
             gbm_bo_get_offset(ctx->gbm_bo, plane),
             gbm_bo_get_stride_for_plane(ctx->gbm_bo, plane),
             gbm_bo_get_modifier(ctx->gbm_bo) >> 32,
             gbm_bo_get_modifier(ctx->gbm_bo)
         );
+
+        // the params request holds its own copy of the fd
+        close(plane_fd);
+        resource_untrack(RESOURCE_FD, plane_fd);
         printf("[info] plane %d: offset %d, stride %d\n", plane, gbm_bo_get_offset(ctx->gbm_bo, plane), gbm_bo_get_stride_for_plane(ctx->gbm_bo, plane));
     }
 
     printf("[info] destroying gbm buffer object\n");
     gbm_bo_destroy(ctx->gbm_bo);
+    resource_untrack(RESOURCE_GBM_BO, ctx->gbm_bo);
     ctx->gbm_bo = NULL;
 
     printf("[info] creating dmabuf wl_buffer object\n");
     ctx->dmabuf_buffer = zwp_linux_buffer_params_v1_create_immed(params, width, height, format, 0);
+    resource_track(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer, 0);
     zwp_linux_buffer_params_v1_destroy(params);
 }
 
@@ -556,6 +680,7 @@ static void zwlr_screencopy_frame_buffer_done(void * data, struct zwlr_screencop
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] buffer_done\n");
 
+    accounting_begin_stage(ACCOUNTING_STAGE_COPY);
     zwlr_screencopy_frame_v1_copy(frame, ctx->dmabuf_buffer);
 }
 
@@ -567,6 +692,13 @@ static void zwlr_screencopy_frame_flags(void * data, struct zwlr_screencopy_fram
 static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] ready\n");
+    accounting_begin_stage(ACCOUNTING_STAGE_PROCESS);
+
+    if (ctx->capture_output != NULL) {
+        output_t * output = (output_t *)wl_output_get_user_data(ctx->capture_output);
+        cadence_frame(&output->cadence, output->name, clock_from_ready(sec_hi, sec_lo, nsec), clock_now_ns());
+    }
+    realtime_frame(clock_from_ready(sec_hi, sec_lo, nsec));
 
     printf("[info] attaching buffer to surface\n");
     wl_surface_attach(ctx->surface, ctx->dmabuf_buffer, 0, 0);
@@ -576,11 +708,23 @@ static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_fram
 
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    accounting_end_frame();
+    probe_mark("first_frame");
+    resources_print_live();
+
+    if (bench_stats_end_frame((uint64_t)ctx->dmabuf_width * ctx->dmabuf_height * 4)) {
+        ctx->closing = true;
+    } else if (ctx->continuous || bench_stats_active()) {
+        printf("[info] requesting next frame\n");
+        request_capture(ctx);
+    }
 }
 
 static void zwlr_screencopy_frame_failed(void * data, struct zwlr_screencopy_frame_v1 * frame) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] failed\n");
+
+    if (bench_stats_fail_frame()) ctx->closing = true;
 }
 
 static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_listener = {
@@ -594,16 +738,35 @@ static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_list
 
 // --- wl_surface event handlers ---
 
+static void request_capture(ctx_t * ctx) {
+    if (ctx->screencopy_frame != NULL) {
+        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+        ctx->screencopy_frame = NULL;
+    }
+
+    if (ctx->capture_output == NULL) {
+        printf("[info] no output to capture\n");
+        return;
+    }
+
+    accounting_begin_frame();
+    bench_stats_begin_frame();
+    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, ctx->capture_output);
+    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+}
+
 static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[wl_surface] enter\n");
 
-    if (ctx->screencopy_frame != NULL) {
-        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+    if (ctx->capture_output != output) {
+        // intervals across a switch between outputs are meaningless
+        output_t * entry = (output_t *)wl_output_get_user_data(output);
+        cadence_restart(&entry->cadence);
     }
 
-    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, output);
-    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+    ctx->capture_output = output;
+    request_capture(ctx);
 }
 
 static const struct wl_surface_listener wl_surface_listener = {
@@ -636,6 +799,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         if (ctx->shm_buffer != NULL) {
             printf("[info] destroying old shm buffer\n");
             wl_buffer_destroy(ctx->shm_buffer);
+            resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
             ctx->shm_buffer = NULL;
         }
 
@@ -651,6 +815,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
             printf("[!] mremap: failed to remap shm file\n");
             exit_fail(ctx);
         }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
         ctx->shm_pixels = (uint32_t *)new_pixels;
         ctx->shm_size = size;
 
@@ -664,6 +829,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
     if (ctx->shm_buffer != NULL) {
         printf("[info] destroying old shm buffer\n");
         wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
         ctx->shm_buffer = NULL;
     }
 
@@ -673,6 +839,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         printf("[!] wl_shm_pool: failed to create buffer\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_WL_BUFFER, ctx->shm_buffer, 0);
 }
 
 
@@ -696,6 +863,7 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -803,11 +971,21 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
     .close = xdg_toplevel_event_close
 };
 
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
+    ctx->event_loop = NULL;
 
     ctx->compositor = NULL;
     ctx->compositor_id = 0;
@@ -845,6 +1023,7 @@ int main(void) {
     ctx->xdg_surface = NULL;
     ctx->xdg_toplevel = NULL;
     ctx->screencopy_frame = NULL;
+    ctx->capture_output = NULL;
 
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
@@ -853,6 +1032,7 @@ int main(void) {
     ctx->xdg_toplevel_configured = false;
     ctx->configured = false;
     ctx->closing = false;
+    ctx->continuous = option_flag("WLEXP_CONTINUOUS");
 
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
@@ -865,6 +1045,12 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
+
+    printf("[info] initializing accounting\n");
+    accounting_init(ctx->display);
+    bench_stats_init();
+    realtime_init();
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -893,6 +1079,7 @@ int main(void) {
         printf("[!] wl_registry: no screencopy found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -900,6 +1087,7 @@ int main(void) {
         printf("[!] memfd_create: failed to create shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
 
     printf("[info] resizing shm file\n");
     ctx->shm_size = 1;
@@ -915,6 +1103,7 @@ int main(void) {
         printf("[!] mmap: failed to map shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
 
     printf("[info] creating shm pool\n");
     ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
@@ -981,8 +1170,26 @@ int main(void) {
         exit_fail(ctx);
     }
 
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
     printf("[info] entering event loop\n");
-    while (wl_display_dispatch(ctx->display) != -1 && !ctx->closing) {}
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
     printf("[info] exiting event loop\n");
 
     cleanup(ctx);
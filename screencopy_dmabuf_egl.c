@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/mman.h>
 #include <wayland-util.h>
 #include <wayland-client-core.h>
@@ -23,10 +24,24 @@
 #include <GLES2/gl2ext.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <options.h>
+#include <probe.h>
+#include <gpu_timer.h>
+#include <accounting.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <cadence.h>
+#include <frame_stats.h>
+#include <hud.h>
+#include <event_loop.h>
+#include <realtime.h>
 
 typedef struct {
     struct wl_output * proxy;
     size_t id;
+    char name[32];
+    cadence_t cadence;
     struct wl_list link;
 } output_t;
 
@@ -57,6 +72,7 @@ typedef struct {
 typedef struct {
     struct wl_display * display;
     struct wl_registry * registry;
+    event_loop_t * event_loop;
 
     struct wl_compositor * compositor;
     struct wl_shm * shm;
@@ -84,6 +100,8 @@ typedef struct {
     struct wl_buffer * dmabuf_buffer;
     uint32_t dmabuf_width;
     uint32_t dmabuf_height;
+    uint32_t dmabuf_format;
+    uint64_t dmabuf_modifier;
 
     struct gbm_device * gbm_main_device;
     struct gbm_bo * gbm_bo;
@@ -97,6 +115,7 @@ typedef struct {
     struct xdg_surface * xdg_surface;
     struct xdg_toplevel * xdg_toplevel;
     struct zwlr_screencopy_frame_v1 * screencopy_frame;
+    struct wl_output * capture_output;
 
     EGLDisplay egl_display;
     EGLContext egl_context;
@@ -106,7 +125,11 @@ typedef struct {
     GLuint egl_vbo;
     GLuint egl_texture;
     GLuint egl_shader_program;
+    gpu_timer_t gpu_timer;
+    frame_stats_t frame_stats;
+    hud_t hud;
     EGLAttrib * egl_image_attribs;
+    int dmabuf_fds[4];
 
     uint32_t last_surface_serial;
     uint32_t win_width;
@@ -115,15 +138,45 @@ typedef struct {
     bool xdg_toplevel_configured;
     bool configured;
     bool closing;
+    bool continuous;
 } ctx_t;
 
+static void destroy_gbm_device(struct gbm_device * device) {
+    // gbm does not take ownership of the render node fd
+    int fd = gbm_device_get_fd(device);
+    gbm_device_destroy(device);
+    close(fd);
+    resource_untrack(RESOURCE_FD, fd);
+}
+
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    accounting_report();
+    bench_stats_report();
+    realtime_report();
+    gpu_timer_report(&ctx->gpu_timer);
+    gpu_timer_destroy(&ctx->gpu_timer);
+    hud_destroy(&ctx->hud);
+
     if (ctx->egl_image_attribs != NULL) free(ctx->egl_image_attribs);
-    if (ctx->egl_shader_program != 0) glDeleteProgram(ctx->egl_shader_program);
-    if (ctx->egl_texture != 0) glDeleteTextures(1, &ctx->egl_texture);
-    if (ctx->egl_vbo != 0) glDeleteBuffers(1, &ctx->egl_vbo);
+    for (size_t i = 0; i < 4; i++) {
+        if (ctx->dmabuf_fds[i] == -1) continue;
+        close(ctx->dmabuf_fds[i]);
+        resource_untrack(RESOURCE_FD, ctx->dmabuf_fds[i]);
+    }
+    if (ctx->egl_shader_program != 0) {
+        glDeleteProgram(ctx->egl_shader_program);
+        resource_untrack(RESOURCE_GL_PROGRAM, ctx->egl_shader_program);
+    }
+    if (ctx->egl_texture != 0) {
+        glDeleteTextures(1, &ctx->egl_texture);
+        resource_untrack(RESOURCE_GL_TEXTURE, ctx->egl_texture);
+    }
+    if (ctx->egl_vbo != 0) {
+        glDeleteBuffers(1, &ctx->egl_vbo);
+        resource_untrack(RESOURCE_GL_BUFFER, ctx->egl_vbo);
+    }
     if (ctx->egl_context != EGL_NO_SURFACE) eglDestroyContext(ctx->egl_display, ctx->egl_context);
     if (ctx->egl_surface != EGL_NO_SURFACE) eglDestroySurface(ctx->egl_display, ctx->egl_surface);
     if (ctx->egl_window != EGL_NO_SURFACE) wl_egl_window_destroy(ctx->egl_window);
@@ -135,12 +188,21 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->viewport != NULL) wp_viewport_destroy(ctx->viewport);
     if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
 
-    if (ctx->dmabuf_buffer != NULL) wl_buffer_destroy(ctx->dmabuf_buffer);
+    if (ctx->dmabuf_buffer != NULL) {
+        wl_buffer_destroy(ctx->dmabuf_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer);
+    }
     if (ctx->dmabuf_feedback != NULL) zwp_linux_dmabuf_feedback_v1_destroy(ctx->dmabuf_feedback);
 
-    if (ctx->dmabuf_format_table != NULL) munmap(ctx->dmabuf_format_table, ctx->dmabuf_format_table_length * sizeof (dmabuf_format_table_entry_t));
-    if (ctx->gbm_bo != NULL) gbm_bo_destroy(ctx->gbm_bo);
-    if (ctx->gbm_main_device != NULL) gbm_device_destroy(ctx->gbm_main_device);
+    if (ctx->dmabuf_format_table != NULL) {
+        munmap(ctx->dmabuf_format_table, ctx->dmabuf_format_table_length * sizeof (dmabuf_format_table_entry_t));
+        resource_untrack(RESOURCE_MAPPING, ctx->dmabuf_format_table);
+    }
+    if (ctx->gbm_bo != NULL) {
+        gbm_bo_destroy(ctx->gbm_bo);
+        resource_untrack(RESOURCE_GBM_BO, ctx->gbm_bo);
+    }
+    if (ctx->gbm_main_device != NULL) destroy_gbm_device(ctx->gbm_main_device);
 
     dmabuf_format_modifiers_t *entry, *entry_next;
     wl_list_for_each_safe(entry, entry_next, &ctx->dmabuf_format_modifiers, link) {
@@ -149,13 +211,23 @@ static void cleanup(ctx_t * ctx) {
         free(entry);
     }
 
-    if (ctx->shm_buffer != NULL) wl_buffer_destroy(ctx->shm_buffer);
+    if (ctx->shm_buffer != NULL) {
+        wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
+    }
     if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
-    if (ctx->shm_pixels != NULL) munmap(ctx->shm_pixels, ctx->shm_size);
-    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
 
     output_t *output, *output_next;
     wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        cadence_report(&output->cadence, output->name);
         wl_list_remove(&output->link);
         wl_output_destroy(output->proxy);
         free(output);
@@ -168,8 +240,11 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
     if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
     if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
     if (ctx->display != NULL) wl_display_disconnect(ctx->display);
 
+    resources_report();
+
     free(ctx);
 }
 
@@ -178,6 +253,33 @@ static void exit_fail(ctx_t * ctx) {
     exit(1);
 }
 
+// --- wl_output event handlers ---
+
+static void wl_output_event_geometry(
+    void * data, struct wl_output * proxy,
+    int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+    int32_t subpixel, const char * make, const char * model, int32_t transform
+) {
+    output_t * output = (output_t *)data;
+    printf("[wl_output] geometry: %s -> %s %s\n", output->name, make, model);
+}
+
+static void wl_output_event_mode(
+    void * data, struct wl_output * proxy,
+    uint32_t flags, int32_t width, int32_t height, int32_t refresh
+) {
+    output_t * output = (output_t *)data;
+    if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+
+    printf("[wl_output] mode: %s -> %dx%d@%d.%03d\n", output->name, width, height, refresh / 1000, refresh % 1000);
+    cadence_set_refresh(&output->cadence, refresh);
+}
+
+static const struct wl_output_listener wl_output_listener = {
+    .geometry = wl_output_event_geometry,
+    .mode = wl_output_event_mode
+};
+
 // --- wl_registry event handlers ---
 
 static void registry_event_add(
@@ -245,7 +347,10 @@ static void registry_event_add(
         printf("[info] binding output\n");
         output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
         output->id = id;
+        snprintf(output->name, sizeof output->name, "output %zu", id);
+        cadence_init(&output->cadence);
         wl_list_insert(&ctx->outputs, &output->link);
+        wl_output_add_listener(output->proxy, &wl_output_listener, (void *)output);
     }
 }
 
@@ -278,6 +383,8 @@ static void registry_event_remove(
         output_t *output, *output_next;
         wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
             if (output->id == id) {
+                if (ctx->capture_output == output->proxy) ctx->capture_output = NULL;
+                cadence_report(&output->cadence, output->name);
                 wl_list_remove(&output->link);
                 wl_output_destroy(output->proxy);
                 free(output);
@@ -329,7 +436,15 @@ static struct gbm_device * create_gbm_device(drmDevice *device) {
     }
 
     free(render_node);
-    return gbm_create_device(fd);
+    resource_track(RESOURCE_FD, fd, 0);
+
+    struct gbm_device * gbm_device = gbm_create_device(fd);
+    if (gbm_device == NULL) {
+        close(fd);
+        resource_untrack(RESOURCE_FD, fd);
+    }
+
+    return gbm_device;
 }
 
 static void linux_dmabuf_feedback_main_device(void * data, struct zwp_linux_dmabuf_feedback_v1 * feedback, struct wl_array * device) {
@@ -337,7 +452,8 @@ static void linux_dmabuf_feedback_main_device(void * data, struct zwp_linux_dmab
     printf("[linux_dmabuf_feedback] main device\n");
 
     if (ctx->gbm_main_device != NULL) {
-        gbm_device_destroy(ctx->gbm_main_device);
+        destroy_gbm_device(ctx->gbm_main_device);
+        ctx->gbm_main_device = NULL;
     }
 
     if (device->size != sizeof (dev_t)) {
@@ -358,6 +474,7 @@ static void linux_dmabuf_feedback_main_device(void * data, struct zwp_linux_dmab
     if (ctx->gbm_main_device == NULL) {
         printf("[error] failed to open gbm device\n");
     }
+    probe_mark("gbm_device");
 
     drmFreeDevices(&drm_device, 1);
 }
@@ -368,20 +485,27 @@ static void linux_dmabuf_feedback_format_table(void * data, struct zwp_linux_dma
 
     if (size % sizeof (dmabuf_format_table_entry_t) != 0) {
         printf("[error] dmabuf format table is not a whole number of entries\n");
+        close(fd);
         exit_fail(ctx);
     }
 
     if (ctx->dmabuf_format_table != NULL) {
         munmap(ctx->dmabuf_format_table, ctx->dmabuf_format_table_length * sizeof (dmabuf_format_table_entry_t));
+        resource_untrack(RESOURCE_MAPPING, ctx->dmabuf_format_table);
     }
 
     ctx->dmabuf_format_table = (dmabuf_format_table_entry_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
     ctx->dmabuf_format_table_length = size / sizeof (dmabuf_format_table_entry_t);
+
+    // the mapping stays valid after the fd is closed
+    close(fd);
+
     if (ctx->dmabuf_format_table == MAP_FAILED) {
         printf("[error] failed to map format table\n");
         ctx->dmabuf_format_table = NULL;
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->dmabuf_format_table, size);
 }
 
 static void linux_dmabuf_feedback_tranche_target_device(void * data, struct zwp_linux_dmabuf_feedback_v1 * feedback, struct wl_array * device) {
@@ -492,6 +616,8 @@ static void linux_dmabuf_feedback_tranche_done(void * data, struct zwp_linux_dma
 static void linux_dmabuf_feedback_done(void * data, struct zwp_linux_dmabuf_feedback_v1 * feedback) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[linux_dmabuf_feedback] done\n");
+
+    probe_mark("dmabuf_feedback");
 }
 
 static const struct zwp_linux_dmabuf_feedback_v1_listener linux_dmabuf_feedback_listener = {
@@ -506,6 +632,17 @@ static const struct zwp_linux_dmabuf_feedback_v1_listener linux_dmabuf_feedback_
 
 // --- zwlr_screencopy_frame_v1 event handlers ---
 
+static void request_capture(ctx_t * ctx);
+
+static void close_dmabuf_fds(ctx_t * ctx) {
+    for (size_t i = 0; i < 4; i++) {
+        if (ctx->dmabuf_fds[i] == -1) continue;
+        close(ctx->dmabuf_fds[i]);
+        resource_untrack(RESOURCE_FD, ctx->dmabuf_fds[i]);
+        ctx->dmabuf_fds[i] = -1;
+    }
+}
+
 static const EGLAttrib fd_attribs[] = {
     EGL_DMA_BUF_PLANE0_FD_EXT,
     EGL_DMA_BUF_PLANE1_FD_EXT,
@@ -554,8 +691,12 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
 
     if (ctx->dmabuf_buffer != NULL) {
         wl_buffer_destroy(ctx->dmabuf_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer);
+        ctx->dmabuf_buffer = NULL;
     }
 
+    close_dmabuf_fds(ctx);
+
     if (ctx->egl_image_attribs != NULL) {
         free(ctx->egl_image_attribs);
         ctx->egl_image_attribs = NULL;
@@ -563,11 +704,13 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
 
     if (ctx->gbm_bo != NULL) {
         gbm_bo_destroy(ctx->gbm_bo);
+        resource_untrack(RESOURCE_GBM_BO, ctx->gbm_bo);
         ctx->gbm_bo = NULL;
     }
 
     ctx->dmabuf_width = width;
     ctx->dmabuf_height = height;
+    ctx->dmabuf_format = format;
 
     printf("[info] finding format modifiers\n");
     uint64_t * modifiers = NULL;
@@ -592,9 +735,20 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
         modifiers, modifiers_length,
         GBM_BO_USE_RENDERING
     );
+    if (ctx->gbm_bo == NULL) {
+        printf("[error] failed to create gbm buffer object\n");
+        exit_fail(ctx);
+    }
+    resource_track(RESOURCE_GBM_BO, ctx->gbm_bo, (size_t)gbm_bo_get_stride(ctx->gbm_bo) * height);
+    ctx->dmabuf_modifier = gbm_bo_get_modifier(ctx->gbm_bo);
 
     int i = 0;
     int planes = gbm_bo_get_plane_count(ctx->gbm_bo);
+    if (planes > 4) {
+        printf("[error] too many dmabuf planes\n");
+        exit_fail(ctx);
+    }
+
     EGLAttrib * image_attribs = malloc((6 + 10 * planes + 1) * sizeof (EGLAttrib));
     ctx->egl_image_attribs = image_attribs;
     if (image_attribs == NULL) {
@@ -613,8 +767,15 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
     printf("[info] dmabuf %dx%d@%c%c%c%c with modifier %lx\n", width, height, PRINT_DRM_FORMAT(format), gbm_bo_get_modifier(ctx->gbm_bo));
 
     for (size_t plane = 0; plane < planes; plane++) {
+        ctx->dmabuf_fds[plane] = gbm_bo_get_fd(ctx->gbm_bo);
+        if (ctx->dmabuf_fds[plane] == -1) {
+            printf("[error] failed to export gbm buffer object\n");
+            zwp_linux_buffer_params_v1_destroy(params);
+            exit_fail(ctx);
+        }
+        resource_track(RESOURCE_FD, ctx->dmabuf_fds[plane], 0);
         image_attribs[i++] = fd_attribs[plane];
-        image_attribs[i++] = gbm_bo_get_fd(ctx->gbm_bo);
+        image_attribs[i++] = ctx->dmabuf_fds[plane];
         image_attribs[i++] = offset_attribs[plane];
         image_attribs[i++] = gbm_bo_get_offset(ctx->gbm_bo, plane);
         image_attribs[i++] = stride_attribs[plane];
@@ -624,15 +785,26 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
         image_attribs[i++] = modifier_high_attribs[plane];
         image_attribs[i++] = (uint32_t)(gbm_bo_get_modifier(ctx->gbm_bo) >> 32);
 
+        int plane_fd = gbm_bo_get_fd_for_plane(ctx->gbm_bo, plane);
+        if (plane_fd == -1) {
+            printf("[error] failed to export plane %zd of gbm buffer object\n", plane);
+            zwp_linux_buffer_params_v1_destroy(params);
+            exit_fail(ctx);
+        }
+        resource_track(RESOURCE_FD, plane_fd, 0);
         zwp_linux_buffer_params_v1_add(
             params,
-            gbm_bo_get_fd_for_plane(ctx->gbm_bo, plane),
+            plane_fd,
             plane,
             gbm_bo_get_offset(ctx->gbm_bo, plane),
             gbm_bo_get_stride_for_plane(ctx->gbm_bo, plane),
             gbm_bo_get_modifier(ctx->gbm_bo) >> 32,
             gbm_bo_get_modifier(ctx->gbm_bo)
         );
+
+        // the params request holds its own copy of the fd
+        close(plane_fd);
+        resource_untrack(RESOURCE_FD, plane_fd);
         printf("[info] plane %zd: offset %d, stride %d\n", plane, gbm_bo_get_offset(ctx->gbm_bo, plane), gbm_bo_get_stride_for_plane(ctx->gbm_bo, plane));
     }
 
@@ -640,10 +812,12 @@ static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screenc
 
     printf("[info] destroying gbm buffer object\n");
     gbm_bo_destroy(ctx->gbm_bo);
+    resource_untrack(RESOURCE_GBM_BO, ctx->gbm_bo);
     ctx->gbm_bo = NULL;
 
     printf("[info] creating dmabuf wl_buffer object\n");
     ctx->dmabuf_buffer = zwp_linux_buffer_params_v1_create_immed(params, width, height, format, 0);
+    resource_track(RESOURCE_WL_BUFFER, ctx->dmabuf_buffer, 0);
     zwp_linux_buffer_params_v1_destroy(params);
 }
 
@@ -651,6 +825,7 @@ static void zwlr_screencopy_frame_buffer_done(void * data, struct zwlr_screencop
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] buffer_done\n");
 
+    accounting_begin_stage(ACCOUNTING_STAGE_COPY);
     zwlr_screencopy_frame_v1_copy(frame, ctx->dmabuf_buffer);
 }
 
@@ -659,9 +834,30 @@ static void zwlr_screencopy_frame_flags(void * data, struct zwlr_screencopy_fram
     printf("[zwlr_screencopy_frame] flags\n");
 }
 
+static void update_hud(ctx_t * ctx) {
+    if (!hud_update_due(&ctx->hud)) return;
+
+    static const double percentiles[] = { 50, 90, 99 };
+    uint64_t latency_ns[3];
+    frame_stats_percentiles(&ctx->frame_stats, percentiles, latency_ns, 3);
+
+    hud_set_line(&ctx->hud, 0, "FPS %.1f (%lu FRAMES)", frame_stats_fps(&ctx->frame_stats), ctx->frame_stats.frames);
+    hud_set_line(&ctx->hud, 1, "LATENCY MS P50 %.2f P90 %.2f P99 %.2f", latency_ns[0] / 1e6, latency_ns[1] / 1e6, latency_ns[2] / 1e6);
+    hud_set_line(&ctx->hud, 2, "IN FLIGHT %zu, %lu FAILED", ctx->frame_stats.in_flight, ctx->frame_stats.cancelled);
+    hud_set_line(&ctx->hud, 3, "%ux%u %c%c%c%c MOD %lx", ctx->dmabuf_width, ctx->dmabuf_height, PRINT_DRM_FORMAT(ctx->dmabuf_format), ctx->dmabuf_modifier);
+    hud_set_line(&ctx->hud, 4, "SCREENCOPY DMABUF + EGLIMAGE");
+}
+
 static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] ready\n");
+    accounting_begin_stage(ACCOUNTING_STAGE_PROCESS);
+
+    if (ctx->capture_output != NULL) {
+        output_t * output = (output_t *)wl_output_get_user_data(ctx->capture_output);
+        cadence_frame(&output->cadence, output->name, clock_from_ready(sec_hi, sec_lo, nsec), clock_now_ns());
+    }
+    realtime_frame(clock_from_ready(sec_hi, sec_lo, nsec));
 
     printf("[info] setting source viewport\n");
     wp_viewport_set_source(ctx->viewport, 0, 0, wl_fixed_from_int(ctx->dmabuf_width), wl_fixed_from_int(ctx->dmabuf_height));
@@ -669,6 +865,8 @@ static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_fram
     glViewport(0, 0, ctx->dmabuf_width, ctx->dmabuf_height);
 
     printf("[info] import dmabuf\n");
+    gpu_timer_begin_frame(&ctx->gpu_timer);
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_UPLOAD);
     // create EGLImage from dmabuf with attribute array
     EGLImage frame_image = eglCreateImage(ctx->egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, ctx->egl_image_attribs);
     free(ctx->egl_image_attribs);
@@ -678,6 +876,7 @@ static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_fram
         printf("[error] error = %x\n", eglGetError());
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_EGL_IMAGE, frame_image, 0);
 
     // convert EGLImage to GL texture
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
@@ -686,25 +885,50 @@ static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_fram
 
     // destroy temporary image
     eglDestroyImage(ctx->egl_display, frame_image);
+    resource_untrack(RESOURCE_EGL_IMAGE, frame_image);
+
+    // the imported image keeps its own reference to the dmabuf
+    close_dmabuf_fds(ctx);
 
     printf("[info] drawing texture\n");
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_DRAW);
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
     glClear(GL_COLOR_BUFFER_BIT);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
+    if (ctx->hud.enabled) gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_HUD);
+    update_hud(ctx);
+    hud_draw(&ctx->hud, ctx->dmabuf_width, ctx->dmabuf_height);
+
     printf("[info] swapping buffers\n");
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_SWAP);
     if (eglSwapBuffers(ctx->egl_display, ctx->egl_surface) != EGL_TRUE) {
         printf("[!] eglSwapBuffers: failed to swap buffers\n");
         exit_fail(ctx);
     }
+    gpu_timer_end_stage(&ctx->gpu_timer);
+    frame_stats_end(&ctx->frame_stats);
 
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    accounting_end_frame();
+    probe_mark("first_frame");
+    resources_print_live();
+
+    if (bench_stats_end_frame((uint64_t)ctx->dmabuf_width * ctx->dmabuf_height * 4)) {
+        ctx->closing = true;
+    } else if (ctx->continuous || bench_stats_active()) {
+        printf("[info] requesting next frame\n");
+        request_capture(ctx);
+    }
 }
 
 static void zwlr_screencopy_frame_failed(void * data, struct zwlr_screencopy_frame_v1 * frame) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] failed\n");
+
+    frame_stats_cancel(&ctx->frame_stats);
+    if (bench_stats_fail_frame()) ctx->closing = true;
 }
 
 static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_listener = {
@@ -718,16 +942,39 @@ static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_list
 
 // --- wl_surface event handlers ---
 
+static void request_capture(ctx_t * ctx) {
+    if (ctx->screencopy_frame != NULL) {
+        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+        ctx->screencopy_frame = NULL;
+    }
+
+    // a frame destroyed before it was presented
+    if (ctx->frame_stats.in_flight != 0) frame_stats_cancel(&ctx->frame_stats);
+
+    if (ctx->capture_output == NULL) {
+        printf("[info] no output to capture\n");
+        return;
+    }
+
+    accounting_begin_frame();
+    bench_stats_begin_frame();
+    frame_stats_begin(&ctx->frame_stats);
+    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, ctx->capture_output);
+    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+}
+
 static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[wl_surface] enter\n");
 
-    if (ctx->screencopy_frame != NULL) {
-        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+    if (ctx->capture_output != output) {
+        // intervals across a switch between outputs are meaningless
+        output_t * entry = (output_t *)wl_output_get_user_data(output);
+        cadence_restart(&entry->cadence);
     }
 
-    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, output);
-    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+    ctx->capture_output = output;
+    request_capture(ctx);
 }
 
 static const struct wl_surface_listener wl_surface_listener = {
@@ -760,6 +1007,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         if (ctx->shm_buffer != NULL) {
             printf("[info] destroying old shm buffer\n");
             wl_buffer_destroy(ctx->shm_buffer);
+            resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
             ctx->shm_buffer = NULL;
         }
 
@@ -775,6 +1023,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
             printf("[!] mremap: failed to remap shm file\n");
             exit_fail(ctx);
         }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
         ctx->shm_pixels = (uint32_t *)new_pixels;
         ctx->shm_size = size;
 
@@ -788,6 +1037,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
     if (ctx->shm_buffer != NULL) {
         printf("[info] destroying old shm buffer\n");
         wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
         ctx->shm_buffer = NULL;
     }
 
@@ -797,6 +1047,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         printf("[!] wl_shm_pool: failed to create buffer\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_WL_BUFFER, ctx->shm_buffer, 0);
 }
 
 
@@ -820,6 +1071,7 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -963,11 +1215,21 @@ const char * fragment_shader =
     "}\n"
 ;
 
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
+    ctx->event_loop = NULL;
 
     ctx->compositor = NULL;
     ctx->compositor_id = 0;
@@ -993,6 +1255,10 @@ int main(void) {
 
     ctx->dmabuf_feedback = NULL;
     ctx->dmabuf_buffer = NULL;
+    ctx->dmabuf_width = 0;
+    ctx->dmabuf_height = 0;
+    ctx->dmabuf_format = 0;
+    ctx->dmabuf_modifier = 0;
 
     ctx->gbm_main_device = NULL;
     ctx->gbm_bo = NULL;
@@ -1005,6 +1271,7 @@ int main(void) {
     ctx->xdg_surface = NULL;
     ctx->xdg_toplevel = NULL;
     ctx->screencopy_frame = NULL;
+    ctx->capture_output = NULL;
 
     ctx->egl_display = EGL_NO_DISPLAY;
     ctx->egl_context = EGL_NO_CONTEXT;
@@ -1013,7 +1280,11 @@ int main(void) {
     ctx->egl_vbo = -1;
     ctx->egl_texture = -1;
     ctx->egl_shader_program = -1;
+    memset(&ctx->gpu_timer, 0, sizeof ctx->gpu_timer);
+    frame_stats_init(&ctx->frame_stats);
+    memset(&ctx->hud, 0, sizeof ctx->hud);
     ctx->egl_image_attribs = NULL;
+    for (size_t i = 0; i < 4; i++) ctx->dmabuf_fds[i] = -1;
 
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
@@ -1022,6 +1293,7 @@ int main(void) {
     ctx->xdg_toplevel_configured = false;
     ctx->configured = false;
     ctx->closing = false;
+    ctx->continuous = option_flag("WLEXP_CONTINUOUS");
 
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
@@ -1034,6 +1306,12 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
+
+    printf("[info] initializing accounting\n");
+    accounting_init(ctx->display);
+    bench_stats_init();
+    realtime_init();
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -1062,6 +1340,7 @@ int main(void) {
         printf("[!] wl_registry: no screencopy found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -1069,6 +1348,7 @@ int main(void) {
         printf("[!] memfd_create: failed to create shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
 
     printf("[info] resizing shm file\n");
     ctx->shm_size = 1;
@@ -1084,6 +1364,7 @@ int main(void) {
         printf("[!] mmap: failed to map shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
 
     printf("[info] creating shm pool\n");
     ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
@@ -1164,6 +1445,7 @@ int main(void) {
         exit_fail(ctx);
     }
     printf("[info] initialized EGL %d.%d\n", major, minor);
+    probe_mark("egl_init");
 
     EGLint num_configs;
     printf("[info] getting number of EGL configs\n");
@@ -1215,11 +1497,13 @@ int main(void) {
 
     printf("[info] create vertex buffer object\n");
     glGenBuffers(1, &ctx->egl_vbo);
+    resource_track(RESOURCE_GL_BUFFER, ctx->egl_vbo, sizeof vertex_array);
     glBindBuffer(GL_ARRAY_BUFFER, ctx->egl_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof vertex_array, vertex_array, GL_STATIC_DRAW);
 
     printf("[info] create texture and set scaling mode\n");
     glGenTextures(1, &ctx->egl_texture);
+    resource_track(RESOURCE_GL_TEXTURE, ctx->egl_texture, 0);
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -1260,6 +1544,7 @@ int main(void) {
 
     printf("[info] create shader program and get pointers to shader uniforms\n");
     ctx->egl_shader_program = glCreateProgram();
+    resource_track(RESOURCE_GL_PROGRAM, ctx->egl_shader_program, 0);
     glAttachShader(ctx->egl_shader_program, vertex_shader);
     glAttachShader(ctx->egl_shader_program, fragment_shader);
     glLinkProgram(ctx->egl_shader_program);
@@ -1268,10 +1553,10 @@ int main(void) {
         printf("[error] failed to link shader program\n");
         glDeleteShader(vertex_shader);
         glDeleteShader(fragment_shader);
-        glDeleteProgram(ctx->egl_shader_program);
         exit_fail(ctx);
     }
     glUseProgram(ctx->egl_shader_program);
+    probe_mark("shader");
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
@@ -1282,6 +1567,12 @@ int main(void) {
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
 
+    printf("[info] initializing gpu timer\n");
+    gpu_timer_init(&ctx->gpu_timer);
+
+    printf("[info] initializing HUD\n");
+    hud_init(&ctx->hud);
+
     printf("[info] clearing frame\n");
     glClearColor(1.0, 1.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -1293,8 +1584,26 @@ int main(void) {
         exit_fail(ctx);
     }
 
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
     printf("[info] entering event loop\n");
-    while (wl_display_dispatch(ctx->display) != -1 && !ctx->closing) {}
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
     printf("[info] exiting event loop\n");
 
     cleanup(ctx);
@@ -0,0 +1,762 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <wayland-util.h>
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+#include <wlr-screencopy-unstable-v1.h>
+#include <options.h>
+#include <probe.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <pixels.h>
+#include <event_loop.h>
+#include <pipeline.h>
+
+// captures an output with screencopy and runs the frames through a
+// processing pipeline (common/pipeline.c) instead of showing them
+//
+// the wayland side only captures into shm buffers and submits them, the
+// stages listed in WLEXP_PIPELINE do everything else on their own threads:
+//
+// - convert: swaps red and blue in place, XRGB8888 to XBGR8888
+// - scale: halves the frame with a 2x2 box filter
+// - encode: run-length encodes the frame
+// - sink: appends a header and the encoded (or raw) frame to
+//   WLEXP_PIPELINE_OUTPUT
+//
+// every shm buffer is a pipeline frame, it is captured into again once the
+// pipeline released it
+
+#define MAX_SLOTS 16
+
+typedef struct {
+    struct wl_output * proxy;
+    size_t id;
+    char name[32];
+    struct wl_list link;
+} output_t;
+
+typedef struct {
+    struct wl_buffer * buffer;
+    bool busy;
+} slot_t;
+
+// in front of every frame in the sink output
+typedef struct {
+    uint64_t sequence;
+    uint64_t timestamp_ns;
+    uint32_t width;
+    uint32_t height;
+    // 0 for raw pixels, otherwise the size of the encoded frame
+    uint64_t encoded_size;
+} record_header_t;
+
+typedef struct {
+    const char * name;
+    pipeline_stage_func_t func;
+} stage_entry_t;
+
+typedef struct {
+    struct wl_display * display;
+    struct wl_registry * registry;
+    event_loop_t * event_loop;
+
+    struct wl_shm * shm;
+    struct zwlr_screencopy_manager_v1 * screencopy;
+    uint32_t shm_id;
+    uint32_t screencopy_id;
+    struct wl_list /*output_t*/ outputs;
+    struct wl_output * capture_output;
+
+    struct wl_shm_pool * shm_pool;
+    slot_t slots[MAX_SLOTS];
+    uint32_t num_slots;
+    uint8_t * shm_pixels;
+    size_t shm_size;
+    size_t slot_size;
+    enum wl_shm_format shm_format;
+    uint32_t shm_width;
+    uint32_t shm_height;
+    uint32_t shm_stride;
+    int shm_fd;
+
+    struct zwlr_screencopy_frame_v1 * screencopy_frame;
+    uint32_t capture_slot;
+    uint64_t sequence;
+    uint32_t in_flight;
+    bool waiting_for_slot;
+    bool resize_pending;
+
+    pipeline_t * pipeline;
+    int output_fd;
+    uint64_t output_bytes;
+
+    bool closing;
+} ctx_t;
+
+static void cleanup(ctx_t * ctx) {
+    printf("[info] cleaning up\n");
+
+    bench_stats_report();
+
+    // the stages still read the shm buffers and write the output
+    ctx->closing = true;
+    pipeline_destroy(ctx->pipeline);
+    if (ctx->output_fd != -1) {
+        printf("[info] wrote %.1f MiB\n", ctx->output_bytes / 1048576.0);
+        close(ctx->output_fd);
+        resource_untrack(RESOURCE_FD, ctx->output_fd);
+    }
+
+    if (ctx->screencopy_frame != NULL) zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+    for (uint32_t i = 0; i < ctx->num_slots; i++) {
+        if (ctx->slots[i].buffer == NULL) continue;
+        wl_buffer_destroy(ctx->slots[i].buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->slots[i].buffer);
+    }
+    if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
+
+    output_t *output, *output_next;
+    wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        wl_list_remove(&output->link);
+        wl_output_destroy(output->proxy);
+        free(output);
+    }
+
+    if (ctx->screencopy != NULL) zwlr_screencopy_manager_v1_destroy(ctx->screencopy);
+    if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
+    if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
+    if (ctx->display != NULL) wl_display_disconnect(ctx->display);
+
+    resources_report();
+
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+// --- pipeline stages ---
+
+static bool stage_convert(void * data, pipeline_frame_t * frame) {
+    pipeline_image_t * image = &frame->image;
+    for (uint32_t y = 0; y < image->height; y++) {
+        uint32_t * row = image->pixels + (size_t)y * image->stride;
+        pixels_swizzle_rb(row, row, image->width);
+    }
+    return true;
+}
+
+static bool stage_scale(void * data, pipeline_frame_t * frame) {
+    pipeline_image_t * image = &frame->image;
+    uint32_t width = image->width / 2;
+    uint32_t height = image->height / 2;
+    if (width == 0 || height == 0) return true;
+
+    uint32_t * scaled = pipeline_frame_scratch(frame, (size_t)width * height);
+    if (scaled == NULL) {
+        printf("[!] pipeline: failed to allocate scaled frame\n");
+        return false;
+    }
+
+    // later stages read the scaled copy instead of the shm buffer
+    pixels_downscale_2x(scaled, width, image->pixels, image->stride, image->width, image->height);
+    image->pixels = scaled;
+    image->width = width;
+    image->height = height;
+    image->stride = width;
+    return true;
+}
+
+static bool stage_encode(void * data, pipeline_frame_t * frame) {
+    pipeline_image_t * image = &frame->image;
+    uint8_t * bytes = pipeline_frame_bytes(frame, PIXELS_RLE_MAX_SIZE(image->width, image->height));
+    if (bytes == NULL) {
+        printf("[!] pipeline: failed to allocate encoded frame\n");
+        return false;
+    }
+
+    frame->size = pixels_encode_rle(bytes, image->pixels, image->width, image->height, image->stride);
+    return true;
+}
+
+static bool write_all(int fd, const void * data, size_t size) {
+    const uint8_t * bytes = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written == -1 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool stage_sink(void * data, pipeline_frame_t * frame) {
+    ctx_t * ctx = (ctx_t *)data;
+    pipeline_image_t * image = &frame->image;
+
+    record_header_t header;
+    header.sequence = frame->sequence;
+    header.timestamp_ns = frame->timestamp_ns;
+    header.width = image->width;
+    header.height = image->height;
+    header.encoded_size = frame->size;
+
+    bool ok = write_all(ctx->output_fd, &header, sizeof header);
+    if (ok && frame->size > 0) {
+        ok = write_all(ctx->output_fd, frame->bytes, frame->size);
+    } else {
+        for (uint32_t y = 0; ok && y < image->height; y++) {
+            ok = write_all(ctx->output_fd, image->pixels + (size_t)y * image->stride, (size_t)image->width * 4);
+        }
+    }
+    if (!ok) {
+        printf("[!] pipeline: failed to write frame %lu: %s\n", frame->sequence, strerror(errno));
+        return false;
+    }
+
+    // only the single sink thread counts
+    ctx->output_bytes += sizeof header + (frame->size > 0 ? frame->size : (size_t)image->width * image->height * 4);
+    return true;
+}
+
+static const stage_entry_t stage_entries[] = {
+    { "convert", stage_convert },
+    { "scale", stage_scale },
+    { "encode", stage_encode },
+    { "sink", stage_sink }
+};
+
+// parses WLEXP_PIPELINE, e.g. "convert,scale:2,encode:4,sink"
+static void add_stages(ctx_t * ctx) {
+    char * list = strdup(option_string("WLEXP_PIPELINE", "convert,scale,encode"));
+    long depth = option_long("WLEXP_PIPELINE_QUEUE", 2);
+    if (list == NULL) {
+        printf("[!] malloc: failed to copy stage list\n");
+        exit_fail(ctx);
+    }
+    if (depth < 1) {
+        printf("[!] pipeline: invalid queue depth %ld\n", depth);
+        free(list);
+        exit_fail(ctx);
+    }
+
+    char * save = NULL;
+    for (char * name = strtok_r(list, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+        long threads = 1;
+        char * count = strchr(name, ':');
+        if (count != NULL) {
+            *count = '\0';
+            char * end;
+            threads = strtol(count + 1, &end, 10);
+            if (end == count + 1 || *end != '\0' || threads < 1) {
+                printf("[!] pipeline: invalid thread count %s for stage %s\n", count + 1, name);
+                free(list);
+                exit_fail(ctx);
+            }
+        }
+
+        const stage_entry_t * entry = NULL;
+        for (size_t i = 0; i < sizeof stage_entries / sizeof stage_entries[0]; i++) {
+            if (strcmp(stage_entries[i].name, name) == 0) entry = &stage_entries[i];
+        }
+        if (entry == NULL) {
+            printf("[!] pipeline: unknown stage %s\n", name);
+            free(list);
+            exit_fail(ctx);
+        }
+
+        if (entry->func == stage_sink) {
+            // frames are appended as they come, one writer keeps them whole
+            threads = 1;
+            if (ctx->output_fd == -1) {
+                const char * path = option_string("WLEXP_PIPELINE_OUTPUT", NULL);
+                if (path == NULL) {
+                    printf("[!] pipeline: the sink stage needs WLEXP_PIPELINE_OUTPUT\n");
+                    free(list);
+                    exit_fail(ctx);
+                }
+
+                ctx->output_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (ctx->output_fd == -1) {
+                    printf("[!] open: failed to open %s: %s\n", path, strerror(errno));
+                    free(list);
+                    exit_fail(ctx);
+                }
+                resource_track(RESOURCE_FD, ctx->output_fd, 0);
+            }
+        }
+
+        if (!pipeline_add_stage(ctx->pipeline, entry->name, threads, depth, entry->func, ctx)) {
+            free(list);
+            exit_fail(ctx);
+        }
+    }
+
+    free(list);
+}
+
+// --- wl_registry event handlers ---
+
+static void registry_event_add(
+    void * data, struct wl_registry * registry,
+    uint32_t id, const char * interface, uint32_t version
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][+] id=%08x %s v%d\n", id, interface, version);
+
+    if (strcmp(interface, "wl_shm") == 0) {
+        if (ctx->shm != NULL) {
+            printf("[!] wl_registry: duplicate shm\n");
+            exit_fail(ctx);
+        }
+
+        ctx->shm = (struct wl_shm *)wl_registry_bind(registry, id, &wl_shm_interface, 1);
+        ctx->shm_id = id;
+    } else if (strcmp(interface, "zwlr_screencopy_manager_v1") == 0) {
+        if (ctx->screencopy != NULL) {
+            printf("[!] wl_registry: duplicate screencopy\n");
+            exit_fail(ctx);
+        }
+
+        ctx->screencopy = (struct zwlr_screencopy_manager_v1 *)wl_registry_bind(registry, id, &zwlr_screencopy_manager_v1_interface, 3);
+        ctx->screencopy_id = id;
+    } else if (strcmp(interface, "wl_output") == 0) {
+        output_t * output = malloc(sizeof (output_t));
+        if (output == NULL) {
+            printf("[!] wl_registry: failed to allocate output handle\n");
+            exit_fail(ctx);
+        }
+
+        printf("[info] binding output\n");
+        output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
+        output->id = id;
+        snprintf(output->name, sizeof output->name, "output %u", id);
+        wl_list_insert(&ctx->outputs, &output->link);
+    }
+}
+
+static void registry_event_remove(
+    void * data, struct wl_registry * registry,
+    uint32_t id
+) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[registry][-] id=%08x\n", id);
+
+    if (id == ctx->shm_id) {
+        printf("[!] wl_registry: shm disapperared\n");
+        exit_fail(ctx);
+    } else if (id == ctx->screencopy_id) {
+        printf("[!] wl_registry: screencopy disapperared\n");
+        exit_fail(ctx);
+    } else {
+        output_t *output, *output_next;
+        wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+            if (output->id == id) {
+                if (ctx->capture_output == output->proxy) {
+                    printf("[!] wl_registry: captured output disappeared\n");
+                    ctx->capture_output = NULL;
+                    ctx->closing = true;
+                }
+                wl_list_remove(&output->link);
+                wl_output_destroy(output->proxy);
+                free(output);
+            }
+        }
+    }
+
+    (void)registry;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_event_add,
+    .global_remove = registry_event_remove
+};
+
+// --- shm buffers ---
+
+static void destroy_shm_buffers(ctx_t * ctx) {
+    for (uint32_t i = 0; i < ctx->num_slots; i++) {
+        slot_t * slot = &ctx->slots[i];
+        if (slot->buffer == NULL) continue;
+
+        printf("[info] destroying old shm buffer\n");
+        wl_buffer_destroy(slot->buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, slot->buffer);
+        slot->buffer = NULL;
+    }
+}
+
+// only called while no frame is in the pipeline, the pool may move
+static void resize_shm_buffers(ctx_t * ctx, enum wl_shm_format format, uint32_t width, uint32_t height, uint32_t stride) {
+    size_t slot_size = (size_t)stride * height;
+    size_t size = slot_size * ctx->num_slots;
+
+    destroy_shm_buffers(ctx);
+
+    if (size > ctx->shm_size) {
+        printf("[info] resizing shm file\n");
+        if (ftruncate(ctx->shm_fd, size) == -1) {
+            printf("[!] ftruncate: failed to resize shm file\n");
+            exit_fail(ctx);
+        }
+
+        printf("[info] remapping shm file\n");
+        void * new_pixels = mremap(ctx->shm_pixels, ctx->shm_size, size, MREMAP_MAYMOVE);
+        if (new_pixels == MAP_FAILED) {
+            printf("[!] mremap: failed to remap shm file\n");
+            exit_fail(ctx);
+        }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
+        ctx->shm_pixels = (uint8_t *)new_pixels;
+        ctx->shm_size = size;
+
+        printf("[info] resizing shm pool\n");
+        wl_shm_pool_resize(ctx->shm_pool, size);
+    }
+
+    ctx->slot_size = slot_size;
+    ctx->shm_format = format;
+    ctx->shm_width = width;
+    ctx->shm_height = height;
+    ctx->shm_stride = stride;
+
+    for (uint32_t i = 0; i < ctx->num_slots; i++) {
+        slot_t * slot = &ctx->slots[i];
+
+        printf("[info] creating shm buffer\n");
+        slot->buffer = wl_shm_pool_create_buffer(ctx->shm_pool, i * slot_size, width, height, stride, format);
+        if (slot->buffer == NULL) {
+            printf("[!] wl_shm_pool: failed to create buffer\n");
+            exit_fail(ctx);
+        }
+        resource_track(RESOURCE_WL_BUFFER, slot->buffer, 0);
+    }
+}
+
+// --- zwlr_screencopy_frame_v1 event handlers ---
+
+static void request_capture(ctx_t * ctx);
+
+static void zwlr_screencopy_frame_buffer_shm(void * data, struct zwlr_screencopy_frame_v1 * frame, enum wl_shm_format format, uint32_t width, uint32_t height, uint32_t stride) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[zwlr_screencopy_frame] buffer_shm: %dx%d+%d@%08x\n", width, height, stride, format);
+
+    if (stride < width * 4) {
+        printf("[!] zwlr_screencopy_frame: only 32 bit formats are supported\n");
+        exit_fail(ctx);
+    }
+
+    if (
+        ctx->slots[0].buffer != NULL && format == ctx->shm_format &&
+        width == ctx->shm_width && height == ctx->shm_height && stride == ctx->shm_stride
+    ) {
+        return;
+    }
+
+    if (ctx->in_flight > 0) {
+        // frames in the pipeline still point into the pool, try again once
+        // all of them were released
+        printf("[info] frame size changed, waiting for the pipeline to drain\n");
+        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+        ctx->screencopy_frame = NULL;
+        ctx->resize_pending = true;
+        return;
+    }
+
+    resize_shm_buffers(ctx, format, width, height, stride);
+}
+
+static void zwlr_screencopy_frame_buffer_dmabuf(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t format, uint32_t width, uint32_t height) {
+    printf("[zwlr_screencopy_frame] buffer_dmabuf: %dx%d@%c%c%c%c\n", width, height,
+        (format >> 0) & 0xff, (format >> 8) & 0xff, (format >> 16) & 0xff, (format >> 24) & 0xff
+    );
+}
+
+static void zwlr_screencopy_frame_buffer_done(void * data, struct zwlr_screencopy_frame_v1 * frame) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[zwlr_screencopy_frame] buffer_done\n");
+
+    // the buffer event destroyed the frame to resize later
+    if (ctx->screencopy_frame == NULL) return;
+
+    printf("[info] copying frame to slot %u\n", ctx->capture_slot);
+    zwlr_screencopy_frame_v1_copy(ctx->screencopy_frame, ctx->slots[ctx->capture_slot].buffer);
+}
+
+static void zwlr_screencopy_frame_flags(void * data, struct zwlr_screencopy_frame_v1 * frame, enum zwlr_screencopy_frame_v1_flags flags) {
+    printf("[zwlr_screencopy_frame] flags: %x\n", flags);
+}
+
+static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[zwlr_screencopy_frame] ready\n");
+
+    pipeline_frame_t * pipeline_frame = pipeline_get_frame(ctx->pipeline, ctx->capture_slot);
+    pipeline_frame->sequence = ctx->sequence++;
+    pipeline_frame->timestamp_ns = clock_from_ready(sec_hi, sec_lo, nsec);
+    pipeline_frame->image.pixels = (uint32_t *)(ctx->shm_pixels + ctx->capture_slot * ctx->slot_size);
+    pipeline_frame->image.width = ctx->shm_width;
+    pipeline_frame->image.height = ctx->shm_height;
+    pipeline_frame->image.stride = ctx->shm_stride / 4;
+
+    if (pipeline_submit(ctx->pipeline, pipeline_frame)) {
+        ctx->slots[ctx->capture_slot].busy = true;
+        ctx->in_flight++;
+    } else {
+        printf("[info] pipeline busy, dropping frame\n");
+    }
+    probe_mark("first_frame");
+
+    if (bench_stats_end_frame((uint64_t)ctx->shm_width * ctx->shm_height * 4)) {
+        ctx->closing = true;
+    } else {
+        request_capture(ctx);
+    }
+}
+
+static void zwlr_screencopy_frame_failed(void * data, struct zwlr_screencopy_frame_v1 * frame) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[zwlr_screencopy_frame] failed\n");
+
+    if (bench_stats_fail_frame()) {
+        ctx->closing = true;
+    } else {
+        request_capture(ctx);
+    }
+}
+
+static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_listener = {
+    .buffer = zwlr_screencopy_frame_buffer_shm,
+    .linux_dmabuf = zwlr_screencopy_frame_buffer_dmabuf,
+    .buffer_done = zwlr_screencopy_frame_buffer_done,
+    .flags = zwlr_screencopy_frame_flags,
+    .ready = zwlr_screencopy_frame_ready,
+    .failed = zwlr_screencopy_frame_failed
+};
+
+static void request_capture(ctx_t * ctx) {
+    if (ctx->screencopy_frame != NULL) {
+        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+        ctx->screencopy_frame = NULL;
+    }
+    if (ctx->closing || ctx->resize_pending) return;
+
+    bool found = false;
+    for (uint32_t i = 0; i < ctx->num_slots && !found; i++) {
+        if (ctx->slots[i].busy) continue;
+        ctx->capture_slot = i;
+        found = true;
+    }
+    if (!found) {
+        // the next released frame requests again
+        printf("[info] every frame is in the pipeline\n");
+        ctx->waiting_for_slot = true;
+        return;
+    }
+
+    bench_stats_begin_frame();
+    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, ctx->capture_output);
+    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+}
+
+// --- pipeline ---
+
+static void frame_released(void * data, pipeline_frame_t * frame, bool completed) {
+    ctx_t * ctx = (ctx_t *)data;
+    ctx->slots[frame->index].busy = false;
+    ctx->in_flight--;
+
+    if (ctx->resize_pending && ctx->in_flight == 0) {
+        ctx->resize_pending = false;
+        request_capture(ctx);
+    } else if (ctx->waiting_for_slot) {
+        ctx->waiting_for_slot = false;
+        request_capture(ctx);
+    }
+}
+
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
+int main(void) {
+    probe_mark("start");
+    printf("[info] allocating context\n");
+    ctx_t * ctx = malloc(sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->display = NULL;
+    ctx->registry = NULL;
+    ctx->event_loop = NULL;
+
+    ctx->shm = NULL;
+    ctx->screencopy = NULL;
+    ctx->shm_id = 0;
+    ctx->screencopy_id = 0;
+    wl_list_init(&ctx->outputs);
+    ctx->capture_output = NULL;
+
+    ctx->shm_pool = NULL;
+    for (uint32_t i = 0; i < MAX_SLOTS; i++) {
+        ctx->slots[i].buffer = NULL;
+        ctx->slots[i].busy = false;
+    }
+    long frames = option_long("WLEXP_PIPELINE_FRAMES", 4);
+    if (frames < 1) frames = 1;
+    if (frames > MAX_SLOTS) frames = MAX_SLOTS;
+    ctx->num_slots = frames;
+    ctx->shm_pixels = NULL;
+    ctx->shm_size = 0;
+    ctx->slot_size = 0;
+    ctx->shm_format = 0;
+    ctx->shm_width = 0;
+    ctx->shm_height = 0;
+    ctx->shm_stride = 0;
+    ctx->shm_fd = -1;
+
+    ctx->screencopy_frame = NULL;
+    ctx->capture_slot = 0;
+    ctx->sequence = 0;
+    ctx->in_flight = 0;
+    ctx->waiting_for_slot = false;
+    ctx->resize_pending = false;
+
+    ctx->pipeline = NULL;
+    ctx->output_fd = -1;
+    ctx->output_bytes = 0;
+
+    ctx->closing = false;
+
+    printf("[info] connecting to display\n");
+    ctx->display = wl_display_connect(NULL);
+    if (ctx->display == NULL) {
+        printf("[!] wl_display: connect failed\n");
+        exit_fail(ctx);
+    }
+    probe_mark("connect");
+    bench_stats_init();
+
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] creating pipeline\n");
+    ctx->pipeline = pipeline_create(ctx->event_loop, ctx->num_slots, frame_released, ctx);
+    if (ctx->pipeline == NULL) {
+        printf("[!] pipeline: failed to create pipeline\n");
+        exit_fail(ctx);
+    }
+    add_stages(ctx);
+    if (!pipeline_start(ctx->pipeline)) {
+        printf("[!] pipeline: failed to start pipeline\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] getting registry\n");
+    ctx->registry = wl_display_get_registry(ctx->display);
+    wl_registry_add_listener(ctx->registry, &registry_listener, (void *)ctx);
+
+    printf("[info] waiting for events\n");
+    wl_display_roundtrip(ctx->display);
+
+    printf("[info] checking if protocols found\n");
+    if (ctx->shm == NULL) {
+        printf("[!] wl_registry: no shm found\n");
+        exit_fail(ctx);
+    } else if (ctx->screencopy == NULL) {
+        printf("[!] wl_registry: no screencopy found\n");
+        exit_fail(ctx);
+    } else if (wl_list_empty(&ctx->outputs)) {
+        printf("[!] wl_registry: no output found\n");
+        exit_fail(ctx);
+    }
+    probe_mark("registry");
+
+    // the first output bound is the last one in the list
+    output_t * output = wl_container_of(ctx->outputs.prev, output, link);
+    ctx->capture_output = output->proxy;
+    printf("[info] capturing %s\n", output->name);
+
+    printf("[info] creating shm file\n");
+    ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
+    if (ctx->shm_fd == -1) {
+        printf("[!] memfd_create: failed to create shm file\n");
+        exit_fail(ctx);
+    }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
+
+    printf("[info] resizing shm file\n");
+    ctx->shm_size = 1;
+    if (ftruncate(ctx->shm_fd, ctx->shm_size) == -1) {
+        printf("[!] ftruncate: failed to resize shm file\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] mapping shm file\n");
+    ctx->shm_pixels = (uint8_t *)mmap(NULL, ctx->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->shm_fd, 0);
+    if (ctx->shm_pixels == MAP_FAILED) {
+        ctx->shm_pixels = NULL;
+        printf("[!] mmap: failed to map shm file\n");
+        exit_fail(ctx);
+    }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
+
+    printf("[info] creating shm pool\n");
+    ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
+    if (ctx->shm_pool == NULL) {
+        printf("[!] wl_shm: failed to create shm pool\n");
+        exit_fail(ctx);
+    }
+
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
+    request_capture(ctx);
+
+    printf("[info] entering event loop\n");
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
+    printf("[info] exiting event loop\n");
+
+    cleanup(ctx);
+}
@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/epoll.h>
 #include <wayland-util.h>
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
@@ -13,10 +15,29 @@
 #include <xdg-shell.h>
 #include <wlr-screencopy-unstable-v1.h>
 #include <drm_fourcc.h>
+#include <options.h>
+#include <probe.h>
+#include <accounting.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <cadence.h>
+#include <timestamp_pattern.h>
+#include <event_loop.h>
+#include <reader_thread.h>
+#include <realtime.h>
+#include <capture_scheduler.h>
+#include <rate_controller.h>
+#include <idle_throttle.h>
+#include <frame_sink.h>
+#include <pixels.h>
+#include <task_pool.h>
 
 typedef struct {
     struct wl_output * proxy;
     size_t id;
+    char name[32];
+    cadence_t cadence;
     struct wl_list link;
 } output_t;
 
@@ -32,9 +53,25 @@ typedef struct {
     (wl_shm_format) \
 )
 
+#define MAX_SHM_SLOTS 8
+
+// one frame sized buffer of the shm pool, held while the compositor has not
+// released it yet, writing while it is being recorded. with rate control, a
+// slot is draining from its commit until it is neither held nor writing
+typedef struct {
+    struct wl_buffer * buffer;
+    bool held;
+    bool writing;
+    bool draining;
+    uint64_t submitted_ns;
+    // commit of the next buffer, before which it cannot be released
+    uint64_t replaced_ns;
+} shm_slot_t;
+
 typedef struct {
     struct wl_display * display;
     struct wl_registry * registry;
+    event_loop_t * event_loop;
 
     struct wl_compositor * compositor;
     struct wl_shm * shm;
@@ -49,11 +86,19 @@ typedef struct {
     struct wl_list /*output_t*/ outputs;
 
     struct wl_shm_pool * shm_pool;
+    shm_slot_t shm_slots[MAX_SHM_SLOTS];
+    uint32_t num_shm_slots;
+    uint32_t shm_slot;
     struct wl_buffer * shm_buffer;
     uint32_t * shm_pixels;
     size_t shm_size;
+    size_t shm_slot_size;
+    enum wl_shm_format shm_format;
     uint32_t shm_width;
     uint32_t shm_height;
+    uint32_t shm_stride;
+    // rows of the last frame are stored bottom-up
+    bool shm_y_invert;
     int shm_fd;
 
     struct wl_surface * surface;
@@ -61,6 +106,27 @@ typedef struct {
     struct xdg_surface * xdg_surface;
     struct xdg_toplevel * xdg_toplevel;
     struct zwlr_screencopy_frame_v1 * screencopy_frame;
+    struct wl_output * capture_output;
+
+    reader_thread_t * reader;
+    reader_queue_t * capture_queue;
+    struct zwlr_screencopy_manager_v1 * screencopy_wrapper;
+    capture_scheduler_t scheduler;
+    rate_controller_t rate;
+    idle_throttle_t idle;
+    frame_sink_t * sink;
+    task_pool_t * tasks;
+
+    // per-tile hashes of the previous and the current frame
+    uint64_t * tile_hashes;
+    uint64_t * next_tile_hashes;
+    uint32_t num_tiles;
+    uint32_t diff_tile_size;
+    bool diff_valid;
+    uint64_t diff_frames;
+    uint64_t diff_tiles;
+    uint64_t diff_changed_tiles;
+    uint64_t diff_total_ns;
 
     uint32_t last_surface_serial;
     uint32_t win_width;
@@ -69,24 +135,64 @@ typedef struct {
     bool xdg_toplevel_configured;
     bool configured;
     bool closing;
+    bool continuous;
+    bool paced;
+    bool rate_control;
+    bool idle_throttle;
+    bool diff;
+    bool frame_damaged;
+    bool waiting_for_slot;
 } ctx_t;
 
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
+    accounting_report();
+    bench_stats_report();
+    realtime_report();
+    timestamp_latency_report();
+
+    if (ctx->sink != NULL) {
+        // completions of the remaining writes must not start captures
+        ctx->waiting_for_slot = false;
+        frame_sink_destroy(ctx->sink);
+    }
+    if (ctx->tasks != NULL) {
+        if (ctx->diff_frames > 0) {
+            printf("[diff] %lu frames, %.3f ms mean to hash %ux%u tiles, %.1f%% of tiles changed\n",
+                ctx->diff_frames, ctx->diff_total_ns / 1e6 / ctx->diff_frames, ctx->diff_tile_size, ctx->diff_tile_size,
+                ctx->diff_tiles > 0 ? 100.0 * ctx->diff_changed_tiles / ctx->diff_tiles : 0
+            );
+        }
+        task_pool_destroy(ctx->tasks);
+    }
+    free(ctx->tile_hashes);
+    free(ctx->next_tile_hashes);
     if (ctx->screencopy_frame != NULL) zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+    if (ctx->screencopy_wrapper != NULL) wl_proxy_wrapper_destroy(ctx->screencopy_wrapper);
     if (ctx->xdg_toplevel != NULL) xdg_toplevel_destroy(ctx->xdg_toplevel);
     if (ctx->xdg_surface != NULL) xdg_surface_destroy(ctx->xdg_surface);
     if (ctx->viewport != NULL) wp_viewport_destroy(ctx->viewport);
     if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
 
-    if (ctx->shm_buffer != NULL) wl_buffer_destroy(ctx->shm_buffer);
+    for (uint32_t i = 0; i < ctx->num_shm_slots; i++) {
+        if (ctx->shm_slots[i].buffer == NULL) continue;
+        wl_buffer_destroy(ctx->shm_slots[i].buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_slots[i].buffer);
+    }
     if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
-    if (ctx->shm_pixels != NULL) munmap(ctx->shm_pixels, ctx->shm_size);
-    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
 
     output_t *output, *output_next;
     wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        cadence_report(&output->cadence, output->name);
         wl_list_remove(&output->link);
         wl_output_destroy(output->proxy);
         free(output);
@@ -98,8 +204,24 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
     if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
     if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->scheduler.timer != NULL) {
+        capture_scheduler_report(&ctx->scheduler);
+        capture_scheduler_finish(&ctx->scheduler);
+    }
+    if (ctx->rate.timer != NULL) {
+        rate_controller_report(&ctx->rate);
+        rate_controller_finish(&ctx->rate);
+    }
+    if (ctx->idle.timer != NULL) {
+        idle_throttle_report(&ctx->idle, 0);
+        idle_throttle_finish(&ctx->idle);
+    }
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
+    if (ctx->reader != NULL) reader_thread_destroy(ctx->reader);
     if (ctx->display != NULL) wl_display_disconnect(ctx->display);
 
+    resources_report();
+
     free(ctx);
 }
 
@@ -108,6 +230,33 @@ static void exit_fail(ctx_t * ctx) {
     exit(1);
 }
 
+// --- wl_output event handlers ---
+
+static void wl_output_event_geometry(
+    void * data, struct wl_output * proxy,
+    int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+    int32_t subpixel, const char * make, const char * model, int32_t transform
+) {
+    output_t * output = (output_t *)data;
+    printf("[wl_output] geometry: %s -> %s %s\n", output->name, make, model);
+}
+
+static void wl_output_event_mode(
+    void * data, struct wl_output * proxy,
+    uint32_t flags, int32_t width, int32_t height, int32_t refresh
+) {
+    output_t * output = (output_t *)data;
+    if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+
+    printf("[wl_output] mode: %s -> %dx%d@%d.%03d\n", output->name, width, height, refresh / 1000, refresh % 1000);
+    cadence_set_refresh(&output->cadence, refresh);
+}
+
+static const struct wl_output_listener wl_output_listener = {
+    .geometry = wl_output_event_geometry,
+    .mode = wl_output_event_mode
+};
+
 // --- wl_registry event handlers ---
 
 static void registry_event_add(
@@ -167,7 +316,10 @@ static void registry_event_add(
         printf("[info] binding output\n");
         output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
         output->id = id;
+        snprintf(output->name, sizeof output->name, "output %zu", id);
+        cadence_init(&output->cadence);
         wl_list_insert(&ctx->outputs, &output->link);
+        wl_output_add_listener(output->proxy, &wl_output_listener, (void *)output);
     }
 }
 
@@ -197,6 +349,8 @@ static void registry_event_remove(
         output_t *output, *output_next;
         wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
             if (output->id == id) {
+                if (ctx->capture_output == output->proxy) ctx->capture_output = NULL;
+                cadence_report(&output->cadence, output->name);
                 wl_list_remove(&output->link);
                 wl_output_destroy(output->proxy);
                 free(output);
@@ -212,18 +366,143 @@ static const struct wl_registry_listener registry_listener = {
     .global_remove = registry_event_remove
 };
 
+// --- wl_buffer event handlers ---
+
+static void retry_capture(ctx_t * ctx);
+
+// a slow recording pushes back on the rate just like a slow release
+static void slot_drained(ctx_t * ctx, shm_slot_t * slot) {
+    if (!slot->draining || slot->held || slot->writing) return;
+    slot->draining = false;
+
+    // compositors release a buffer when the next one is committed, counting
+    // from before that would never let the drain drop below the interval
+    uint64_t since_ns = slot->replaced_ns != 0 ? slot->replaced_ns : slot->submitted_ns;
+    rate_controller_drained(&ctx->rate, clock_now_ns() - since_ns);
+}
+
+static void wl_buffer_release(void * data, struct wl_buffer * buffer) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    for (uint32_t i = 0; i < ctx->num_shm_slots; i++) {
+        shm_slot_t * slot = &ctx->shm_slots[i];
+        if (slot->buffer != buffer || !slot->held) continue;
+
+        printf("[wl_buffer] release\n");
+        slot->held = false;
+        slot_drained(ctx, slot);
+    }
+
+    retry_capture(ctx);
+}
+
+static const struct wl_buffer_listener wl_buffer_listener = {
+    .release = wl_buffer_release
+};
+
+// --- frame diff ---
+
+typedef struct {
+    const uint32_t * pixels;
+    uint32_t stride;
+    uint64_t * hashes;
+} diff_job_t;
+
+static void hash_tile(void * data, uint32_t index, task_region_t tile) {
+    diff_job_t * job = (diff_job_t *)data;
+    const uint32_t * pixels = job->pixels + (size_t)tile.y * job->stride + tile.x;
+    job->hashes[index] = pixels_hash(pixels, tile.width, tile.height, job->stride);
+}
+
+static uint32_t diff_frame(ctx_t * ctx, const uint32_t * pixels) {
+    uint32_t tiles = task_pool_tile_count(ctx->shm_width, ctx->shm_height, ctx->diff_tile_size, ctx->diff_tile_size);
+    if (tiles != ctx->num_tiles) {
+        free(ctx->tile_hashes);
+        free(ctx->next_tile_hashes);
+        ctx->tile_hashes = malloc(tiles * sizeof (uint64_t));
+        ctx->next_tile_hashes = malloc(tiles * sizeof (uint64_t));
+        if (ctx->tile_hashes == NULL || ctx->next_tile_hashes == NULL) {
+            printf("[!] malloc: failed to allocate tile hashes\n");
+            exit_fail(ctx);
+        }
+        ctx->num_tiles = tiles;
+        ctx->diff_valid = false;
+    }
+
+    uint64_t start_ns = clock_now_ns();
+    diff_job_t job;
+    job.pixels = pixels;
+    job.stride = ctx->shm_stride / 4;
+    job.hashes = ctx->next_tile_hashes;
+    task_pool_for_tiles(ctx->tasks, ctx->shm_width, ctx->shm_height, ctx->diff_tile_size, ctx->diff_tile_size, hash_tile, &job);
+
+    // joined, compare with the previous frame on this thread
+    uint32_t changed = 0;
+    for (uint32_t i = 0; i < tiles; i++) {
+        if (!ctx->diff_valid || ctx->next_tile_hashes[i] != ctx->tile_hashes[i]) changed++;
+    }
+    uint64_t * hashes = ctx->tile_hashes;
+    ctx->tile_hashes = ctx->next_tile_hashes;
+    ctx->next_tile_hashes = hashes;
+    ctx->diff_valid = true;
+
+    uint64_t diff_ns = clock_now_ns() - start_ns;
+    ctx->diff_frames++;
+    ctx->diff_tiles += tiles;
+    ctx->diff_changed_tiles += changed;
+    ctx->diff_total_ns += diff_ns;
+    printf("[diff] %u of %u tiles changed, hashed in %.3f ms\n", changed, tiles, diff_ns / 1e6);
+    return changed;
+}
+
 // --- zwlr_screencopy_frame_v1 event handlers ---
 
+static void request_capture(ctx_t * ctx);
+
+static void destroy_shm_buffers(ctx_t * ctx) {
+    for (uint32_t i = 0; i < ctx->num_shm_slots; i++) {
+        shm_slot_t * slot = &ctx->shm_slots[i];
+        if (slot->buffer == NULL) continue;
+
+        printf("[info] destroying old shm buffer\n");
+        wl_buffer_destroy(slot->buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, slot->buffer);
+        slot->buffer = NULL;
+
+        // its release will never arrive, a write in progress still drains it
+        if (slot->held) {
+            slot->held = false;
+            if (!slot->writing && slot->draining) {
+                slot->draining = false;
+                rate_controller_discarded(&ctx->rate);
+            }
+        }
+    }
+    ctx->shm_buffer = NULL;
+}
+
 static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t width, uint32_t height, uint32_t stride) {
     uint32_t bytes_per_pixel = width / stride;
-    uint32_t size = stride * height;
+    size_t frame_size = (size_t)stride * height;
+    // O_DIRECT recording needs every slot aligned
+    size_t slot_size = frame_size;
+    if (ctx->sink != NULL) slot_size = (frame_size + FRAME_SINK_ALIGNMENT - 1) & ~(size_t)(FRAME_SINK_ALIGNMENT - 1);
+    size_t size = slot_size * ctx->num_shm_slots;
+
+    // buffers are kept as long as the compositor keeps sending the same
+    // parameters, so the ones it still holds are not destroyed under it
+    if (
+        ctx->shm_buffer != NULL && format == ctx->shm_format &&
+        width == ctx->shm_width && height == ctx->shm_height && stride == ctx->shm_stride
+    ) {
+        return;
+    }
+
+    // slots being recorded are about to change
+    if (ctx->sink != NULL) frame_sink_flush(ctx->sink);
 
     if (size > ctx->shm_size) {
-        if (ctx->shm_buffer != NULL) {
-            printf("[info] destroying old shm buffer\n");
-            wl_buffer_destroy(ctx->shm_buffer);
-            ctx->shm_buffer = NULL;
-        }
+        destroy_shm_buffers(ctx);
 
         printf("[info] resizing shm file\n");
         if (ftruncate(ctx->shm_fd, size) == -1) {
@@ -237,27 +516,41 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
             printf("[!] mremap: failed to remap shm file\n");
             exit_fail(ctx);
         }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
         ctx->shm_pixels = (uint32_t *)new_pixels;
         ctx->shm_size = size;
+        realtime_prefault(ctx->shm_pixels, ctx->shm_size);
+        if (ctx->sink != NULL) frame_sink_set_pool(ctx->sink, ctx->shm_pixels, ctx->shm_size);
 
         printf("[info] resizing shm pool\n");
         wl_shm_pool_resize(ctx->shm_pool, size);
     }
 
+    ctx->shm_slot_size = slot_size;
+    ctx->diff_valid = false;
+    ctx->shm_format = format;
     ctx->shm_width = width;
     ctx->shm_height = height;
+    ctx->shm_stride = stride;
 
-    if (ctx->shm_buffer != NULL) {
-        printf("[info] destroying old shm buffer\n");
-        wl_buffer_destroy(ctx->shm_buffer);
-        ctx->shm_buffer = NULL;
+    destroy_shm_buffers(ctx);
+
+    for (uint32_t i = 0; i < ctx->num_shm_slots; i++) {
+        shm_slot_t * slot = &ctx->shm_slots[i];
+
+        printf("[info] creating shm buffer\n");
+        slot->buffer = wl_shm_pool_create_buffer(ctx->shm_pool, i * slot_size, width, height, stride, format);
+        if (slot->buffer == NULL) {
+            printf("[!] wl_shm_pool: failed to create buffer\n");
+            exit_fail(ctx);
+        }
+        resource_track(RESOURCE_WL_BUFFER, slot->buffer, 0);
+        wl_buffer_add_listener(slot->buffer, &wl_buffer_listener, (void *)ctx);
     }
+    ctx->shm_buffer = ctx->shm_slots[ctx->shm_slot].buffer;
 
-    printf("[info] creating shm buffer\n");
-    ctx->shm_buffer = wl_shm_pool_create_buffer(ctx->shm_pool, 0, width, height, stride, format);
-    if (ctx->shm_buffer == NULL) {
-        printf("[!] wl_shm_pool: failed to create buffer\n");
-        exit_fail(ctx);
+    if (ctx->sink != NULL) {
+        printf("[info] recording %ux%u frames with stride %u as %c%c%c%c\n", width, height, stride, PRINT_WL_SHM_FORMAT(format));
     }
 }
 
@@ -280,31 +573,119 @@ static void zwlr_screencopy_frame_buffer_done(void * data, struct zwlr_screencop
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] buffer_done\n");
 
-    zwlr_screencopy_frame_v1_copy(frame, ctx->shm_buffer);
+    accounting_begin_stage(ACCOUNTING_STAGE_COPY);
+    if (ctx->idle_throttle) {
+        zwlr_screencopy_frame_v1_copy_with_damage(frame, ctx->shm_buffer);
+    } else {
+        zwlr_screencopy_frame_v1_copy(frame, ctx->shm_buffer);
+    }
 }
 
 static void zwlr_screencopy_frame_flags(void * data, struct zwlr_screencopy_frame_v1 * frame, enum zwlr_screencopy_frame_v1_flags flags) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] flags\n");
+
+    ctx->shm_y_invert = (flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT) != 0;
+}
+
+static void zwlr_screencopy_frame_damage(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[zwlr_screencopy_frame] damage %d,%d %dx%d\n", x, y, width, height);
+
+    if (width > 0 && height > 0) ctx->frame_damaged = true;
+}
+
+// no capture is pending from here on, see retry_capture
+static void finish_capture(ctx_t * ctx, struct zwlr_screencopy_frame_v1 * frame) {
+    zwlr_screencopy_frame_v1_destroy(frame);
+    if (ctx->screencopy_frame == frame) ctx->screencopy_frame = NULL;
 }
 
 static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] ready\n");
+    accounting_begin_stage(ACCOUNTING_STAGE_PROCESS);
+    finish_capture(ctx, frame);
+
+    int32_t refresh_mhz = 0;
+    if (ctx->capture_output != NULL) {
+        output_t * output = (output_t *)wl_output_get_user_data(ctx->capture_output);
+        cadence_frame(&output->cadence, output->name, clock_from_ready(sec_hi, sec_lo, nsec), clock_now_ns());
+        refresh_mhz = output->cadence.refresh_mhz;
+    }
+    realtime_frame(clock_from_ready(sec_hi, sec_lo, nsec));
 
-    printf("[info] attaching buffer to surface\n");
-    wl_surface_attach(ctx->surface, ctx->shm_buffer, 0, 0);
+    uint32_t * pixels = (uint32_t *)((uint8_t *)ctx->shm_pixels + ctx->shm_slot * ctx->shm_slot_size);
+    // compositors may report damage for frames that did not change
+    bool changed = ctx->diff ? diff_frame(ctx, pixels) > 0 : ctx->frame_damaged;
 
-    printf("[info] setting source viewport\n");
-    wp_viewport_set_source(ctx->viewport, 0, 0, wl_fixed_from_int(ctx->shm_width), wl_fixed_from_int(ctx->shm_height));
+    // an unchanged frame is already shown in the window
+    bool process = !ctx->idle_throttle || idle_throttle_frame(&ctx->idle, changed);
+    if (process) {
+        if (ctx->idle_throttle) idle_throttle_begin_processing(&ctx->idle);
+        timestamp_latency_frame(pixels, ctx->shm_width, ctx->shm_height, ctx->shm_stride, ctx->shm_y_invert, clock_from_ready(sec_hi, sec_lo, nsec));
 
-    printf("[info] committing surface\n");
-    wl_surface_commit(ctx->surface);
+        printf("[info] attaching buffer to surface\n");
+        wl_surface_attach(ctx->surface, ctx->shm_buffer, 0, 0);
+
+        printf("[info] setting source viewport\n");
+        wp_viewport_set_source(ctx->viewport, 0, 0, wl_fixed_from_int(ctx->shm_width), wl_fixed_from_int(ctx->shm_height));
+
+        printf("[info] committing surface\n");
+        wl_surface_commit(ctx->surface);
+        if (ctx->rate_control) {
+            uint64_t now_ns = clock_now_ns();
+            for (uint32_t i = 0; i < ctx->num_shm_slots; i++) {
+                shm_slot_t * slot = &ctx->shm_slots[i];
+                if (slot->held && slot->replaced_ns == 0) slot->replaced_ns = now_ns;
+            }
+
+            // handed to the compositor until it releases the buffer
+            shm_slot_t * slot = &ctx->shm_slots[ctx->shm_slot];
+            slot->held = true;
+            slot->draining = true;
+            slot->submitted_ns = now_ns;
+            slot->replaced_ns = 0;
+        }
+        if (ctx->sink != NULL) {
+            // not captured into again before the write completed
+            size_t frame_size = (size_t)ctx->shm_stride * ctx->shm_height;
+            ctx->shm_slots[ctx->shm_slot].writing = frame_sink_write(ctx->sink, ctx->shm_slot * ctx->shm_slot_size, frame_size);
+        }
+        if (ctx->idle_throttle) idle_throttle_end_processing(&ctx->idle);
+    }
+    accounting_end_frame();
+    probe_mark("first_frame");
+    resources_print_live();
+
+    if (bench_stats_end_frame((uint64_t)ctx->shm_width * ctx->shm_height * 4)) {
+        ctx->closing = true;
+    } else if (ctx->paced) {
+        capture_scheduler_ready(&ctx->scheduler, clock_from_ready(sec_hi, sec_lo, nsec), refresh_mhz);
+    } else if (ctx->rate_control) {
+        rate_controller_submitted(&ctx->rate);
+    } else if (ctx->idle_throttle) {
+        idle_throttle_next(&ctx->idle);
+    } else if (ctx->continuous || bench_stats_active()) {
+        printf("[info] requesting next frame\n");
+        request_capture(ctx);
+    }
 }
 
 static void zwlr_screencopy_frame_failed(void * data, struct zwlr_screencopy_frame_v1 * frame) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] failed\n");
+    finish_capture(ctx, frame);
+
+    if (bench_stats_fail_frame()) {
+        ctx->closing = true;
+    } else if (ctx->paced) {
+        capture_scheduler_failed(&ctx->scheduler);
+    } else if (ctx->rate_control) {
+        rate_controller_failed(&ctx->rate);
+    } else if (ctx->idle_throttle) {
+        idle_throttle_next(&ctx->idle);
+    }
 }
 
 static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_listener = {
@@ -312,24 +693,77 @@ static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_list
     .linux_dmabuf = zwlr_screencopy_frame_buffer_dmabuf,
     .buffer_done = zwlr_screencopy_frame_buffer_done,
     .flags = zwlr_screencopy_frame_flags,
+    .damage = zwlr_screencopy_frame_damage,
     .ready = zwlr_screencopy_frame_ready,
     .failed = zwlr_screencopy_frame_failed
 };
 
 // --- wl_surface event handlers ---
 
-static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
-    ctx_t * ctx = (ctx_t *)data;
-    printf("[wl_surface] enter\n");
+static bool select_free_slot(ctx_t * ctx) {
+    for (uint32_t i = 0; i < ctx->num_shm_slots; i++) {
+        if (ctx->shm_slots[i].held || ctx->shm_slots[i].writing) continue;
+
+        ctx->shm_slot = i;
+        ctx->shm_buffer = ctx->shm_slots[i].buffer;
+        return true;
+    }
+
+    return false;
+}
+
+// called when a slot became free again, ignored while a capture is pending
+static void retry_capture(ctx_t * ctx) {
+    if (!ctx->waiting_for_slot || ctx->screencopy_frame != NULL) return;
+    request_capture(ctx);
+}
 
+static void request_capture(ctx_t * ctx) {
     if (ctx->screencopy_frame != NULL) {
         zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+        ctx->screencopy_frame = NULL;
+    }
+
+    if (ctx->capture_output == NULL) {
+        printf("[info] no output to capture\n");
+        return;
     }
 
-    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, output);
+    if (!select_free_slot(ctx)) {
+        // the next release or completed write requests again
+        printf("[info] every shm buffer is busy\n");
+        ctx->waiting_for_slot = true;
+        return;
+    }
+
+    ctx->waiting_for_slot = false;
+
+    // with a reader thread, frames are created on the capture queue
+    struct zwlr_screencopy_manager_v1 * manager = ctx->screencopy_wrapper != NULL ? ctx->screencopy_wrapper : ctx->screencopy;
+
+    accounting_begin_frame();
+    bench_stats_begin_frame();
+    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(manager, 0, ctx->capture_output);
+    if (ctx->paced) capture_scheduler_begin(&ctx->scheduler);
+    if (ctx->rate_control) rate_controller_begin(&ctx->rate);
+    ctx->frame_damaged = false;
     zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
 }
 
+static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[wl_surface] enter\n");
+
+    if (ctx->capture_output != output) {
+        // intervals across a switch between outputs are meaningless
+        output_t * entry = (output_t *)wl_output_get_user_data(output);
+        cadence_restart(&entry->cadence);
+    }
+
+    ctx->capture_output = output;
+    request_capture(ctx);
+}
+
 static const struct wl_surface_listener wl_surface_listener = {
     .enter = wl_surface_enter
 };
@@ -372,6 +806,7 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -479,11 +914,63 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
     .close = xdg_toplevel_event_close
 };
 
+// --- reader thread ---
+
+static void capture_queue_readable(void * data, int fd, uint32_t events) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    if (reader_queue_dispatch(ctx->capture_queue) == -1) {
+        printf("[!] wl_display: dispatching capture queue failed\n");
+        ctx->closing = true;
+    }
+}
+
+// --- capture scheduler ---
+
+static void scheduled_capture(void * data) {
+    ctx_t * ctx = (ctx_t *)data;
+    request_capture(ctx);
+}
+
+// --- rate controller ---
+
+static void rate_controlled_capture(void * data) {
+    ctx_t * ctx = (ctx_t *)data;
+    request_capture(ctx);
+}
+
+// --- idle throttle ---
+
+static void throttled_capture(void * data) {
+    ctx_t * ctx = (ctx_t *)data;
+    request_capture(ctx);
+}
+
+// --- frame sink ---
+
+static void frame_recorded(void * data, size_t pool_offset, bool ok) {
+    ctx_t * ctx = (ctx_t *)data;
+    shm_slot_t * slot = &ctx->shm_slots[pool_offset / ctx->shm_slot_size];
+    slot->writing = false;
+    slot_drained(ctx, slot);
+    retry_capture(ctx);
+}
+
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
+    ctx->event_loop = NULL;
 
     ctx->compositor = NULL;
     ctx->compositor_id = 0;
@@ -498,17 +985,52 @@ int main(void) {
     wl_list_init(&ctx->outputs);
 
     ctx->shm_pool = NULL;
+    for (uint32_t i = 0; i < MAX_SHM_SLOTS; i++) {
+        ctx->shm_slots[i].buffer = NULL;
+        ctx->shm_slots[i].held = false;
+        ctx->shm_slots[i].writing = false;
+        ctx->shm_slots[i].draining = false;
+        ctx->shm_slots[i].submitted_ns = 0;
+        ctx->shm_slots[i].replaced_ns = 0;
+    }
+    ctx->num_shm_slots = 1;
+    ctx->shm_slot = 0;
     ctx->shm_buffer = NULL;
     ctx->shm_pixels = NULL;
     ctx->shm_size = 0;
+    ctx->shm_slot_size = 0;
+    ctx->shm_format = 0;
     ctx->shm_width = 0;
     ctx->shm_height = 0;
+    ctx->shm_stride = 0;
+    ctx->shm_y_invert = false;
     ctx->shm_fd = -1;
 
     ctx->surface = NULL;
     ctx->xdg_surface = NULL;
     ctx->xdg_toplevel = NULL;
     ctx->screencopy_frame = NULL;
+    ctx->capture_output = NULL;
+
+    ctx->reader = NULL;
+    ctx->capture_queue = NULL;
+    ctx->screencopy_wrapper = NULL;
+    ctx->scheduler.timer = NULL;
+    ctx->rate.timer = NULL;
+    ctx->idle.timer = NULL;
+    ctx->sink = NULL;
+    ctx->tasks = NULL;
+
+    ctx->tile_hashes = NULL;
+    ctx->next_tile_hashes = NULL;
+    ctx->num_tiles = 0;
+    ctx->diff_tile_size = option_long("WLEXP_DIFF_TILE", 64);
+    if (ctx->diff_tile_size < 8) ctx->diff_tile_size = 8;
+    ctx->diff_valid = false;
+    ctx->diff_frames = 0;
+    ctx->diff_tiles = 0;
+    ctx->diff_changed_tiles = 0;
+    ctx->diff_total_ns = 0;
 
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
@@ -517,6 +1039,35 @@ int main(void) {
     ctx->xdg_toplevel_configured = false;
     ctx->configured = false;
     ctx->closing = false;
+    ctx->continuous = option_flag("WLEXP_CONTINUOUS");
+    ctx->paced = option_flag("WLEXP_PACED");
+    // paced capture takes precedence
+    ctx->rate_control = !ctx->paced && option_flag("WLEXP_RATE_CONTROL");
+    if (ctx->paced && option_flag("WLEXP_RATE_CONTROL")) {
+        printf("[!] WLEXP_RATE_CONTROL is ignored with WLEXP_PACED\n");
+    }
+    if (ctx->rate_control) {
+        // one buffer always stays free to capture into
+        long buffers = option_long("WLEXP_RATE_BUFFERS", 3);
+        if (buffers < 2) buffers = 2;
+        if (buffers > MAX_SHM_SLOTS) buffers = MAX_SHM_SLOTS;
+        ctx->num_shm_slots = buffers;
+    }
+    ctx->idle_throttle = !ctx->paced && !ctx->rate_control && option_flag("WLEXP_IDLE");
+    if (!ctx->idle_throttle && option_flag("WLEXP_IDLE")) {
+        printf("[!] WLEXP_IDLE is ignored with %s\n", ctx->paced ? "WLEXP_PACED" : "WLEXP_RATE_CONTROL");
+    }
+    ctx->diff = option_flag("WLEXP_DIFF");
+    ctx->frame_damaged = false;
+    ctx->waiting_for_slot = false;
+    const char * record_path = option_string("WLEXP_RECORD", NULL);
+    if (record_path != NULL) {
+        // frames are captured into other buffers while earlier ones are written
+        long buffers = option_long("WLEXP_RECORD_BUFFERS", 4);
+        if (buffers < 2) buffers = 2;
+        if (buffers > MAX_SHM_SLOTS) buffers = MAX_SHM_SLOTS;
+        if ((uint32_t)buffers > ctx->num_shm_slots) ctx->num_shm_slots = buffers;
+    }
 
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
@@ -529,6 +1080,60 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
+
+    printf("[info] initializing accounting\n");
+    accounting_init(ctx->display);
+    bench_stats_init();
+    realtime_init();
+    timestamp_latency_init();
+
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    // the first capture is requested while waiting for configure below
+    if (ctx->paced) {
+        printf("[info] creating capture scheduler\n");
+        if (!capture_scheduler_init(&ctx->scheduler, ctx->event_loop, scheduled_capture, ctx)) {
+            printf("[!] capture_scheduler: failed to create timer\n");
+            exit_fail(ctx);
+        }
+    } else if (ctx->rate_control) {
+        printf("[info] creating rate controller\n");
+        if (!rate_controller_init(&ctx->rate, ctx->event_loop, ctx->num_shm_slots - 1, rate_controlled_capture, ctx)) {
+            printf("[!] rate_controller: failed to create timer\n");
+            exit_fail(ctx);
+        }
+    } else if (ctx->idle_throttle) {
+        printf("[info] creating idle throttle\n");
+        if (!idle_throttle_init(&ctx->idle, ctx->event_loop, throttled_capture, ctx)) {
+            printf("[!] idle_throttle: failed to create timer\n");
+            exit_fail(ctx);
+        }
+    }
+
+    if (record_path != NULL) {
+        printf("[info] creating frame sink\n");
+        ctx->sink = frame_sink_create(record_path, ctx->event_loop, frame_recorded, ctx);
+        if (ctx->sink == NULL) {
+            printf("[!] frame_sink: failed to create frame sink\n");
+            exit_fail(ctx);
+        }
+    }
+
+    if (ctx->diff) {
+        // after realtime_init, so the workers share the pinned CPUs
+        printf("[info] creating task pool\n");
+        ctx->tasks = task_pool_create();
+        if (ctx->tasks == NULL) {
+            printf("[!] task_pool: failed to create task pool\n");
+            exit_fail(ctx);
+        }
+    }
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -554,6 +1159,37 @@ int main(void) {
         printf("[!] wl_registry: no screencopy found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
+
+    if (option_flag("WLEXP_READER_THREAD")) {
+        printf("[info] creating reader thread\n");
+        ctx->reader = reader_thread_create(ctx->display);
+        if (ctx->reader == NULL) {
+            printf("[!] reader_thread: failed to create reader thread\n");
+            exit_fail(ctx);
+        }
+
+        printf("[info] creating capture queue\n");
+        ctx->capture_queue = reader_thread_add_queue(ctx->reader);
+        if (ctx->capture_queue == NULL) {
+            printf("[!] reader_thread: failed to create capture queue\n");
+            exit_fail(ctx);
+        }
+
+        printf("[info] creating screencopy wrapper\n");
+        ctx->screencopy_wrapper = wl_proxy_create_wrapper(ctx->screencopy);
+        if (ctx->screencopy_wrapper == NULL) {
+            printf("[!] wl_proxy: failed to create screencopy wrapper\n");
+            exit_fail(ctx);
+        }
+        wl_proxy_set_queue((struct wl_proxy *)ctx->screencopy_wrapper, reader_queue_get_queue(ctx->capture_queue));
+
+        printf("[info] starting reader thread\n");
+        if (!reader_thread_start(ctx->reader)) {
+            printf("[!] reader_thread: failed to start reader thread\n");
+            exit_fail(ctx);
+        }
+    }
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -561,6 +1197,7 @@ int main(void) {
         printf("[!] memfd_create: failed to create shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
 
     printf("[info] resizing shm file\n");
     ctx->shm_size = 1;
@@ -576,6 +1213,7 @@ int main(void) {
         printf("[!] mmap: failed to map shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
 
     printf("[info] creating shm pool\n");
     ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
@@ -636,8 +1274,27 @@ int main(void) {
         exit_fail(ctx);
     }
 
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
+    if (ctx->capture_queue != NULL) {
+        int fd = reader_queue_get_fd(ctx->capture_queue);
+        if (event_loop_add_fd(ctx->event_loop, fd, EPOLLIN, capture_queue_readable, ctx) == NULL) {
+            printf("[!] event_loop: failed to watch capture queue\n");
+            exit_fail(ctx);
+        }
+    }
+
     printf("[info] entering event loop\n");
-    while (wl_display_dispatch(ctx->display) != -1 && !ctx->closing) {}
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
     printf("[info] exiting event loop\n");
 
     cleanup(ctx);
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/mman.h>
 #include <wayland-util.h>
 #include <wayland-client-core.h>
@@ -19,10 +20,25 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <drm_fourcc.h>
+#include <options.h>
+#include <probe.h>
+#include <gpu_timer.h>
+#include <accounting.h>
+#include <bench_stats.h>
+#include <resources.h>
+#include <clock.h>
+#include <cadence.h>
+#include <timestamp_pattern.h>
+#include <frame_stats.h>
+#include <hud.h>
+#include <event_loop.h>
+#include <realtime.h>
 
 typedef struct {
     struct wl_output * proxy;
     size_t id;
+    char name[32];
+    cadence_t cadence;
     struct wl_list link;
 } output_t;
 
@@ -41,6 +57,7 @@ typedef struct {
 typedef struct {
     struct wl_display * display;
     struct wl_registry * registry;
+    event_loop_t * event_loop;
 
     struct wl_compositor * compositor;
     struct wl_shm * shm;
@@ -60,6 +77,10 @@ typedef struct {
     size_t shm_size;
     uint32_t shm_width;
     uint32_t shm_height;
+    uint32_t shm_stride;
+    // rows of the last frame are stored bottom-up
+    bool shm_y_invert;
+    enum wl_shm_format shm_format;
     int shm_fd;
 
     struct wl_surface * surface;
@@ -67,6 +88,7 @@ typedef struct {
     struct xdg_surface * xdg_surface;
     struct xdg_toplevel * xdg_toplevel;
     struct zwlr_screencopy_frame_v1 * screencopy_frame;
+    struct wl_output * capture_output;
 
     EGLDisplay egl_display;
     EGLContext egl_context;
@@ -76,6 +98,9 @@ typedef struct {
     GLuint egl_vbo;
     GLuint egl_texture;
     GLuint egl_shader_program;
+    gpu_timer_t gpu_timer;
+    frame_stats_t frame_stats;
+    hud_t hud;
 
     uint32_t last_surface_serial;
     uint32_t win_width;
@@ -84,14 +109,32 @@ typedef struct {
     bool xdg_toplevel_configured;
     bool configured;
     bool closing;
+    bool continuous;
 } ctx_t;
 
 static void cleanup(ctx_t * ctx) {
     printf("[info] cleaning up\n");
 
-    if (ctx->egl_shader_program != 0) glDeleteProgram(ctx->egl_shader_program);
-    if (ctx->egl_texture != 0) glDeleteTextures(1, &ctx->egl_texture);
-    if (ctx->egl_vbo != 0) glDeleteBuffers(1, &ctx->egl_vbo);
+    accounting_report();
+    bench_stats_report();
+    realtime_report();
+    timestamp_latency_report();
+    gpu_timer_report(&ctx->gpu_timer);
+    gpu_timer_destroy(&ctx->gpu_timer);
+    hud_destroy(&ctx->hud);
+
+    if (ctx->egl_shader_program != 0) {
+        glDeleteProgram(ctx->egl_shader_program);
+        resource_untrack(RESOURCE_GL_PROGRAM, ctx->egl_shader_program);
+    }
+    if (ctx->egl_texture != 0) {
+        glDeleteTextures(1, &ctx->egl_texture);
+        resource_untrack(RESOURCE_GL_TEXTURE, ctx->egl_texture);
+    }
+    if (ctx->egl_vbo != 0) {
+        glDeleteBuffers(1, &ctx->egl_vbo);
+        resource_untrack(RESOURCE_GL_BUFFER, ctx->egl_vbo);
+    }
     if (ctx->egl_context != EGL_NO_SURFACE) eglDestroyContext(ctx->egl_display, ctx->egl_context);
     if (ctx->egl_surface != EGL_NO_SURFACE) eglDestroySurface(ctx->egl_display, ctx->egl_surface);
     if (ctx->egl_window != EGL_NO_SURFACE) wl_egl_window_destroy(ctx->egl_window);
@@ -103,13 +146,23 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->viewport != NULL) wp_viewport_destroy(ctx->viewport);
     if (ctx->surface != NULL) wl_surface_destroy(ctx->surface);
 
-    if (ctx->shm_buffer != NULL) wl_buffer_destroy(ctx->shm_buffer);
+    if (ctx->shm_buffer != NULL) {
+        wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
+    }
     if (ctx->shm_pool != NULL) wl_shm_pool_destroy(ctx->shm_pool);
-    if (ctx->shm_pixels != NULL) munmap(ctx->shm_pixels, ctx->shm_size);
-    if (ctx->shm_fd != -1) close(ctx->shm_fd);
+    if (ctx->shm_pixels != NULL) {
+        munmap(ctx->shm_pixels, ctx->shm_size);
+        resource_untrack(RESOURCE_MAPPING, ctx->shm_pixels);
+    }
+    if (ctx->shm_fd != -1) {
+        close(ctx->shm_fd);
+        resource_untrack(RESOURCE_FD, ctx->shm_fd);
+    }
 
     output_t *output, *output_next;
     wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
+        cadence_report(&output->cadence, output->name);
         wl_list_remove(&output->link);
         wl_output_destroy(output->proxy);
         free(output);
@@ -121,8 +174,11 @@ static void cleanup(ctx_t * ctx) {
     if (ctx->shm != NULL) wl_shm_destroy(ctx->shm);
     if (ctx->compositor != NULL) wl_compositor_destroy(ctx->compositor);
     if (ctx->registry != NULL) wl_registry_destroy(ctx->registry);
+    if (ctx->event_loop != NULL) event_loop_destroy(ctx->event_loop);
     if (ctx->display != NULL) wl_display_disconnect(ctx->display);
 
+    resources_report();
+
     free(ctx);
 }
 
@@ -131,6 +187,33 @@ static void exit_fail(ctx_t * ctx) {
     exit(1);
 }
 
+// --- wl_output event handlers ---
+
+static void wl_output_event_geometry(
+    void * data, struct wl_output * proxy,
+    int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+    int32_t subpixel, const char * make, const char * model, int32_t transform
+) {
+    output_t * output = (output_t *)data;
+    printf("[wl_output] geometry: %s -> %s %s\n", output->name, make, model);
+}
+
+static void wl_output_event_mode(
+    void * data, struct wl_output * proxy,
+    uint32_t flags, int32_t width, int32_t height, int32_t refresh
+) {
+    output_t * output = (output_t *)data;
+    if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+
+    printf("[wl_output] mode: %s -> %dx%d@%d.%03d\n", output->name, width, height, refresh / 1000, refresh % 1000);
+    cadence_set_refresh(&output->cadence, refresh);
+}
+
+static const struct wl_output_listener wl_output_listener = {
+    .geometry = wl_output_event_geometry,
+    .mode = wl_output_event_mode
+};
+
 // --- wl_registry event handlers ---
 
 static void registry_event_add(
@@ -190,7 +273,10 @@ static void registry_event_add(
         printf("[info] binding output\n");
         output->proxy = wl_registry_bind(registry, id, &wl_output_interface, 1);
         output->id = id;
+        snprintf(output->name, sizeof output->name, "output %zu", id);
+        cadence_init(&output->cadence);
         wl_list_insert(&ctx->outputs, &output->link);
+        wl_output_add_listener(output->proxy, &wl_output_listener, (void *)output);
     }
 }
 
@@ -220,6 +306,8 @@ static void registry_event_remove(
         output_t *output, *output_next;
         wl_list_for_each_safe(output, output_next, &ctx->outputs, link) {
             if (output->id == id) {
+                if (ctx->capture_output == output->proxy) ctx->capture_output = NULL;
+                cadence_report(&output->cadence, output->name);
                 wl_list_remove(&output->link);
                 wl_output_destroy(output->proxy);
                 free(output);
@@ -237,6 +325,8 @@ static const struct wl_registry_listener registry_listener = {
 
 // --- zwlr_screencopy_frame_v1 event handlers ---
 
+static void request_capture(ctx_t * ctx);
+
 static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t width, uint32_t height, uint32_t stride) {
     uint32_t bytes_per_pixel = width / stride;
     uint32_t size = stride * height;
@@ -245,6 +335,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         if (ctx->shm_buffer != NULL) {
             printf("[info] destroying old shm buffer\n");
             wl_buffer_destroy(ctx->shm_buffer);
+            resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
             ctx->shm_buffer = NULL;
         }
 
@@ -260,8 +351,10 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
             printf("[!] mremap: failed to remap shm file\n");
             exit_fail(ctx);
         }
+        resource_retrack(RESOURCE_MAPPING, ctx->shm_pixels, new_pixels, size);
         ctx->shm_pixels = (uint32_t *)new_pixels;
         ctx->shm_size = size;
+        realtime_prefault(ctx->shm_pixels, ctx->shm_size);
 
         printf("[info] resizing shm pool\n");
         wl_shm_pool_resize(ctx->shm_pool, size);
@@ -269,10 +362,13 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
 
     ctx->shm_width = width;
     ctx->shm_height = height;
+    ctx->shm_stride = stride;
+    ctx->shm_format = format;
 
     if (ctx->shm_buffer != NULL) {
         printf("[info] destroying old shm buffer\n");
         wl_buffer_destroy(ctx->shm_buffer);
+        resource_untrack(RESOURCE_WL_BUFFER, ctx->shm_buffer);
         ctx->shm_buffer = NULL;
     }
 
@@ -282,6 +378,7 @@ static void resize_shm_buffer(ctx_t * ctx, enum wl_shm_format format, uint32_t w
         printf("[!] wl_shm_pool: failed to create buffer\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_WL_BUFFER, ctx->shm_buffer, 0);
 }
 
 static void zwlr_screencopy_frame_buffer_shm(void * data, struct zwlr_screencopy_frame_v1 * frame, enum wl_shm_format format, uint32_t width, uint32_t height, uint32_t stride) {
@@ -303,17 +400,42 @@ static void zwlr_screencopy_frame_buffer_done(void * data, struct zwlr_screencop
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] buffer_done\n");
 
+    accounting_begin_stage(ACCOUNTING_STAGE_COPY);
     zwlr_screencopy_frame_v1_copy(frame, ctx->shm_buffer);
 }
 
 static void zwlr_screencopy_frame_flags(void * data, struct zwlr_screencopy_frame_v1 * frame, enum zwlr_screencopy_frame_v1_flags flags) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] flags\n");
+
+    ctx->shm_y_invert = (flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT) != 0;
+}
+
+static void update_hud(ctx_t * ctx) {
+    if (!hud_update_due(&ctx->hud)) return;
+
+    static const double percentiles[] = { 50, 90, 99 };
+    uint64_t latency_ns[3];
+    frame_stats_percentiles(&ctx->frame_stats, percentiles, latency_ns, 3);
+
+    hud_set_line(&ctx->hud, 0, "FPS %.1f (%lu FRAMES)", frame_stats_fps(&ctx->frame_stats), ctx->frame_stats.frames);
+    hud_set_line(&ctx->hud, 1, "LATENCY MS P50 %.2f P90 %.2f P99 %.2f", latency_ns[0] / 1e6, latency_ns[1] / 1e6, latency_ns[2] / 1e6);
+    hud_set_line(&ctx->hud, 2, "IN FLIGHT %zu, %lu FAILED", ctx->frame_stats.in_flight, ctx->frame_stats.cancelled);
+    hud_set_line(&ctx->hud, 3, "%ux%u %c%c%c%c LINEAR", ctx->shm_width, ctx->shm_height, PRINT_WL_SHM_FORMAT(ctx->shm_format));
+    hud_set_line(&ctx->hud, 4, "SCREENCOPY SHM + GLTEXIMAGE2D");
 }
 
 static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_frame_v1 * frame, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] ready\n");
+    accounting_begin_stage(ACCOUNTING_STAGE_PROCESS);
+
+    if (ctx->capture_output != NULL) {
+        output_t * output = (output_t *)wl_output_get_user_data(ctx->capture_output);
+        cadence_frame(&output->cadence, output->name, clock_from_ready(sec_hi, sec_lo, nsec), clock_now_ns());
+    }
+    realtime_frame(clock_from_ready(sec_hi, sec_lo, nsec));
+    timestamp_latency_frame(ctx->shm_pixels, ctx->shm_width, ctx->shm_height, ctx->shm_stride, ctx->shm_y_invert, clock_from_ready(sec_hi, sec_lo, nsec));
 
     printf("[info] setting source viewport\n");
     wp_viewport_set_source(ctx->viewport, 0, 0, wl_fixed_from_int(ctx->shm_width), wl_fixed_from_int(ctx->shm_height));
@@ -321,6 +443,8 @@ static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_fram
     glViewport(0, 0, ctx->shm_width, ctx->shm_height);
 
     printf("[info] uploading texture\n");
+    gpu_timer_begin_frame(&ctx->gpu_timer);
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_UPLOAD);
     uint32_t stride = ctx->shm_size / ctx->shm_height;
     uint32_t bytes_per_pixel = stride / ctx->shm_width;
     glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / bytes_per_pixel);
@@ -331,23 +455,45 @@ static void zwlr_screencopy_frame_ready(void * data, struct zwlr_screencopy_fram
     glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
 
     printf("[info] drawing texture\n");
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_DRAW);
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
     glClear(GL_COLOR_BUFFER_BIT);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
+    if (ctx->hud.enabled) gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_HUD);
+    update_hud(ctx);
+    hud_draw(&ctx->hud, ctx->shm_width, ctx->shm_height);
+
     printf("[info] swapping buffers\n");
+    gpu_timer_begin_stage(&ctx->gpu_timer, GPU_TIMER_STAGE_SWAP);
     if (eglSwapBuffers(ctx->egl_display, ctx->egl_surface) != EGL_TRUE) {
         printf("[!] eglSwapBuffers: failed to swap buffers\n");
         exit_fail(ctx);
     }
+    gpu_timer_end_stage(&ctx->gpu_timer);
+    frame_stats_end(&ctx->frame_stats);
 
     printf("[info] committing surface\n");
     wl_surface_commit(ctx->surface);
+    accounting_end_frame();
+    probe_mark("first_frame");
+    resources_print_live();
+
+    // copied into the shm buffer by the compositor, then uploaded to the texture
+    if (bench_stats_end_frame((uint64_t)ctx->shm_width * ctx->shm_height * 4 * 2)) {
+        ctx->closing = true;
+    } else if (ctx->continuous || bench_stats_active()) {
+        printf("[info] requesting next frame\n");
+        request_capture(ctx);
+    }
 }
 
 static void zwlr_screencopy_frame_failed(void * data, struct zwlr_screencopy_frame_v1 * frame) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[zwlr_screencopy_frame] failed\n");
+
+    frame_stats_cancel(&ctx->frame_stats);
+    if (bench_stats_fail_frame()) ctx->closing = true;
 }
 
 static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_listener = {
@@ -361,16 +507,39 @@ static const struct zwlr_screencopy_frame_v1_listener zwlr_screencopy_frame_list
 
 // --- wl_surface event handlers ---
 
+static void request_capture(ctx_t * ctx) {
+    if (ctx->screencopy_frame != NULL) {
+        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+        ctx->screencopy_frame = NULL;
+    }
+
+    // a frame destroyed before it was presented
+    if (ctx->frame_stats.in_flight != 0) frame_stats_cancel(&ctx->frame_stats);
+
+    if (ctx->capture_output == NULL) {
+        printf("[info] no output to capture\n");
+        return;
+    }
+
+    accounting_begin_frame();
+    bench_stats_begin_frame();
+    frame_stats_begin(&ctx->frame_stats);
+    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, ctx->capture_output);
+    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+}
+
 static void wl_surface_enter(void * data, struct wl_surface * surface, struct wl_output * output) {
     ctx_t * ctx = (ctx_t *)data;
     printf("[wl_surface] enter\n");
 
-    if (ctx->screencopy_frame != NULL) {
-        zwlr_screencopy_frame_v1_destroy(ctx->screencopy_frame);
+    if (ctx->capture_output != output) {
+        // intervals across a switch between outputs are meaningless
+        output_t * entry = (output_t *)wl_output_get_user_data(output);
+        cadence_restart(&entry->cadence);
     }
 
-    ctx->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(ctx->screencopy, 0, output);
-    zwlr_screencopy_frame_v1_add_listener(ctx->screencopy_frame, &zwlr_screencopy_frame_listener, (void *)ctx);
+    ctx->capture_output = output;
+    request_capture(ctx);
 }
 
 static const struct wl_surface_listener wl_surface_listener = {
@@ -415,6 +584,7 @@ static void surface_configure_resize(ctx_t * ctx, uint32_t width, uint32_t heigh
 }
 
 static void surface_configure_finished(ctx_t * ctx) {
+    probe_mark("configure");
     printf("[info] acknowledging configure\n");
     xdg_surface_ack_configure(ctx->xdg_surface, ctx->last_surface_serial);
 
@@ -558,11 +728,21 @@ const char * fragment_shader =
     "}\n"
 ;
 
+// --- signal handlers ---
+
+static void handle_signal(void * data, int signal) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, closing\n", signal);
+    ctx->closing = true;
+}
+
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
     ctx->registry = NULL;
+    ctx->event_loop = NULL;
 
     ctx->compositor = NULL;
     ctx->compositor_id = 0;
@@ -581,13 +761,17 @@ int main(void) {
     ctx->shm_pixels = NULL;
     ctx->shm_size = 0;
     ctx->shm_width = 0;
+    ctx->shm_format = 0;
     ctx->shm_height = 0;
+    ctx->shm_stride = 0;
+    ctx->shm_y_invert = false;
     ctx->shm_fd = -1;
 
     ctx->surface = NULL;
     ctx->xdg_surface = NULL;
     ctx->xdg_toplevel = NULL;
     ctx->screencopy_frame = NULL;
+    ctx->capture_output = NULL;
 
     ctx->egl_display = EGL_NO_DISPLAY;
     ctx->egl_context = EGL_NO_CONTEXT;
@@ -596,6 +780,9 @@ int main(void) {
     ctx->egl_vbo = -1;
     ctx->egl_texture = -1;
     ctx->egl_shader_program = -1;
+    memset(&ctx->gpu_timer, 0, sizeof ctx->gpu_timer);
+    frame_stats_init(&ctx->frame_stats);
+    memset(&ctx->hud, 0, sizeof ctx->hud);
 
     ctx->last_surface_serial = 0;
     ctx->win_width = 0;
@@ -604,6 +791,7 @@ int main(void) {
     ctx->xdg_toplevel_configured = false;
     ctx->configured = false;
     ctx->closing = false;
+    ctx->continuous = option_flag("WLEXP_CONTINUOUS");
 
     if (ctx == NULL) {
         printf("[!] malloc: allocating context failed\n");
@@ -616,6 +804,13 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
+
+    printf("[info] initializing accounting\n");
+    accounting_init(ctx->display);
+    bench_stats_init();
+    realtime_init();
+    timestamp_latency_init();
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -641,6 +836,7 @@ int main(void) {
         printf("[!] wl_registry: no screencopy found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating shm file\n");
     ctx->shm_fd = memfd_create("wl_shm_buffer", 0);
@@ -648,6 +844,7 @@ int main(void) {
         printf("[!] memfd_create: failed to create shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_FD, ctx->shm_fd, 0);
 
     printf("[info] resizing shm file\n");
     ctx->shm_size = 1;
@@ -663,6 +860,7 @@ int main(void) {
         printf("[!] mmap: failed to map shm file\n");
         exit_fail(ctx);
     }
+    resource_track(RESOURCE_MAPPING, ctx->shm_pixels, ctx->shm_size);
 
     printf("[info] creating shm pool\n");
     ctx->shm_pool = wl_shm_create_pool(ctx->shm, ctx->shm_fd, ctx->shm_size);
@@ -737,6 +935,7 @@ int main(void) {
         exit_fail(ctx);
     }
     printf("[info] initialized EGL %d.%d\n", major, minor);
+    probe_mark("egl_init");
 
     EGLint num_configs;
     printf("[info] getting number of EGL configs\n");
@@ -788,11 +987,13 @@ int main(void) {
 
     printf("[info] create vertex buffer object\n");
     glGenBuffers(1, &ctx->egl_vbo);
+    resource_track(RESOURCE_GL_BUFFER, ctx->egl_vbo, sizeof vertex_array);
     glBindBuffer(GL_ARRAY_BUFFER, ctx->egl_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof vertex_array, vertex_array, GL_STATIC_DRAW);
 
     printf("[info] create texture and set scaling mode\n");
     glGenTextures(1, &ctx->egl_texture);
+    resource_track(RESOURCE_GL_TEXTURE, ctx->egl_texture, 0);
     glBindTexture(GL_TEXTURE_2D, ctx->egl_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -833,6 +1034,7 @@ int main(void) {
 
     printf("[info] create shader program and get pointers to shader uniforms\n");
     ctx->egl_shader_program = glCreateProgram();
+    resource_track(RESOURCE_GL_PROGRAM, ctx->egl_shader_program, 0);
     glAttachShader(ctx->egl_shader_program, vertex_shader);
     glAttachShader(ctx->egl_shader_program, fragment_shader);
     glLinkProgram(ctx->egl_shader_program);
@@ -841,10 +1043,10 @@ int main(void) {
         printf("[error] failed to link shader program\n");
         glDeleteShader(vertex_shader);
         glDeleteShader(fragment_shader);
-        glDeleteProgram(ctx->egl_shader_program);
         exit_fail(ctx);
     }
     glUseProgram(ctx->egl_shader_program);
+    probe_mark("shader");
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
@@ -855,6 +1057,12 @@ int main(void) {
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
 
+    printf("[info] initializing gpu timer\n");
+    gpu_timer_init(&ctx->gpu_timer);
+
+    printf("[info] initializing HUD\n");
+    hud_init(&ctx->hud);
+
     printf("[info] clearing frame\n");
     glClearColor(1.0, 1.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -866,8 +1074,26 @@ int main(void) {
         exit_fail(ctx);
     }
 
+    printf("[info] creating event loop\n");
+    ctx->event_loop = event_loop_create(ctx->display);
+    if (ctx->event_loop == NULL) {
+        printf("[!] event_loop: failed to create event loop\n");
+        exit_fail(ctx);
+    }
+
+    // interrupting a capture still prints its reports
+    if (
+        event_loop_add_signal(ctx->event_loop, SIGINT, handle_signal, ctx) == NULL ||
+        event_loop_add_signal(ctx->event_loop, SIGTERM, handle_signal, ctx) == NULL
+    ) {
+        printf("[!] event_loop: failed to watch signals\n");
+        exit_fail(ctx);
+    }
+
     printf("[info] entering event loop\n");
-    while (wl_display_dispatch(ctx->display) != -1 && !ctx->closing) {}
+    if (!event_loop_run(ctx->event_loop, &ctx->closing)) {
+        printf("[!] wl_display: connection failed\n");
+    }
     printf("[info] exiting event loop\n");
 
     cleanup(ctx);
@@ -0,0 +1,1599 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <linux/udmabuf.h>
+#include <linux/dma-buf.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+#include <wayland-server.h>
+#include <xdg-shell-server.h>
+#include <viewporter-server.h>
+#include <fractional-scale-v1-server.h>
+#include <linux-dmabuf-unstable-v1-server.h>
+#include <wlr-screencopy-unstable-v1-server.h>
+#include <wlr-export-dmabuf-unstable-v1-server.h>
+#include <drm_fourcc.h>
+#include <options.h>
+#include <clock.h>
+
+// headless compositor implementing just enough of the globals the
+// experiments bind to run every capture path without a GPU or a display
+//
+// a single virtual output produces frames from a timer at WLEXP_MOCK_FPS,
+// drawing a synthetic pattern into a CPU framebuffer; screencopy copies it
+// into shm or (linear, mmap-able) dmabuf buffers, export-dmabuf hands out
+// udmabufs, or plain memfds where /dev/udmabuf is not available
+
+#define EXPORT_BUFFERS 4
+#define BOX_SIZE 128
+#define BOX_SPEED 8
+#define CHECKER_SIZE 32
+
+typedef struct {
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+} box_t;
+
+typedef enum {
+    DAMAGE_FULL,
+    DAMAGE_BOX,
+    DAMAGE_STATIC
+} damage_pattern_t;
+
+typedef struct {
+    uint32_t format;
+    uint32_t padding;
+    uint64_t modifier;
+} dmabuf_format_table_entry_t;
+
+typedef struct {
+    int memfd;
+    int fd;
+    uint8_t * pixels;
+    size_t size;
+} export_buffer_t;
+
+typedef struct ctx ctx_t;
+
+typedef struct {
+    struct wl_resource * resource;
+    ctx_t * ctx;
+    int fds[4];
+    uint32_t offsets[4];
+    uint32_t strides[4];
+    uint64_t modifier;
+    bool used;
+} dmabuf_params_t;
+
+typedef struct {
+    struct wl_resource * resource;
+    int32_t width;
+    int32_t height;
+    uint32_t format;
+    uint64_t modifier;
+    int fds[4];
+    uint32_t offsets[4];
+    uint32_t strides[4];
+    uint8_t * map;
+    size_t map_size;
+} dmabuf_buffer_t;
+
+typedef struct {
+    struct wl_resource * resource;
+    ctx_t * ctx;
+
+    struct wl_resource * pending_buffer;
+    bool pending_attached;
+    struct wl_resource * buffer;
+    struct wl_listener buffer_destroy;
+    struct wl_list /*wl_callback resource*/ pending_callbacks;
+    struct wl_list /*wl_callback resource*/ callbacks;
+
+    struct wl_resource * xdg_surface;
+    struct wl_resource * xdg_toplevel;
+    bool configure_sent;
+    bool configure_acked;
+    bool entered;
+
+    struct wl_list link;
+} surface_t;
+
+typedef struct {
+    struct wl_resource * resource;
+    box_t damage;
+    struct wl_list link;
+} screencopy_client_t;
+
+typedef struct {
+    struct wl_resource * resource;
+    ctx_t * ctx;
+    screencopy_client_t * client;
+    box_t region;
+
+    struct wl_resource * buffer;
+    struct wl_listener buffer_destroy;
+    bool copy_requested;
+    bool with_damage;
+
+    struct wl_list link;
+} screencopy_frame_t;
+
+typedef struct {
+    struct wl_resource * resource;
+    ctx_t * ctx;
+    struct wl_list link;
+} export_frame_t;
+
+typedef struct ctx {
+    struct wl_display * display;
+    struct wl_event_loop * loop;
+    struct wl_event_source * timer_source;
+    struct wl_event_source * sigint_source;
+    struct wl_event_source * sigterm_source;
+    int timer_fd;
+    bool verbose;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t refresh_mhz;
+    uint32_t scale_120;
+    damage_pattern_t damage_pattern;
+
+    uint32_t * framebuffer;
+    uint64_t frame;
+    uint64_t frame_time_ns;
+    box_t frame_damage;
+    int32_t box_x;
+    int32_t box_dx;
+
+    struct wl_list /*wl_output resource*/ output_resources;
+    struct wl_list /*surface_t*/ surfaces;
+    struct wl_list /*screencopy_client_t*/ screencopy_clients;
+    struct wl_list /*screencopy_frame_t*/ screencopy_frames;
+    struct wl_list /*export_frame_t*/ export_frames;
+
+    dev_t render_device;
+    bool dmabuf_available;
+    int format_table_fd;
+    size_t format_table_size;
+
+    export_buffer_t export_buffers[EXPORT_BUFFERS];
+    size_t export_next;
+    size_t export_current;
+    bool export_udmabuf;
+
+    uint64_t missed_ticks;
+    uint64_t screencopy_copies;
+    uint64_t export_frames_sent;
+    uint64_t bytes_copied;
+} ctx_t;
+
+static void cleanup(ctx_t * ctx) {
+    printf("[info] cleaning up\n");
+    printf("[info] %lu frames, %lu missed ticks, %lu screencopy copies, %lu export frames, %lu bytes copied\n",
+        ctx->frame, ctx->missed_ticks, ctx->screencopy_copies, ctx->export_frames_sent, ctx->bytes_copied
+    );
+
+    if (ctx->display != NULL) wl_display_destroy_clients(ctx->display);
+
+    for (size_t i = 0; i < EXPORT_BUFFERS; i++) {
+        export_buffer_t * buffer = &ctx->export_buffers[i];
+        if (buffer->pixels != NULL) munmap(buffer->pixels, buffer->size);
+        if (buffer->fd != -1 && buffer->fd != buffer->memfd) close(buffer->fd);
+        if (buffer->memfd != -1) close(buffer->memfd);
+    }
+
+    if (ctx->format_table_fd != -1) close(ctx->format_table_fd);
+    if (ctx->timer_source != NULL) wl_event_source_remove(ctx->timer_source);
+    if (ctx->sigint_source != NULL) wl_event_source_remove(ctx->sigint_source);
+    if (ctx->sigterm_source != NULL) wl_event_source_remove(ctx->sigterm_source);
+    if (ctx->timer_fd != -1) close(ctx->timer_fd);
+    if (ctx->framebuffer != NULL) free(ctx->framebuffer);
+    if (ctx->display != NULL) wl_display_destroy(ctx->display);
+
+    free(ctx);
+}
+
+static void exit_fail(ctx_t * ctx) {
+    cleanup(ctx);
+    exit(1);
+}
+
+static void resource_destroy(struct wl_client * client, struct wl_resource * resource) {
+    wl_resource_destroy(resource);
+}
+
+static void unlink_resource(struct wl_resource * resource) {
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+// --- boxes ---
+
+static bool box_empty(box_t box) {
+    return box.x1 >= box.x2 || box.y1 >= box.y2;
+}
+
+static box_t box_union(box_t a, box_t b) {
+    if (box_empty(a)) return b;
+    if (box_empty(b)) return a;
+
+    box_t box = {
+        .x1 = a.x1 < b.x1 ? a.x1 : b.x1,
+        .y1 = a.y1 < b.y1 ? a.y1 : b.y1,
+        .x2 = a.x2 > b.x2 ? a.x2 : b.x2,
+        .y2 = a.y2 > b.y2 ? a.y2 : b.y2
+    };
+    return box;
+}
+
+static box_t box_intersect(box_t a, box_t b) {
+    box_t box = {
+        .x1 = a.x1 > b.x1 ? a.x1 : b.x1,
+        .y1 = a.y1 > b.y1 ? a.y1 : b.y1,
+        .x2 = a.x2 < b.x2 ? a.x2 : b.x2,
+        .y2 = a.y2 < b.y2 ? a.y2 : b.y2
+    };
+    if (box_empty(box)) box = (box_t){ 0 };
+    return box;
+}
+
+// --- synthetic frames ---
+
+static uint32_t checker_color(ctx_t * ctx, int32_t x, int32_t y, uint32_t offset) {
+    bool odd = (((x + offset) / CHECKER_SIZE) + (y / CHECKER_SIZE)) & 1;
+    return odd ? 0xff303030 : 0xffd0d0d0;
+}
+
+static void fill_checker(ctx_t * ctx, box_t box, uint32_t offset) {
+    for (int32_t y = box.y1; y < box.y2; y++) {
+        uint32_t * row = &ctx->framebuffer[y * ctx->width];
+        for (int32_t x = box.x1; x < box.x2; x++) row[x] = checker_color(ctx, x, y, offset);
+    }
+}
+
+static void fill_color(ctx_t * ctx, box_t box, uint32_t color) {
+    for (int32_t y = box.y1; y < box.y2; y++) {
+        uint32_t * row = &ctx->framebuffer[y * ctx->width];
+        for (int32_t x = box.x1; x < box.x2; x++) row[x] = color;
+    }
+}
+
+static box_t moving_box(ctx_t * ctx) {
+    int32_t y = ((int32_t)ctx->height - BOX_SIZE) / 2;
+    box_t box = { ctx->box_x, y, ctx->box_x + BOX_SIZE, y + BOX_SIZE };
+    box_t output = { 0, 0, ctx->width, ctx->height };
+    return box_intersect(box, output);
+}
+
+static void render_frame(ctx_t * ctx) {
+    box_t output = { 0, 0, ctx->width, ctx->height };
+
+    if (ctx->frame == 0) {
+        fill_checker(ctx, output, 0);
+        if (ctx->damage_pattern == DAMAGE_BOX) fill_color(ctx, moving_box(ctx), 0xffff00ff);
+        ctx->frame_damage = output;
+        return;
+    }
+
+    switch (ctx->damage_pattern) {
+        case DAMAGE_FULL:
+            fill_checker(ctx, output, ctx->frame * BOX_SPEED);
+            ctx->frame_damage = output;
+            break;
+        case DAMAGE_BOX: {
+            box_t old_box = moving_box(ctx);
+            fill_checker(ctx, old_box, 0);
+
+            ctx->box_x += ctx->box_dx;
+            if (ctx->box_x <= 0 || ctx->box_x + BOX_SIZE >= (int32_t)ctx->width) ctx->box_dx = -ctx->box_dx;
+
+            box_t new_box = moving_box(ctx);
+            fill_color(ctx, new_box, 0xffff00ff);
+            ctx->frame_damage = box_union(old_box, new_box);
+            break;
+        }
+        case DAMAGE_STATIC:
+            ctx->frame_damage = (box_t){ 0 };
+            break;
+    }
+}
+
+static uint64_t copy_frame(ctx_t * ctx, box_t region, uint8_t * dst, uint32_t dst_stride) {
+    uint32_t row_bytes = (region.x2 - region.x1) * 4;
+    for (int32_t y = region.y1; y < region.y2; y++) {
+        const uint32_t * src = &ctx->framebuffer[y * ctx->width + region.x1];
+        memcpy(dst + (size_t)(y - region.y1) * dst_stride, src, row_bytes);
+    }
+
+    return (uint64_t)row_bytes * (region.y2 - region.y1);
+}
+
+// --- wl_callback ---
+
+static void fire_frame_callbacks(ctx_t * ctx) {
+    uint32_t time_ms = ctx->frame_time_ns / 1000000;
+
+    surface_t * surface;
+    wl_list_for_each(surface, &ctx->surfaces, link) {
+        struct wl_resource *callback, *callback_next;
+        wl_resource_for_each_safe(callback, callback_next, &surface->callbacks) {
+            wl_callback_send_done(callback, time_ms);
+            wl_resource_destroy(callback);
+        }
+    }
+}
+
+// --- wl_buffer (dmabuf) request handlers ---
+
+static void dmabuf_buffer_destroy(struct wl_resource * resource) {
+    dmabuf_buffer_t * buffer = (dmabuf_buffer_t *)wl_resource_get_user_data(resource);
+    if (buffer->map != NULL) munmap(buffer->map, buffer->map_size);
+    for (size_t i = 0; i < 4; i++) {
+        if (buffer->fds[i] != -1) close(buffer->fds[i]);
+    }
+    free(buffer);
+}
+
+static const struct wl_buffer_interface dmabuf_buffer_impl = {
+    .destroy = resource_destroy
+};
+
+static dmabuf_buffer_t * dmabuf_buffer_from_resource(struct wl_resource * resource) {
+    if (!wl_resource_instance_of(resource, &wl_buffer_interface, &dmabuf_buffer_impl)) return NULL;
+    return (dmabuf_buffer_t *)wl_resource_get_user_data(resource);
+}
+
+static uint8_t * dmabuf_buffer_map(dmabuf_buffer_t * buffer) {
+    if (buffer->map != NULL) return buffer->map;
+
+    // only linear single plane buffers are advertised, so a CPU mapping of
+    // plane 0 is the whole image
+    size_t size = buffer->offsets[0] + (size_t)buffer->strides[0] * buffer->height;
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fds[0], 0);
+    if (map == MAP_FAILED) {
+        printf("[!] mmap: failed to map dmabuf\n");
+        return NULL;
+    }
+
+    buffer->map = (uint8_t *)map;
+    buffer->map_size = size;
+    return buffer->map;
+}
+
+static void dmabuf_sync(int fd, uint64_t flags) {
+    struct dma_buf_sync sync = { .flags = flags | DMA_BUF_SYNC_WRITE };
+    // fails on memfds, which need no synchronization
+    ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+// --- zwp_linux_buffer_params_v1 request handlers ---
+
+static void dmabuf_params_destroy(struct wl_resource * resource) {
+    dmabuf_params_t * params = (dmabuf_params_t *)wl_resource_get_user_data(resource);
+    for (size_t i = 0; i < 4; i++) {
+        if (params->fds[i] != -1) close(params->fds[i]);
+    }
+    free(params);
+}
+
+static void dmabuf_params_add(
+    struct wl_client * client, struct wl_resource * resource,
+    int32_t fd, uint32_t plane_idx, uint32_t offset, uint32_t stride, uint32_t modifier_hi, uint32_t modifier_lo
+) {
+    dmabuf_params_t * params = (dmabuf_params_t *)wl_resource_get_user_data(resource);
+
+    if (params->used) {
+        close(fd);
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED, "params already used");
+        return;
+    } else if (plane_idx >= 4) {
+        close(fd);
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_PLANE_IDX, "plane index %u out of bounds", plane_idx);
+        return;
+    } else if (params->fds[plane_idx] != -1) {
+        close(fd);
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_PLANE_SET, "plane %u already set", plane_idx);
+        return;
+    }
+
+    params->fds[plane_idx] = fd;
+    params->offsets[plane_idx] = offset;
+    params->strides[plane_idx] = stride;
+    params->modifier = ((uint64_t)modifier_hi << 32) | modifier_lo;
+}
+
+static struct wl_resource * dmabuf_params_create_buffer(
+    struct wl_client * client, struct wl_resource * resource,
+    uint32_t buffer_id, int32_t width, int32_t height, uint32_t format
+) {
+    dmabuf_params_t * params = (dmabuf_params_t *)wl_resource_get_user_data(resource);
+
+    if (params->used) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED, "params already used");
+        return NULL;
+    } else if (params->fds[0] == -1) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE, "plane 0 missing");
+        return NULL;
+    } else if (width <= 0 || height <= 0) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_DIMENSIONS, "invalid size %dx%d", width, height);
+        return NULL;
+    }
+
+    // copies map plane 0 up to here, a shorter fd would SIGBUS the compositor
+    size_t size = params->offsets[0] + (size_t)params->strides[0] * height;
+    off_t fd_size = lseek(params->fds[0], 0, SEEK_END);
+    if (fd_size == -1) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_WL_BUFFER, "plane 0 size unknown");
+        return NULL;
+    } else if ((uint64_t)fd_size < size) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_OUT_OF_BOUNDS,
+            "plane 0 needs %zu bytes, fd has %lld", size, (long long)fd_size
+        );
+        return NULL;
+    }
+    params->used = true;
+
+    dmabuf_buffer_t * buffer = malloc(sizeof *buffer);
+    if (buffer == NULL) {
+        wl_resource_post_no_memory(resource);
+        return NULL;
+    }
+
+    buffer->resource = wl_resource_create(client, &wl_buffer_interface, 1, buffer_id);
+    if (buffer->resource == NULL) {
+        free(buffer);
+        wl_resource_post_no_memory(resource);
+        return NULL;
+    }
+
+    buffer->width = width;
+    buffer->height = height;
+    buffer->format = format;
+    buffer->modifier = params->modifier;
+    for (size_t i = 0; i < 4; i++) {
+        buffer->fds[i] = params->fds[i];
+        buffer->offsets[i] = params->offsets[i];
+        buffer->strides[i] = params->strides[i];
+        params->fds[i] = -1;
+    }
+    buffer->map = NULL;
+    buffer->map_size = 0;
+
+    wl_resource_set_implementation(buffer->resource, &dmabuf_buffer_impl, buffer, dmabuf_buffer_destroy);
+    return buffer->resource;
+}
+
+static void dmabuf_params_create(
+    struct wl_client * client, struct wl_resource * resource,
+    int32_t width, int32_t height, uint32_t format, uint32_t flags
+) {
+    struct wl_resource * buffer = dmabuf_params_create_buffer(client, resource, 0, width, height, format);
+    if (buffer == NULL) {
+        zwp_linux_buffer_params_v1_send_failed(resource);
+        return;
+    }
+
+    zwp_linux_buffer_params_v1_send_created(resource, buffer);
+}
+
+static void dmabuf_params_create_immed(
+    struct wl_client * client, struct wl_resource * resource,
+    uint32_t buffer_id, int32_t width, int32_t height, uint32_t format, uint32_t flags
+) {
+    dmabuf_params_create_buffer(client, resource, buffer_id, width, height, format);
+}
+
+static const struct zwp_linux_buffer_params_v1_interface dmabuf_params_impl = {
+    .destroy = resource_destroy,
+    .add = dmabuf_params_add,
+    .create = dmabuf_params_create,
+    .create_immed = dmabuf_params_create_immed
+};
+
+// --- zwp_linux_dmabuf_v1 request handlers ---
+
+static const struct zwp_linux_dmabuf_feedback_v1_interface dmabuf_feedback_impl = {
+    .destroy = resource_destroy
+};
+
+static void dmabuf_create_params(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+
+    dmabuf_params_t * params = malloc(sizeof *params);
+    if (params == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    params->resource = wl_resource_create(client, &zwp_linux_buffer_params_v1_interface, wl_resource_get_version(resource), id);
+    if (params->resource == NULL) {
+        free(params);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    params->ctx = ctx;
+    for (size_t i = 0; i < 4; i++) params->fds[i] = -1;
+    params->modifier = DRM_FORMAT_MOD_INVALID;
+    params->used = false;
+    wl_resource_set_implementation(params->resource, &dmabuf_params_impl, params, dmabuf_params_destroy);
+}
+
+static void dmabuf_send_feedback(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+
+    struct wl_resource * feedback = wl_resource_create(client, &zwp_linux_dmabuf_feedback_v1_interface, wl_resource_get_version(resource), id);
+    if (feedback == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(feedback, &dmabuf_feedback_impl, ctx, NULL);
+
+    struct wl_array device;
+    device.size = sizeof ctx->render_device;
+    device.alloc = 0;
+    device.data = &ctx->render_device;
+
+    uint16_t index_data[] = { 0, 1 };
+    struct wl_array indices;
+    indices.size = sizeof index_data;
+    indices.alloc = 0;
+    indices.data = index_data;
+
+    zwp_linux_dmabuf_feedback_v1_send_format_table(feedback, ctx->format_table_fd, ctx->format_table_size);
+    zwp_linux_dmabuf_feedback_v1_send_main_device(feedback, &device);
+    zwp_linux_dmabuf_feedback_v1_send_tranche_target_device(feedback, &device);
+    zwp_linux_dmabuf_feedback_v1_send_tranche_flags(feedback, 0);
+    zwp_linux_dmabuf_feedback_v1_send_tranche_formats(feedback, &indices);
+    zwp_linux_dmabuf_feedback_v1_send_tranche_done(feedback);
+    zwp_linux_dmabuf_feedback_v1_send_done(feedback);
+}
+
+static void dmabuf_get_default_feedback(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    dmabuf_send_feedback(client, resource, id);
+}
+
+static void dmabuf_get_surface_feedback(struct wl_client * client, struct wl_resource * resource, uint32_t id, struct wl_resource * surface) {
+    dmabuf_send_feedback(client, resource, id);
+}
+
+static const struct zwp_linux_dmabuf_v1_interface dmabuf_impl = {
+    .destroy = resource_destroy,
+    .create_params = dmabuf_create_params,
+    .get_default_feedback = dmabuf_get_default_feedback,
+    .get_surface_feedback = dmabuf_get_surface_feedback
+};
+
+static void dmabuf_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    struct wl_resource * resource = wl_resource_create(client, &zwp_linux_dmabuf_v1_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &dmabuf_impl, ctx, NULL);
+}
+
+// --- wl_output ---
+
+static const struct wl_output_interface output_impl = {
+    .release = resource_destroy
+};
+
+static void output_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    struct wl_resource * resource = wl_resource_create(client, &wl_output_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &output_impl, ctx, unlink_resource);
+    wl_list_insert(&ctx->output_resources, wl_resource_get_link(resource));
+
+    wl_output_send_geometry(resource, 0, 0, 0, 0, WL_OUTPUT_SUBPIXEL_UNKNOWN, "wayland-experiments", "mock output", WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED, ctx->width, ctx->height, ctx->refresh_mhz);
+    if (version >= WL_OUTPUT_SCALE_SINCE_VERSION) wl_output_send_scale(resource, 1);
+    if (version >= WL_OUTPUT_NAME_SINCE_VERSION) wl_output_send_name(resource, "MOCK-1");
+    if (version >= WL_OUTPUT_DESCRIPTION_SINCE_VERSION) wl_output_send_description(resource, "mock compositor output");
+    if (version >= WL_OUTPUT_DONE_SINCE_VERSION) wl_output_send_done(resource);
+}
+
+static struct wl_resource * output_resource_for_client(ctx_t * ctx, struct wl_client * client) {
+    struct wl_resource * resource;
+    wl_resource_for_each(resource, &ctx->output_resources) {
+        if (wl_resource_get_client(resource) == client) return resource;
+    }
+    return NULL;
+}
+
+// --- wl_surface request handlers ---
+
+static void surface_buffer_destroyed(struct wl_listener * listener, void * data) {
+    surface_t * surface = wl_container_of(listener, surface, buffer_destroy);
+    surface->buffer = NULL;
+    wl_list_remove(&surface->buffer_destroy.link);
+    wl_list_init(&surface->buffer_destroy.link);
+}
+
+static void surface_attach(struct wl_client * client, struct wl_resource * resource, struct wl_resource * buffer, int32_t x, int32_t y) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+    surface->pending_buffer = buffer;
+    surface->pending_attached = true;
+}
+
+static void surface_damage(struct wl_client * client, struct wl_resource * resource, int32_t x, int32_t y, int32_t width, int32_t height) {}
+
+static void surface_frame(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+
+    struct wl_resource * callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+    if (callback == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(callback, NULL, NULL, unlink_resource);
+    wl_list_insert(surface->pending_callbacks.prev, wl_resource_get_link(callback));
+}
+
+static void surface_set_region(struct wl_client * client, struct wl_resource * resource, struct wl_resource * region) {}
+
+static void surface_commit(struct wl_client * client, struct wl_resource * resource) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+    ctx_t * ctx = surface->ctx;
+
+    if (surface->pending_attached) {
+        if (surface->buffer != NULL && surface->buffer != surface->pending_buffer) {
+            // the content was sampled on commit, so the old buffer is free again
+            wl_buffer_send_release(surface->buffer);
+        }
+
+        wl_list_remove(&surface->buffer_destroy.link);
+        wl_list_init(&surface->buffer_destroy.link);
+        surface->buffer = surface->pending_buffer;
+        if (surface->buffer != NULL) wl_resource_add_destroy_listener(surface->buffer, &surface->buffer_destroy);
+
+        surface->pending_buffer = NULL;
+        surface->pending_attached = false;
+    }
+
+    wl_list_insert_list(surface->callbacks.prev, &surface->pending_callbacks);
+    wl_list_init(&surface->pending_callbacks);
+
+    if (surface->xdg_toplevel == NULL) return;
+
+    if (!surface->configure_sent) {
+        printf("[xdg_surface] initial commit, configuring\n");
+        struct wl_array states;
+        wl_array_init(&states);
+        uint32_t * state = wl_array_add(&states, sizeof *state);
+        if (state != NULL) *state = XDG_TOPLEVEL_STATE_ACTIVATED;
+
+        xdg_toplevel_send_configure(surface->xdg_toplevel, 0, 0, &states);
+        xdg_surface_send_configure(surface->xdg_surface, wl_display_next_serial(ctx->display));
+        wl_array_release(&states);
+        surface->configure_sent = true;
+    } else if (surface->configure_acked && !surface->entered) {
+        // the capture clients only start capturing once their surface
+        // entered an output, so enter as soon as the toplevel is configured
+        struct wl_resource * output = output_resource_for_client(ctx, client);
+        if (output != NULL) {
+            printf("[wl_surface] entering output\n");
+            wl_surface_send_enter(resource, output);
+            surface->entered = true;
+        }
+    }
+}
+
+static void surface_set_buffer_transform(struct wl_client * client, struct wl_resource * resource, int32_t transform) {}
+
+static void surface_set_buffer_scale(struct wl_client * client, struct wl_resource * resource, int32_t scale) {}
+
+static void surface_offset(struct wl_client * client, struct wl_resource * resource, int32_t x, int32_t y) {}
+
+static const struct wl_surface_interface surface_impl = {
+    .destroy = resource_destroy,
+    .attach = surface_attach,
+    .damage = surface_damage,
+    .frame = surface_frame,
+    .set_opaque_region = surface_set_region,
+    .set_input_region = surface_set_region,
+    .commit = surface_commit,
+    .set_buffer_transform = surface_set_buffer_transform,
+    .set_buffer_scale = surface_set_buffer_scale,
+    .damage_buffer = surface_damage,
+    .offset = surface_offset
+};
+
+static void surface_destroy(struct wl_resource * resource) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+
+    struct wl_resource *callback, *callback_next;
+    wl_resource_for_each_safe(callback, callback_next, &surface->pending_callbacks) wl_resource_destroy(callback);
+    wl_resource_for_each_safe(callback, callback_next, &surface->callbacks) wl_resource_destroy(callback);
+
+    if (surface->xdg_surface != NULL) wl_resource_set_user_data(surface->xdg_surface, NULL);
+    if (surface->xdg_toplevel != NULL) wl_resource_set_user_data(surface->xdg_toplevel, NULL);
+
+    wl_list_remove(&surface->buffer_destroy.link);
+    wl_list_remove(&surface->link);
+    free(surface);
+}
+
+// --- wl_region request handlers ---
+
+static void region_add(struct wl_client * client, struct wl_resource * resource, int32_t x, int32_t y, int32_t width, int32_t height) {}
+
+static const struct wl_region_interface region_impl = {
+    .destroy = resource_destroy,
+    .add = region_add,
+    .subtract = region_add
+};
+
+// --- wl_compositor request handlers ---
+
+static void compositor_create_surface(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+
+    surface_t * surface = calloc(1, sizeof *surface);
+    if (surface == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    surface->resource = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(resource), id);
+    if (surface->resource == NULL) {
+        free(surface);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    surface->ctx = ctx;
+    surface->buffer_destroy.notify = surface_buffer_destroyed;
+    wl_list_init(&surface->buffer_destroy.link);
+    wl_list_init(&surface->pending_callbacks);
+    wl_list_init(&surface->callbacks);
+    wl_list_insert(&ctx->surfaces, &surface->link);
+    wl_resource_set_implementation(surface->resource, &surface_impl, surface, surface_destroy);
+}
+
+static void compositor_create_region(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    struct wl_resource * region = wl_resource_create(client, &wl_region_interface, 1, id);
+    if (region == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(region, &region_impl, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_impl = {
+    .create_surface = compositor_create_surface,
+    .create_region = compositor_create_region
+};
+
+static void compositor_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    struct wl_resource * resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &compositor_impl, data, NULL);
+}
+
+// --- xdg_toplevel request handlers ---
+
+static void toplevel_set_parent(struct wl_client * client, struct wl_resource * resource, struct wl_resource * parent) {}
+static void toplevel_set_string(struct wl_client * client, struct wl_resource * resource, const char * string) {}
+static void toplevel_show_window_menu(struct wl_client * client, struct wl_resource * resource, struct wl_resource * seat, uint32_t serial, int32_t x, int32_t y) {}
+static void toplevel_move(struct wl_client * client, struct wl_resource * resource, struct wl_resource * seat, uint32_t serial) {}
+static void toplevel_resize(struct wl_client * client, struct wl_resource * resource, struct wl_resource * seat, uint32_t serial, uint32_t edges) {}
+static void toplevel_set_size(struct wl_client * client, struct wl_resource * resource, int32_t width, int32_t height) {}
+static void toplevel_set_state(struct wl_client * client, struct wl_resource * resource) {}
+static void toplevel_set_fullscreen(struct wl_client * client, struct wl_resource * resource, struct wl_resource * output) {}
+
+static const struct xdg_toplevel_interface toplevel_impl = {
+    .destroy = resource_destroy,
+    .set_parent = toplevel_set_parent,
+    .set_title = toplevel_set_string,
+    .set_app_id = toplevel_set_string,
+    .show_window_menu = toplevel_show_window_menu,
+    .move = toplevel_move,
+    .resize = toplevel_resize,
+    .set_max_size = toplevel_set_size,
+    .set_min_size = toplevel_set_size,
+    .set_maximized = toplevel_set_state,
+    .unset_maximized = toplevel_set_state,
+    .set_fullscreen = toplevel_set_fullscreen,
+    .unset_fullscreen = toplevel_set_state,
+    .set_minimized = toplevel_set_state
+};
+
+static void toplevel_destroy(struct wl_resource * resource) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+    if (surface == NULL) return;
+
+    surface->xdg_toplevel = NULL;
+    surface->configure_sent = false;
+    surface->configure_acked = false;
+}
+
+// --- xdg_surface request handlers ---
+
+static void xdg_surface_get_toplevel(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+    if (surface == NULL) {
+        wl_resource_post_error(resource, XDG_SURFACE_ERROR_DEFUNCT_ROLE_OBJECT, "surface was destroyed");
+        return;
+    } else if (surface->xdg_toplevel != NULL) {
+        wl_resource_post_error(resource, XDG_SURFACE_ERROR_ALREADY_CONSTRUCTED, "surface already has a toplevel");
+        return;
+    }
+
+    surface->xdg_toplevel = wl_resource_create(client, &xdg_toplevel_interface, wl_resource_get_version(resource), id);
+    if (surface->xdg_toplevel == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(surface->xdg_toplevel, &toplevel_impl, surface, toplevel_destroy);
+}
+
+static void xdg_surface_get_popup(struct wl_client * client, struct wl_resource * resource, uint32_t id, struct wl_resource * parent, struct wl_resource * positioner) {
+    wl_client_post_implementation_error(client, "popups are not supported by the mock compositor");
+}
+
+static void xdg_surface_set_window_geometry(struct wl_client * client, struct wl_resource * resource, int32_t x, int32_t y, int32_t width, int32_t height) {}
+
+static void xdg_surface_ack_configure(struct wl_client * client, struct wl_resource * resource, uint32_t serial) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+    if (surface == NULL) return;
+
+    surface->configure_acked = true;
+}
+
+static const struct xdg_surface_interface xdg_surface_impl = {
+    .destroy = resource_destroy,
+    .get_toplevel = xdg_surface_get_toplevel,
+    .get_popup = xdg_surface_get_popup,
+    .set_window_geometry = xdg_surface_set_window_geometry,
+    .ack_configure = xdg_surface_ack_configure
+};
+
+static void xdg_surface_destroy(struct wl_resource * resource) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(resource);
+    if (surface == NULL) return;
+
+    surface->xdg_surface = NULL;
+}
+
+// --- xdg_wm_base request handlers ---
+
+static void wm_base_create_positioner(struct wl_client * client, struct wl_resource * resource, uint32_t id) {
+    wl_client_post_implementation_error(client, "positioners are not supported by the mock compositor");
+}
+
+static void wm_base_get_xdg_surface(struct wl_client * client, struct wl_resource * resource, uint32_t id, struct wl_resource * surface_resource) {
+    surface_t * surface = (surface_t *)wl_resource_get_user_data(surface_resource);
+    if (surface->xdg_surface != NULL) {
+        wl_resource_post_error(resource, XDG_WM_BASE_ERROR_ROLE, "surface already has an xdg_surface");
+        return;
+    }
+
+    surface->xdg_surface = wl_resource_create(client, &xdg_surface_interface, wl_resource_get_version(resource), id);
+    if (surface->xdg_surface == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(surface->xdg_surface, &xdg_surface_impl, surface, xdg_surface_destroy);
+}
+
+static void wm_base_pong(struct wl_client * client, struct wl_resource * resource, uint32_t serial) {}
+
+static const struct xdg_wm_base_interface wm_base_impl = {
+    .destroy = resource_destroy,
+    .create_positioner = wm_base_create_positioner,
+    .get_xdg_surface = wm_base_get_xdg_surface,
+    .pong = wm_base_pong
+};
+
+static void wm_base_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    struct wl_resource * resource = wl_resource_create(client, &xdg_wm_base_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &wm_base_impl, data, NULL);
+}
+
+// --- wp_viewporter request handlers ---
+
+static void viewport_set_source(struct wl_client * client, struct wl_resource * resource, wl_fixed_t x, wl_fixed_t y, wl_fixed_t width, wl_fixed_t height) {}
+
+static void viewport_set_destination(struct wl_client * client, struct wl_resource * resource, int32_t width, int32_t height) {}
+
+static const struct wp_viewport_interface viewport_impl = {
+    .destroy = resource_destroy,
+    .set_source = viewport_set_source,
+    .set_destination = viewport_set_destination
+};
+
+static void viewporter_get_viewport(struct wl_client * client, struct wl_resource * resource, uint32_t id, struct wl_resource * surface) {
+    struct wl_resource * viewport = wl_resource_create(client, &wp_viewport_interface, wl_resource_get_version(resource), id);
+    if (viewport == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(viewport, &viewport_impl, NULL, NULL);
+}
+
+static const struct wp_viewporter_interface viewporter_impl = {
+    .destroy = resource_destroy,
+    .get_viewport = viewporter_get_viewport
+};
+
+static void viewporter_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    struct wl_resource * resource = wl_resource_create(client, &wp_viewporter_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &viewporter_impl, data, NULL);
+}
+
+// --- wp_fractional_scale_manager_v1 request handlers ---
+
+static const struct wp_fractional_scale_v1_interface fractional_scale_impl = {
+    .destroy = resource_destroy
+};
+
+static void fractional_scale_get(struct wl_client * client, struct wl_resource * resource, uint32_t id, struct wl_resource * surface) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+
+    struct wl_resource * scale = wl_resource_create(client, &wp_fractional_scale_v1_interface, wl_resource_get_version(resource), id);
+    if (scale == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(scale, &fractional_scale_impl, NULL, NULL);
+    wp_fractional_scale_v1_send_preferred_scale(scale, ctx->scale_120);
+}
+
+static const struct wp_fractional_scale_manager_v1_interface fractional_scale_manager_impl = {
+    .destroy = resource_destroy,
+    .get_fractional_scale = fractional_scale_get
+};
+
+static void fractional_scale_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    struct wl_resource * resource = wl_resource_create(client, &wp_fractional_scale_manager_v1_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &fractional_scale_manager_impl, data, NULL);
+}
+
+// --- zwlr_screencopy_frame_v1 request handlers ---
+
+static void screencopy_frame_buffer_destroyed(struct wl_listener * listener, void * data) {
+    screencopy_frame_t * frame = wl_container_of(listener, frame, buffer_destroy);
+    frame->buffer = NULL;
+    wl_list_remove(&frame->buffer_destroy.link);
+    wl_list_init(&frame->buffer_destroy.link);
+}
+
+static bool screencopy_frame_check_buffer(screencopy_frame_t * frame, struct wl_resource * buffer) {
+    int32_t width = frame->region.x2 - frame->region.x1;
+    int32_t height = frame->region.y2 - frame->region.y1;
+
+    struct wl_shm_buffer * shm_buffer = wl_shm_buffer_get(buffer);
+    if (shm_buffer != NULL) {
+        uint32_t format = wl_shm_buffer_get_format(shm_buffer);
+        return (format == WL_SHM_FORMAT_XRGB8888 || format == WL_SHM_FORMAT_ARGB8888)
+            && wl_shm_buffer_get_width(shm_buffer) == width
+            && wl_shm_buffer_get_height(shm_buffer) == height
+            && wl_shm_buffer_get_stride(shm_buffer) >= width * 4;
+    }
+
+    dmabuf_buffer_t * dmabuf_buffer = dmabuf_buffer_from_resource(buffer);
+    if (dmabuf_buffer != NULL) {
+        return (dmabuf_buffer->format == DRM_FORMAT_XRGB8888 || dmabuf_buffer->format == DRM_FORMAT_ARGB8888)
+            && dmabuf_buffer->width == width
+            && dmabuf_buffer->height == height
+            && dmabuf_buffer->strides[0] >= (uint32_t)width * 4;
+    }
+
+    return false;
+}
+
+static void screencopy_frame_request_copy(struct wl_resource * resource, struct wl_resource * buffer, bool with_damage) {
+    screencopy_frame_t * frame = (screencopy_frame_t *)wl_resource_get_user_data(resource);
+    ctx_t * ctx = frame->ctx;
+
+    if (frame->copy_requested) {
+        wl_resource_post_error(resource, ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED, "frame already copied");
+        return;
+    } else if (!screencopy_frame_check_buffer(frame, buffer)) {
+        wl_resource_post_error(resource, ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER, "invalid buffer");
+        return;
+    }
+
+    frame->copy_requested = true;
+    frame->with_damage = with_damage;
+    frame->buffer = buffer;
+    wl_resource_add_destroy_listener(buffer, &frame->buffer_destroy);
+    wl_list_insert(ctx->screencopy_frames.prev, &frame->link);
+}
+
+static void screencopy_frame_copy(struct wl_client * client, struct wl_resource * resource, struct wl_resource * buffer) {
+    screencopy_frame_request_copy(resource, buffer, false);
+}
+
+static void screencopy_frame_copy_with_damage(struct wl_client * client, struct wl_resource * resource, struct wl_resource * buffer) {
+    screencopy_frame_request_copy(resource, buffer, true);
+}
+
+static const struct zwlr_screencopy_frame_v1_interface screencopy_frame_impl = {
+    .copy = screencopy_frame_copy,
+    .destroy = resource_destroy,
+    .copy_with_damage = screencopy_frame_copy_with_damage
+};
+
+static void screencopy_frame_destroy(struct wl_resource * resource) {
+    screencopy_frame_t * frame = (screencopy_frame_t *)wl_resource_get_user_data(resource);
+    wl_list_remove(&frame->buffer_destroy.link);
+    wl_list_remove(&frame->link);
+    free(frame);
+}
+
+// copies the current frame into the buffer of a pending screencopy frame,
+// returns false if the frame has to wait for damage
+static bool screencopy_frame_complete(ctx_t * ctx, screencopy_frame_t * frame) {
+    box_t damage = { 0 };
+    if (frame->with_damage) {
+        if (frame->client == NULL) return false;
+
+        damage = box_intersect(frame->client->damage, frame->region);
+        if (box_empty(damage)) return false;
+        frame->client->damage = (box_t){ 0 };
+    }
+
+    if (frame->buffer == NULL) {
+        zwlr_screencopy_frame_v1_send_failed(frame->resource);
+        return true;
+    }
+
+    uint64_t bytes = 0;
+    struct wl_shm_buffer * shm_buffer = wl_shm_buffer_get(frame->buffer);
+    dmabuf_buffer_t * dmabuf_buffer = dmabuf_buffer_from_resource(frame->buffer);
+    if (shm_buffer != NULL) {
+        wl_shm_buffer_begin_access(shm_buffer);
+        bytes = copy_frame(ctx, frame->region, (uint8_t *)wl_shm_buffer_get_data(shm_buffer), wl_shm_buffer_get_stride(shm_buffer));
+        wl_shm_buffer_end_access(shm_buffer);
+    } else if (dmabuf_buffer != NULL) {
+        uint8_t * pixels = dmabuf_buffer_map(dmabuf_buffer);
+        if (pixels == NULL) {
+            zwlr_screencopy_frame_v1_send_failed(frame->resource);
+            return true;
+        }
+
+        dmabuf_sync(dmabuf_buffer->fds[0], DMA_BUF_SYNC_START);
+        bytes = copy_frame(ctx, frame->region, pixels + dmabuf_buffer->offsets[0], dmabuf_buffer->strides[0]);
+        dmabuf_sync(dmabuf_buffer->fds[0], DMA_BUF_SYNC_END);
+    }
+
+    ctx->screencopy_copies++;
+    ctx->bytes_copied += bytes;
+
+    uint64_t sec = ctx->frame_time_ns / 1000000000;
+    uint32_t nsec = ctx->frame_time_ns % 1000000000;
+    zwlr_screencopy_frame_v1_send_flags(frame->resource, 0);
+    if (frame->with_damage) {
+        zwlr_screencopy_frame_v1_send_damage(frame->resource,
+            damage.x1 - frame->region.x1, damage.y1 - frame->region.y1,
+            damage.x2 - damage.x1, damage.y2 - damage.y1
+        );
+    }
+    zwlr_screencopy_frame_v1_send_ready(frame->resource, sec >> 32, sec & 0xffffffff, nsec);
+    return true;
+}
+
+static void complete_screencopy_frames(ctx_t * ctx) {
+    screencopy_client_t * client;
+    wl_list_for_each(client, &ctx->screencopy_clients, link) {
+        client->damage = box_union(client->damage, ctx->frame_damage);
+    }
+
+    screencopy_frame_t *frame, *frame_next;
+    wl_list_for_each_safe(frame, frame_next, &ctx->screencopy_frames, link) {
+        if (!screencopy_frame_complete(ctx, frame)) continue;
+
+        wl_list_remove(&frame->link);
+        wl_list_init(&frame->link);
+        wl_list_remove(&frame->buffer_destroy.link);
+        wl_list_init(&frame->buffer_destroy.link);
+    }
+}
+
+// --- zwlr_screencopy_manager_v1 request handlers ---
+
+static void screencopy_capture(struct wl_client * client, struct wl_resource * resource, uint32_t id, box_t region) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+    screencopy_client_t * screencopy_client = NULL;
+    screencopy_client_t * entry;
+    wl_list_for_each(entry, &ctx->screencopy_clients, link) {
+        if (entry->resource == resource) screencopy_client = entry;
+    }
+
+    screencopy_frame_t * frame = calloc(1, sizeof *frame);
+    if (frame == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    frame->resource = wl_resource_create(client, &zwlr_screencopy_frame_v1_interface, wl_resource_get_version(resource), id);
+    if (frame->resource == NULL) {
+        free(frame);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    frame->ctx = ctx;
+    frame->client = screencopy_client;
+    frame->region = region;
+    frame->buffer_destroy.notify = screencopy_frame_buffer_destroyed;
+    wl_list_init(&frame->buffer_destroy.link);
+    wl_list_init(&frame->link);
+    wl_resource_set_implementation(frame->resource, &screencopy_frame_impl, frame, screencopy_frame_destroy);
+
+    if (box_empty(region)) {
+        zwlr_screencopy_frame_v1_send_failed(frame->resource);
+        return;
+    }
+
+    uint32_t width = region.x2 - region.x1;
+    uint32_t height = region.y2 - region.y1;
+    zwlr_screencopy_frame_v1_send_buffer(frame->resource, WL_SHM_FORMAT_XRGB8888, width, height, width * 4);
+    if (wl_resource_get_version(frame->resource) >= ZWLR_SCREENCOPY_FRAME_V1_LINUX_DMABUF_SINCE_VERSION) {
+        if (ctx->dmabuf_available) zwlr_screencopy_frame_v1_send_linux_dmabuf(frame->resource, DRM_FORMAT_XRGB8888, width, height);
+        zwlr_screencopy_frame_v1_send_buffer_done(frame->resource);
+    }
+}
+
+static void screencopy_capture_output(struct wl_client * client, struct wl_resource * resource, uint32_t id, int32_t overlay_cursor, struct wl_resource * output) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+    box_t region = { 0, 0, ctx->width, ctx->height };
+    screencopy_capture(client, resource, id, region);
+}
+
+static void screencopy_capture_output_region(
+    struct wl_client * client, struct wl_resource * resource, uint32_t id, int32_t overlay_cursor, struct wl_resource * output,
+    int32_t x, int32_t y, int32_t width, int32_t height
+) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+    box_t output_box = { 0, 0, ctx->width, ctx->height };
+    box_t region = { x, y, x + width, y + height };
+    screencopy_capture(client, resource, id, box_intersect(region, output_box));
+}
+
+static const struct zwlr_screencopy_manager_v1_interface screencopy_impl = {
+    .capture_output = screencopy_capture_output,
+    .capture_output_region = screencopy_capture_output_region,
+    .destroy = resource_destroy
+};
+
+static void screencopy_destroy(struct wl_resource * resource) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+
+    screencopy_client_t *client, *client_next;
+    wl_list_for_each_safe(client, client_next, &ctx->screencopy_clients, link) {
+        if (client->resource != resource) continue;
+
+        screencopy_frame_t * frame;
+        wl_list_for_each(frame, &ctx->screencopy_frames, link) {
+            if (frame->client == client) frame->client = NULL;
+        }
+
+        wl_list_remove(&client->link);
+        free(client);
+    }
+}
+
+static void screencopy_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    screencopy_client_t * screencopy_client = malloc(sizeof *screencopy_client);
+    if (screencopy_client == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    struct wl_resource * resource = wl_resource_create(client, &zwlr_screencopy_manager_v1_interface, version, id);
+    if (resource == NULL) {
+        free(screencopy_client);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    // the first copy with damage of a new client gets the whole output
+    screencopy_client->resource = resource;
+    screencopy_client->damage = (box_t){ 0, 0, ctx->width, ctx->height };
+    wl_list_insert(&ctx->screencopy_clients, &screencopy_client->link);
+    wl_resource_set_implementation(resource, &screencopy_impl, ctx, screencopy_destroy);
+}
+
+// --- zwlr_export_dmabuf_frame_v1 request handlers ---
+
+static const struct zwlr_export_dmabuf_frame_v1_interface export_frame_impl = {
+    .destroy = resource_destroy
+};
+
+static void export_frame_destroy(struct wl_resource * resource) {
+    export_frame_t * frame = (export_frame_t *)wl_resource_get_user_data(resource);
+    wl_list_remove(&frame->link);
+    free(frame);
+}
+
+static void complete_export_frames(ctx_t * ctx) {
+    export_frame_t *frame, *frame_next;
+    wl_list_for_each_safe(frame, frame_next, &ctx->export_frames, link) {
+        // buffers are reused round-robin, a client holding on to a frame
+        // for more than EXPORT_BUFFERS frames sees it change. without
+        // damage, the last buffer is exported again like a compositor that
+        // did not repaint
+        if (!box_empty(ctx->frame_damage) || ctx->export_frames_sent == 0) {
+            ctx->export_current = ctx->export_next;
+            ctx->export_next = (ctx->export_next + 1) % EXPORT_BUFFERS;
+
+            box_t output = { 0, 0, ctx->width, ctx->height };
+            ctx->bytes_copied += copy_frame(ctx, output, ctx->export_buffers[ctx->export_current].pixels, ctx->width * 4);
+        }
+        export_buffer_t * buffer = &ctx->export_buffers[ctx->export_current];
+        ctx->export_frames_sent++;
+
+        uint64_t sec = ctx->frame_time_ns / 1000000000;
+        uint32_t nsec = ctx->frame_time_ns % 1000000000;
+        uint64_t modifier = DRM_FORMAT_MOD_LINEAR;
+        zwlr_export_dmabuf_frame_v1_send_frame(frame->resource,
+            ctx->width, ctx->height, 0, 0, 0, ZWLR_EXPORT_DMABUF_FRAME_V1_FLAGS_TRANSIENT,
+            DRM_FORMAT_XRGB8888, modifier >> 32, modifier & 0xffffffff, 1
+        );
+        zwlr_export_dmabuf_frame_v1_send_object(frame->resource, 0, buffer->fd, buffer->size, 0, ctx->width * 4, 0);
+        zwlr_export_dmabuf_frame_v1_send_ready(frame->resource, sec >> 32, sec & 0xffffffff, nsec);
+
+        wl_list_remove(&frame->link);
+        wl_list_init(&frame->link);
+    }
+}
+
+// --- zwlr_export_dmabuf_manager_v1 request handlers ---
+
+static void export_capture_output(struct wl_client * client, struct wl_resource * resource, uint32_t id, int32_t overlay_cursor, struct wl_resource * output) {
+    ctx_t * ctx = (ctx_t *)wl_resource_get_user_data(resource);
+
+    export_frame_t * frame = malloc(sizeof *frame);
+    if (frame == NULL) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    frame->resource = wl_resource_create(client, &zwlr_export_dmabuf_frame_v1_interface, wl_resource_get_version(resource), id);
+    if (frame->resource == NULL) {
+        free(frame);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    frame->ctx = ctx;
+    wl_list_insert(ctx->export_frames.prev, &frame->link);
+    wl_resource_set_implementation(frame->resource, &export_frame_impl, frame, export_frame_destroy);
+}
+
+static const struct zwlr_export_dmabuf_manager_v1_interface export_impl = {
+    .capture_output = export_capture_output,
+    .destroy = resource_destroy
+};
+
+static void export_bind(struct wl_client * client, void * data, uint32_t version, uint32_t id) {
+    struct wl_resource * resource = wl_resource_create(client, &zwlr_export_dmabuf_manager_v1_interface, version, id);
+    if (resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &export_impl, data, NULL);
+}
+
+// --- output frame timer ---
+
+static int output_tick(int fd, uint32_t mask, void * data) {
+    ctx_t * ctx = (ctx_t *)data;
+
+    uint64_t expirations = 0;
+    if (read(fd, &expirations, sizeof expirations) != sizeof expirations) return 0;
+    if (expirations > 1) ctx->missed_ticks += expirations - 1;
+
+    ctx->frame_time_ns = clock_now_ns();
+    render_frame(ctx);
+    if (ctx->verbose) {
+        printf("[output] frame %lu, damage %d,%d %dx%d\n", ctx->frame,
+            ctx->frame_damage.x1, ctx->frame_damage.y1,
+            ctx->frame_damage.x2 - ctx->frame_damage.x1, ctx->frame_damage.y2 - ctx->frame_damage.y1
+        );
+    }
+
+    complete_screencopy_frames(ctx);
+    complete_export_frames(ctx);
+    fire_frame_callbacks(ctx);
+    ctx->frame++;
+
+    wl_display_flush_clients(ctx->display);
+    return 0;
+}
+
+static int handle_signal(int signal, void * data) {
+    ctx_t * ctx = (ctx_t *)data;
+    printf("[info] received signal %d, terminating\n", signal);
+    wl_display_terminate(ctx->display);
+    return 0;
+}
+
+// --- setup ---
+
+static bool find_render_node(ctx_t * ctx) {
+    const char * path = option_string("WLEXP_MOCK_RENDER_NODE", "/dev/dri/renderD128");
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISCHR(st.st_mode)) {
+        printf("[info] no render node at %s, not advertising linux-dmabuf\n", path);
+        return false;
+    }
+
+    printf("[info] using render node %s\n", path);
+    ctx->render_device = st.st_rdev;
+    return true;
+}
+
+static void create_format_table(ctx_t * ctx) {
+    const dmabuf_format_table_entry_t table[] = {
+        { DRM_FORMAT_XRGB8888, 0, DRM_FORMAT_MOD_LINEAR },
+        { DRM_FORMAT_ARGB8888, 0, DRM_FORMAT_MOD_LINEAR }
+    };
+
+    ctx->format_table_fd = memfd_create("dmabuf_format_table", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ctx->format_table_fd == -1) {
+        printf("[!] memfd_create: failed to create format table\n");
+        exit_fail(ctx);
+    }
+
+    if (write(ctx->format_table_fd, table, sizeof table) != sizeof table) {
+        printf("[!] write: failed to fill format table\n");
+        exit_fail(ctx);
+    }
+    fcntl(ctx->format_table_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    ctx->format_table_size = sizeof table;
+}
+
+static void create_export_buffers(ctx_t * ctx) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t size = ((size_t)ctx->width * ctx->height * 4 + page_size - 1) / page_size * page_size;
+
+    int udmabuf = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    ctx->export_udmabuf = udmabuf != -1;
+    if (!ctx->export_udmabuf) printf("[info] /dev/udmabuf not available, exporting memfds\n");
+
+    for (size_t i = 0; i < EXPORT_BUFFERS; i++) {
+        export_buffer_t * buffer = &ctx->export_buffers[i];
+        buffer->size = size;
+
+        buffer->memfd = memfd_create("export_dmabuf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (buffer->memfd == -1 || ftruncate(buffer->memfd, size) == -1) {
+            printf("[!] memfd_create: failed to create export buffer\n");
+            if (udmabuf != -1) close(udmabuf);
+            exit_fail(ctx);
+        }
+
+        void * pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->memfd, 0);
+        if (pixels == MAP_FAILED) {
+            printf("[!] mmap: failed to map export buffer\n");
+            if (udmabuf != -1) close(udmabuf);
+            exit_fail(ctx);
+        }
+        buffer->pixels = (uint8_t *)pixels;
+
+        buffer->fd = buffer->memfd;
+        if (ctx->export_udmabuf) {
+            // udmabuf needs the memfd to be unshrinkable
+            fcntl(buffer->memfd, F_ADD_SEALS, F_SEAL_SHRINK);
+
+            struct udmabuf_create create = {
+                .memfd = buffer->memfd,
+                .flags = UDMABUF_FLAGS_CLOEXEC,
+                .offset = 0,
+                .size = size
+            };
+            int fd = ioctl(udmabuf, UDMABUF_CREATE, &create);
+            if (fd >= 0) {
+                buffer->fd = fd;
+            } else {
+                printf("[!] udmabuf: failed to create dmabuf, exporting memfd\n");
+            }
+        }
+    }
+
+    if (udmabuf != -1) close(udmabuf);
+}
+
+static damage_pattern_t parse_damage_pattern(const char * name) {
+    if (strcmp(name, "full") == 0) return DAMAGE_FULL;
+    if (strcmp(name, "box") == 0) return DAMAGE_BOX;
+    if (strcmp(name, "static") == 0) return DAMAGE_STATIC;
+
+    printf("[!] unknown damage pattern %s, using full\n", name);
+    return DAMAGE_FULL;
+}
+
+int main(void) {
+    printf("[info] allocating context\n");
+    ctx_t * ctx = malloc(sizeof (ctx_t));
+    if (ctx == NULL) {
+        printf("[!] malloc: allocating context failed\n");
+        exit(1);
+    }
+
+    ctx->display = NULL;
+    ctx->loop = NULL;
+    ctx->timer_source = NULL;
+    ctx->sigint_source = NULL;
+    ctx->sigterm_source = NULL;
+    ctx->timer_fd = -1;
+    ctx->verbose = option_flag("WLEXP_MOCK_VERBOSE");
+
+    ctx->width = option_long("WLEXP_MOCK_WIDTH", 1920);
+    ctx->height = option_long("WLEXP_MOCK_HEIGHT", 1080);
+    ctx->refresh_mhz = option_double("WLEXP_MOCK_FPS", 60) * 1000;
+    ctx->scale_120 = option_double("WLEXP_MOCK_SCALE", 1) * 120;
+    ctx->damage_pattern = parse_damage_pattern(option_string("WLEXP_MOCK_DAMAGE", "full"));
+
+    ctx->framebuffer = NULL;
+    ctx->frame = 0;
+    ctx->frame_time_ns = 0;
+    ctx->frame_damage = (box_t){ 0 };
+    ctx->box_x = 0;
+    ctx->box_dx = BOX_SPEED;
+
+    wl_list_init(&ctx->output_resources);
+    wl_list_init(&ctx->surfaces);
+    wl_list_init(&ctx->screencopy_clients);
+    wl_list_init(&ctx->screencopy_frames);
+    wl_list_init(&ctx->export_frames);
+
+    ctx->render_device = 0;
+    ctx->dmabuf_available = false;
+    ctx->format_table_fd = -1;
+    ctx->format_table_size = 0;
+
+    for (size_t i = 0; i < EXPORT_BUFFERS; i++) {
+        ctx->export_buffers[i].memfd = -1;
+        ctx->export_buffers[i].fd = -1;
+        ctx->export_buffers[i].pixels = NULL;
+        ctx->export_buffers[i].size = 0;
+    }
+    ctx->export_next = 0;
+    ctx->export_current = 0;
+    ctx->export_udmabuf = false;
+
+    ctx->missed_ticks = 0;
+    ctx->screencopy_copies = 0;
+    ctx->export_frames_sent = 0;
+    ctx->bytes_copied = 0;
+
+    if (ctx->width == 0 || ctx->height == 0 || ctx->width > 16384 || ctx->height > 16384 || ctx->refresh_mhz == 0) {
+        printf("[!] invalid output mode %ux%u@%u mHz\n", ctx->width, ctx->height, ctx->refresh_mhz);
+        exit_fail(ctx);
+    }
+    printf("[info] output %ux%u@%u.%03u Hz, scale %u/120\n", ctx->width, ctx->height, ctx->refresh_mhz / 1000, ctx->refresh_mhz % 1000, ctx->scale_120);
+
+    printf("[info] allocating framebuffer\n");
+    ctx->framebuffer = malloc((size_t)ctx->width * ctx->height * 4);
+    if (ctx->framebuffer == NULL) {
+        printf("[!] malloc: allocating framebuffer failed\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] creating display\n");
+    ctx->display = wl_display_create();
+    if (ctx->display == NULL) {
+        printf("[!] wl_display: create failed\n");
+        exit_fail(ctx);
+    }
+    ctx->loop = wl_display_get_event_loop(ctx->display);
+
+    const char * socket = option_string("WLEXP_MOCK_SOCKET", NULL);
+    if (socket != NULL) {
+        if (wl_display_add_socket(ctx->display, socket) != 0) {
+            printf("[!] wl_display: failed to add socket %s\n", socket);
+            exit_fail(ctx);
+        }
+    } else {
+        socket = wl_display_add_socket_auto(ctx->display);
+        if (socket == NULL) {
+            printf("[!] wl_display: failed to add socket\n");
+            exit_fail(ctx);
+        }
+    }
+
+    printf("[info] creating globals\n");
+    if (wl_display_init_shm(ctx->display) != 0) {
+        printf("[!] wl_display: failed to initialize shm\n");
+        exit_fail(ctx);
+    }
+
+    bool globals_created =
+        wl_global_create(ctx->display, &wl_compositor_interface, 4, ctx, compositor_bind) != NULL &&
+        wl_global_create(ctx->display, &wl_output_interface, 4, ctx, output_bind) != NULL &&
+        wl_global_create(ctx->display, &xdg_wm_base_interface, 2, ctx, wm_base_bind) != NULL &&
+        wl_global_create(ctx->display, &wp_viewporter_interface, 1, ctx, viewporter_bind) != NULL &&
+        wl_global_create(ctx->display, &wp_fractional_scale_manager_v1_interface, 1, ctx, fractional_scale_bind) != NULL &&
+        wl_global_create(ctx->display, &zwlr_screencopy_manager_v1_interface, 3, ctx, screencopy_bind) != NULL &&
+        wl_global_create(ctx->display, &zwlr_export_dmabuf_manager_v1_interface, 1, ctx, export_bind) != NULL;
+    if (!globals_created) {
+        printf("[!] wl_global: failed to create globals\n");
+        exit_fail(ctx);
+    }
+
+    ctx->dmabuf_available = find_render_node(ctx);
+    if (ctx->dmabuf_available) {
+        create_format_table(ctx);
+        if (wl_global_create(ctx->display, &zwp_linux_dmabuf_v1_interface, 4, ctx, dmabuf_bind) == NULL) {
+            printf("[!] wl_global: failed to create linux-dmabuf global\n");
+            exit_fail(ctx);
+        }
+    }
+
+    printf("[info] creating export buffers\n");
+    create_export_buffers(ctx);
+
+    printf("[info] creating frame timer\n");
+    ctx->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (ctx->timer_fd == -1) {
+        printf("[!] timerfd_create: failed to create frame timer\n");
+        exit_fail(ctx);
+    }
+
+    uint64_t interval_ns = 1000000000000 / ctx->refresh_mhz;
+    struct itimerspec timer = {
+        .it_interval = { interval_ns / 1000000000, interval_ns % 1000000000 },
+        .it_value = { interval_ns / 1000000000, interval_ns % 1000000000 }
+    };
+    if (timerfd_settime(ctx->timer_fd, 0, &timer, NULL) == -1) {
+        printf("[!] timerfd_settime: failed to arm frame timer\n");
+        exit_fail(ctx);
+    }
+
+    ctx->timer_source = wl_event_loop_add_fd(ctx->loop, ctx->timer_fd, WL_EVENT_READABLE, output_tick, ctx);
+    ctx->sigint_source = wl_event_loop_add_signal(ctx->loop, SIGINT, handle_signal, ctx);
+    ctx->sigterm_source = wl_event_loop_add_signal(ctx->loop, SIGTERM, handle_signal, ctx);
+    if (ctx->timer_source == NULL || ctx->sigint_source == NULL || ctx->sigterm_source == NULL) {
+        printf("[!] wl_event_loop: failed to add event sources\n");
+        exit_fail(ctx);
+    }
+
+    printf("[info] listening on WAYLAND_DISPLAY=%s\n", socket);
+    fflush(stdout);
+
+    printf("[info] entering event loop\n");
+    wl_display_run(ctx->display);
+    printf("[info] exiting event loop\n");
+
+    cleanup(ctx);
+}
@@ -4,6 +4,7 @@
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
+#include <probe.h>
 
 typedef struct {
     struct wl_display * display;
@@ -68,6 +69,7 @@ static const struct wl_registry_listener registry_listener = {
 };
 
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
@@ -87,6 +89,7 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -100,6 +103,7 @@ int main(void) {
         printf("[!] wl_registry: no compositor found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating surface\n");
     ctx->surface = wl_compositor_create_surface(ctx->compositor);
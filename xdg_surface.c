@@ -5,6 +5,7 @@
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
 #include <xdg-shell.h>
+#include <probe.h>
 
 typedef struct {
     struct wl_display * display;
@@ -87,6 +88,7 @@ static const struct wl_registry_listener registry_listener = {
 };
 
 int main(void) {
+    probe_mark("start");
     printf("[info] allocating context\n");
     ctx_t * ctx = malloc(sizeof (ctx_t));
     ctx->display = NULL;
@@ -110,6 +112,7 @@ int main(void) {
         printf("[!] wl_display: connect failed\n");
         exit_fail(ctx);
     }
+    probe_mark("connect");
 
     printf("[info] getting registry\n");
     ctx->registry = wl_display_get_registry(ctx->display);
@@ -126,6 +129,7 @@ int main(void) {
         printf("[!] wl_registry: no xdg_wm_base found\n");
         exit_fail(ctx);
     }
+    probe_mark("registry");
 
     printf("[info] creating surface\n");
     ctx->surface = wl_compositor_create_surface(ctx->compositor);